@@ -0,0 +1,213 @@
+///////////////////////////////////////////////////////////////////////////////
+// allocationtracking.cpp
+// ============
+// count heap allocations per frame and per scope
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "AllocationTracking.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+// declaration of global variables
+namespace
+{
+	// counters of the current thread, plain values because
+	// only the owning thread ever writes them
+	thread_local unsigned long long g_ThreadAllocations = 0;
+	thread_local unsigned long long g_ThreadFrees = 0;
+	thread_local unsigned long long g_ThreadBytes = 0;
+
+	// counters summed over every thread
+	std::atomic<unsigned long long> g_GlobalAllocations(0);
+	std::atomic<unsigned long long> g_GlobalFrees(0);
+	std::atomic<unsigned long long> g_GlobalBytes(0);
+}
+
+#ifdef ENABLE_ALLOCATION_TRACKING
+
+// declaration of the allocation hooks
+namespace
+{
+	void* TrackedAllocate(size_t size)
+	{
+		g_ThreadAllocations++;
+		g_ThreadBytes += size;
+		g_GlobalAllocations.fetch_add(1, std::memory_order_relaxed);
+		g_GlobalBytes.fetch_add(size, std::memory_order_relaxed);
+
+		return(malloc((size > 0) ? size : 1));
+	}
+
+	void TrackedFree(void* pointer)
+	{
+		if (NULL != pointer)
+		{
+			g_ThreadFrees++;
+			g_GlobalFrees.fetch_add(1, std::memory_order_relaxed);
+			free(pointer);
+		}
+	}
+}
+
+void* operator new(size_t size)
+{
+	void* pointer = TrackedAllocate(size);
+	if (NULL == pointer)
+	{
+		throw std::bad_alloc();
+	}
+	return(pointer);
+}
+
+void* operator new[](size_t size)
+{
+	void* pointer = TrackedAllocate(size);
+	if (NULL == pointer)
+	{
+		throw std::bad_alloc();
+	}
+	return(pointer);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return(TrackedAllocate(size));
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return(TrackedAllocate(size));
+}
+
+void operator delete(void* pointer) noexcept
+{
+	TrackedFree(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+	TrackedFree(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+	TrackedFree(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept
+{
+	TrackedFree(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+	TrackedFree(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+	TrackedFree(pointer);
+}
+
+#endif
+
+/***********************************************************
+ *  IsEnabled()
+ *
+ *  This function is used for checking whether the global
+ *  allocation hooks are compiled into the build.
+ ***********************************************************/
+bool AllocationTracker::IsEnabled()
+{
+#ifdef ENABLE_ALLOCATION_TRACKING
+	return(true);
+#else
+	return(false);
+#endif
+}
+
+/***********************************************************
+ *  GetThreadStats()
+ *
+ *  This function is used for getting the running counters
+ *  of the calling thread.
+ ***********************************************************/
+AllocationTracker::ALLOCATION_STATS AllocationTracker::GetThreadStats()
+{
+	ALLOCATION_STATS stats;
+
+	stats.allocations = g_ThreadAllocations;
+	stats.frees = g_ThreadFrees;
+	stats.bytes = g_ThreadBytes;
+
+	return(stats);
+}
+
+/***********************************************************
+ *  GetGlobalStats()
+ *
+ *  This function is used for getting the running counters
+ *  summed over every thread.
+ ***********************************************************/
+AllocationTracker::ALLOCATION_STATS AllocationTracker::GetGlobalStats()
+{
+	ALLOCATION_STATS stats;
+
+	stats.allocations = g_GlobalAllocations.load(std::memory_order_relaxed);
+	stats.frees = g_GlobalFrees.load(std::memory_order_relaxed);
+	stats.bytes = g_GlobalBytes.load(std::memory_order_relaxed);
+
+	return(stats);
+}
+
+/***********************************************************
+ *  AllocationScope()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+AllocationScope::AllocationScope(const char* scopeName, bool bReport)
+{
+	m_scopeName = scopeName;
+	m_bReport = bReport;
+	m_startStats = AllocationTracker::GetThreadStats();
+}
+
+/***********************************************************
+ *  ~AllocationScope()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+AllocationScope::~AllocationScope()
+{
+	if (m_bReport == true)
+	{
+		AllocationTracker::ALLOCATION_STATS stats = GetStats();
+		if (stats.allocations > 0)
+		{
+			std::cout << "ALLOC: " << m_scopeName << " made " << stats.allocations
+				<< " allocations, " << stats.bytes << " bytes" << std::endl;
+		}
+	}
+}
+
+/***********************************************************
+ *  GetStats()
+ *
+ *  This method is used for getting the allocations made by
+ *  the calling thread since the scope started.
+ ***********************************************************/
+AllocationTracker::ALLOCATION_STATS AllocationScope::GetStats() const
+{
+	AllocationTracker::ALLOCATION_STATS current = AllocationTracker::GetThreadStats();
+	AllocationTracker::ALLOCATION_STATS stats;
+
+	stats.allocations = current.allocations - m_startStats.allocations;
+	stats.frees = current.frees - m_startStats.frees;
+	stats.bytes = current.bytes - m_startStats.bytes;
+
+	return(stats);
+}
@@ -0,0 +1,64 @@
+///////////////////////////////////////////////////////////////////////////////
+// allocationtracking.h
+// ============
+// count heap allocations per frame and per scope
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+/***********************************************************
+ *  Heap allocation tracking
+ *
+ *  When ENABLE_ALLOCATION_TRACKING is defined for the build,
+ *  the global operator new and delete are replaced with
+ *  versions that count every allocation and its size. The
+ *  counters are kept per thread, so a scope only sees the
+ *  allocations made by its own thread. Without the define
+ *  the counters always stay at zero and cost nothing.
+ ***********************************************************/
+namespace AllocationTracker
+{
+	// allocation counters for the calling thread
+	struct ALLOCATION_STATS
+	{
+		unsigned long long allocations;
+		unsigned long long frees;
+		unsigned long long bytes;
+	};
+
+	// check whether the allocation hooks are compiled in
+	bool IsEnabled();
+	// get the running counters of the calling thread
+	ALLOCATION_STATS GetThreadStats();
+	// get the running counters of all threads together
+	ALLOCATION_STATS GetGlobalStats();
+}
+
+/***********************************************************
+ *  AllocationScope
+ *
+ *  This class is used for measuring the heap allocations
+ *  made by the calling thread between its construction and
+ *  the call to GetStats, for example over one frame.
+ ***********************************************************/
+class AllocationScope
+{
+public:
+	// constructor, the name is used for the report
+	AllocationScope(const char* scopeName, bool bReport = false);
+	// destructor, reports the allocations if requested
+	~AllocationScope();
+
+private:
+	// name printed in the report
+	const char* m_scopeName;
+	// print a line when the scope allocated anything
+	bool m_bReport;
+	// thread counters when the scope started
+	AllocationTracker::ALLOCATION_STATS m_startStats;
+
+public:
+	// get the allocations made since the scope started
+	AllocationTracker::ALLOCATION_STATS GetStats() const;
+};
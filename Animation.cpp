@@ -0,0 +1,422 @@
+///////////////////////////////////////////////////////////////////////////////
+// animation.cpp
+// ============
+// keyframe animation clips evaluated in batches for many objects
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Animation.h"
+
+#include <xmmintrin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// declaration of global variables
+namespace
+{
+	// objects evaluated together by one SSE operation
+	const int g_BatchWidth = 4;
+	// smaller batches are evaluated on the calling thread, the
+	// wake up of the workers costs more than they would save
+	const int g_ParallelInstanceThreshold = 256;
+}
+
+/***********************************************************
+ *  AnimationClip()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+AnimationClip::AnimationClip(bool bLoop)
+{
+	m_bLoop = bLoop;
+}
+
+/***********************************************************
+ *  AddKeyframe()
+ *
+ *  This method is used for appending a key to the clip. Keys
+ *  have to be added in increasing time order.
+ ***********************************************************/
+bool AnimationClip::AddKeyframe(float time, const KEYFRAME& keyframe)
+{
+	if ((time < 0.0f) ||
+		((m_times.empty() == false) && (time <= m_times.back())))
+	{
+		std::cout << "Keyframe at " << time << " is out of order" << std::endl;
+		return(false);
+	}
+
+	m_times.push_back(time);
+	m_channels[CHANNEL_POSITION_X].push_back(keyframe.position.x);
+	m_channels[CHANNEL_POSITION_Y].push_back(keyframe.position.y);
+	m_channels[CHANNEL_POSITION_Z].push_back(keyframe.position.z);
+	m_channels[CHANNEL_ROTATION_X].push_back(keyframe.rotation.x);
+	m_channels[CHANNEL_ROTATION_Y].push_back(keyframe.rotation.y);
+	m_channels[CHANNEL_ROTATION_Z].push_back(keyframe.rotation.z);
+	m_channels[CHANNEL_SCALE_X].push_back(keyframe.scale.x);
+	m_channels[CHANNEL_SCALE_Y].push_back(keyframe.scale.y);
+	m_channels[CHANNEL_SCALE_Z].push_back(keyframe.scale.z);
+	m_channels[CHANNEL_COLOR_R].push_back(keyframe.color.r);
+	m_channels[CHANNEL_COLOR_G].push_back(keyframe.color.g);
+	m_channels[CHANNEL_COLOR_B].push_back(keyframe.color.b);
+	m_channels[CHANNEL_COLOR_A].push_back(keyframe.color.a);
+
+	return(true);
+}
+
+/***********************************************************
+ *  AnimationSystem()
+ *
+ *  The constructor for the class - the worker threads are
+ *  started here and sleep until the first large batch
+ ***********************************************************/
+AnimationSystem::AnimationSystem(int workerThreads)
+{
+	m_instanceCount = 0;
+	m_workGeneration = 0;
+	m_pendingWorkers = 0;
+	m_batchSize = 0;
+	m_evaluationTime = 0.0;
+	m_bShutdown = false;
+
+	for (int i = 0; i < workerThreads; i++)
+	{
+		m_workers.push_back(std::thread(&AnimationSystem::WorkerMain, this, i));
+	}
+}
+
+/***********************************************************
+ *  ~AnimationSystem()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+AnimationSystem::~AnimationSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_workMutex);
+		m_bShutdown = true;
+	}
+	m_workReady.notify_all();
+
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		m_workers[i].join();
+	}
+	m_workers.clear();
+}
+
+/***********************************************************
+ *  AddClip()
+ *
+ *  This method is used for adding a clip that animated
+ *  objects can play.
+ ***********************************************************/
+int AnimationSystem::AddClip(const AnimationClip& clip)
+{
+	m_clips.push_back(clip);
+	return((int)m_clips.size() - 1);
+}
+
+/***********************************************************
+ *  AddInstance()
+ *
+ *  This method is used for adding an object that plays the
+ *  passed in clip. The offset shifts the object within the
+ *  clip, so many objects can share one clip out of step.
+ ***********************************************************/
+int AnimationSystem::AddInstance(int clip, float timeOffset, float speed)
+{
+	if ((clip < 0) || (clip >= (int)m_clips.size()) ||
+		(m_clips[clip].GetKeyCount() == 0))
+	{
+		std::cout << "Animation clip " << clip << " has no keys" << std::endl;
+		return(-1);
+	}
+
+	int instance = m_instanceCount;
+	int paddedCount = ((instance + g_BatchWidth) / g_BatchWidth) * g_BatchWidth;
+
+	// new padding repeats the first object, so the last group
+	// of four always reads valid keys
+	if (paddedCount > (int)m_instanceClip.size())
+	{
+		int padClip = (instance == 0) ? clip : m_instanceClip[0];
+		float padOffset = (instance == 0) ? timeOffset : m_instanceOffset[0];
+		float padSpeed = (instance == 0) ? speed : m_instanceSpeed[0];
+
+		m_instanceClip.resize(paddedCount, padClip);
+		m_instanceOffset.resize(paddedCount, padOffset);
+		m_instanceSpeed.resize(paddedCount, padSpeed);
+		m_instanceKey.resize(paddedCount, 0);
+		for (int i = 0; i < AnimationClip::TOTAL_CHANNELS; i++)
+		{
+			m_output[i].resize(paddedCount, 0.0f);
+		}
+	}
+
+	m_instanceClip[instance] = clip;
+	m_instanceOffset[instance] = timeOffset;
+	m_instanceSpeed[instance] = speed;
+	m_instanceKey[instance] = 0;
+	m_instanceCount++;
+
+	return(instance);
+}
+
+/***********************************************************
+ *  ClearInstances()
+ *
+ *  This method is used for removing every animated object,
+ *  so a new set of objects can be added. The arrays keep
+ *  their capacity for the next set.
+ ***********************************************************/
+void AnimationSystem::ClearInstances()
+{
+	m_instanceClip.clear();
+	m_instanceOffset.clear();
+	m_instanceSpeed.clear();
+	m_instanceKey.clear();
+	for (int i = 0; i < AnimationClip::TOTAL_CHANNELS; i++)
+	{
+		m_output[i].clear();
+	}
+	m_instanceCount = 0;
+}
+
+/***********************************************************
+ *  FindKeys()
+ *
+ *  This method is used for finding the two keys an object
+ *  is between at the passed in time, and how far it is from
+ *  the first to the second.
+ ***********************************************************/
+void AnimationSystem::FindKeys(int instance, double time, int& keyA, int& keyB, float& blend)
+{
+	const AnimationClip& clip = m_clips[m_instanceClip[instance]];
+	int keyCount = clip.GetKeyCount();
+	const float* times = clip.GetTimes();
+
+	keyA = 0;
+	keyB = 0;
+	blend = 0.0f;
+	if (keyCount < 2)
+	{
+		return;
+	}
+
+	// the time is kept in double until it is wrapped into the
+	// clip, so a display running for days does not lose precision
+	double duration = clip.GetDuration();
+	double clipTime = (time * m_instanceSpeed[instance]) + m_instanceOffset[instance];
+	if (clip.IsLooping() == true)
+	{
+		clipTime = std::fmod(clipTime, duration);
+		if (clipTime < 0.0)
+		{
+			clipTime += duration;
+		}
+	}
+	else
+	{
+		clipTime = std::min(std::max(clipTime, 0.0), duration);
+	}
+	float localTime = (float)clipTime;
+
+	int key = m_instanceKey[instance];
+	if ((key > keyCount - 2) || (localTime < times[key]))
+	{
+		key = (int)(std::upper_bound(times, times + keyCount, localTime) - times) - 1;
+	}
+	else
+	{
+		while ((key < keyCount - 2) && (localTime >= times[key + 1]))
+		{
+			key++;
+		}
+	}
+	key = std::min(std::max(key, 0), keyCount - 2);
+	m_instanceKey[instance] = key;
+
+	float span = times[key + 1] - times[key];
+	keyA = key;
+	keyB = key + 1;
+	blend = std::min(std::max((localTime - times[key]) / span, 0.0f), 1.0f);
+}
+
+/***********************************************************
+ *  EvaluateRange()
+ *
+ *  This method is used for evaluating the objects in the
+ *  passed in range, four at a time. The keys are found per
+ *  object, then each channel is gathered from the four
+ *  clips and blended with one SSE operation.
+ ***********************************************************/
+void AnimationSystem::EvaluateRange(int begin, int end, double time)
+{
+	int keyA[g_BatchWidth];
+	int keyB[g_BatchWidth];
+	float blend[g_BatchWidth];
+	const AnimationClip* clips[g_BatchWidth];
+
+	for (int base = begin; base < end; base += g_BatchWidth)
+	{
+		for (int lane = 0; lane < g_BatchWidth; lane++)
+		{
+			FindKeys(base + lane, time, keyA[lane], keyB[lane], blend[lane]);
+			clips[lane] = &m_clips[m_instanceClip[base + lane]];
+		}
+
+		__m128 factor = _mm_loadu_ps(blend);
+		for (int channel = 0; channel < AnimationClip::TOTAL_CHANNELS; channel++)
+		{
+			const float* values0 = clips[0]->GetChannel(channel);
+			const float* values1 = clips[1]->GetChannel(channel);
+			const float* values2 = clips[2]->GetChannel(channel);
+			const float* values3 = clips[3]->GetChannel(channel);
+
+			__m128 from = _mm_set_ps(
+				values3[keyA[3]], values2[keyA[2]], values1[keyA[1]], values0[keyA[0]]);
+			__m128 to = _mm_set_ps(
+				values3[keyB[3]], values2[keyB[2]], values1[keyB[1]], values0[keyB[0]]);
+			__m128 result = _mm_add_ps(from, _mm_mul_ps(_mm_sub_ps(to, from), factor));
+
+			_mm_storeu_ps(&m_output[channel][base], result);
+		}
+	}
+}
+
+/***********************************************************
+ *  WorkerMain()
+ *
+ *  This method is run by each worker thread. It sleeps until
+ *  a batch is posted, evaluates its share of the objects
+ *  and reports back when done.
+ ***********************************************************/
+void AnimationSystem::WorkerMain(int workerIndex)
+{
+	unsigned int lastGeneration = 0;
+
+	for (;;)
+	{
+		int batchSize = 0;
+		double time = 0.0;
+		{
+			std::unique_lock<std::mutex> lock(m_workMutex);
+			while ((m_bShutdown == false) && (m_workGeneration == lastGeneration))
+			{
+				m_workReady.wait(lock);
+			}
+			if (m_bShutdown == true)
+			{
+				return;
+			}
+			lastGeneration = m_workGeneration;
+			batchSize = m_batchSize;
+			time = m_evaluationTime;
+		}
+
+		// the calling thread takes the first share
+		int paddedCount = (int)m_instanceClip.size();
+		int begin = std::min(batchSize * (workerIndex + 1), paddedCount);
+		int end = std::min(begin + batchSize, paddedCount);
+		EvaluateRange(begin, end, time);
+
+		{
+			std::lock_guard<std::mutex> lock(m_workMutex);
+			m_pendingWorkers--;
+			if (m_pendingWorkers == 0)
+			{
+				m_workDone.notify_one();
+			}
+		}
+	}
+}
+
+/***********************************************************
+ *  Evaluate()
+ *
+ *  This method is used for evaluating every animated object
+ *  at the passed in time. Large batches are split evenly
+ *  between the calling thread and the workers, and the call
+ *  returns once every share is done.
+ ***********************************************************/
+void AnimationSystem::Evaluate(double time)
+{
+	int paddedCount = (int)m_instanceClip.size();
+	if (paddedCount == 0)
+	{
+		return;
+	}
+
+	if ((m_workers.empty() == true) || (m_instanceCount < g_ParallelInstanceThreshold))
+	{
+		EvaluateRange(0, paddedCount, time);
+		return;
+	}
+
+	// shares are whole groups of four, so no two threads
+	// ever write the same group
+	int shares = (int)m_workers.size() + 1;
+	int batchSize = (paddedCount + shares - 1) / shares;
+	batchSize = ((batchSize + g_BatchWidth - 1) / g_BatchWidth) * g_BatchWidth;
+
+	{
+		std::lock_guard<std::mutex> lock(m_workMutex);
+		m_batchSize = batchSize;
+		m_evaluationTime = time;
+		m_pendingWorkers = (int)m_workers.size();
+		m_workGeneration++;
+	}
+	m_workReady.notify_all();
+
+	EvaluateRange(0, std::min(batchSize, paddedCount), time);
+
+	std::unique_lock<std::mutex> lock(m_workMutex);
+	while (m_pendingWorkers > 0)
+	{
+		m_workDone.wait(lock);
+	}
+}
+
+/***********************************************************
+ *  GetTransform()
+ *
+ *  This method is used for getting the evaluated transform
+ *  of an object, in the form SetTransformations takes.
+ ***********************************************************/
+void AnimationSystem::GetTransform(
+	int instance,
+	glm::vec3& scaleXYZ,
+	glm::vec3& rotationDegrees,
+	glm::vec3& positionXYZ) const
+{
+	scaleXYZ = glm::vec3(
+		m_output[AnimationClip::CHANNEL_SCALE_X][instance],
+		m_output[AnimationClip::CHANNEL_SCALE_Y][instance],
+		m_output[AnimationClip::CHANNEL_SCALE_Z][instance]);
+	rotationDegrees = glm::vec3(
+		m_output[AnimationClip::CHANNEL_ROTATION_X][instance],
+		m_output[AnimationClip::CHANNEL_ROTATION_Y][instance],
+		m_output[AnimationClip::CHANNEL_ROTATION_Z][instance]);
+	positionXYZ = glm::vec3(
+		m_output[AnimationClip::CHANNEL_POSITION_X][instance],
+		m_output[AnimationClip::CHANNEL_POSITION_Y][instance],
+		m_output[AnimationClip::CHANNEL_POSITION_Z][instance]);
+}
+
+/***********************************************************
+ *  GetColor()
+ *
+ *  This method is used for getting the evaluated color of
+ *  an object.
+ ***********************************************************/
+glm::vec4 AnimationSystem::GetColor(int instance) const
+{
+	return(glm::vec4(
+		m_output[AnimationClip::CHANNEL_COLOR_R][instance],
+		m_output[AnimationClip::CHANNEL_COLOR_G][instance],
+		m_output[AnimationClip::CHANNEL_COLOR_B][instance],
+		m_output[AnimationClip::CHANNEL_COLOR_A][instance]));
+}
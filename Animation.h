@@ -0,0 +1,162 @@
+///////////////////////////////////////////////////////////////////////////////
+// animation.h
+// ============
+// keyframe animation clips evaluated in batches for many objects
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/***********************************************************
+ *  AnimationClip
+ *
+ *  This class holds the keyframes of one animation. Every
+ *  key sets all of the channels, and each channel is kept
+ *  in its own contiguous array so the evaluation reads the
+ *  values of one channel without striding over the others.
+ ***********************************************************/
+class AnimationClip
+{
+public:
+	// animated values, in the order they are stored
+	enum CHANNEL
+	{
+		CHANNEL_POSITION_X,
+		CHANNEL_POSITION_Y,
+		CHANNEL_POSITION_Z,
+		CHANNEL_ROTATION_X,		// Euler degrees, as SetTransformations
+		CHANNEL_ROTATION_Y,
+		CHANNEL_ROTATION_Z,
+		CHANNEL_SCALE_X,
+		CHANNEL_SCALE_Y,
+		CHANNEL_SCALE_Z,
+		CHANNEL_COLOR_R,
+		CHANNEL_COLOR_G,
+		CHANNEL_COLOR_B,
+		CHANNEL_COLOR_A,
+		TOTAL_CHANNELS
+	};
+
+	// the values of every channel at one point in time
+	struct KEYFRAME
+	{
+		glm::vec3 position;
+		glm::vec3 rotation;
+		glm::vec3 scale;
+		glm::vec4 color;
+	};
+
+	// constructor
+	AnimationClip(bool bLoop);
+
+private:
+	// key times in seconds, increasing
+	std::vector<float> m_times;
+	// key values, one array per channel
+	std::vector<float> m_channels[TOTAL_CHANNELS];
+	// true when the clip repeats after the last key
+	bool m_bLoop;
+
+public:
+	// append a key, later than every key added so far
+	bool AddKeyframe(float time, const KEYFRAME& keyframe);
+
+	// get the time of the last key
+	float GetDuration() const { return m_times.empty() ? 0.0f : m_times.back(); }
+	int GetKeyCount() const { return (int)m_times.size(); }
+	bool IsLooping() const { return m_bLoop; }
+
+	// get the key times and the values of one channel
+	const float* GetTimes() const { return m_times.data(); }
+	const float* GetChannel(int channel) const { return m_channels[channel].data(); }
+};
+
+/***********************************************************
+ *  AnimationSystem
+ *
+ *  This class is used for evaluating the clips of all of
+ *  the animated objects at once. Objects are processed four
+ *  at a time, each channel is interpolated with one SSE
+ *  operation for the four objects, and the results land in
+ *  per channel output arrays. Large batches are split over
+ *  worker threads that are started once and wait between
+ *  frames, so evaluating never creates threads or touches
+ *  the heap.
+ ***********************************************************/
+class AnimationSystem
+{
+public:
+	// constructor
+	AnimationSystem(int workerThreads);
+	// destructor
+	~AnimationSystem();
+
+private:
+	// clips shared by the animated objects
+	std::vector<AnimationClip> m_clips;
+
+	// animated objects, one entry per object in each array,
+	// padded to a multiple of four with copies of the first
+	std::vector<int> m_instanceClip;
+	std::vector<float> m_instanceOffset;
+	std::vector<float> m_instanceSpeed;
+	// key found for each object last time, the search
+	// starts there since time mostly moves forward
+	std::vector<int> m_instanceKey;
+	int m_instanceCount;
+
+	// evaluated values, one array per channel
+	std::vector<float> m_output[AnimationClip::TOTAL_CHANNELS];
+
+	// worker threads and the batch they share
+	std::vector<std::thread> m_workers;
+	std::mutex m_workMutex;
+	std::condition_variable m_workReady;
+	std::condition_variable m_workDone;
+	unsigned int m_workGeneration;
+	int m_pendingWorkers;
+	int m_batchSize;
+	double m_evaluationTime;
+	bool m_bShutdown;
+
+	// disable copying, the system owns its threads
+	AnimationSystem(const AnimationSystem&);
+	AnimationSystem& operator=(const AnimationSystem&);
+
+	// wait for batches and evaluate the worker's share
+	void WorkerMain(int workerIndex);
+	// evaluate the objects in the range, in groups of four
+	void EvaluateRange(int begin, int end, double time);
+	// find the key pair and blend factor of one object
+	void FindKeys(int instance, double time, int& keyA, int& keyB, float& blend);
+
+public:
+	// add a clip and return its index
+	int AddClip(const AnimationClip& clip);
+	// add an animated object and return its index
+	int AddInstance(int clip, float timeOffset, float speed);
+	// remove every animated object, the clips are kept
+	void ClearInstances();
+
+	// evaluate every object at the passed in time in seconds
+	void Evaluate(double time);
+
+	// get the evaluated transform of an object
+	void GetTransform(
+		int instance,
+		glm::vec3& scaleXYZ,
+		glm::vec3& rotationDegrees,
+		glm::vec3& positionXYZ) const;
+	// get the evaluated color of an object
+	glm::vec4 GetColor(int instance) const;
+
+	int GetInstanceCount() const { return m_instanceCount; }
+	int GetWorkerCount() const { return (int)m_workers.size(); }
+};
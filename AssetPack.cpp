@@ -0,0 +1,433 @@
+///////////////////////////////////////////////////////////////////////////////
+// assetpack.cpp
+// ============
+// read the textures, shaders and meshes from one mapped archive
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "AssetPack.h"
+#include "MappedFile.h"
+
+#include <cstring>
+#include <iostream>
+
+// declaration of global variables
+namespace
+{
+	// the mounted pack and its table of contents
+	MappedFile g_PackFile;
+	const AssetPack::PACK_ENTRY* g_Entries = NULL;
+	unsigned int g_EntryCount = 0;
+	const char* g_Names = NULL;
+
+	// shortest match the compression stores, and the farthest
+	// back a match may start
+	const size_t g_MinMatch = 4;
+	const size_t g_MaxOffset = 65535;
+	// bits of the hash of the next bytes used to find matches
+	const int g_MatchHashBits = 16;
+	// largest literal or match length that fits in the token
+	const size_t g_TokenLength = 15;
+
+	/***********************************************************
+	 *  WriteLength()
+	 *
+	 *  This function is used for writing the part of a length
+	 *  that did not fit into the token, as bytes of 255 and
+	 *  the rest.
+	 ***********************************************************/
+	void WriteLength(std::vector<unsigned char>& output, size_t length)
+	{
+		while (length >= 255)
+		{
+			output.push_back(255);
+			length -= 255;
+		}
+		output.push_back((unsigned char)length);
+	}
+
+	/***********************************************************
+	 *  ReadLength()
+	 *
+	 *  This function is used for adding the part of a length
+	 *  written by WriteLength() to the passed in length.
+	 ***********************************************************/
+	bool ReadLength(const unsigned char* data, size_t size, size_t& position, size_t& length)
+	{
+		unsigned char value = 255;
+		while (value == 255)
+		{
+			if (position >= size)
+			{
+				return(false);
+			}
+			value = data[position++];
+			length += value;
+		}
+		return(true);
+	}
+
+	/***********************************************************
+	 *  WriteSequence()
+	 *
+	 *  This function is used for writing the literal bytes up
+	 *  to a match followed by the match. A match length of 0
+	 *  writes the last literals of the data, with no match.
+	 ***********************************************************/
+	void WriteSequence(
+		std::vector<unsigned char>& output,
+		const unsigned char* literals,
+		size_t literalCount,
+		size_t offset,
+		size_t matchLength)
+	{
+		size_t matchCode = (matchLength > 0) ? (matchLength - g_MinMatch) : 0;
+		size_t literalToken = (literalCount < g_TokenLength) ? literalCount : g_TokenLength;
+		size_t matchToken = (matchCode < g_TokenLength) ? matchCode : g_TokenLength;
+
+		output.push_back((unsigned char)((literalToken << 4) | matchToken));
+		if (literalToken == g_TokenLength)
+		{
+			WriteLength(output, literalCount - g_TokenLength);
+		}
+		output.insert(output.end(), literals, literals + literalCount);
+
+		if (matchLength > 0)
+		{
+			output.push_back((unsigned char)(offset & 0xFF));
+			output.push_back((unsigned char)(offset >> 8));
+			if (matchToken == g_TokenLength)
+			{
+				WriteLength(output, matchCode - g_TokenLength);
+			}
+		}
+	}
+
+	/***********************************************************
+	 *  CheckPack()
+	 *
+	 *  This function is used for checking that the header,
+	 *  the table of contents and every entry fit inside the
+	 *  mapped pack, so the lookups never read past it.
+	 ***********************************************************/
+	bool CheckPack(const unsigned char* data, size_t size)
+	{
+		if (size < sizeof(AssetPack::PACK_HEADER))
+		{
+			return(false);
+		}
+
+		AssetPack::PACK_HEADER header;
+		memcpy(&header, data, sizeof(header));
+		if ((header.magic != AssetPack::PACK_MAGIC) || (header.version != AssetPack::PACK_VERSION))
+		{
+			return(false);
+		}
+
+		unsigned long long tableEnd = sizeof(header) + (unsigned long long)header.entryCount * sizeof(AssetPack::PACK_ENTRY);
+		if ((tableEnd > size) || (header.namesOffset < tableEnd) ||
+			(header.namesOffset + header.nameBytes > size) ||
+			((header.nameBytes > 0) && (data[header.namesOffset + header.nameBytes - 1] != '\0')))
+		{
+			return(false);
+		}
+
+		const AssetPack::PACK_ENTRY* entries = reinterpret_cast<const AssetPack::PACK_ENTRY*>(data + sizeof(header));
+		for (unsigned int i = 0; i < header.entryCount; i++)
+		{
+			const AssetPack::PACK_ENTRY& entry = entries[i];
+			if ((entry.nameOffset >= header.nameBytes) ||
+				(entry.offset > size) || (entry.storedSize > size - entry.offset) ||
+				(entry.compression > AssetPack::COMPRESSION_LZ) ||
+				((entry.compression == AssetPack::COMPRESSION_NONE) && (entry.storedSize != entry.size)) ||
+				((i > 0) && (entries[i - 1].nameHash > entry.nameHash)))
+			{
+				return(false);
+			}
+		}
+
+		return(true);
+	}
+
+	/***********************************************************
+	 *  FindEntry()
+	 *
+	 *  This function is used for finding an entry by name in
+	 *  the sorted table of contents of the mounted pack.
+	 ***********************************************************/
+	const AssetPack::PACK_ENTRY* FindEntry(const char* name)
+	{
+		unsigned long long hash = AssetPack::HashName(name);
+
+		// first entry whose hash is not below the searched one
+		unsigned int first = 0;
+		unsigned int count = g_EntryCount;
+		while (count > 0)
+		{
+			unsigned int half = count / 2;
+			if (g_Entries[first + half].nameHash < hash)
+			{
+				first += half + 1;
+				count -= half + 1;
+			}
+			else
+			{
+				count = half;
+			}
+		}
+
+		for (unsigned int i = first; (i < g_EntryCount) && (g_Entries[i].nameHash == hash); i++)
+		{
+			if (strcmp(g_Names + g_Entries[i].nameOffset, name) == 0)
+			{
+				return(&g_Entries[i]);
+			}
+		}
+
+		return(NULL);
+	}
+}
+
+/***********************************************************
+ *  Mount()
+ *
+ *  This function is used for mapping the pack and checking
+ *  its table of contents. A pack that is already mounted
+ *  is replaced.
+ ***********************************************************/
+bool AssetPack::Mount(const char* filename)
+{
+	Unmount();
+
+	if ((NULL == filename) || (g_PackFile.Open(filename) == false))
+	{
+		return(false);
+	}
+
+	if (CheckPack(g_PackFile.GetData(), g_PackFile.GetSize()) == false)
+	{
+		std::cout << "Damaged asset pack:" << filename << std::endl;
+		g_PackFile.Close();
+		return(false);
+	}
+
+	PACK_HEADER header;
+	memcpy(&header, g_PackFile.GetData(), sizeof(header));
+	g_Entries = reinterpret_cast<const PACK_ENTRY*>(g_PackFile.GetData() + sizeof(header));
+	g_EntryCount = header.entryCount;
+	g_Names = reinterpret_cast<const char*>(g_PackFile.GetData() + header.namesOffset);
+
+	std::cout << "INFO: Asset pack mounted:" << filename << ", " << g_EntryCount << " entries" << std::endl;
+	return(true);
+}
+
+/***********************************************************
+ *  Unmount()
+ *
+ *  This function is used for unmapping the pack. Views
+ *  handed out by Read() are invalid afterwards.
+ ***********************************************************/
+void AssetPack::Unmount()
+{
+	g_Entries = NULL;
+	g_EntryCount = 0;
+	g_Names = NULL;
+	g_PackFile.Close();
+}
+
+/***********************************************************
+ *  IsMounted()
+ *
+ *  This function is used for checking whether a pack is
+ *  mounted.
+ ***********************************************************/
+bool AssetPack::IsMounted()
+{
+	return(g_PackFile.IsOpen());
+}
+
+/***********************************************************
+ *  Read()
+ *
+ *  This function is used for getting the bytes of an entry
+ *  of the mounted pack. A stored entry is returned as a
+ *  view into the mapping and leaves the buffer alone, a
+ *  compressed entry is unpacked into the buffer.
+ ***********************************************************/
+bool AssetPack::Read(
+	const char* name,
+	std::vector<unsigned char>& buffer,
+	const unsigned char*& data,
+	size_t& size)
+{
+	data = NULL;
+	size = 0;
+
+	if ((NULL == name) || (NULL == g_Entries))
+	{
+		return(false);
+	}
+
+	const PACK_ENTRY* pEntry = FindEntry(name);
+	if (NULL == pEntry)
+	{
+		return(false);
+	}
+
+	const unsigned char* stored = g_PackFile.GetData() + pEntry->offset;
+	if (pEntry->compression == COMPRESSION_NONE)
+	{
+		data = stored;
+		size = (size_t)pEntry->size;
+		return(true);
+	}
+
+	buffer.resize((size_t)pEntry->size);
+	if ((buffer.empty() == false) &&
+		(Decompress(stored, (size_t)pEntry->storedSize, &buffer[0], buffer.size()) == false))
+	{
+		std::cout << "Damaged asset pack entry:" << name << std::endl;
+		return(false);
+	}
+
+	data = buffer.empty() ? stored : &buffer[0];
+	size = buffer.size();
+	return(true);
+}
+
+/***********************************************************
+ *  HashName()
+ *
+ *  This function is used for hashing an entry name with
+ *  64-bit FNV-1a, which the packer and the lookups share.
+ ***********************************************************/
+unsigned long long AssetPack::HashName(const char* name)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	for (const char* character = name; *character != '\0'; character++)
+	{
+		hash ^= (unsigned char)*character;
+		hash *= 1099511628211ULL;
+	}
+	return(hash);
+}
+
+/***********************************************************
+ *  Compress()
+ *
+ *  This function is used for compressing bytes into
+ *  sequences of literal bytes followed by a match, a copy
+ *  of earlier bytes given by its distance and length. The
+ *  matches are found through a hash of the next four
+ *  bytes, which trades some size for a quick packer and a
+ *  decoder that only copies bytes.
+ ***********************************************************/
+void AssetPack::Compress(const unsigned char* data, size_t size, std::vector<unsigned char>& compressed)
+{
+	compressed.clear();
+	compressed.reserve(size + (size / 255) + 16);
+
+	// last position + 1 of each hash, 0 for none
+	std::vector<size_t> lastPositions((size_t)1 << g_MatchHashBits, 0);
+
+	size_t anchor = 0;
+	size_t position = 0;
+	while (position + g_MinMatch <= size)
+	{
+		unsigned int sequence = 0;
+		memcpy(&sequence, data + position, g_MinMatch);
+		size_t hash = (size_t)((sequence * 2654435761u) >> (32 - g_MatchHashBits));
+		size_t candidate = lastPositions[hash];
+		lastPositions[hash] = position + 1;
+
+		if ((0 == candidate) || (position - (candidate - 1) > g_MaxOffset) ||
+			(memcmp(data + candidate - 1, data + position, g_MinMatch) != 0))
+		{
+			position++;
+			continue;
+		}
+		candidate--;
+
+		size_t length = g_MinMatch;
+		while ((position + length < size) && (data[candidate + length] == data[position + length]))
+		{
+			length++;
+		}
+
+		WriteSequence(compressed, data + anchor, position - anchor, position - candidate, length);
+		position += length;
+		anchor = position;
+	}
+
+	WriteSequence(compressed, data + anchor, size - anchor, 0, 0);
+}
+
+/***********************************************************
+ *  Decompress()
+ *
+ *  This function is used for unpacking bytes written by
+ *  Compress(). Every length and distance is checked, so
+ *  damaged bytes fail instead of writing out of bounds.
+ ***********************************************************/
+bool AssetPack::Decompress(
+	const unsigned char* data,
+	size_t size,
+	unsigned char* output,
+	size_t outputSize)
+{
+	size_t position = 0;
+	size_t written = 0;
+
+	while (position < size)
+	{
+		unsigned char token = data[position++];
+
+		size_t literalCount = token >> 4;
+		if ((literalCount == g_TokenLength) && (ReadLength(data, size, position, literalCount) == false))
+		{
+			return(false);
+		}
+		if ((literalCount > size - position) || (literalCount > outputSize - written))
+		{
+			return(false);
+		}
+		memcpy(output + written, data + position, literalCount);
+		position += literalCount;
+		written += literalCount;
+
+		// the last sequence has no match
+		if (position == size)
+		{
+			break;
+		}
+
+		if (size - position < 2)
+		{
+			return(false);
+		}
+		size_t offset = data[position] | ((size_t)data[position + 1] << 8);
+		position += 2;
+
+		size_t length = token & 0x0F;
+		if ((length == g_TokenLength) && (ReadLength(data, size, position, length) == false))
+		{
+			return(false);
+		}
+		length += g_MinMatch;
+		if ((0 == offset) || (offset > written) || (length > outputSize - written))
+		{
+			return(false);
+		}
+
+		// the copy may overlap the bytes it writes, which
+		// repeats them, so it goes one byte at a time
+		const unsigned char* source = output + written - offset;
+		for (size_t i = 0; i < length; i++)
+		{
+			output[written + i] = source[i];
+		}
+		written += length;
+	}
+
+	return(written == outputSize);
+}
@@ -0,0 +1,103 @@
+///////////////////////////////////////////////////////////////////////////////
+// assetpack.h
+// ============
+// read the textures, shaders and meshes from one mapped archive
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/***********************************************************
+ *  AssetPack
+ *
+ *  These functions are used for reading assets out of one
+ *  packed archive built by the AssetPacker tool, instead of
+ *  opening every loose file. The pack is mapped once, and
+ *  an entry stored without compression is handed to the
+ *  loaders as a view into the mapping, with no copy and no
+ *  file call per asset.
+ *
+ *  The pack starts with a header and a table of contents
+ *  sorted by the hash of the entry names, followed by the
+ *  names and then the entry data, each entry starting on an
+ *  ENTRY_ALIGNMENT boundary. Entries are named by the path
+ *  the loaders ask for, like "textures/wood.jpg", with
+ *  forward slashes. Compressed entries are unpacked into a
+ *  buffer of the caller.
+ *
+ *  The pack is mounted once for the whole process before
+ *  any loader runs. After that it is only read, so every
+ *  thread and GL context can use it at the same time. An
+ *  asset that is not in the pack is loaded from its loose
+ *  file as before.
+ ***********************************************************/
+namespace AssetPack
+{
+	// identifies a pack, "CPAK" in little endian
+	const unsigned int PACK_MAGIC = 0x4B415043;
+	// bumped whenever the layout changes
+	const unsigned int PACK_VERSION = 1;
+	// every entry starts on a multiple of this
+	const size_t ENTRY_ALIGNMENT = 64;
+
+	// how the bytes of an entry are stored
+	enum COMPRESSION
+	{
+		COMPRESSION_NONE,
+		COMPRESSION_LZ
+	};
+
+	// start of the pack, the table of contents follows it
+	struct PACK_HEADER
+	{
+		unsigned int magic;
+		unsigned int version;
+		unsigned int entryCount;
+		unsigned int nameBytes;		// size of the name table
+		unsigned long long namesOffset;
+		unsigned long long reserved;
+	};
+
+	// one entry of the table of contents
+	struct PACK_ENTRY
+	{
+		unsigned long long nameHash;
+		unsigned long long offset;		// from the start of the pack
+		unsigned long long storedSize;	// bytes in the pack
+		unsigned long long size;		// bytes once unpacked
+		unsigned int nameOffset;		// into the name table
+		unsigned int compression;		// COMPRESSION
+	};
+
+	// map the pack for every loader, false when it is missing
+	// or damaged - the loaders then use the loose files
+	bool Mount(const char* filename);
+	// unmap the pack, no view into it may be in use
+	void Unmount();
+	// check whether a pack is mounted
+	bool IsMounted();
+
+	// get the bytes of an entry, a view into the mapping when
+	// stored and unpacked into the buffer when compressed -
+	// false when the entry is not in the pack
+	bool Read(
+		const char* name,
+		std::vector<unsigned char>& buffer,
+		const unsigned char*& data,
+		size_t& size);
+
+	// hash an entry name for the table of contents
+	unsigned long long HashName(const char* name);
+	// compress bytes for the pack
+	void Compress(const unsigned char* data, size_t size, std::vector<unsigned char>& compressed);
+	// unpack compressed bytes, false when they are damaged or do
+	// not unpack into exactly the output size
+	bool Decompress(
+		const unsigned char* data,
+		size_t size,
+		unsigned char* output,
+		size_t outputSize);
+}
@@ -0,0 +1,516 @@
+///////////////////////////////////////////////////////////////////////////////
+// batchrenderer.cpp
+// ============
+// render a list of camera views offscreen on every core
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "BatchRenderer.h"
+#include "ViewManager.h"
+#include "MemoryAccounting.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+// declaration of global variables
+namespace
+{
+	// shader sources of the scene, the same as the window uses
+	const char* const g_VertexShaderPath = "shaders/vertexShader.glsl";
+	const char* const g_FragmentShaderPath = "shaders/fragmentShader.glsl";
+	const char* const g_ShaderCacheDirectory = "shadercache";
+
+	// bytes per texel of the offscreen target, for the accounting
+	const long long g_ColorBytesPerTexel = 4;
+	const long long g_DepthBytesPerTexel = 4;
+}
+
+/***********************************************************
+ *  BatchRenderer()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+BatchRenderer::BatchRenderer(int workerCount, int width, int height)
+{
+	if (workerCount <= 0)
+	{
+		workerCount = std::max((int)std::thread::hardware_concurrency(), 1);
+	}
+	m_workerCount = workerCount;
+	m_width = std::max(width, 1);
+	m_height = std::max(height, 1);
+	m_nextJob = 0;
+	m_failedViews = 0;
+	m_elapsedSeconds = 0.0;
+}
+
+/***********************************************************
+ *  ~BatchRenderer()
+ *
+ *  The destructor for the class - the workers free their
+ *  GL objects before Run() returns
+ ***********************************************************/
+BatchRenderer::~BatchRenderer()
+{
+}
+
+/***********************************************************
+ *  LoadJobs()
+ *
+ *  This method is used for reading the camera views from
+ *  the passed in text file. Each line holds the camera
+ *  position, the point it looks at, the vertical field of
+ *  view in degrees and the image file to write:
+ *
+ *      px py pz  tx ty tz  fov  output.ppm
+ *
+ *  Empty lines and lines starting with # are skipped.
+ ***********************************************************/
+bool BatchRenderer::LoadJobs(const char* filename)
+{
+	std::ifstream file(filename);
+	if (!file.is_open())
+	{
+		std::cout << "Could not open batch job list:" << filename << std::endl;
+		return(false);
+	}
+
+	m_jobs.clear();
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+		size_t first = line.find_first_not_of(" \t\r");
+		if ((first == std::string::npos) || (line[first] == '#'))
+		{
+			continue;
+		}
+
+		RENDER_JOB job;
+		std::istringstream fields(line);
+		fields >> job.position.x >> job.position.y >> job.position.z
+			>> job.target.x >> job.target.y >> job.target.z
+			>> job.fieldOfView >> job.outputPath;
+		if ((fields.fail() == true) || (job.fieldOfView <= 0.0f) || (job.fieldOfView >= 180.0f))
+		{
+			std::cout << "Invalid batch job at line " << lineNumber << ":" << filename << std::endl;
+			return(false);
+		}
+		m_jobs.push_back(job);
+	}
+
+	if (m_jobs.empty() == true)
+	{
+		std::cout << "Batch job list is empty:" << filename << std::endl;
+		return(false);
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  PrepareWorker()
+ *
+ *  This method is used for creating the scene of a worker
+ *  and the framebuffer it renders into. Every program the
+ *  scene can draw with is built, and the first view is
+ *  rendered once so the lightmaps are baked - the caller
+ *  holds the prepare lock, so only the first worker writes
+ *  the caches on disk.
+ ***********************************************************/
+bool BatchRenderer::PrepareWorker(WORKER& worker)
+{
+	worker.pShaderManager = new ShaderManager();
+	worker.pShaderCache = new ShaderProgramCache(g_ShaderCacheDirectory);
+	worker.pResourceManager = new ResourceManager(worker.pShaderCache);
+	worker.pShaderPermutations = new ShaderPermutationSet(
+		worker.pResourceManager,
+		g_VertexShaderPath,
+		g_FragmentShaderPath);
+	worker.pSceneManager = new SceneManager(
+		worker.pShaderManager,
+		worker.pShaderPermutations,
+		worker.pResourceManager);
+
+	// start every permutation before waiting on any of them
+	for (unsigned int i = 0; i < ShaderPermutationSet::TOTAL_PERMUTATIONS; i++)
+	{
+		if (ShaderPermutationSet::IsUsefulCombination(i) == true)
+		{
+			worker.pShaderPermutations->PrefetchProgram(i);
+		}
+	}
+	for (unsigned int i = 0; i < ShaderPermutationSet::TOTAL_PERMUTATIONS; i++)
+	{
+		if (ShaderPermutationSet::IsUsefulCombination(i) == true)
+		{
+			worker.pShaderPermutations->GetProgram(i);
+		}
+	}
+
+	GLuint programID = worker.pShaderPermutations->GetProgram(
+		ShaderPermutationSet::FEATURE_TEXTURE |
+		ShaderPermutationSet::FEATURE_LIGHTING);
+	if (0 == programID)
+	{
+		return(false);
+	}
+	worker.pShaderManager->m_programID = programID;
+	worker.pShaderManager->use();
+
+	worker.pSceneManager->PrepareScene();
+
+	glGenRenderbuffers(1, &worker.colorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, worker.colorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_width, m_height);
+	glGenRenderbuffers(1, &worker.depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, worker.depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, m_width, m_height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &worker.framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, worker.framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, worker.colorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, worker.depthBuffer);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	long long texels = (long long)m_width * m_height;
+	MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_TEXTURE, "batchColorTarget", texels * g_ColorBytesPerTexel);
+	MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_TEXTURE, "batchDepthTarget", texels * g_DepthBytesPerTexel);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "Could not create batch render target, status:" << status << std::endl;
+		return(false);
+	}
+
+	worker.pixels.resize((size_t)m_width * m_height * 3);
+
+	// the lightmaps bake on the first draw that uses them
+	return(RenderJob(worker, m_jobs[0]));
+}
+
+/***********************************************************
+ *  ReleaseWorker()
+ *
+ *  This method is used for freeing the scene and the render
+ *  target of a worker while its context is current.
+ ***********************************************************/
+void BatchRenderer::ReleaseWorker(WORKER& worker)
+{
+	if (0 != worker.framebuffer)
+	{
+		glDeleteFramebuffers(1, &worker.framebuffer);
+		glDeleteRenderbuffers(1, &worker.colorBuffer);
+		glDeleteRenderbuffers(1, &worker.depthBuffer);
+
+		long long texels = (long long)m_width * m_height;
+		MemoryAccounting::Free(MemoryAccounting::CATEGORY_TEXTURE, "batchColorTarget", texels * g_ColorBytesPerTexel);
+		MemoryAccounting::Free(MemoryAccounting::CATEGORY_TEXTURE, "batchDepthTarget", texels * g_DepthBytesPerTexel);
+	}
+	worker.framebuffer = 0;
+	worker.colorBuffer = 0;
+	worker.depthBuffer = 0;
+
+	if (NULL != worker.pSceneManager)
+	{
+		delete worker.pSceneManager;
+		worker.pSceneManager = NULL;
+	}
+	if (NULL != worker.pShaderManager)
+	{
+		delete worker.pShaderManager;
+		worker.pShaderManager = NULL;
+	}
+	if (NULL != worker.pShaderPermutations)
+	{
+		delete worker.pShaderPermutations;
+		worker.pShaderPermutations = NULL;
+	}
+	// the resource manager goes after every handle owner
+	if (NULL != worker.pResourceManager)
+	{
+		delete worker.pResourceManager;
+		worker.pResourceManager = NULL;
+	}
+	if (NULL != worker.pShaderCache)
+	{
+		delete worker.pShaderCache;
+		worker.pShaderCache = NULL;
+	}
+
+	std::vector<unsigned char>().swap(worker.pixels);
+}
+
+/***********************************************************
+ *  RenderJob()
+ *
+ *  This method is used for rendering the view of one job
+ *  into the framebuffer of the worker and reading it back.
+ *  The animations are held at their start, so every view
+ *  shows the same scene.
+ ***********************************************************/
+bool BatchRenderer::RenderJob(WORKER& worker, const RENDER_JOB& job)
+{
+	GLStateCache* pStateCache = worker.pSceneManager->GetStateCache();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, worker.framebuffer);
+	glViewport(0, 0, m_width, m_height);
+
+	// the clear obeys the masks, which the last draw of the
+	// previous view may have turned off
+	pStateCache->SetEnabled(GL_DEPTH_TEST, true);
+	pStateCache->SetDepthMask(true);
+	pStateCache->SetColorMask(true);
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	glm::mat4 view;
+	glm::mat4 projection;
+	float zNear = 0.0f;
+	float zFar = 0.0f;
+	ViewManager::GetSceneView(
+		job.position, job.target, job.fieldOfView,
+		m_width, m_height, view, projection, zNear, zFar);
+	worker.pSceneManager->SetSceneView(
+		view, projection, zNear, zFar, m_width, m_height);
+
+	// the views of a batch do not follow from each other
+	worker.pSceneManager->SetCameraCut();
+	worker.pSceneManager->UpdateAnimations(0.0);
+	worker.pSceneManager->RenderScene();
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, m_width, m_height, GL_RGB, GL_UNSIGNED_BYTE, &worker.pixels[0]);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// free the GPU resources released during the view
+	worker.pResourceManager->CollectGarbage();
+
+	return(glGetError() == GL_NO_ERROR);
+}
+
+/***********************************************************
+ *  WriteImage()
+ *
+ *  This method is used for writing the pixels read back by
+ *  a worker into a binary PPM file. GL returns the rows
+ *  bottom up, so they are written in reverse.
+ ***********************************************************/
+bool BatchRenderer::WriteImage(const WORKER& worker, const char* filename) const
+{
+	std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Could not write batch image:" << filename << std::endl;
+		return(false);
+	}
+
+	char header[64];
+	snprintf(header, sizeof(header), "P6\n%d %d\n255\n", m_width, m_height);
+	file << header;
+
+	size_t rowBytes = (size_t)m_width * 3;
+	for (int y = m_height - 1; y >= 0; y--)
+	{
+		file.write(reinterpret_cast<const char*>(&worker.pixels[(size_t)y * rowBytes]), rowBytes);
+	}
+
+	file.close();
+	return(!file.fail());
+}
+
+/***********************************************************
+ *  WorkerThread()
+ *
+ *  This method is used by each worker for preparing its
+ *  scene in turn and then rendering jobs until none are
+ *  left. The context is released again before returning,
+ *  so the window can be destroyed on the calling thread.
+ ***********************************************************/
+void BatchRenderer::WorkerThread(int workerIndex)
+{
+	WORKER& worker = m_workers[workerIndex];
+	glfwMakeContextCurrent(worker.pWindow);
+
+	{
+		std::lock_guard<std::mutex> lock(m_prepareMutex);
+		worker.bPrepared = PrepareWorker(worker);
+	}
+	if (worker.bPrepared == false)
+	{
+		std::cout << "Could not prepare batch worker " << workerIndex << std::endl;
+	}
+
+	while (worker.bPrepared == true)
+	{
+		int job = m_nextJob.fetch_add(1);
+		if (job >= (int)m_jobs.size())
+		{
+			break;
+		}
+
+		const RENDER_JOB& renderJob = m_jobs[job];
+		if ((RenderJob(worker, renderJob) == true) &&
+			(WriteImage(worker, renderJob.outputPath.c_str()) == true))
+		{
+			worker.renderedViews++;
+		}
+		else
+		{
+			std::cout << "Could not render batch view:" << renderJob.outputPath << std::endl;
+			m_failedViews++;
+		}
+	}
+
+	ReleaseWorker(worker);
+	glfwMakeContextCurrent(NULL);
+}
+
+/***********************************************************
+ *  Run()
+ *
+ *  This method is used for rendering every job. A hidden
+ *  window is created for each worker on this thread, GLEW
+ *  is loaded once through the first context, and then
+ *  the workers render the jobs in parallel.
+ ***********************************************************/
+bool BatchRenderer::Run()
+{
+	if (m_jobs.empty() == true)
+	{
+		return(false);
+	}
+
+	// the framebuffer of each worker is the render target, so
+	// the windows only carry the contexts
+	m_workers.clear();
+	m_workers.resize(m_workerCount);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	int createdWorkers = 0;
+	for (int i = 0; i < m_workerCount; i++)
+	{
+		WORKER& worker = m_workers[i];
+		worker.pShaderManager = NULL;
+		worker.pShaderCache = NULL;
+		worker.pResourceManager = NULL;
+		worker.pShaderPermutations = NULL;
+		worker.pSceneManager = NULL;
+		worker.framebuffer = 0;
+		worker.colorBuffer = 0;
+		worker.depthBuffer = 0;
+		worker.renderedViews = 0;
+		worker.bPrepared = false;
+		worker.pWindow = glfwCreateWindow(1, 1, "batch", NULL, NULL);
+		if (NULL == worker.pWindow)
+		{
+			std::cout << "Could not create batch context " << i << std::endl;
+			continue;
+		}
+		createdWorkers++;
+	}
+	glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+	if (0 == createdWorkers)
+	{
+		return(false);
+	}
+
+	// every context comes from the same driver, so the entry
+	// points loaded through one of them serve all of them
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		if (NULL != m_workers[i].pWindow)
+		{
+			glfwMakeContextCurrent(m_workers[i].pWindow);
+			break;
+		}
+	}
+	GLenum GLEWInitResult = glewInit();
+	glfwMakeContextCurrent(NULL);
+	if (GLEW_OK != GLEWInitResult)
+	{
+		std::cout << "Could not initialize GLEW for the batch:" << glewGetErrorString(GLEWInitResult) << std::endl;
+		createdWorkers = 0;
+	}
+
+	m_nextJob = 0;
+	m_failedViews = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> threads;
+	for (int i = 0; (i < m_workerCount) && (createdWorkers > 0); i++)
+	{
+		if (NULL != m_workers[i].pWindow)
+		{
+			threads.push_back(std::thread(&BatchRenderer::WorkerThread, this, i));
+		}
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+	{
+		threads[i].join();
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	m_elapsedSeconds = elapsed.count();
+
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		if (NULL != m_workers[i].pWindow)
+		{
+			glfwDestroyWindow(m_workers[i].pWindow);
+			m_workers[i].pWindow = NULL;
+		}
+	}
+
+	int renderedViews = 0;
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		renderedViews += m_workers[i].renderedViews;
+	}
+	return(renderedViews == (int)m_jobs.size());
+}
+
+/***********************************************************
+ *  WriteReport()
+ *
+ *  This method is used for writing how many views were
+ *  rendered, how fast, and how they spread over the
+ *  workers. The time includes preparing the workers.
+ ***********************************************************/
+void BatchRenderer::WriteReport(std::ostream& output) const
+{
+	int renderedViews = 0;
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		renderedViews += m_workers[i].renderedViews;
+	}
+
+	double framesPerSecond = (m_elapsedSeconds > 0.0) ? (renderedViews / m_elapsedSeconds) : 0.0;
+	output << "INFO: Batch rendered " << renderedViews << " of " << m_jobs.size() << " views at "
+		<< m_width << "x" << m_height << " in " << std::fixed << std::setprecision(2)
+		<< m_elapsedSeconds << " s, " << framesPerSecond << " frames per second on "
+		<< m_workers.size() << " contexts" << std::endl;
+	output << std::defaultfloat << std::setprecision(6);
+
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		output << "  worker " << i << ": " << m_workers[i].renderedViews << " views";
+		if (m_workers[i].bPrepared == false)
+		{
+			output << " (not started)";
+		}
+		output << std::endl;
+	}
+	if (m_failedViews > 0)
+	{
+		output << "  failed views: " << m_failedViews.load() << std::endl;
+	}
+}
@@ -0,0 +1,125 @@
+///////////////////////////////////////////////////////////////////////////////
+// batchrenderer.h
+// ============
+// render a list of camera views offscreen on every core
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "SceneManager.h"
+#include "ShaderManager.h"
+#include "ShaderCache.h"
+#include "ShaderPermutations.h"
+#include "ResourceManager.h"
+
+#include <GL/glew.h>
+#include "GLFW/glfw3.h"
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/***********************************************************
+ *  BatchRenderer
+ *
+ *  This class is used for rendering many views of the scene
+ *  without a visible window, like the shots of a catalog.
+ *  The jobs are read from a text file, one camera per line,
+ *  and each view is written into its own PPM image.
+ *
+ *  Every worker thread gets a hidden window for its own GL
+ *  context, its own scene and managers and a framebuffer
+ *  of the output size, since GL objects like vertex arrays
+ *  and framebuffers cannot be shared between contexts. The
+ *  workers prepare one after the other, so the first one
+ *  fills the mesh, shader binary and lightmap caches on
+ *  disk and the others only map and read them. After that
+ *  the workers take jobs from a shared counter until the
+ *  list is done.
+ *
+ *  The windows are created and destroyed on the thread
+ *  that calls Run(), which GLFW requires.
+ ***********************************************************/
+class BatchRenderer
+{
+public:
+	// one camera view to render
+	struct RENDER_JOB
+	{
+		glm::vec3 position;
+		glm::vec3 target;
+		float fieldOfView;		// vertical, in degrees
+		std::string outputPath;
+	};
+
+	// constructor, 0 workers uses every core
+	BatchRenderer(int workerCount, int width, int height);
+	// destructor
+	~BatchRenderer();
+
+private:
+	// the context and scene of one worker thread
+	struct WORKER
+	{
+		GLFWwindow* pWindow;
+		ShaderManager* pShaderManager;
+		ShaderProgramCache* pShaderCache;
+		ResourceManager* pResourceManager;
+		ShaderPermutationSet* pShaderPermutations;
+		SceneManager* pSceneManager;
+		// offscreen target the views are rendered into
+		GLuint framebuffer;
+		GLuint colorBuffer;
+		GLuint depthBuffer;
+		// read back pixels of the last view
+		std::vector<unsigned char> pixels;
+		int renderedViews;
+		bool bPrepared;
+	};
+
+	int m_workerCount;
+	int m_width;
+	int m_height;
+	std::vector<RENDER_JOB> m_jobs;
+	std::vector<WORKER> m_workers;
+
+	// shared by the workers while the batch runs
+	std::mutex m_prepareMutex;
+	std::atomic<int> m_nextJob;
+	std::atomic<int> m_failedViews;
+	double m_elapsedSeconds;
+
+	// disable copying, the workers own GL contexts
+	BatchRenderer(const BatchRenderer&);
+	BatchRenderer& operator=(const BatchRenderer&);
+
+	// create the scene and render target of a worker, with
+	// its context current
+	bool PrepareWorker(WORKER& worker);
+	// free the GL objects of a worker, with its context current
+	void ReleaseWorker(WORKER& worker);
+	// render one job into the pixels of the worker
+	bool RenderJob(WORKER& worker, const RENDER_JOB& job);
+	// take and render jobs until the list is done
+	void WorkerThread(int workerIndex);
+	// write the pixels of the worker into a PPM file
+	bool WriteImage(const WORKER& worker, const char* filename) const;
+
+public:
+	// read the jobs, one per line as position, target, field
+	// of view and output path - # starts a comment
+	bool LoadJobs(const char* filename);
+	// get the number of jobs read
+	int GetJobCount() const { return (int)m_jobs.size(); }
+
+	// render every job, GLFW must be initialized - returns
+	// false when no worker could start or a view failed
+	bool Run();
+
+	// write the number of views and the frames per second
+	void WriteReport(std::ostream& output) const;
+};
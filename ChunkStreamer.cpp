@@ -0,0 +1,1061 @@
+///////////////////////////////////////////////////////////////////////////////
+// chunkstreamer.cpp
+// ============
+// stream the chunks of a large world in and out around the camera
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ChunkStreamer.h"
+#include "MemoryAccounting.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// declaration of global variables
+namespace
+{
+	const char* const g_WorldFileName = "world.bin";
+	// tag the chunk records are accounted under
+	const char* const g_ChunkMemoryTag = "worldChunks";
+
+	// sanity limits for the counts read from a chunk file
+	const unsigned int g_MaxChunkResources = 256;
+	const unsigned int g_MaxChunkObjects = 1 << 20;
+
+	// default distances and budgets, the load radius matches the
+	// far plane of the camera and the unload radius adds one
+	// chunk of the generated warehouse to it
+	const float g_DefaultLoadRadius = 100.0f;
+	const float g_DefaultUnloadRadius = 124.0f;
+	const float g_DefaultPrefetchSeconds = 2.0f;
+	const long long g_DefaultIOBudget = 256 * 1024;
+	const int g_DefaultMaxUploads = 1;
+
+	// a prefetched chunk queues behind every chunk inside the
+	// load radius around the camera
+	const float g_PrefetchPriorityOffset = 1.0e4f;
+
+	// layout of the generated warehouse - props stand on a grid
+	// of cells, with an aisle after every few rows and along
+	// the edge of every chunk
+	const float g_WarehouseChunkSize = 24.0f;
+	const float g_WarehouseCellSize = 3.0f;
+	const int g_WarehouseRowsPerAisle = 3;
+	// one cell in this many is left empty
+	const int g_WarehouseEmptyCells = 7;
+	// chunks per side of the blocks sharing a streamed texture
+	const int g_WarehouseZoneSize = 4;
+	// height of the tallest prop, for the chunk bounds
+	const float g_WarehousePropHeight = 3.0f;
+	// cells this close to the origin are left empty for the desk
+	const float g_WarehouseClearRadius = 16.0f;
+
+	// materials and textures the scene defines
+	const char* const g_WarehouseMaterials[] = { "plastic", "metal", "wood", "leather" };
+	const char* const g_WarehouseSceneTextures[] = { "cubeTexture", "woodTexture" };
+	// textures only the warehouse uses, one per zone
+	struct WAREHOUSE_TEXTURE
+	{
+		const char* tag;
+		const char* filename;
+	};
+	const WAREHOUSE_TEXTURE g_WarehouseZoneTextures[] =
+	{
+		{ "palletTexture", "textures/wood.jpg" },
+		{ "binTexture", "textures/cube.jpg" },
+		{ "wrapTexture", "textures/leather.jpg" }
+	};
+	const int g_WarehouseMaterialCount = sizeof(g_WarehouseMaterials) / sizeof(g_WarehouseMaterials[0]);
+	const int g_WarehouseSceneTextureCount = sizeof(g_WarehouseSceneTextures) / sizeof(g_WarehouseSceneTextures[0]);
+	const int g_WarehouseZoneTextureCount = sizeof(g_WarehouseZoneTextures) / sizeof(g_WarehouseZoneTextures[0]);
+
+	/***********************************************************
+	 *  SetResource()
+	 *
+	 *  This function is used for filling in a chunk resource,
+	 *  cutting strings that are too long for it.
+	 ***********************************************************/
+	void SetResource(
+		ChunkStreamer::CHUNK_RESOURCE& resource,
+		ChunkStreamer::RESOURCE_TYPE type,
+		const char* tag,
+		const char* filename)
+	{
+		memset(&resource, 0, sizeof(resource));
+		resource.type = type;
+		strncpy(resource.tag, tag, ChunkStreamer::TAG_LENGTH - 1);
+		if (NULL != filename)
+		{
+			strncpy(resource.filename, filename, ChunkStreamer::FILENAME_LENGTH - 1);
+		}
+	}
+}
+
+// out of class definitions for the integral constants
+const unsigned int ChunkStreamer::WORLD_MAGIC;
+const unsigned int ChunkStreamer::CHUNK_MAGIC;
+const unsigned int ChunkStreamer::WORLD_VERSION;
+const int ChunkStreamer::TAG_LENGTH;
+const int ChunkStreamer::FILENAME_LENGTH;
+
+/***********************************************************
+ *  ChunkStreamer()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+ChunkStreamer::ChunkStreamer(ResourceManager* pResourceManager)
+{
+	m_pResourceManager = pResourceManager;
+	memset(&m_world, 0, sizeof(m_world));
+	m_settings = GetDefaultSettings();
+	m_textureGeneration = 0;
+	m_ioCredit = 0;
+	m_bytesRead = 0;
+	m_bStopLoader = false;
+	m_residentBytes = 0;
+	m_chunksLoaded = 0;
+	m_chunksEvicted = 0;
+}
+
+/***********************************************************
+ *  ~ChunkStreamer()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+ChunkStreamer::~ChunkStreamer()
+{
+	Close();
+	m_pResourceManager = NULL;
+}
+
+/***********************************************************
+ *  GetDefaultSettings()
+ *
+ *  This method is used for getting the distances and
+ *  budgets used when nothing else is asked for.
+ ***********************************************************/
+ChunkStreamer::STREAMING_SETTINGS ChunkStreamer::GetDefaultSettings()
+{
+	STREAMING_SETTINGS settings;
+	settings.loadRadius = g_DefaultLoadRadius;
+	settings.unloadRadius = g_DefaultUnloadRadius;
+	settings.prefetchSeconds = g_DefaultPrefetchSeconds;
+	settings.ioBudgetBytes = g_DefaultIOBudget;
+	settings.maxUploadsPerFrame = g_DefaultMaxUploads;
+	return(settings);
+}
+
+/***********************************************************
+ *  Open()
+ *
+ *  This method is used for reading the header of a world
+ *  and starting the loading thread. No chunk is loaded
+ *  until the first Update().
+ ***********************************************************/
+bool ChunkStreamer::Open(const char* worldPath, const STREAMING_SETTINGS& settings)
+{
+	Close();
+
+	if (NULL == worldPath)
+	{
+		return(false);
+	}
+
+	std::string headerPath = std::string(worldPath) + "/" + g_WorldFileName;
+	std::ifstream file(headerPath.c_str(), std::ios::in | std::ios::binary);
+	WORLD_HEADER world;
+	if (!file.is_open() || !file.read(reinterpret_cast<char*>(&world), sizeof(world)))
+	{
+		std::cout << "Could not open world:" << worldPath << std::endl;
+		return(false);
+	}
+	if ((world.magic != WORLD_MAGIC) || (world.version != WORLD_VERSION) ||
+		!(world.chunkSize > 0.0f) || (world.chunksX <= 0) || (world.chunksZ <= 0) ||
+		((long long)world.chunksX * world.chunksZ > (1 << 24)))
+	{
+		std::cout << "Damaged world header:" << headerPath << std::endl;
+		return(false);
+	}
+
+	m_worldPath = worldPath;
+	m_world = world;
+	m_settings = settings;
+	m_settings.unloadRadius = std::max(m_settings.unloadRadius, m_settings.loadRadius);
+	m_settings.maxUploadsPerFrame = std::max(m_settings.maxUploadsPerFrame, 1);
+
+	CHUNK_SLOT emptySlot;
+	emptySlot.state = CHUNK_UNLOADED;
+	emptySlot.pChunk = NULL;
+	m_slots.assign((size_t)world.chunksX * world.chunksZ, emptySlot);
+
+	m_ioCredit = m_settings.ioBudgetBytes;
+	m_bytesRead = 0;
+	m_bStopLoader = false;
+	m_loader = std::thread(&ChunkStreamer::LoaderMain, this);
+
+	std::cout << "INFO: World opened:" << worldPath << ", " << world.chunksX << " x " << world.chunksZ
+		<< " chunks of " << world.chunkSize << " units" << std::endl;
+	return(true);
+}
+
+/***********************************************************
+ *  Close()
+ *
+ *  This method is used for stopping the loading thread and
+ *  dropping every chunk and texture.
+ ***********************************************************/
+void ChunkStreamer::Close()
+{
+	if (m_loader.joinable() == true)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_loadMutex);
+			m_bStopLoader = true;
+			m_requests.clear();
+		}
+		m_workQueued.notify_one();
+		m_loader.join();
+	}
+
+	// the loads finished after the last update were never taken
+	for (size_t i = 0; i < m_results.size(); i++)
+	{
+		delete m_results[i].pChunk;
+		if (NULL != m_results[i].pImage)
+		{
+			ResourceManager::FreeImage(*m_results[i].pImage);
+			delete m_results[i].pImage;
+		}
+	}
+	m_results.clear();
+
+	for (size_t i = 0; i < m_slots.size(); i++)
+	{
+		if (NULL != m_slots[i].pChunk)
+		{
+			EvictChunk((int)i);
+		}
+	}
+	for (size_t i = 0; i < m_textures.size(); i++)
+	{
+		if (NULL != m_textures[i].pImage)
+		{
+			ResourceManager::FreeImage(*m_textures[i].pImage);
+			delete m_textures[i].pImage;
+		}
+	}
+
+	m_slots.clear();
+	m_textures.clear();
+	m_loadedChunks.clear();
+	m_residentChunks.clear();
+	m_residentList.clear();
+	m_textureGeneration++;
+}
+
+/***********************************************************
+ *  GetChunkPath()
+ *
+ *  This method is used for getting the file of a chunk.
+ ***********************************************************/
+std::string ChunkStreamer::GetChunkPath(int chunkX, int chunkZ) const
+{
+	char filename[64];
+	snprintf(filename, sizeof(filename), "/chunk_%d_%d.bin", chunkX, chunkZ);
+	return(m_worldPath + filename);
+}
+
+/***********************************************************
+ *  GetChunkDistance()
+ *
+ *  This method is used for getting the distance on the
+ *  ground plane from a point to the square of a chunk,
+ *  0 when the point is inside it.
+ ***********************************************************/
+float ChunkStreamer::GetChunkDistance(int slot, const glm::vec2& point) const
+{
+	float minX = (m_world.firstChunkX + (slot % m_world.chunksX)) * m_world.chunkSize;
+	float minZ = (m_world.firstChunkZ + (slot / m_world.chunksX)) * m_world.chunkSize;
+
+	float dx = std::max(std::max(minX - point.x, point.x - (minX + m_world.chunkSize)), 0.0f);
+	float dz = std::max(std::max(minZ - point.y, point.y - (minZ + m_world.chunkSize)), 0.0f);
+	return(sqrt((dx * dx) + (dz * dz)));
+}
+
+/***********************************************************
+ *  ReadChunk()
+ *
+ *  This method is used for reading a chunk file and checking
+ *  every count and index in it, so a damaged file is never
+ *  drawn from. Safe on the loading thread.
+ ***********************************************************/
+bool ChunkStreamer::ReadChunk(const std::string& path, int chunkX, int chunkZ, STREAMED_CHUNK& chunk) const
+{
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+	{
+		return(false);
+	}
+	std::streamoff length = file.tellg();
+	file.seekg(0, std::ios::beg);
+
+	CHUNK_HEADER header;
+	if ((length < (std::streamoff)sizeof(header)) ||
+		!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+	{
+		return(false);
+	}
+	if ((header.magic != CHUNK_MAGIC) || (header.version != WORLD_VERSION) ||
+		(header.chunkX != chunkX) || (header.chunkZ != chunkZ) ||
+		(header.resourceCount > g_MaxChunkResources) || (header.objectCount > g_MaxChunkObjects) ||
+		(length != (std::streamoff)(sizeof(header) +
+			header.resourceCount * sizeof(CHUNK_RESOURCE) +
+			header.objectCount * sizeof(CHUNK_OBJECT))))
+	{
+		return(false);
+	}
+
+	chunk.chunkX = chunkX;
+	chunk.chunkZ = chunkZ;
+	chunk.boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+	chunk.boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+	chunk.bytes = (long long)length;
+	chunk.resources.resize(header.resourceCount);
+	chunk.objects.resize(header.objectCount);
+	if (((header.resourceCount > 0) &&
+			!file.read(reinterpret_cast<char*>(&chunk.resources[0]), header.resourceCount * sizeof(CHUNK_RESOURCE))) ||
+		((header.objectCount > 0) &&
+			!file.read(reinterpret_cast<char*>(&chunk.objects[0]), header.objectCount * sizeof(CHUNK_OBJECT))))
+	{
+		return(false);
+	}
+
+	for (size_t i = 0; i < chunk.resources.size(); i++)
+	{
+		CHUNK_RESOURCE& resource = chunk.resources[i];
+		resource.tag[TAG_LENGTH - 1] = '\0';
+		resource.filename[FILENAME_LENGTH - 1] = '\0';
+		if ((resource.type > RESOURCE_TEXTURE) || (resource.tag[0] == '\0'))
+		{
+			return(false);
+		}
+	}
+	int resourceCount = (int)chunk.resources.size();
+	for (size_t i = 0; i < chunk.objects.size(); i++)
+	{
+		const CHUNK_OBJECT& object = chunk.objects[i];
+		if ((object.prop >= TOTAL_CHUNK_PROPS) ||
+			(object.material < -1) || (object.material >= resourceCount) ||
+			(object.texture < -1) || (object.texture >= resourceCount) ||
+			((object.material >= 0) && (chunk.resources[object.material].type != RESOURCE_MATERIAL)) ||
+			((object.texture >= 0) && (chunk.resources[object.texture].type != RESOURCE_TEXTURE)))
+		{
+			return(false);
+		}
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  LoaderMain()
+ *
+ *  This method is run by the loading thread. It reads the
+ *  queued chunk or image with the lowest priority value
+ *  while the I/O budget of the frame lasts, then waits for
+ *  the next frame to refill it.
+ ***********************************************************/
+void ChunkStreamer::LoaderMain()
+{
+	std::unique_lock<std::mutex> lock(m_loadMutex);
+	for (;;)
+	{
+		while ((m_bStopLoader == false) && ((m_requests.empty() == true) || (m_ioCredit <= 0)))
+		{
+			m_workQueued.wait(lock);
+		}
+		if (m_bStopLoader == true)
+		{
+			break;
+		}
+
+		size_t next = 0;
+		for (size_t i = 1; i < m_requests.size(); i++)
+		{
+			if (m_requests[i].priority < m_requests[next].priority)
+			{
+				next = i;
+			}
+		}
+		LOAD_REQUEST request = m_requests[next];
+		m_requests[next] = m_requests.back();
+		m_requests.pop_back();
+		lock.unlock();
+
+		LOAD_RESULT result;
+		result.chunk = request.chunk;
+		result.texture = request.texture;
+		result.pChunk = NULL;
+		result.pImage = NULL;
+		long long bytes = 0;
+		if (request.chunk >= 0)
+		{
+			int chunkX = m_world.firstChunkX + (request.chunk % m_world.chunksX);
+			int chunkZ = m_world.firstChunkZ + (request.chunk / m_world.chunksX);
+			result.pChunk = new STREAMED_CHUNK();
+			if (ReadChunk(request.path, chunkX, chunkZ, *result.pChunk) == true)
+			{
+				bytes = result.pChunk->bytes;
+			}
+			else
+			{
+				delete result.pChunk;
+				result.pChunk = NULL;
+			}
+		}
+		else
+		{
+			// the decode happens here so the render thread only uploads
+			result.pImage = new ResourceManager::DECODED_IMAGE();
+			result.pImage->encodedData = NULL;
+			result.pImage->encodedSize = 0;
+			result.pImage->texels = NULL;
+			if (ResourceManager::ReadImage(request.path.c_str(), *result.pImage) == true)
+			{
+				bytes = (long long)result.pImage->encodedSize;
+				ResourceManager::DecodeImage(*result.pImage);
+			}
+		}
+
+		lock.lock();
+		m_results.push_back(result);
+		m_ioCredit -= bytes;
+		m_bytesRead += bytes;
+	}
+}
+
+/***********************************************************
+ *  ReferenceTextures()
+ *
+ *  This method is used for counting a loaded chunk as a user
+ *  of each of its streamed textures, and queueing the
+ *  images of the ones that are not uploaded yet.
+ ***********************************************************/
+void ChunkStreamer::ReferenceTextures(int slot, std::vector<LOAD_REQUEST>& requests)
+{
+	const STREAMED_CHUNK& chunk = *m_slots[slot].pChunk;
+	std::vector<int>& textures = m_slots[slot].textures;
+	textures.assign(chunk.resources.size(), -1);
+
+	for (size_t i = 0; i < chunk.resources.size(); i++)
+	{
+		const CHUNK_RESOURCE& resource = chunk.resources[i];
+		if ((resource.type != RESOURCE_TEXTURE) || (resource.filename[0] == '\0'))
+		{
+			continue;
+		}
+
+		// the number of distinct textures in a world is small
+		int texture = 0;
+		while ((texture < (int)m_textures.size()) && (m_textures[texture].texture.tag != resource.tag))
+		{
+			texture++;
+		}
+		if (texture == (int)m_textures.size())
+		{
+			TEXTURE_SLOT textureSlot;
+			textureSlot.texture.tag = resource.tag;
+			textureSlot.texture.filename = resource.filename;
+			textureSlot.texture.bHasAlpha = false;
+			textureSlot.state = TEXTURE_IDLE;
+			textureSlot.references = 0;
+			textureSlot.pImage = NULL;
+			m_textures.push_back(textureSlot);
+		}
+
+		TEXTURE_SLOT& textureSlot = m_textures[texture];
+		textureSlot.references++;
+		textures[i] = texture;
+		if (textureSlot.state == TEXTURE_IDLE)
+		{
+			// a texture is queued ahead of every chunk, since the
+			// chunk waiting for it is already in memory
+			LOAD_REQUEST request;
+			request.chunk = -1;
+			request.texture = texture;
+			request.path = textureSlot.texture.filename;
+			request.priority = -1.0f;
+			requests.push_back(request);
+			textureSlot.state = TEXTURE_REQUESTED;
+		}
+	}
+}
+
+/***********************************************************
+ *  ReleaseTextures()
+ *
+ *  This method is used for giving back the textures of a
+ *  chunk. A texture no chunk uses any more is released, the
+ *  resource manager frees it once the scene lets go too.
+ ***********************************************************/
+void ChunkStreamer::ReleaseTextures(int slot)
+{
+	std::vector<int>& textures = m_slots[slot].textures;
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		if (textures[i] < 0)
+		{
+			continue;
+		}
+
+		TEXTURE_SLOT& textureSlot = m_textures[textures[i]];
+		textureSlot.references--;
+		if (textureSlot.references > 0)
+		{
+			continue;
+		}
+
+		if (textureSlot.texture.handle.IsValid() == true)
+		{
+			textureSlot.texture.handle.Reset();
+			m_textureGeneration++;
+		}
+		if (NULL != textureSlot.pImage)
+		{
+			ResourceManager::FreeImage(*textureSlot.pImage);
+			delete textureSlot.pImage;
+			textureSlot.pImage = NULL;
+		}
+		// an image still being read is dropped when it arrives
+		if (textureSlot.state != TEXTURE_REQUESTED)
+		{
+			textureSlot.state = TEXTURE_IDLE;
+		}
+	}
+	textures.clear();
+}
+
+/***********************************************************
+ *  AreTexturesReady()
+ *
+ *  This method is used for checking whether every streamed
+ *  texture of a loaded chunk is uploaded, or has failed.
+ ***********************************************************/
+bool ChunkStreamer::AreTexturesReady(int slot) const
+{
+	const std::vector<int>& textures = m_slots[slot].textures;
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		if ((textures[i] >= 0) &&
+			(m_textures[textures[i]].state != TEXTURE_READY) &&
+			(m_textures[textures[i]].state != TEXTURE_FAILED))
+		{
+			return(false);
+		}
+	}
+	return(true);
+}
+
+/***********************************************************
+ *  EvictChunk()
+ *
+ *  This method is used for dropping a loaded or resident
+ *  chunk and its textures.
+ ***********************************************************/
+void ChunkStreamer::EvictChunk(int slot)
+{
+	CHUNK_SLOT& chunkSlot = m_slots[slot];
+	if (chunkSlot.state == CHUNK_RESIDENT)
+	{
+		std::vector<int>::iterator resident = std::find(m_residentChunks.begin(), m_residentChunks.end(), slot);
+		if (resident != m_residentChunks.end())
+		{
+			*resident = m_residentChunks.back();
+			m_residentChunks.pop_back();
+		}
+		m_chunksEvicted++;
+	}
+	else if (chunkSlot.state == CHUNK_LOADED)
+	{
+		std::vector<int>::iterator loaded = std::find(m_loadedChunks.begin(), m_loadedChunks.end(), slot);
+		if (loaded != m_loadedChunks.end())
+		{
+			*loaded = m_loadedChunks.back();
+			m_loadedChunks.pop_back();
+		}
+	}
+
+	ReleaseTextures(slot);
+	if (NULL != chunkSlot.pChunk)
+	{
+		MemoryAccounting::Free(MemoryAccounting::CATEGORY_STREAMED_DATA, g_ChunkMemoryTag, chunkSlot.pChunk->bytes);
+		m_residentBytes -= chunkSlot.pChunk->bytes;
+		delete chunkSlot.pChunk;
+		chunkSlot.pChunk = NULL;
+	}
+	std::vector<int>().swap(chunkSlot.textures);
+	chunkSlot.state = CHUNK_UNLOADED;
+}
+
+/***********************************************************
+ *  Update()
+ *
+ *  This method is used for moving the streaming along for
+ *  the camera of the next frame. The finished loads are
+ *  taken over, the textures within the upload budget are
+ *  uploaded, chunks with all of their textures become
+ *  resident, the chunks past the unload radius are dropped
+ *  and the missing chunks inside the load radius are queued.
+ ***********************************************************/
+void ChunkStreamer::Update(const glm::vec3& position, const glm::vec3& velocity)
+{
+	if (m_slots.empty() == true)
+	{
+		return;
+	}
+
+	// chunks are measured from the camera and from where the
+	// camera will be if it keeps moving
+	glm::vec2 camera(position.x, position.z);
+	glm::vec2 ahead = camera + (glm::vec2(velocity.x, velocity.z) * m_settings.prefetchSeconds);
+
+	// take the finished loads, refill the budget and drop the
+	// queued chunks that are now out of range
+	std::vector<LOAD_RESULT> results;
+	{
+		std::lock_guard<std::mutex> lock(m_loadMutex);
+		results.swap(m_results);
+
+		m_ioCredit = (m_settings.ioBudgetBytes > 0) ?
+			std::min(m_ioCredit + m_settings.ioBudgetBytes, m_settings.ioBudgetBytes) :
+			(1LL << 62);
+
+		for (size_t i = 0; i < m_requests.size(); )
+		{
+			LOAD_REQUEST& request = m_requests[i];
+			if (request.chunk < 0)
+			{
+				i++;
+				continue;
+			}
+
+			float cameraDistance = GetChunkDistance(request.chunk, camera);
+			float aheadDistance = GetChunkDistance(request.chunk, ahead);
+			if ((cameraDistance > m_settings.unloadRadius) && (aheadDistance > m_settings.unloadRadius))
+			{
+				m_slots[request.chunk].state = CHUNK_UNLOADED;
+				request = m_requests.back();
+				m_requests.pop_back();
+				continue;
+			}
+			request.priority = (cameraDistance <= m_settings.loadRadius) ?
+				cameraDistance : (aheadDistance + g_PrefetchPriorityOffset);
+			i++;
+		}
+	}
+
+	std::vector<LOAD_REQUEST> requests;
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		LOAD_RESULT& result = results[i];
+		if (result.chunk >= 0)
+		{
+			CHUNK_SLOT& chunkSlot = m_slots[result.chunk];
+			if (NULL == result.pChunk)
+			{
+				std::cout << "Could not read world chunk:" << GetChunkPath(
+					m_world.firstChunkX + (result.chunk % m_world.chunksX),
+					m_world.firstChunkZ + (result.chunk / m_world.chunksX)) << std::endl;
+				chunkSlot.state = CHUNK_MISSING;
+				continue;
+			}
+			if ((chunkSlot.state != CHUNK_REQUESTED) ||
+				((GetChunkDistance(result.chunk, camera) > m_settings.unloadRadius) &&
+				(GetChunkDistance(result.chunk, ahead) > m_settings.unloadRadius)))
+			{
+				// the camera moved away while the chunk was read
+				if (chunkSlot.state == CHUNK_REQUESTED)
+				{
+					chunkSlot.state = CHUNK_UNLOADED;
+				}
+				delete result.pChunk;
+				continue;
+			}
+
+			chunkSlot.state = CHUNK_LOADED;
+			chunkSlot.pChunk = result.pChunk;
+			MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_STREAMED_DATA, g_ChunkMemoryTag, result.pChunk->bytes);
+			m_residentBytes += result.pChunk->bytes;
+			m_loadedChunks.push_back(result.chunk);
+			ReferenceTextures(result.chunk, requests);
+		}
+		else
+		{
+			TEXTURE_SLOT& textureSlot = m_textures[result.texture];
+			if (textureSlot.references <= 0)
+			{
+				// no chunk wants the texture any more
+				ResourceManager::FreeImage(*result.pImage);
+				delete result.pImage;
+				textureSlot.state = TEXTURE_IDLE;
+				continue;
+			}
+			if (NULL == result.pImage->texels)
+			{
+				std::cout << "Could not load world texture:" << textureSlot.texture.filename << std::endl;
+				ResourceManager::FreeImage(*result.pImage);
+				delete result.pImage;
+				textureSlot.state = TEXTURE_FAILED;
+				continue;
+			}
+			textureSlot.pImage = result.pImage;
+			textureSlot.state = TEXTURE_DECODED;
+		}
+	}
+
+	// upload the decoded textures within the budget
+	int uploads = 0;
+	for (size_t i = 0; (i < m_textures.size()) && (uploads < m_settings.maxUploadsPerFrame); i++)
+	{
+		TEXTURE_SLOT& textureSlot = m_textures[i];
+		if (textureSlot.state != TEXTURE_DECODED)
+		{
+			continue;
+		}
+
+		bool bHasAlpha = false;
+		textureSlot.texture.handle = m_pResourceManager->UploadImage(*textureSlot.pImage, bHasAlpha);
+		textureSlot.texture.bHasAlpha = bHasAlpha;
+		textureSlot.state = (textureSlot.texture.handle.IsValid() == true) ? TEXTURE_READY : TEXTURE_FAILED;
+		ResourceManager::FreeImage(*textureSlot.pImage);
+		delete textureSlot.pImage;
+		textureSlot.pImage = NULL;
+		m_textureGeneration++;
+		uploads++;
+	}
+
+	// hand over the chunks whose textures are all there
+	for (size_t i = 0; i < m_loadedChunks.size(); )
+	{
+		int slot = m_loadedChunks[i];
+		if (AreTexturesReady(slot) == false)
+		{
+			i++;
+			continue;
+		}
+		m_slots[slot].state = CHUNK_RESIDENT;
+		m_residentChunks.push_back(slot);
+		m_loadedChunks[i] = m_loadedChunks.back();
+		m_loadedChunks.pop_back();
+		m_chunksLoaded++;
+	}
+
+	// drop the chunks past the unload radius of both points,
+	// the gap to the load radius keeps a chunk from being
+	// loaded and dropped again while the camera hovers near it
+	for (int pass = 0; pass < 2; pass++)
+	{
+		std::vector<int>& chunks = (pass == 0) ? m_loadedChunks : m_residentChunks;
+		for (size_t i = 0; i < chunks.size(); )
+		{
+			int slot = chunks[i];
+			if ((GetChunkDistance(slot, camera) > m_settings.unloadRadius) &&
+				(GetChunkDistance(slot, ahead) > m_settings.unloadRadius))
+			{
+				// moves the last chunk of the list into this place
+				EvictChunk(slot);
+				continue;
+			}
+			i++;
+		}
+	}
+
+	// queue the missing chunks inside the load radius of the
+	// camera, and the ones ahead of it
+	for (int point = 0; point < 2; point++)
+	{
+		const glm::vec2& center = (point == 0) ? camera : ahead;
+		int firstX = (int)std::floor((center.x - m_settings.loadRadius) / m_world.chunkSize) - m_world.firstChunkX;
+		int lastX = (int)std::floor((center.x + m_settings.loadRadius) / m_world.chunkSize) - m_world.firstChunkX;
+		int firstZ = (int)std::floor((center.y - m_settings.loadRadius) / m_world.chunkSize) - m_world.firstChunkZ;
+		int lastZ = (int)std::floor((center.y + m_settings.loadRadius) / m_world.chunkSize) - m_world.firstChunkZ;
+		firstX = std::max(firstX, 0);
+		firstZ = std::max(firstZ, 0);
+		lastX = std::min(lastX, m_world.chunksX - 1);
+		lastZ = std::min(lastZ, m_world.chunksZ - 1);
+
+		for (int z = firstZ; z <= lastZ; z++)
+		{
+			for (int x = firstX; x <= lastX; x++)
+			{
+				int slot = (z * m_world.chunksX) + x;
+				if ((m_slots[slot].state != CHUNK_UNLOADED) ||
+					(GetChunkDistance(slot, center) > m_settings.loadRadius))
+				{
+					continue;
+				}
+
+				float cameraDistance = GetChunkDistance(slot, camera);
+				LOAD_REQUEST request;
+				request.chunk = slot;
+				request.texture = -1;
+				request.path = GetChunkPath(m_world.firstChunkX + x, m_world.firstChunkZ + z);
+				request.priority = (cameraDistance <= m_settings.loadRadius) ?
+					cameraDistance : (GetChunkDistance(slot, ahead) + g_PrefetchPriorityOffset);
+				requests.push_back(request);
+				m_slots[slot].state = CHUNK_REQUESTED;
+			}
+		}
+	}
+
+	if (requests.empty() == false)
+	{
+		std::lock_guard<std::mutex> lock(m_loadMutex);
+		m_requests.insert(m_requests.end(), requests.begin(), requests.end());
+	}
+	// the budget was refilled, so wake the loader either way
+	m_workQueued.notify_one();
+
+	m_residentList.clear();
+	for (size_t i = 0; i < m_residentChunks.size(); i++)
+	{
+		m_residentList.push_back(m_slots[m_residentChunks[i]].pChunk);
+	}
+}
+
+/***********************************************************
+ *  GetResidentObjectCount()
+ *
+ *  This method is used for getting the number of objects in
+ *  the resident chunks.
+ ***********************************************************/
+int ChunkStreamer::GetResidentObjectCount() const
+{
+	int count = 0;
+	for (size_t i = 0; i < m_residentList.size(); i++)
+	{
+		count += (int)m_residentList[i]->objects.size();
+	}
+	return(count);
+}
+
+/***********************************************************
+ *  GetStats()
+ *
+ *  This method is used for getting the state of the
+ *  streaming.
+ ***********************************************************/
+ChunkStreamer::STREAMING_STATS ChunkStreamer::GetStats() const
+{
+	STREAMING_STATS stats;
+	stats.residentChunks = (int)m_residentChunks.size();
+	stats.pendingChunks = (int)m_loadedChunks.size();
+	for (size_t i = 0; i < m_slots.size(); i++)
+	{
+		if (m_slots[i].state == CHUNK_REQUESTED)
+		{
+			stats.pendingChunks++;
+		}
+	}
+	stats.residentBytes = m_residentBytes;
+	{
+		std::lock_guard<std::mutex> lock(m_loadMutex);
+		stats.bytesRead = m_bytesRead;
+	}
+	stats.chunksLoaded = m_chunksLoaded;
+	stats.chunksEvicted = m_chunksEvicted;
+	stats.textures = 0;
+	for (size_t i = 0; i < m_textures.size(); i++)
+	{
+		if (m_textures[i].texture.handle.IsValid() == true)
+		{
+			stats.textures++;
+		}
+	}
+	return(stats);
+}
+
+/***********************************************************
+ *  WriteReport()
+ *
+ *  This method is used for printing the state of the
+ *  streaming.
+ ***********************************************************/
+void ChunkStreamer::WriteReport(std::ostream& output) const
+{
+	STREAMING_STATS stats = GetStats();
+
+	output << "World streaming: " << m_worldPath << std::endl;
+	output << "  resident chunks  " << stats.residentChunks << ", " << stats.residentBytes << " bytes" << std::endl;
+	output << "  pending chunks   " << stats.pendingChunks << std::endl;
+	output << "  streamed textures " << stats.textures << std::endl;
+	output << "  chunks loaded    " << stats.chunksLoaded << ", evicted " << stats.chunksEvicted << std::endl;
+	output << "  bytes read       " << stats.bytesRead << std::endl;
+}
+
+/***********************************************************
+ *  HasWorld()
+ *
+ *  This method is used for checking whether a folder holds
+ *  a world header, without reading it.
+ ***********************************************************/
+bool ChunkStreamer::HasWorld(const char* worldPath)
+{
+	if (NULL == worldPath)
+	{
+		return(false);
+	}
+
+	std::string headerPath = std::string(worldPath) + "/" + g_WorldFileName;
+	std::ifstream file(headerPath.c_str(), std::ios::in | std::ios::binary);
+	return(file.is_open());
+}
+
+/***********************************************************
+ *  WriteWarehouse()
+ *
+ *  This method is used for writing a generated warehouse,
+ *  rows of props between aisles across a square of chunks
+ *  centered on the origin. The props, materials and
+ *  textures come from a fixed seed per chunk, so every run
+ *  writes the same world. Blocks of chunks share a texture
+ *  of their own, which is streamed in with them.
+ ***********************************************************/
+bool ChunkStreamer::WriteWarehouse(const char* worldPath, int chunksPerSide)
+{
+	if ((NULL == worldPath) || (chunksPerSide <= 0))
+	{
+		return(false);
+	}
+
+#ifdef _WIN32
+	_mkdir(worldPath);
+#else
+	mkdir(worldPath, 0755);
+#endif
+
+	WORLD_HEADER world;
+	memset(&world, 0, sizeof(world));
+	world.magic = WORLD_MAGIC;
+	world.version = WORLD_VERSION;
+	world.chunkSize = g_WarehouseChunkSize;
+	world.firstChunkX = -(chunksPerSide / 2);
+	world.firstChunkZ = -(chunksPerSide / 2);
+	world.chunksX = chunksPerSide;
+	world.chunksZ = chunksPerSide;
+
+	std::string headerPath = std::string(worldPath) + "/" + g_WorldFileName;
+	std::ofstream headerFile(headerPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!headerFile.is_open() || !headerFile.write(reinterpret_cast<const char*>(&world), sizeof(world)))
+	{
+		std::cout << "Could not write world:" << headerPath << std::endl;
+		return(false);
+	}
+	headerFile.close();
+
+	int cellsPerSide = (int)(g_WarehouseChunkSize / g_WarehouseCellSize);
+	std::vector<CHUNK_RESOURCE> resources;
+	std::vector<CHUNK_OBJECT> objects;
+	for (int z = 0; z < world.chunksZ; z++)
+	{
+		for (int x = 0; x < world.chunksX; x++)
+		{
+			int chunkX = world.firstChunkX + x;
+			int chunkZ = world.firstChunkZ + z;
+
+			// the materials, the scene textures and the one of
+			// the zone the chunk is in
+			resources.resize(g_WarehouseMaterialCount + g_WarehouseSceneTextureCount + 1);
+			for (int i = 0; i < g_WarehouseMaterialCount; i++)
+			{
+				SetResource(resources[i], RESOURCE_MATERIAL, g_WarehouseMaterials[i], NULL);
+			}
+			for (int i = 0; i < g_WarehouseSceneTextureCount; i++)
+			{
+				SetResource(resources[g_WarehouseMaterialCount + i], RESOURCE_TEXTURE, g_WarehouseSceneTextures[i], NULL);
+			}
+			int zone = ((x / g_WarehouseZoneSize) + (z / g_WarehouseZoneSize)) % g_WarehouseZoneTextureCount;
+			SetResource(resources.back(), RESOURCE_TEXTURE,
+				g_WarehouseZoneTextures[zone].tag, g_WarehouseZoneTextures[zone].filename);
+
+			objects.clear();
+			unsigned int seed = 2166136261u ^ ((unsigned int)x * 73856093u) ^ ((unsigned int)z * 19349663u);
+			for (int cellZ = 0; cellZ < cellsPerSide; cellZ++)
+			{
+				// aisles between the rows and along the chunk edge
+				if ((cellZ % (g_WarehouseRowsPerAisle + 1)) == g_WarehouseRowsPerAisle)
+				{
+					continue;
+				}
+				for (int cellX = 1; cellX < cellsPerSide; cellX++)
+				{
+					seed = (seed * 1664525u) + 1013904223u;
+					if (((seed >> 16) % g_WarehouseEmptyCells) == 0)
+					{
+						continue;
+					}
+
+					CHUNK_OBJECT object;
+					object.prop = (seed >> 8) % TOTAL_CHUNK_PROPS;
+					object.material = (int)((seed >> 12) % g_WarehouseMaterialCount);
+					object.texture = (object.prop == PROP_CUBE) ?
+						(int)(g_WarehouseMaterialCount + ((seed >> 20) % (g_WarehouseSceneTextureCount + 1))) : -1;
+					object.position[0] = (chunkX * g_WarehouseChunkSize) + ((cellX + 0.5f) * g_WarehouseCellSize);
+					object.position[1] = 0.0f;
+					object.position[2] = (chunkZ * g_WarehouseChunkSize) + ((cellZ + 0.5f) * g_WarehouseCellSize);
+					if ((object.position[0] * object.position[0]) + (object.position[2] * object.position[2]) <
+						(g_WarehouseClearRadius * g_WarehouseClearRadius))
+					{
+						continue;
+					}
+					objects.push_back(object);
+				}
+			}
+
+			CHUNK_HEADER header;
+			memset(&header, 0, sizeof(header));
+			header.magic = CHUNK_MAGIC;
+			header.version = WORLD_VERSION;
+			header.chunkX = chunkX;
+			header.chunkZ = chunkZ;
+			header.resourceCount = (unsigned int)resources.size();
+			header.objectCount = (unsigned int)objects.size();
+			// the props stand inside their cells, a cell size wide
+			header.boundsMin[0] = chunkX * g_WarehouseChunkSize;
+			header.boundsMin[1] = 0.0f;
+			header.boundsMin[2] = chunkZ * g_WarehouseChunkSize;
+			header.boundsMax[0] = (chunkX + 1) * g_WarehouseChunkSize;
+			header.boundsMax[1] = g_WarehousePropHeight;
+			header.boundsMax[2] = (chunkZ + 1) * g_WarehouseChunkSize;
+
+			char filename[64];
+			snprintf(filename, sizeof(filename), "/chunk_%d_%d.bin", chunkX, chunkZ);
+			std::string path = std::string(worldPath) + filename;
+			std::ofstream file(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.write(reinterpret_cast<const char*>(&resources[0]), resources.size() * sizeof(CHUNK_RESOURCE));
+			if (objects.empty() == false)
+			{
+				file.write(reinterpret_cast<const char*>(&objects[0]), objects.size() * sizeof(CHUNK_OBJECT));
+			}
+			if (!file.good())
+			{
+				std::cout << "Could not write world chunk:" << path << std::endl;
+				return(false);
+			}
+		}
+	}
+
+	std::cout << "INFO: World written:" << worldPath << ", " << chunksPerSide << " x " << chunksPerSide << " chunks" << std::endl;
+	return(true);
+}
@@ -0,0 +1,326 @@
+///////////////////////////////////////////////////////////////////////////////
+// chunkstreamer.h
+// ============
+// stream the chunks of a large world in and out around the camera
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "ResourceManager.h"
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/***********************************************************
+ *  ChunkStreamer
+ *
+ *  This class is used for walking through a world that is
+ *  too large to load up front. The world is a grid of
+ *  square chunks on the ground plane, each stored in its
+ *  own file with the props standing in it and the
+ *  materials and textures they are drawn with. Only the
+ *  chunks around the camera are kept in memory.
+ *
+ *  Every frame the render thread passes the camera position
+ *  and velocity to Update(). Chunks closer than the load
+ *  radius to the camera, or to where the velocity takes it
+ *  within the prefetch time, are queued nearest first for a
+ *  loading thread, which reads the chunk files and decodes
+ *  the images of their textures. Chunks are only dropped
+ *  again past the larger unload radius, so a camera moving
+ *  back and forth over a chunk border does not load the
+ *  same chunk over and over.
+ *
+ *  The loading thread reads no more than the I/O budget
+ *  per frame, and the render thread uploads no more than a
+ *  few textures per frame, so streaming never causes a
+ *  long frame. A chunk is only handed to the scene once
+ *  all of its textures are uploaded. Textures are counted
+ *  by the chunks that use them and shared by content with
+ *  the rest of the scene through the resource manager.
+ *
+ *  World layout on disk, all fields little endian:
+ *    <world>/world.bin              WORLD_HEADER
+ *    <world>/chunk_<x>_<z>.bin      CHUNK_HEADER, then the
+ *                                   CHUNK_RESOURCE and the
+ *                                   CHUNK_OBJECT records
+ *  A resource without a filename names a material or
+ *  texture the scene defines itself. A texture tag names
+ *  the same image in every chunk that uses it.
+ ***********************************************************/
+class ChunkStreamer
+{
+public:
+	// identify the world and chunk files, "WRLD" and "CHNK"
+	// in little endian
+	static const unsigned int WORLD_MAGIC = 0x444C5257;
+	static const unsigned int CHUNK_MAGIC = 0x4B4E4843;
+	// bumped whenever the layout changes
+	static const unsigned int WORLD_VERSION = 1;
+	// fixed lengths of the strings in a chunk, with the terminator
+	static const int TAG_LENGTH = 32;
+	static const int FILENAME_LENGTH = 64;
+
+	// props a chunk object can be
+	enum CHUNK_PROP
+	{
+		PROP_POKEBALL,
+		PROP_CAN,
+		PROP_CUBE,
+		TOTAL_CHUNK_PROPS
+	};
+
+	// kinds of resources a chunk references
+	enum RESOURCE_TYPE
+	{
+		RESOURCE_MATERIAL,
+		RESOURCE_TEXTURE
+	};
+
+	// contents of world.bin
+	struct WORLD_HEADER
+	{
+		unsigned int magic;
+		unsigned int version;
+		float chunkSize;			// side of a chunk in world units
+		int firstChunkX;			// chunk coordinates of the corner
+		int firstChunkZ;
+		int chunksX;				// chunks along each axis
+		int chunksZ;
+		unsigned int reserved;
+	};
+
+	// start of a chunk file
+	struct CHUNK_HEADER
+	{
+		unsigned int magic;
+		unsigned int version;
+		int chunkX;
+		int chunkZ;
+		unsigned int resourceCount;
+		unsigned int objectCount;
+		float boundsMin[3];			// world-space bounds of the objects
+		float boundsMax[3];
+	};
+
+	// a material or texture referenced by the chunk objects
+	struct CHUNK_RESOURCE
+	{
+		unsigned int type;					// RESOURCE_TYPE
+		char tag[TAG_LENGTH];				// what the scene draws it by
+		char filename[FILENAME_LENGTH];		// image file, empty when the
+											// scene defines the resource
+	};
+
+	// one prop standing in the chunk
+	struct CHUNK_OBJECT
+	{
+		unsigned int prop;			// CHUNK_PROP
+		int material;				// resource index, -1 for none
+		int texture;				// resource index, -1 for none
+		float position[3];
+	};
+
+	// a chunk read from its file
+	struct STREAMED_CHUNK
+	{
+		int chunkX;
+		int chunkZ;
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		std::vector<CHUNK_RESOURCE> resources;
+		std::vector<CHUNK_OBJECT> objects;
+		long long bytes;			// size of the chunk file
+	};
+
+	// a texture uploaded for the chunks that use it
+	struct STREAMED_TEXTURE
+	{
+		std::string tag;
+		std::string filename;
+		ResourceHandle handle;		// empty until uploaded
+		bool bHasAlpha;
+	};
+
+	// distances in world units, measured on the ground plane
+	struct STREAMING_SETTINGS
+	{
+		float loadRadius;			// chunks closer than this are loaded
+		float unloadRadius;			// chunks farther than this are dropped
+		float prefetchSeconds;		// how far ahead the velocity is followed
+		long long ioBudgetBytes;	// file bytes read per frame, 0 for no limit
+		int maxUploadsPerFrame;		// textures uploaded per frame
+	};
+
+	// state of the streaming for reports
+	struct STREAMING_STATS
+	{
+		int residentChunks;
+		int pendingChunks;			// queued, loading or waiting for textures
+		long long residentBytes;
+		long long bytesRead;
+		unsigned long long chunksLoaded;
+		unsigned long long chunksEvicted;
+		int textures;
+	};
+
+	// constructor
+	ChunkStreamer(ResourceManager* pResourceManager);
+	// destructor
+	~ChunkStreamer();
+
+private:
+	// life of a chunk as seen by the render thread
+	enum CHUNK_STATE
+	{
+		CHUNK_UNLOADED,
+		CHUNK_REQUESTED,			// queued for or being read by the loading thread
+		CHUNK_LOADED,				// read, waiting for its textures
+		CHUNK_RESIDENT,				// drawn by the scene
+		CHUNK_MISSING				// the file could not be read
+	};
+
+	// life of a streamed texture
+	enum TEXTURE_STATE
+	{
+		TEXTURE_IDLE,				// not used by any chunk
+		TEXTURE_REQUESTED,			// being read and decoded
+		TEXTURE_DECODED,			// waiting for its upload
+		TEXTURE_READY,
+		TEXTURE_FAILED				// drawn without the texture
+	};
+
+	// bookkeeping for one chunk of the world grid
+	struct CHUNK_SLOT
+	{
+		CHUNK_STATE state;
+		STREAMED_CHUNK* pChunk;		// set while loaded or resident
+		// streamed texture of each resource, -1 for none
+		std::vector<int> textures;
+	};
+
+	// bookkeeping for one streamed texture
+	struct TEXTURE_SLOT
+	{
+		STREAMED_TEXTURE texture;
+		TEXTURE_STATE state;
+		int references;				// loaded and resident chunks using it
+		ResourceManager::DECODED_IMAGE* pImage;	// set while decoded
+	};
+
+	// work for the loading thread, a chunk or a texture image
+	struct LOAD_REQUEST
+	{
+		int chunk;					// slot index, -1 for a texture
+		int texture;				// texture index, -1 for a chunk
+		std::string path;
+		float priority;				// lower is loaded first
+	};
+
+	// work the loading thread has finished
+	struct LOAD_RESULT
+	{
+		int chunk;
+		int texture;
+		STREAMED_CHUNK* pChunk;		// NULL when it could not be read
+		ResourceManager::DECODED_IMAGE* pImage;
+	};
+
+	// uploads the textures of the chunks
+	ResourceManager* m_pResourceManager;
+
+	// the opened world
+	std::string m_worldPath;
+	WORLD_HEADER m_world;
+	STREAMING_SETTINGS m_settings;
+	std::vector<CHUNK_SLOT> m_slots;
+	std::vector<TEXTURE_SLOT> m_textures;
+	// changes whenever a texture is uploaded or released
+	unsigned int m_textureGeneration;
+
+	// chunks by state, slot indices, render thread only
+	std::vector<int> m_loadedChunks;
+	std::vector<int> m_residentChunks;
+	std::vector<const STREAMED_CHUNK*> m_residentList;
+
+	// shared with the loading thread
+	std::thread m_loader;
+	mutable std::mutex m_loadMutex;
+	std::condition_variable m_workQueued;
+	std::vector<LOAD_REQUEST> m_requests;
+	std::vector<LOAD_RESULT> m_results;
+	long long m_ioCredit;
+	long long m_bytesRead;
+	bool m_bStopLoader;
+
+	// counters reported by GetStats()
+	long long m_residentBytes;
+	unsigned long long m_chunksLoaded;
+	unsigned long long m_chunksEvicted;
+
+	// disable copying, the streamer owns its thread
+	ChunkStreamer(const ChunkStreamer&);
+	ChunkStreamer& operator=(const ChunkStreamer&);
+
+	// read the queued chunks and images until closed
+	void LoaderMain();
+	// read and check a chunk file
+	bool ReadChunk(const std::string& path, int chunkX, int chunkZ, STREAMED_CHUNK& chunk) const;
+
+	// get the file of a chunk
+	std::string GetChunkPath(int chunkX, int chunkZ) const;
+	// get the distance on the ground plane from a point to a chunk
+	float GetChunkDistance(int slot, const glm::vec2& point) const;
+
+	// take the textures of a loaded chunk, queueing the images
+	// that are not uploaded yet
+	void ReferenceTextures(int slot, std::vector<LOAD_REQUEST>& requests);
+	// give the textures of a chunk back
+	void ReleaseTextures(int slot);
+	// check whether every texture of a chunk is uploaded
+	bool AreTexturesReady(int slot) const;
+	// drop a loaded or resident chunk
+	void EvictChunk(int slot);
+
+public:
+	// open a world and start the loading thread
+	bool Open(const char* worldPath, const STREAMING_SETTINGS& settings);
+	// stop the loading thread and drop every chunk
+	void Close();
+	// check whether a world is open
+	bool IsOpen() const { return (m_slots.empty() == false); }
+
+	// queue, hand over and drop chunks for the camera, render
+	// thread only, outside of the frame since it allocates
+	void Update(const glm::vec3& position, const glm::vec3& velocity);
+
+	// get the chunks the scene draws, valid until the next Update()
+	const std::vector<const STREAMED_CHUNK*>& GetResidentChunks() const { return m_residentList; }
+	// get the streamed textures, a texture is in use while its
+	// handle is set
+	int GetTextureCount() const { return (int)m_textures.size(); }
+	const STREAMED_TEXTURE& GetTexture(int index) const { return m_textures[index].texture; }
+	unsigned int GetTextureGeneration() const { return m_textureGeneration; }
+	// get the number of objects in the resident chunks
+	int GetResidentObjectCount() const;
+
+	// get the state of the streaming
+	STREAMING_STATS GetStats() const;
+	// print the state of the streaming
+	void WriteReport(std::ostream& output) const;
+
+	// get the default distances and budgets
+	static STREAMING_SETTINGS GetDefaultSettings();
+	// check whether a folder holds a world header
+	static bool HasWorld(const char* worldPath);
+	// write a generated warehouse of the passed in number of
+	// chunks per side, for walking through and measuring
+	static bool WriteWarehouse(const char* worldPath, int chunksPerSide);
+};
@@ -0,0 +1,394 @@
+///////////////////////////////////////////////////////////////////////////////
+// dynamicresolution.cpp
+// ============
+// scale the scene render resolution to hold a GPU frame time budget
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "DynamicResolution.h"
+#include "MemoryAccounting.h"
+#include "PerformanceCounters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// declaration of global variables
+namespace
+{
+	// weight of a new timer sample in the smoothed frame time
+	const float g_FrameTimeSmoothing = 0.1f;
+	// the controller aims a little below the budget and holds
+	// the scale while the time is inside this band
+	const float g_TargetBudgetFraction = 0.9f;
+	const float g_HoldBandLow = 0.8f;
+	const float g_HoldBandHigh = 0.95f;
+	// largest change of the scale per frame
+	const float g_MaxScaleStep = 0.05f;
+	// render sizes are rounded to this many pixels so small
+	// scale changes do not move the image every frame
+	const int g_SizeGranularity = 8;
+
+	// bytes per texel of the offscreen targets
+	const int g_ColorBytesPerTexel = 4;
+	const int g_DepthBytesPerTexel = 4;
+}
+
+// out of class definitions for the integral constants
+const int DynamicResolution::TIMER_QUERY_FRAMES;
+
+/***********************************************************
+ *  DynamicResolution()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+DynamicResolution::DynamicResolution()
+{
+	m_framebuffer = 0;
+	m_colorTexture = 0;
+	m_depthBuffer = 0;
+	m_outputWidth = 0;
+	m_outputHeight = 0;
+	m_renderWidth = 0;
+	m_renderHeight = 0;
+	m_scale = 1.0f;
+	m_minScale = 0.5f;
+	m_maxScale = 1.0f;
+	m_frameTimeBudget = 16.0f;
+	m_smoothedFrameTime = 0.0f;
+	m_frameIndex = 0;
+	m_bTimingFrame = false;
+	m_upscaleProgram = 0;
+	m_emptyVAO = 0;
+	m_sourceTextureLocation = -1;
+	m_sourceScaleLocation = -1;
+	m_sourceTexelSizeLocation = -1;
+	m_sharpnessLocation = -1;
+	m_sharpness = 0.5f;
+	m_bEnabled = false;
+	m_pStateCache = NULL;
+
+	for (int i = 0; i < TIMER_QUERY_FRAMES; i++)
+	{
+		m_timerQueries[i] = 0;
+		m_bQueryIssued[i] = false;
+	}
+}
+
+/***********************************************************
+ *  ~DynamicResolution()
+ *
+ *  The destructor for the class - the upscale program is
+ *  freed by the resource manager
+ ***********************************************************/
+DynamicResolution::~DynamicResolution()
+{
+	DestroyTargets();
+
+	if (0 != m_timerQueries[0])
+	{
+		glDeleteQueries(TIMER_QUERY_FRAMES, m_timerQueries);
+	}
+	if (0 != m_emptyVAO)
+	{
+		glDeleteVertexArrays(1, &m_emptyVAO);
+		m_emptyVAO = 0;
+	}
+
+	m_upscaleProgramHandle.Reset();
+	m_upscaleProgram = 0;
+}
+
+/***********************************************************
+ *  Initialize()
+ *
+ *  This method is used for creating the upscale program
+ *  for the passed in filter and the timer queries. The
+ *  offscreen target is created by the first frame, once
+ *  the output size is known.
+ ***********************************************************/
+bool DynamicResolution::Initialize(ResourceManager* pResourceManager, UPSCALE_FILTER filter)
+{
+	if (NULL == pResourceManager)
+	{
+		return(false);
+	}
+
+	m_upscaleProgramHandle = pResourceManager->LoadProgram(
+		"shaders/upscaleVertexShader.glsl",
+		"shaders/upscaleFragmentShader.glsl",
+		(filter == FILTER_SHARPEN) ? "#define USE_SHARPEN 1\n" : "#define USE_SHARPEN 0\n");
+	m_upscaleProgram = m_upscaleProgramHandle.GetID();
+	if (0 == m_upscaleProgram)
+	{
+		std::cout << "Dynamic resolution disabled, no upscale program" << std::endl;
+		return(false);
+	}
+
+	m_sourceTextureLocation = glGetUniformLocation(m_upscaleProgram, "sourceTexture");
+	m_sourceScaleLocation = glGetUniformLocation(m_upscaleProgram, "sourceScale");
+	m_sourceTexelSizeLocation = glGetUniformLocation(m_upscaleProgram, "sourceTexelSize");
+	m_sharpnessLocation = glGetUniformLocation(m_upscaleProgram, "sharpness");
+
+	// the full screen triangle is built from gl_VertexID, but
+	// the core profile still needs a vertex array bound
+	glGenVertexArrays(1, &m_emptyVAO);
+	glGenQueries(TIMER_QUERY_FRAMES, m_timerQueries);
+
+	m_bEnabled = true;
+	return(true);
+}
+
+/***********************************************************
+ *  SetScaleLimits()
+ *
+ *  This method is used for setting the range the per axis
+ *  resolution scale may move within.
+ ***********************************************************/
+void DynamicResolution::SetScaleLimits(float minScale, float maxScale)
+{
+	m_minScale = std::min(std::max(minScale, 0.1f), 1.0f);
+	m_maxScale = std::min(std::max(maxScale, m_minScale), 1.0f);
+	m_scale = std::min(std::max(m_scale, m_minScale), m_maxScale);
+}
+
+/***********************************************************
+ *  CreateTargets()
+ *
+ *  This method is used for allocating the offscreen color
+ *  and depth target at the full output size.
+ ***********************************************************/
+bool DynamicResolution::CreateTargets(int width, int height)
+{
+	DestroyTargets();
+	// deleting the old target unbound it behind the cache,
+	// and the new texture may get the same name
+	m_pStateCache->Invalidate();
+
+	glGenTextures(1, &m_colorTexture);
+	m_pStateCache->BindTexture(0, m_colorTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	m_pStateCache->BindTexture(0, 0);
+
+	glGenRenderbuffers(1, &m_depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &m_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_colorTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_depthBuffer);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "Could not create dynamic resolution target, status:" << status << std::endl;
+		DestroyTargets();
+		return(false);
+	}
+
+	m_outputWidth = width;
+	m_outputHeight = height;
+
+	long long texels = (long long)width * height;
+	MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_TEXTURE, "sceneColorTarget", texels * g_ColorBytesPerTexel);
+	MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_TEXTURE, "sceneDepthTarget", texels * g_DepthBytesPerTexel);
+
+	return(true);
+}
+
+/***********************************************************
+ *  DestroyTargets()
+ *
+ *  This method is used for freeing the offscreen target.
+ ***********************************************************/
+void DynamicResolution::DestroyTargets()
+{
+	if (0 != m_framebuffer)
+	{
+		glDeleteFramebuffers(1, &m_framebuffer);
+		glDeleteTextures(1, &m_colorTexture);
+		glDeleteRenderbuffers(1, &m_depthBuffer);
+
+		long long texels = (long long)m_outputWidth * m_outputHeight;
+		MemoryAccounting::Free(MemoryAccounting::CATEGORY_TEXTURE, "sceneColorTarget", texels * g_ColorBytesPerTexel);
+		MemoryAccounting::Free(MemoryAccounting::CATEGORY_TEXTURE, "sceneDepthTarget", texels * g_DepthBytesPerTexel);
+	}
+
+	m_framebuffer = 0;
+	m_colorTexture = 0;
+	m_depthBuffer = 0;
+	m_outputWidth = 0;
+	m_outputHeight = 0;
+}
+
+/***********************************************************
+ *  CollectTimerResults()
+ *
+ *  This method is used for reading every timer query the
+ *  GPU has finished, oldest first, into the controller.
+ ***********************************************************/
+void DynamicResolution::CollectTimerResults()
+{
+	for (int age = TIMER_QUERY_FRAMES; age > 0; age--)
+	{
+		int slot = (int)((m_frameIndex + TIMER_QUERY_FRAMES - age) % TIMER_QUERY_FRAMES);
+		if (m_bQueryIssued[slot] == false)
+		{
+			continue;
+		}
+
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(m_timerQueries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available == GL_FALSE)
+		{
+			// later queries cannot be finished either
+			break;
+		}
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(m_timerQueries[slot], GL_QUERY_RESULT, &elapsed);
+		m_bQueryIssued[slot] = false;
+
+		UpdateScale((float)((double)elapsed / 1000000.0));
+	}
+}
+
+/***********************************************************
+ *  UpdateScale()
+ *
+ *  This method is used for feeding a measured frame time
+ *  into the controller. The pixel count grows with the
+ *  square of the scale, so the scale moves by the square
+ *  root of the time ratio, limited per frame so a single
+ *  slow frame cannot make the image jump.
+ ***********************************************************/
+void DynamicResolution::UpdateScale(float frameTime)
+{
+	if (m_smoothedFrameTime <= 0.0f)
+	{
+		m_smoothedFrameTime = frameTime;
+	}
+	else
+	{
+		m_smoothedFrameTime += (frameTime - m_smoothedFrameTime) * g_FrameTimeSmoothing;
+	}
+
+	if ((m_smoothedFrameTime <= 0.0f) || (m_frameTimeBudget <= 0.0f))
+	{
+		return;
+	}
+
+	float load = m_smoothedFrameTime / m_frameTimeBudget;
+	if ((load >= g_HoldBandLow) && (load <= g_HoldBandHigh))
+	{
+		return;
+	}
+
+	float desiredScale = m_scale * std::sqrt((g_TargetBudgetFraction * m_frameTimeBudget) / m_smoothedFrameTime);
+	desiredScale = std::min(std::max(desiredScale, m_scale - g_MaxScaleStep), m_scale + g_MaxScaleStep);
+	m_scale = std::min(std::max(desiredScale, m_minScale), m_maxScale);
+}
+
+/***********************************************************
+ *  BeginFrame()
+ *
+ *  This method is used for binding the offscreen target
+ *  with a viewport at the current scale and starting the
+ *  GPU timer. Without a target the scene renders straight
+ *  into the window.
+ ***********************************************************/
+void DynamicResolution::BeginFrame(int outputWidth, int outputHeight)
+{
+	m_renderWidth = std::max(outputWidth, 1);
+	m_renderHeight = std::max(outputHeight, 1);
+
+	if ((m_bEnabled == false) || (NULL == m_pStateCache))
+	{
+		glViewport(0, 0, m_renderWidth, m_renderHeight);
+		return;
+	}
+
+	if ((outputWidth != m_outputWidth) || (outputHeight != m_outputHeight))
+	{
+		if ((outputWidth <= 0) || (outputHeight <= 0) ||
+			(CreateTargets(outputWidth, outputHeight) == false))
+		{
+			glViewport(0, 0, m_renderWidth, m_renderHeight);
+			return;
+		}
+	}
+
+	CollectTimerResults();
+
+	m_renderWidth = (int)(outputWidth * m_scale);
+	m_renderHeight = (int)(outputHeight * m_scale);
+	m_renderWidth = ((m_renderWidth + (g_SizeGranularity / 2)) / g_SizeGranularity) * g_SizeGranularity;
+	m_renderHeight = ((m_renderHeight + (g_SizeGranularity / 2)) / g_SizeGranularity) * g_SizeGranularity;
+	m_renderWidth = std::min(std::max(m_renderWidth, g_SizeGranularity), outputWidth);
+	m_renderHeight = std::min(std::max(m_renderHeight, g_SizeGranularity), outputHeight);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glViewport(0, 0, m_renderWidth, m_renderHeight);
+
+	// a query the GPU has not finished yet is skipped rather
+	// than waited on, that frame is simply not measured
+	int slot = (int)(m_frameIndex % TIMER_QUERY_FRAMES);
+	m_bTimingFrame = (m_bQueryIssued[slot] == false);
+	if (m_bTimingFrame == true)
+	{
+		glBeginQuery(GL_TIME_ELAPSED, m_timerQueries[slot]);
+	}
+}
+
+/***********************************************************
+ *  EndFrame()
+ *
+ *  This method is used for upscaling the scaled corner of
+ *  the offscreen target into the window and stopping the
+ *  GPU timer, so the upscale is part of the measured time.
+ ***********************************************************/
+void DynamicResolution::EndFrame()
+{
+	if ((m_bEnabled == false) || (0 == m_framebuffer) || (NULL == m_pStateCache))
+	{
+		return;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, m_outputWidth, m_outputHeight);
+
+	m_pStateCache->SetEnabled(GL_DEPTH_TEST, false);
+	m_pStateCache->SetEnabled(GL_BLEND, false);
+
+	m_pStateCache->UseProgram(m_upscaleProgram);
+	m_pStateCache->BindTexture(0, m_colorTexture);
+	m_pStateCache->SetUniform(m_sourceTextureLocation, 0);
+	m_pStateCache->SetUniform(
+		m_sourceScaleLocation,
+		glm::vec2((float)m_renderWidth / (float)m_outputWidth, (float)m_renderHeight / (float)m_outputHeight));
+	m_pStateCache->SetUniform(m_sourceTexelSizeLocation, glm::vec2(1.0f / m_outputWidth, 1.0f / m_outputHeight));
+	m_pStateCache->SetUniform(m_sharpnessLocation, m_sharpness);
+
+	m_pStateCache->BindVertexArray(m_emptyVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	PerformanceCounters::Add(PerformanceCounters::COUNTER_DRAW_CALLS, 1);
+	PerformanceCounters::Add(PerformanceCounters::COUNTER_TRIANGLES, 1);
+
+	m_pStateCache->SetEnabled(GL_DEPTH_TEST, true);
+
+	if (m_bTimingFrame == true)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		m_bQueryIssued[m_frameIndex % TIMER_QUERY_FRAMES] = true;
+		m_bTimingFrame = false;
+	}
+
+	m_frameIndex++;
+}
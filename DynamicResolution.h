@@ -0,0 +1,123 @@
+///////////////////////////////////////////////////////////////////////////////
+// dynamicresolution.h
+// ============
+// scale the scene render resolution to hold a GPU frame time budget
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "ResourceManager.h"
+#include "GLStateCache.h"
+
+#include <GL/glew.h>
+
+/***********************************************************
+ *  DynamicResolution
+ *
+ *  This class is used for rendering the scene into an
+ *  offscreen target at a fraction of the window resolution
+ *  and upscaling the result into the window. GPU timer
+ *  queries measure each frame, and the fraction is raised
+ *  or lowered so the measured time stays under the budget.
+ *  Timer results are only read once the GPU has them, so
+ *  measuring never stalls the CPU.
+ ***********************************************************/
+class DynamicResolution
+{
+public:
+	// filters used for upscaling into the window
+	enum UPSCALE_FILTER
+	{
+		FILTER_BILINEAR,
+		FILTER_SHARPEN
+	};
+
+	// number of frames a timer query can be in flight
+	static const int TIMER_QUERY_FRAMES = 4;
+
+	// constructor
+	DynamicResolution();
+	// destructor
+	~DynamicResolution();
+
+private:
+	// offscreen target allocated at the full output size, the
+	// scene only renders into the scaled corner of it
+	GLuint m_framebuffer;
+	GLuint m_colorTexture;
+	GLuint m_depthBuffer;
+	int m_outputWidth;
+	int m_outputHeight;
+
+	// size of the scaled corner used this frame
+	int m_renderWidth;
+	int m_renderHeight;
+
+	// controller state, scale is per axis
+	float m_scale;
+	float m_minScale;
+	float m_maxScale;
+	float m_frameTimeBudget;		// milliseconds
+	float m_smoothedFrameTime;		// milliseconds, 0 until measured
+
+	// GPU timer queries for the last frames
+	GLuint m_timerQueries[TIMER_QUERY_FRAMES];
+	bool m_bQueryIssued[TIMER_QUERY_FRAMES];
+	unsigned int m_frameIndex;
+	bool m_bTimingFrame;
+
+	// full screen upscale pass
+	ResourceHandle m_upscaleProgramHandle;
+	GLuint m_upscaleProgram;
+	GLuint m_emptyVAO;
+	GLint m_sourceTextureLocation;
+	GLint m_sourceScaleLocation;
+	GLint m_sourceTexelSizeLocation;
+	GLint m_sharpnessLocation;
+	float m_sharpness;
+
+	// false when the targets could not be created
+	bool m_bEnabled;
+	// state of the context the scene is drawn in
+	GLStateCache* m_pStateCache;
+
+	// allocate the offscreen target at the output size
+	bool CreateTargets(int width, int height);
+	// free the offscreen target
+	void DestroyTargets();
+	// read the finished timer queries into the controller
+	void CollectTimerResults();
+	// adjust the scale from a measured frame time
+	void UpdateScale(float frameTime);
+
+public:
+	// create the upscale program and timer queries
+	bool Initialize(ResourceManager* pResourceManager, UPSCALE_FILTER filter);
+
+	// set the GPU time each frame should stay under
+	void SetFrameTimeBudget(float milliseconds) { m_frameTimeBudget = milliseconds; }
+	// set the range the per axis scale may move within
+	void SetScaleLimits(float minScale, float maxScale);
+	// set the strength of the sharpen filter, 0 to 1
+	void SetSharpness(float sharpness) { m_sharpness = sharpness; }
+	// set the state cache of the scene context, the scene
+	// renders straight into the window until it is set
+	void SetStateCache(GLStateCache* pStateCache) { m_pStateCache = pStateCache; }
+
+	// bind the scaled target and start timing the frame
+	void BeginFrame(int outputWidth, int outputHeight);
+	// stop timing and upscale the target into the window
+	void EndFrame();
+
+	// get the offscreen color target, 0 when rendering
+	// straight into the window
+	GLuint GetColorTexture() const { return m_colorTexture; }
+	// get the size the scene is rendered at this frame
+	int GetRenderWidth() const { return m_renderWidth; }
+	int GetRenderHeight() const { return m_renderHeight; }
+	// get the current per axis resolution scale
+	float GetResolutionScale() const { return m_scale; }
+	// get the smoothed GPU frame time in milliseconds
+	float GetFrameTime() const { return m_smoothedFrameTime; }
+};
@@ -0,0 +1,161 @@
+///////////////////////////////////////////////////////////////////////////////
+// framearena.cpp
+// ============
+// linear allocator for transient data that only lives for one frame
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "FrameArena.h"
+#include "MemoryAccounting.h"
+
+#include <algorithm>
+#include <cstdint>
+
+/***********************************************************
+ *  FrameArena()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+FrameArena::FrameArena(size_t capacity)
+{
+	m_capacity = capacity;
+	m_buffer = new unsigned char[m_capacity];
+	MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_CPU_STAGING, "frameArena", (long long)m_capacity);
+	m_offset = 0;
+	m_frameBytes = 0;
+	m_highWaterMark = 0;
+	m_unreportedCapacity = 0;
+}
+
+/***********************************************************
+ *  ~FrameArena()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+FrameArena::~FrameArena()
+{
+	Reset();
+	delete[] m_buffer;
+	m_buffer = NULL;
+	MemoryAccounting::Free(MemoryAccounting::CATEGORY_CPU_STAGING, "frameArena", (long long)m_capacity);
+}
+
+/***********************************************************
+ *  Allocate()
+ *
+ *  This method is used for allocating memory that stays
+ *  valid until the next reset. The alignment must be a
+ *  power of two. Nothing is constructed or destructed, so
+ *  only plain data should be stored in the arena.
+ ***********************************************************/
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+	uintptr_t base = reinterpret_cast<uintptr_t>(m_buffer);
+	uintptr_t aligned = (base + m_offset + (alignment - 1)) & ~(uintptr_t)(alignment - 1);
+	size_t newOffset = (size_t)(aligned - base) + size;
+
+	m_frameBytes += size;
+
+	if (newOffset <= m_capacity)
+	{
+		m_offset = newOffset;
+		return(reinterpret_cast<void*>(aligned));
+	}
+
+	// the block is full, fall back to the heap for this frame
+	unsigned char* block = new unsigned char[size + alignment];
+	m_overflowBlocks.push_back(block);
+	m_frameBytes += alignment;
+
+	uintptr_t blockBase = reinterpret_cast<uintptr_t>(block);
+	return(reinterpret_cast<void*>(
+		(blockBase + (alignment - 1)) & ~(uintptr_t)(alignment - 1)));
+}
+
+/***********************************************************
+ *  Reset()
+ *
+ *  This method is used for releasing every allocation of
+ *  the frame. When the frame overflowed, the block is grown
+ *  so that the same load fits without the heap next time.
+ ***********************************************************/
+void FrameArena::Reset()
+{
+	m_highWaterMark = std::max(m_highWaterMark, m_frameBytes);
+
+	if (!m_overflowBlocks.empty())
+	{
+		for (size_t i = 0; i < m_overflowBlocks.size(); i++)
+		{
+			delete[] m_overflowBlocks[i];
+		}
+		m_overflowBlocks.clear();
+
+		// leave room for alignment padding as well
+		size_t newCapacity = std::max(m_capacity * 2, m_highWaterMark + (m_highWaterMark / 4));
+		// the frame is running, so the growth is only printed
+		// by the next ReportGrowth()
+		if (0 == m_unreportedCapacity)
+		{
+			m_unreportedCapacity = m_capacity;
+		}
+
+		delete[] m_buffer;
+		m_buffer = new unsigned char[newCapacity];
+		MemoryAccounting::Allocate(
+			MemoryAccounting::CATEGORY_CPU_STAGING,
+			"frameArena",
+			(long long)newCapacity - (long long)m_capacity);
+		m_capacity = newCapacity;
+	}
+
+	m_offset = 0;
+	m_frameBytes = 0;
+}
+
+/***********************************************************
+ *  Reserve()
+ *
+ *  This method is used for growing the block before a frame
+ *  that would overflow it, so the frame itself does not
+ *  have to touch the heap. Every allocation of the current
+ *  frame is released, as with Reset().
+ ***********************************************************/
+void FrameArena::Reserve(size_t capacity)
+{
+	Reset();
+	if (capacity <= m_capacity)
+	{
+		return;
+	}
+
+	if (0 == m_unreportedCapacity)
+	{
+		m_unreportedCapacity = m_capacity;
+	}
+
+	delete[] m_buffer;
+	m_buffer = new unsigned char[capacity];
+	MemoryAccounting::Allocate(
+		MemoryAccounting::CATEGORY_CPU_STAGING,
+		"frameArena",
+		(long long)capacity - (long long)m_capacity);
+	m_capacity = capacity;
+}
+
+/***********************************************************
+ *  ReportGrowth()
+ *
+ *  This method is used for printing how far the block grew
+ *  since the last report, if it grew at all.
+ ***********************************************************/
+void FrameArena::ReportGrowth(std::ostream& output)
+{
+	if (0 == m_unreportedCapacity)
+	{
+		return;
+	}
+
+	output << "INFO: Frame arena grown from " << m_unreportedCapacity << " to " << m_capacity << " bytes" << std::endl;
+	m_unreportedCapacity = 0;
+}
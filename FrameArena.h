@@ -0,0 +1,75 @@
+///////////////////////////////////////////////////////////////////////////////
+// framearena.h
+// ============
+// linear allocator for transient data that only lives for one frame
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+/***********************************************************
+ *  FrameArena
+ *
+ *  This class hands out memory by bumping an offset inside
+ *  one preallocated block, and releases everything at once
+ *  when it is reset at the start of the next frame. If a
+ *  frame needs more than the block holds, the extra memory
+ *  comes from the heap and the block is grown at the next
+ *  reset, so steady-state frames never touch the heap.
+ ***********************************************************/
+class FrameArena
+{
+public:
+	// constructor
+	FrameArena(size_t capacity);
+	// destructor
+	~FrameArena();
+
+private:
+	// preallocated block and the current offset into it
+	unsigned char* m_buffer;
+	size_t m_capacity;
+	size_t m_offset;
+	// bytes handed out this frame, including overflow blocks
+	size_t m_frameBytes;
+	// largest number of bytes used by any frame
+	size_t m_highWaterMark;
+	// heap blocks used when the frame ran out of space
+	std::vector<unsigned char*> m_overflowBlocks;
+	// capacity before the growths not reported yet, 0 for none
+	size_t m_unreportedCapacity;
+
+	// disable copying, the arena owns its block
+	FrameArena(const FrameArena&);
+	FrameArena& operator=(const FrameArena&);
+
+public:
+	// allocate uninitialized memory for the current frame
+	void* Allocate(size_t size, size_t alignment = 16);
+	// allocate an uninitialized array for the current frame
+	template<typename T>
+	T* AllocateArray(size_t count)
+	{
+		return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+	}
+	// release every allocation of the frame
+	void Reset();
+	// release every allocation and grow the block to at least
+	// the passed in size, between frames when the next ones
+	// are known to need more
+	void Reserve(size_t capacity);
+
+	// get the bytes handed out so far this frame
+	size_t GetUsedBytes() const { return m_frameBytes; }
+	// get the size of the preallocated block
+	size_t GetCapacity() const { return m_capacity; }
+	// get the most bytes used by any frame
+	size_t GetHighWaterMark() const { return m_highWaterMark; }
+	// print the growths since the last call, outside of the
+	// frame since printing allocates
+	void ReportGrowth(std::ostream& output);
+};
@@ -0,0 +1,545 @@
+///////////////////////////////////////////////////////////////////////////////
+// framecapture.cpp
+// ============
+// record the rendered frames to disk without stalling the GPU
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "FrameCapture.h"
+#include "MemoryAccounting.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// declaration of global variables
+namespace
+{
+	const char* g_PackBufferName = "capturePackBuffers";
+	const char* g_QueuedFrameName = "captureFrames";
+
+	// longest single wait on a readback fence, in nanoseconds
+	const GLuint64 g_FenceTimeout = 1000000000;
+
+	/***********************************************************
+	 *  HasExtension()
+	 *
+	 *  This function is used for checking the end of a path
+	 *  against an extension, ignoring the case.
+	 ***********************************************************/
+	bool HasExtension(const std::string& path, const char* extension)
+	{
+		size_t length = strlen(extension);
+		if (path.size() < length)
+		{
+			return(false);
+		}
+
+		for (size_t i = 0; i < length; i++)
+		{
+			char character = path[path.size() - length + i];
+			if ((character >= 'A') && (character <= 'Z'))
+			{
+				character = (char)(character - 'A' + 'a');
+			}
+			if (character != extension[i])
+			{
+				return(false);
+			}
+		}
+		return(true);
+	}
+}
+
+// out of class definitions for the integral constants
+const int FrameCapture::READBACK_FRAMES;
+const int FrameCapture::QUEUED_FRAMES;
+
+/***********************************************************
+ *  FrameCapture()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+FrameCapture::FrameCapture()
+{
+	m_format = FORMAT_Y4M;
+	m_width = 0;
+	m_height = 0;
+	m_framesPerSecond = 60;
+	m_bRecording = false;
+	m_startTime = 0.0;
+	m_outputFrames = 0;
+	m_issuedFrames = 0;
+	m_retiredFrames = 0;
+	m_freeCount = 0;
+	m_queueHead = 0;
+	m_queueCount = 0;
+	m_bStopWriter = false;
+	m_writtenFrames = 0;
+	m_skippedFrames = 0;
+	m_droppedFrames = 0;
+	m_writerStalls = 0;
+
+	for (int i = 0; i < READBACK_FRAMES; i++)
+	{
+		m_packBuffers[i] = 0;
+		m_fences[i] = 0;
+		m_slotRepeats[i] = 0;
+	}
+	for (int i = 0; i < QUEUED_FRAMES; i++)
+	{
+		m_frameRepeats[i] = 0;
+	}
+}
+
+/***********************************************************
+ *  ~FrameCapture()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+FrameCapture::~FrameCapture()
+{
+	Stop();
+}
+
+/***********************************************************
+ *  GetFormatForPath()
+ *
+ *  This method is used for picking the capture format from
+ *  the extension of the output path.
+ ***********************************************************/
+FrameCapture::CAPTURE_FORMAT FrameCapture::GetFormatForPath(const char* path)
+{
+	std::string text = path;
+	if (HasExtension(text, ".y4m") == true)
+	{
+		return(FORMAT_Y4M);
+	}
+	if (HasExtension(text, ".rgb") == true)
+	{
+		return(FORMAT_RAW_RGB);
+	}
+	return(FORMAT_IMAGE_SEQUENCE);
+}
+
+/***********************************************************
+ *  Start()
+ *
+ *  This method is used for starting a recording into the
+ *  passed in path. Every buffer the recording needs is
+ *  allocated here, so capturing a frame does not allocate.
+ ***********************************************************/
+bool FrameCapture::Start(const char* path, int width, int height, int framesPerSecond)
+{
+	Stop();
+
+	m_path = path;
+	m_format = GetFormatForPath(path);
+	m_framesPerSecond = (framesPerSecond > 0) ? framesPerSecond : 60;
+	m_width = width;
+	m_height = height;
+	// the 4:2:0 chroma planes need an even size
+	if (m_format == FORMAT_Y4M)
+	{
+		m_width &= ~1;
+		m_height &= ~1;
+	}
+	if ((m_width <= 0) || (m_height <= 0))
+	{
+		std::cout << "Could not start capture, the window is empty" << std::endl;
+		return(false);
+	}
+
+	if (m_format == FORMAT_IMAGE_SEQUENCE)
+	{
+#ifdef _WIN32
+		_mkdir(m_path.c_str());
+#else
+		mkdir(m_path.c_str(), 0755);
+#endif
+	}
+	else
+	{
+		m_file.open(m_path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!m_file.is_open())
+		{
+			std::cout << "Could not open capture file:" << m_path << std::endl;
+			return(false);
+		}
+		if (m_format == FORMAT_Y4M)
+		{
+			char header[128];
+			snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n",
+				m_width, m_height, m_framesPerSecond);
+			m_file << header;
+		}
+	}
+
+	size_t frameBytes = GetFrameBytes();
+	glGenBuffers(READBACK_FRAMES, m_packBuffers);
+	for (int i = 0; i < READBACK_FRAMES; i++)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, m_packBuffers[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, frameBytes, NULL, GL_STREAM_READ);
+		m_fences[i] = 0;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_CPU_STAGING, g_PackBufferName, (long long)frameBytes * READBACK_FRAMES);
+
+	for (int i = 0; i < QUEUED_FRAMES; i++)
+	{
+		m_frames[i].resize(frameBytes);
+		m_freeFrames[i] = i;
+	}
+	MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_CPU_STAGING, g_QueuedFrameName, (long long)frameBytes * QUEUED_FRAMES);
+	m_convertBuffer.resize((size_t)m_width * m_height * 3);
+
+	m_freeCount = QUEUED_FRAMES;
+	m_queueHead = 0;
+	m_queueCount = 0;
+	m_startTime = 0.0;
+	m_outputFrames = 0;
+	m_issuedFrames = 0;
+	m_retiredFrames = 0;
+	m_writtenFrames = 0;
+	m_skippedFrames = 0;
+	m_droppedFrames = 0;
+	m_writerStalls = 0;
+	m_bStopWriter = false;
+	m_writer = std::thread(&FrameCapture::WriterMain, this);
+
+	m_bRecording = true;
+	std::cout << "Recording " << m_width << "x" << m_height << " frames to " << m_path << std::endl;
+	return(true);
+}
+
+/***********************************************************
+ *  RetireOldestFrame()
+ *
+ *  This method is used for copying the oldest readback out
+ *  of its pack buffer and queuing it for the writer. When
+ *  not asked to wait, a readback the GPU has not finished
+ *  is left for a later frame.
+ ***********************************************************/
+bool FrameCapture::RetireOldestFrame(bool bWait)
+{
+	if (m_retiredFrames == m_issuedFrames)
+	{
+		return(false);
+	}
+
+	int slot = (int)(m_retiredFrames % READBACK_FRAMES);
+	GLenum status = glClientWaitSync(m_fences[slot], 0, 0);
+	if ((status == GL_TIMEOUT_EXPIRED) && (bWait == false))
+	{
+		return(false);
+	}
+	while (status == GL_TIMEOUT_EXPIRED)
+	{
+		status = glClientWaitSync(m_fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, g_FenceTimeout);
+	}
+	glDeleteSync(m_fences[slot]);
+	m_fences[slot] = 0;
+
+	// a full queue means the disk is slower than the frames,
+	// the render thread has to wait for the writer then
+	int frame = -1;
+	{
+		std::unique_lock<std::mutex> lock(m_queueMutex);
+		if (m_freeCount == 0)
+		{
+			m_writerStalls++;
+		}
+		while (m_freeCount == 0)
+		{
+			m_frameFreed.wait(lock);
+		}
+		frame = m_freeFrames[--m_freeCount];
+	}
+
+	size_t frameBytes = GetFrameBytes();
+	bool bCopied = false;
+	if (status != GL_WAIT_FAILED)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, m_packBuffers[slot]);
+		const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes, GL_MAP_READ_BIT);
+		if (NULL != pixels)
+		{
+			memcpy(&m_frames[frame][0], pixels, frameBytes);
+			bCopied = true;
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_queueMutex);
+		if (bCopied == true)
+		{
+			m_frameRepeats[frame] = m_slotRepeats[slot];
+			m_queuedFrames[(m_queueHead + m_queueCount) % QUEUED_FRAMES] = frame;
+			m_queueCount++;
+		}
+		else
+		{
+			m_freeFrames[m_freeCount++] = frame;
+			m_skippedFrames++;
+		}
+	}
+	m_frameQueued.notify_one();
+
+	m_retiredFrames++;
+	return(true);
+}
+
+/***********************************************************
+ *  CaptureFrame()
+ *
+ *  This method is used for reading the window contents of
+ *  the frame that was just rendered, before the buffers are
+ *  swapped. Finished readbacks are queued first, and the
+ *  oldest one is waited on only when its buffer is needed.
+ *  The frame is only read when an output frame is due by
+ *  its time, and is written once for every due frame.
+ ***********************************************************/
+void FrameCapture::CaptureFrame(int framebufferWidth, int framebufferHeight, double frameTime)
+{
+	if (m_bRecording == false)
+	{
+		return;
+	}
+
+	while (RetireOldestFrame(false) == true)
+	{
+	}
+	if (m_issuedFrames - m_retiredFrames >= (unsigned int)READBACK_FRAMES)
+	{
+		RetireOldestFrame(true);
+	}
+
+	// the output has a fixed size, frames rendered while the
+	// window is smaller are left out
+	if ((framebufferWidth < m_width) || (framebufferHeight < m_height))
+	{
+		m_skippedFrames++;
+		return;
+	}
+
+	// output frame n is due at the start time plus n frame
+	// intervals, a frame rendered before the next one is due
+	// is not needed
+	if (0 == m_outputFrames)
+	{
+		m_startTime = frameTime;
+	}
+	unsigned int dueFrames = (unsigned int)((frameTime - m_startTime) * m_framesPerSecond) + 1;
+	if (dueFrames <= m_outputFrames)
+	{
+		m_droppedFrames++;
+		return;
+	}
+
+	int slot = (int)(m_issuedFrames % READBACK_FRAMES);
+	m_slotRepeats[slot] = (int)(dueFrames - m_outputFrames);
+	m_outputFrames = dueFrames;
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glReadBuffer(GL_BACK);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, m_packBuffers[slot]);
+	glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	m_fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	m_issuedFrames++;
+}
+
+/***********************************************************
+ *  Stop()
+ *
+ *  This method is used for finishing the recording. The
+ *  readbacks in flight are waited on, the writer empties
+ *  the queue, and the output and buffers are released.
+ ***********************************************************/
+void FrameCapture::Stop()
+{
+	if (m_bRecording == false)
+	{
+		return;
+	}
+
+	while (RetireOldestFrame(true) == true)
+	{
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_queueMutex);
+		m_bStopWriter = true;
+	}
+	m_frameQueued.notify_one();
+	m_writer.join();
+
+	if (m_file.is_open())
+	{
+		m_file.close();
+	}
+
+	glDeleteBuffers(READBACK_FRAMES, m_packBuffers);
+	for (int i = 0; i < READBACK_FRAMES; i++)
+	{
+		m_packBuffers[i] = 0;
+	}
+	size_t frameBytes = GetFrameBytes();
+	MemoryAccounting::Free(MemoryAccounting::CATEGORY_CPU_STAGING, g_PackBufferName, (long long)frameBytes * READBACK_FRAMES);
+	MemoryAccounting::Free(MemoryAccounting::CATEGORY_CPU_STAGING, g_QueuedFrameName, (long long)frameBytes * QUEUED_FRAMES);
+
+	for (int i = 0; i < QUEUED_FRAMES; i++)
+	{
+		std::vector<unsigned char>().swap(m_frames[i]);
+	}
+	std::vector<unsigned char>().swap(m_convertBuffer);
+
+	m_bRecording = false;
+	std::cout << "Recorded " << m_writtenFrames << " frames to " << m_path << " at " << m_framesPerSecond << " fps ("
+		<< m_skippedFrames << " skipped, " << m_droppedFrames << " dropped for the rate, "
+		<< m_writerStalls << " writer stalls)" << std::endl;
+	if (m_format == FORMAT_RAW_RGB)
+	{
+		std::cout << "Raw frames are rgb24 " << m_width << "x" << m_height << " at " << m_framesPerSecond << " fps" << std::endl;
+	}
+}
+
+/***********************************************************
+ *  WriterMain()
+ *
+ *  This method is run by the writer thread. It writes the
+ *  queued frames in order and gives their buffers back.
+ ***********************************************************/
+void FrameCapture::WriterMain()
+{
+	for (;;)
+	{
+		int frame = -1;
+		{
+			std::unique_lock<std::mutex> lock(m_queueMutex);
+			while ((m_queueCount == 0) && (m_bStopWriter == false))
+			{
+				m_frameQueued.wait(lock);
+			}
+			if (m_queueCount == 0)
+			{
+				return;
+			}
+			frame = m_queuedFrames[m_queueHead];
+			m_queueHead = (m_queueHead + 1) % QUEUED_FRAMES;
+			m_queueCount--;
+		}
+
+		// a frame after a slow one fills the output frames the
+		// slow one left empty
+		for (int repeat = 0; repeat < m_frameRepeats[frame]; repeat++)
+		{
+			if (WriteFrame(&m_frames[frame][0], m_writtenFrames) == true)
+			{
+				m_writtenFrames++;
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_queueMutex);
+			m_freeFrames[m_freeCount++] = frame;
+		}
+		m_frameFreed.notify_one();
+	}
+}
+
+/***********************************************************
+ *  WriteFrame()
+ *
+ *  This method is used for converting one frame and writing
+ *  it out. GL rows start at the bottom, so the rows are
+ *  flipped while converting.
+ ***********************************************************/
+bool FrameCapture::WriteFrame(const unsigned char* pixels, unsigned int frameNumber)
+{
+	int rowBytes = m_width * 4;
+
+	if (m_format == FORMAT_Y4M)
+	{
+		// BT.601 studio range, the chroma of each 2x2 block is
+		// taken from the average of its four pixels
+		unsigned char* yPlane = &m_convertBuffer[0];
+		unsigned char* uPlane = yPlane + (m_width * m_height);
+		unsigned char* vPlane = uPlane + ((m_width / 2) * (m_height / 2));
+
+		for (int y = 0; y < m_height; y++)
+		{
+			const unsigned char* row = pixels + ((size_t)(m_height - 1 - y) * rowBytes);
+			for (int x = 0; x < m_width; x++)
+			{
+				int r = row[x * 4];
+				int g = row[x * 4 + 1];
+				int b = row[x * 4 + 2];
+				yPlane[y * m_width + x] = (unsigned char)((((66 * r) + (129 * g) + (25 * b) + 128) >> 8) + 16);
+			}
+		}
+		for (int y = 0; y < m_height / 2; y++)
+		{
+			const unsigned char* row0 = pixels + ((size_t)(m_height - 1 - (y * 2)) * rowBytes);
+			const unsigned char* row1 = row0 - rowBytes;
+			for (int x = 0; x < m_width / 2; x++)
+			{
+				int offset = x * 8;
+				int r = (row0[offset] + row0[offset + 4] + row1[offset] + row1[offset + 4] + 2) >> 2;
+				int g = (row0[offset + 1] + row0[offset + 5] + row1[offset + 1] + row1[offset + 5] + 2) >> 2;
+				int b = (row0[offset + 2] + row0[offset + 6] + row1[offset + 2] + row1[offset + 6] + 2) >> 2;
+				uPlane[y * (m_width / 2) + x] = (unsigned char)((((-38 * r) - (74 * g) + (112 * b) + 128) >> 8) + 128);
+				vPlane[y * (m_width / 2) + x] = (unsigned char)((((112 * r) - (94 * g) - (18 * b) + 128) >> 8) + 128);
+			}
+		}
+
+		m_file << "FRAME\n";
+		m_file.write((const char*)yPlane, (std::streamsize)(m_width * m_height * 3 / 2));
+		return(!m_file.fail());
+	}
+
+	// both remaining formats store top-down 24-bit RGB
+	for (int y = 0; y < m_height; y++)
+	{
+		const unsigned char* row = pixels + ((size_t)(m_height - 1 - y) * rowBytes);
+		unsigned char* output = &m_convertBuffer[(size_t)y * m_width * 3];
+		for (int x = 0; x < m_width; x++)
+		{
+			output[x * 3] = row[x * 4];
+			output[x * 3 + 1] = row[x * 4 + 1];
+			output[x * 3 + 2] = row[x * 4 + 2];
+		}
+	}
+
+	if (m_format == FORMAT_RAW_RGB)
+	{
+		m_file.write((const char*)&m_convertBuffer[0], (std::streamsize)m_convertBuffer.size());
+		return(!m_file.fail());
+	}
+
+	char filename[64];
+	snprintf(filename, sizeof(filename), "/frame_%06u.ppm", frameNumber);
+	std::ofstream image((m_path + filename).c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!image.is_open())
+	{
+		std::cout << "Could not write capture image:" << m_path << filename << std::endl;
+		return(false);
+	}
+
+	char header[64];
+	snprintf(header, sizeof(header), "P6\n%d %d\n255\n", m_width, m_height);
+	image << header;
+	image.write((const char*)&m_convertBuffer[0], (std::streamsize)m_convertBuffer.size());
+	image.close();
+	return(!image.fail());
+}
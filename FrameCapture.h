@@ -0,0 +1,134 @@
+///////////////////////////////////////////////////////////////////////////////
+// framecapture.h
+// ============
+// record the rendered frames to disk without stalling the GPU
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/***********************************************************
+ *  FrameCapture
+ *
+ *  This class is used for recording the window contents.
+ *  Each frame is read into one of a ring of pixel pack
+ *  buffers and a fence is placed behind the read, so the
+ *  copy runs on the GPU while the next frames render. The
+ *  buffer is only mapped once its fence has passed, a few
+ *  frames later, and the pixels are handed to a writer
+ *  thread that converts and writes them. The render thread
+ *  only waits when the ring or the writer falls behind.
+ *
+ *  The output has a fixed frame rate while the frames are
+ *  rendered at whatever rate the pacing delivers, so each
+ *  rendered frame is timed and stands in for the output
+ *  frames up to its time - it is dropped when the output
+ *  already reached it and written more than once after a
+ *  slow frame.
+ ***********************************************************/
+class FrameCapture
+{
+public:
+	// file formats the frames can be written in
+	enum CAPTURE_FORMAT
+	{
+		FORMAT_Y4M,				// YUV 4:2:0 video, plays in most tools
+		FORMAT_RAW_RGB,			// headerless 24-bit RGB frames
+		FORMAT_IMAGE_SEQUENCE	// one PPM image per frame in a folder
+	};
+
+	// number of frames a readback can be in flight
+	static const int READBACK_FRAMES = 3;
+	// number of frames waiting for the writer
+	static const int QUEUED_FRAMES = 8;
+
+	// constructor
+	FrameCapture();
+	// destructor
+	~FrameCapture();
+
+private:
+	// output settings of the current recording
+	std::string m_path;
+	CAPTURE_FORMAT m_format;
+	int m_width;
+	int m_height;
+	int m_framesPerSecond;
+	bool m_bRecording;
+
+	// time of the first captured frame in seconds, and the
+	// output frames the captured frames stand in for so far
+	double m_startTime;
+	unsigned int m_outputFrames;
+
+	// ring of pack buffers, each with the fence of its read
+	// and the output frames its pixels are written as
+	GLuint m_packBuffers[READBACK_FRAMES];
+	GLsync m_fences[READBACK_FRAMES];
+	int m_slotRepeats[READBACK_FRAMES];
+	unsigned int m_issuedFrames;
+	unsigned int m_retiredFrames;
+
+	// frames copied out of the pack buffers, and the queue
+	// of the ones waiting for the writer
+	std::vector<unsigned char> m_frames[QUEUED_FRAMES];
+	int m_frameRepeats[QUEUED_FRAMES];
+	int m_freeFrames[QUEUED_FRAMES];
+	int m_freeCount;
+	int m_queuedFrames[QUEUED_FRAMES];
+	int m_queueHead;
+	int m_queueCount;
+
+	// writer thread and its output
+	std::thread m_writer;
+	std::mutex m_queueMutex;
+	std::condition_variable m_frameQueued;
+	std::condition_variable m_frameFreed;
+	bool m_bStopWriter;
+	std::ofstream m_file;
+	std::vector<unsigned char> m_convertBuffer;
+
+	// counters reported when the recording stops
+	unsigned int m_writtenFrames;
+	unsigned int m_skippedFrames;
+	unsigned int m_droppedFrames;
+	unsigned int m_writerStalls;
+
+	// disable copying, the capture owns its thread
+	FrameCapture(const FrameCapture&);
+	FrameCapture& operator=(const FrameCapture&);
+
+	// size of one RGBA frame in bytes
+	size_t GetFrameBytes() const { return (size_t)m_width * m_height * 4; }
+
+	// map the oldest pack buffer and queue its pixels
+	bool RetireOldestFrame(bool bWait);
+	// write the queued frames until the recording stops
+	void WriterMain();
+	// convert and write one bottom-up RGBA frame
+	bool WriteFrame(const unsigned char* pixels, unsigned int frameNumber);
+
+public:
+	// pick the format from the extension of the path, a path
+	// without a known extension is used as a folder
+	static CAPTURE_FORMAT GetFormatForPath(const char* path);
+
+	// start recording frames of the passed in size
+	bool Start(const char* path, int width, int height, int framesPerSecond);
+	// read back the window contents of the current frame,
+	// rendered at the passed in time in seconds
+	void CaptureFrame(int framebufferWidth, int framebufferHeight, double frameTime);
+	// finish the readbacks and writes and close the output
+	void Stop();
+
+	bool IsRecording() const { return m_bRecording; }
+};
@@ -0,0 +1,478 @@
+///////////////////////////////////////////////////////////////////////////////
+// framepacer.cpp
+// ============
+// deliver frames at an even rate and measure how even they are
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "FramePacer.h"
+#include "PerformanceCounters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+// missing from older SDKs, the flag is ignored before Windows 10 1803
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#endif
+
+// declaration of global variables
+namespace
+{
+	// names of the modes used on the command line and in reports
+	const char* g_ModeNames[] =
+	{
+		"vsync",
+		"adaptive",
+		"cap",
+		"uncapped"
+	};
+
+	// refresh rate assumed when the monitor does not report one
+	const int g_DefaultRefreshRate = 60;
+
+	// length of one OS sleep, in seconds, and what a sleep is
+	// assumed to take before any was measured
+	const double g_SleepQuantum = 0.001;
+	const double g_InitialSleepMean = 0.002;
+	// weight of a new sample in the measured sleep length
+	const double g_SleepSmoothing = 0.1;
+	// the pacer only sleeps while the remaining time is more than
+	// this many deviations above the mean sleep
+	const double g_SleepDeviations = 2.0;
+
+	// weight of a shorter frame in the predicted frame work
+	const double g_WorkSmoothing = 0.05;
+	// spare time left in the low latency mode for the swap and
+	// for frames a little longer than predicted, in seconds
+	const double g_LowLatencyMargin = 0.0015;
+
+	// an interval this much longer than the target is late
+	const double g_LateIntervalFactor = 1.5;
+}
+
+// out of class definitions for the integral constants
+const int FramePacer::HISTORY_FRAMES;
+
+/***********************************************************
+ *  FramePacer()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+FramePacer::FramePacer()
+{
+	m_mode = PACING_VSYNC;
+	m_targetFramesPerSecond = 60.0;
+	m_bLowLatency = false;
+	m_frameInterval = 0.0;
+	m_bStarted = false;
+	m_predictedWork = 0.0;
+	m_sleepMean = g_InitialSleepMean;
+	m_sleepVariance = 0.0;
+	m_intervalCount = 0;
+	m_intervalIndex = 0;
+	m_intervalSum = 0.0;
+	m_totalFrames = 0;
+	m_totalLateFrames = 0;
+	memset(m_intervals, 0, sizeof(m_intervals));
+
+#ifdef _WIN32
+	// a high resolution timer sleeps close to the quantum,
+	// without it a sleep can last a whole scheduler tick
+	m_timerHandle = CreateWaitableTimerExW(
+		NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+#endif
+}
+
+/***********************************************************
+ *  ~FramePacer()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+FramePacer::~FramePacer()
+{
+#ifdef _WIN32
+	if (NULL != m_timerHandle)
+	{
+		CloseHandle((HANDLE)m_timerHandle);
+		m_timerHandle = NULL;
+	}
+#endif
+}
+
+/***********************************************************
+ *  Configure()
+ *
+ *  This method is used for choosing how the frames are
+ *  paced. The swap interval is only changed by Apply().
+ ***********************************************************/
+void FramePacer::Configure(PACING_MODE mode, double targetFramesPerSecond, bool bLowLatency)
+{
+	m_mode = mode;
+	if (targetFramesPerSecond > 0.0)
+	{
+		m_targetFramesPerSecond = targetFramesPerSecond;
+	}
+	m_bLowLatency = bLowLatency;
+}
+
+/***********************************************************
+ *  Apply()
+ *
+ *  This method is used for setting the swap interval for
+ *  the chosen mode and the interval between frame slots.
+ *  Adaptive vsync falls back to plain vsync when the driver
+ *  cannot tear late frames.
+ ***********************************************************/
+void FramePacer::Apply(GLFWwindow* pWindow)
+{
+	// the vsync modes run at the refresh rate of the monitor
+	// the window is on, a window in windowed mode uses the
+	// primary monitor
+	int refreshRate = g_DefaultRefreshRate;
+	GLFWmonitor* pMonitor = (NULL != pWindow) ? glfwGetWindowMonitor(pWindow) : NULL;
+	if (NULL == pMonitor)
+	{
+		pMonitor = glfwGetPrimaryMonitor();
+	}
+	const GLFWvidmode* pVideoMode = (NULL != pMonitor) ? glfwGetVideoMode(pMonitor) : NULL;
+	if ((NULL != pVideoMode) && (pVideoMode->refreshRate > 0))
+	{
+		refreshRate = pVideoMode->refreshRate;
+	}
+
+	if ((m_mode == PACING_ADAPTIVE_VSYNC) &&
+		(glfwExtensionSupported("WGL_EXT_swap_control_tear") == GLFW_FALSE) &&
+		(glfwExtensionSupported("GLX_EXT_swap_control_tear") == GLFW_FALSE))
+	{
+		std::cout << "INFO: Adaptive vsync is not supported, using vsync" << std::endl;
+		m_mode = PACING_VSYNC;
+	}
+
+	switch (m_mode)
+	{
+	case PACING_VSYNC:
+		glfwSwapInterval(1);
+		m_frameInterval = 1.0 / refreshRate;
+		break;
+	case PACING_ADAPTIVE_VSYNC:
+		glfwSwapInterval(-1);
+		m_frameInterval = 1.0 / refreshRate;
+		break;
+	case PACING_FRAME_CAP:
+		glfwSwapInterval(0);
+		m_frameInterval = 1.0 / m_targetFramesPerSecond;
+		break;
+	default:
+		glfwSwapInterval(0);
+		m_frameInterval = 0.0;
+		break;
+	}
+
+	// the frames are timed again from the next one
+	m_bStarted = false;
+
+	std::cout << "INFO: Frame pacing: " << GetModeName(m_mode);
+	if (m_frameInterval > 0.0)
+	{
+		std::cout << " at " << (1.0 / m_frameInterval) << " fps";
+	}
+	if (m_bLowLatency == true)
+	{
+		std::cout << ", low latency";
+	}
+	std::cout << std::endl;
+}
+
+/***********************************************************
+ *  SleepOnce()
+ *
+ *  This method is used for sleeping through the OS for one
+ *  quantum and folding the time it really took into the
+ *  measured sleep length.
+ ***********************************************************/
+void FramePacer::SleepOnce()
+{
+	Clock::time_point start = Clock::now();
+
+	bool bSlept = false;
+#ifdef _WIN32
+	if (NULL != m_timerHandle)
+	{
+		// relative due time in 100 nanosecond units
+		LARGE_INTEGER dueTime;
+		dueTime.QuadPart = -(LONGLONG)(g_SleepQuantum * 1.0e7);
+		if (SetWaitableTimerEx((HANDLE)m_timerHandle, &dueTime, 0, NULL, NULL, NULL, 0) != FALSE)
+		{
+			WaitForSingleObject((HANDLE)m_timerHandle, INFINITE);
+			bSlept = true;
+		}
+	}
+#endif
+	if (bSlept == false)
+	{
+		std::this_thread::sleep_for(std::chrono::duration<double>(g_SleepQuantum));
+	}
+
+	double slept = std::chrono::duration<double>(Clock::now() - start).count();
+	double difference = slept - m_sleepMean;
+	m_sleepMean += g_SleepSmoothing * difference;
+	m_sleepVariance = (1.0 - g_SleepSmoothing) * (m_sleepVariance + g_SleepSmoothing * difference * difference);
+}
+
+/***********************************************************
+ *  WaitUntil()
+ *
+ *  This method is used for waiting until the passed in
+ *  time. It sleeps while a sleep would most likely end
+ *  before that time and spins for the rest, since an OS
+ *  sleep alone can overshoot by a large part of a frame.
+ ***********************************************************/
+void FramePacer::WaitUntil(Clock::time_point deadline)
+{
+	for (;;)
+	{
+		double remaining = std::chrono::duration<double>(deadline - Clock::now()).count();
+		if (remaining <= 0.0)
+		{
+			break;
+		}
+
+		double sleepEstimate = m_sleepMean + g_SleepDeviations * sqrt(m_sleepVariance);
+		if (remaining > sleepEstimate)
+		{
+			SleepOnce();
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+/***********************************************************
+ *  WaitForInput()
+ *
+ *  This method is used for waiting before the frame reads
+ *  its input. In the low latency mode the frame starts as
+ *  late as the predicted work allows, so it still finishes
+ *  before its slot.
+ ***********************************************************/
+void FramePacer::WaitForInput()
+{
+	if ((m_bLowLatency == true) && (m_bStarted == true) && (m_frameInterval > 0.0))
+	{
+		double lead = std::min(m_predictedWork + g_LowLatencyMargin, m_frameInterval);
+		Clock::time_point slot = (m_mode == PACING_FRAME_CAP) ?
+			m_nextDeadline :
+			m_lastPresent + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(m_frameInterval));
+		WaitUntil(slot - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(lead)));
+	}
+
+	m_frameStart = Clock::now();
+}
+
+/***********************************************************
+ *  EndFrame()
+ *
+ *  This method is used for finishing a frame after its swap.
+ *  The low latency mode waits for the GPU so the swap time
+ *  is known and no frame queues up behind it, the frame cap
+ *  mode then sleeps until the next slot. The interval since
+ *  the last presented frame is recorded as the jitter.
+ ***********************************************************/
+void FramePacer::EndFrame()
+{
+	if (m_bLowLatency == true)
+	{
+		glFinish();
+	}
+
+	Clock::time_point workEnd = Clock::now();
+	Clock::duration frameInterval =
+		std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(m_frameInterval));
+	if (m_bStarted == false)
+	{
+		// the first frame only starts the timing
+		m_bStarted = true;
+		m_lastPresent = workEnd;
+		m_nextDeadline = workEnd + frameInterval;
+		m_predictedWork = std::chrono::duration<double>(workEnd - m_frameStart).count();
+		return;
+	}
+
+	// a longer frame raises the prediction right away, so the
+	// low latency wait never starts a slow frame too late
+	double work = std::chrono::duration<double>(workEnd - m_frameStart).count();
+	if (work > m_predictedWork)
+	{
+		m_predictedWork = work;
+	}
+	else
+	{
+		m_predictedWork += g_WorkSmoothing * (work - m_predictedWork);
+	}
+
+	if ((m_mode == PACING_FRAME_CAP) && (m_bLowLatency == false))
+	{
+		WaitUntil(m_nextDeadline);
+	}
+
+	Clock::time_point present = Clock::now();
+	RecordInterval(std::chrono::duration<double, std::milli>(present - m_lastPresent).count());
+	m_lastPresent = present;
+
+	// a frame that missed its slot moves the slots instead of
+	// rushing the following frames to catch up
+	if (m_mode == PACING_FRAME_CAP)
+	{
+		m_nextDeadline += frameInterval;
+		if (m_nextDeadline < present)
+		{
+			m_nextDeadline = present + frameInterval;
+		}
+	}
+}
+
+/***********************************************************
+ *  RecordInterval()
+ *
+ *  This method is used for adding the interval of a
+ *  presented frame to the history and publishing how far it
+ *  was from the target, or from the mean when uncapped.
+ ***********************************************************/
+void FramePacer::RecordInterval(double milliseconds)
+{
+	if (m_intervalCount == HISTORY_FRAMES)
+	{
+		m_intervalSum -= m_intervals[m_intervalIndex];
+	}
+	else
+	{
+		m_intervalCount++;
+	}
+	m_intervals[m_intervalIndex] = milliseconds;
+	m_intervalSum += milliseconds;
+	m_intervalIndex = (m_intervalIndex + 1) % HISTORY_FRAMES;
+
+	double target = (m_frameInterval > 0.0) ? (m_frameInterval * 1000.0) : (m_intervalSum / m_intervalCount);
+	m_totalFrames++;
+	if (milliseconds > target * g_LateIntervalFactor)
+	{
+		m_totalLateFrames++;
+	}
+
+	PerformanceCounters::Add(
+		PerformanceCounters::COUNTER_PACING_JITTER,
+		(long long)(fabs(milliseconds - target) * 1000.0));
+}
+
+/***********************************************************
+ *  GetStats()
+ *
+ *  This method is used for summarizing the intervals of the
+ *  newest presented frames.
+ ***********************************************************/
+FramePacer::PACING_STATS FramePacer::GetStats() const
+{
+	PACING_STATS stats;
+	memset(&stats, 0, sizeof(stats));
+	stats.frames = m_intervalCount;
+	stats.targetInterval = m_frameInterval * 1000.0;
+	if (m_intervalCount == 0)
+	{
+		return(stats);
+	}
+
+	stats.meanInterval = m_intervalSum / m_intervalCount;
+	double target = (stats.targetInterval > 0.0) ? stats.targetInterval : stats.meanInterval;
+
+	double squaredSum = 0.0;
+	for (int i = 0; i < m_intervalCount; i++)
+	{
+		double difference = m_intervals[i] - stats.meanInterval;
+		squaredSum += difference * difference;
+		stats.worstDeviation = std::max(stats.worstDeviation, fabs(m_intervals[i] - target));
+		if (m_intervals[i] > target * g_LateIntervalFactor)
+		{
+			stats.lateFrames++;
+		}
+	}
+	stats.jitter = sqrt(squaredSum / m_intervalCount);
+
+	return(stats);
+}
+
+/***********************************************************
+ *  WriteReport()
+ *
+ *  This method is used for printing the pacing in use and
+ *  the jitter of the newest presented frames.
+ ***********************************************************/
+void FramePacer::WriteReport(std::ostream& output) const
+{
+	PACING_STATS stats = GetStats();
+
+	output << "Frame pacing: " << GetModeName(m_mode);
+	if (m_bLowLatency == true)
+	{
+		output << ", low latency";
+	}
+	output << std::endl;
+	if (stats.frames == 0)
+	{
+		output << "  no frames presented" << std::endl;
+		return;
+	}
+
+	output << "  target interval  " << stats.targetInterval << " ms" << std::endl;
+	output << "  mean interval    " << stats.meanInterval << " ms over the last " << stats.frames << " frames" << std::endl;
+	output << "  jitter           " << stats.jitter << " ms" << std::endl;
+	output << "  worst deviation  " << stats.worstDeviation << " ms" << std::endl;
+	output << "  late frames      " << stats.lateFrames << " recently, "
+		<< m_totalLateFrames << " of " << m_totalFrames << " in total" << std::endl;
+}
+
+/***********************************************************
+ *  GetModeName()
+ *
+ *  This method is used for getting the name of a mode.
+ ***********************************************************/
+const char* FramePacer::GetModeName(PACING_MODE mode)
+{
+	if ((mode < PACING_VSYNC) || (mode > PACING_UNCAPPED))
+	{
+		return("unknown");
+	}
+	return(g_ModeNames[mode]);
+}
+
+/***********************************************************
+ *  ParseMode()
+ *
+ *  This method is used for finding a mode by its name.
+ ***********************************************************/
+bool FramePacer::ParseMode(const char* name, PACING_MODE& mode)
+{
+	for (int i = PACING_VSYNC; (NULL != name) && (i <= PACING_UNCAPPED); i++)
+	{
+		if (strcmp(name, g_ModeNames[i]) == 0)
+		{
+			mode = (PACING_MODE)i;
+			return(true);
+		}
+	}
+	return(false);
+}
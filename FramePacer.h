@@ -0,0 +1,148 @@
+///////////////////////////////////////////////////////////////////////////////
+// framepacer.h
+// ============
+// deliver frames at an even rate and measure how even they are
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include "GLFW/glfw3.h"
+
+#include <chrono>
+#include <ostream>
+
+/***********************************************************
+ *  FramePacer
+ *
+ *  This class is used for deciding when each frame of the
+ *  window starts and is handed to the display. It sets the
+ *  swap interval for the vsync modes, or holds a target
+ *  frame rate with the swap interval off. Waiting for a
+ *  frame slot sleeps through the OS until the remaining
+ *  time drops below what a sleep may overshoot, measured
+ *  as the pacer runs, and spins for the rest, so frames
+ *  leave on time without a core spinning the whole frame.
+ *
+ *  By default the wait comes after the swap. In the low
+ *  latency mode the pacer waits for the GPU after each
+ *  swap instead, and then sleeps before the input is read
+ *  for as long as the predicted frame work leaves spare,
+ *  so the frame is built from the newest input and
+ *  finishes just in time for its slot.
+ *
+ *  The interval from one presented frame to the next is
+ *  compared to the target interval. The difference is the
+ *  pacing jitter, published per frame as a performance
+ *  counter and summed up by WriteReport().
+ ***********************************************************/
+class FramePacer
+{
+public:
+	// how the frames are paced
+	enum PACING_MODE
+	{
+		PACING_VSYNC,				// wait for every vertical blank
+		PACING_ADAPTIVE_VSYNC,		// tear instead of waiting when late
+		PACING_FRAME_CAP,			// target frame rate, swap interval off
+		PACING_UNCAPPED				// as fast as the frames render
+	};
+
+	// newest presented frames kept for the jitter statistics
+	static const int HISTORY_FRAMES = 240;
+
+	// summary of the newest presented frames, in milliseconds
+	struct PACING_STATS
+	{
+		int frames;
+		double targetInterval;		// 0 when uncapped
+		double meanInterval;
+		double jitter;				// standard deviation of the intervals
+		double worstDeviation;		// largest distance from the target
+		int lateFrames;				// intervals past the late threshold
+	};
+
+	// constructor
+	FramePacer();
+	// destructor
+	~FramePacer();
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	// requested pacing
+	PACING_MODE m_mode;
+	double m_targetFramesPerSecond;
+	bool m_bLowLatency;
+
+	// seconds between frame slots, 0 when uncapped
+	double m_frameInterval;
+	// start of the next slot in the frame cap mode
+	Clock::time_point m_nextDeadline;
+	// when the current frame started reading input
+	Clock::time_point m_frameStart;
+	// when the last frame was presented
+	Clock::time_point m_lastPresent;
+	bool m_bStarted;
+
+	// seconds the frame work is expected to take, raised right
+	// away by a longer frame and lowered slowly
+	double m_predictedWork;
+
+	// measured length of an OS sleep, in seconds
+	double m_sleepMean;
+	double m_sleepVariance;
+
+	// intervals of the newest presented frames, in milliseconds
+	double m_intervals[HISTORY_FRAMES];
+	int m_intervalCount;
+	int m_intervalIndex;
+	double m_intervalSum;
+	unsigned long long m_totalFrames;
+	unsigned long long m_totalLateFrames;
+
+#ifdef _WIN32
+	// high resolution waitable timer, NULL when the system has none
+	void* m_timerHandle;
+#endif
+
+	// disable copying, the pacer owns the timer
+	FramePacer(const FramePacer&);
+	FramePacer& operator=(const FramePacer&);
+
+	// sleep once for a short quantum and measure the overshoot
+	void SleepOnce();
+	// sleep and then spin until the passed in time
+	void WaitUntil(Clock::time_point deadline);
+	// record the interval of a presented frame
+	void RecordInterval(double milliseconds);
+
+public:
+	// choose the pacing, the target frame rate is only used by
+	// the frame cap mode - takes effect at the next Apply()
+	void Configure(PACING_MODE mode, double targetFramesPerSecond, bool bLowLatency);
+	// set the swap interval of the window, its context must be
+	// current, and read the refresh rate of its monitor
+	void Apply(GLFWwindow* pWindow);
+
+	// wait until the frame may read its input, only waits in
+	// the low latency mode
+	void WaitForInput();
+	// call right after the swap - waits for the next slot in
+	// the frame cap mode and measures the frame
+	void EndFrame();
+
+	// get the pacing in use
+	PACING_MODE GetMode() const { return m_mode; }
+	bool IsLowLatency() const { return m_bLowLatency; }
+	// summarize the newest presented frames
+	PACING_STATS GetStats() const;
+	// print the pacing and the jitter of the newest frames
+	void WriteReport(std::ostream& output) const;
+
+	// get the name of a mode used on the command line and in reports
+	static const char* GetModeName(PACING_MODE mode);
+	// find a mode by name, false when there is none
+	static bool ParseMode(const char* name, PACING_MODE& mode);
+};
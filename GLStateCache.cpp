@@ -0,0 +1,526 @@
+///////////////////////////////////////////////////////////////////////////////
+// glstatecache.cpp
+// ============
+// skip GL calls that would not change the current state
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "GLStateCache.h"
+#include "PerformanceCounters.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cstring>
+
+// declaration of global variables
+namespace
+{
+	// capabilities whose enable bit is tracked, anything
+	// else is passed straight through
+	const GLenum g_TrackedCapabilities[] =
+	{
+		GL_DEPTH_TEST,
+		GL_BLEND,
+		GL_CULL_FACE,
+		GL_SCISSOR_TEST,
+		GL_STENCIL_TEST
+	};
+	const int g_TrackedCapabilityCount = sizeof(g_TrackedCapabilities) / sizeof(g_TrackedCapabilities[0]);
+
+	/***********************************************************
+	 *  GetCapabilityBit()
+	 *
+	 *  This function is used for getting the bit of a tracked
+	 *  capability, 0 when it is not tracked.
+	 ***********************************************************/
+	unsigned int GetCapabilityBit(GLenum capability)
+	{
+		for (int i = 0; i < g_TrackedCapabilityCount; i++)
+		{
+			if (g_TrackedCapabilities[i] == capability)
+			{
+				return(1u << i);
+			}
+		}
+		return(0);
+	}
+}
+
+// out of class definitions for the integral constants
+const int GLStateCache::MAX_TEXTURE_UNITS;
+const int GLStateCache::MAX_SHADOWED_LOCATION;
+const GLuint GLStateCache::INVALID_NAME;
+
+/***********************************************************
+ *  GLStateCache()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+GLStateCache::GLStateCache()
+{
+	m_currentProgram = -1;
+	m_stats.issuedCalls = 0;
+	m_stats.skippedCalls = 0;
+	Invalidate();
+}
+
+/***********************************************************
+ *  ~GLStateCache()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+GLStateCache::~GLStateCache()
+{
+}
+
+/***********************************************************
+ *  CountIssued()
+ *
+ *  This method is used for counting a call that was sent
+ *  to the driver.
+ ***********************************************************/
+void GLStateCache::CountIssued(int counter)
+{
+	m_stats.issuedCalls++;
+	PerformanceCounters::Add((PerformanceCounters::COUNTER)counter, 1);
+}
+
+/***********************************************************
+ *  CountSkipped()
+ *
+ *  This method is used for counting a call that was not
+ *  sent because it would not have changed anything.
+ ***********************************************************/
+void GLStateCache::CountSkipped()
+{
+	m_stats.skippedCalls++;
+	PerformanceCounters::Add(PerformanceCounters::COUNTER_REDUNDANT_CALLS, 1);
+}
+
+/***********************************************************
+ *  Invalidate()
+ *
+ *  This method is used for forgetting the bound objects,
+ *  enable bits and masks, so the next call of each goes
+ *  through. The uniform values stay, they can only change
+ *  through the program they belong to.
+ ***********************************************************/
+void GLStateCache::Invalidate()
+{
+	m_program = INVALID_NAME;
+	m_currentProgram = -1;
+	m_vertexArray = INVALID_NAME;
+	for (int i = 0; i < MAX_TEXTURE_UNITS; i++)
+	{
+		m_textures[i] = INVALID_NAME;
+	}
+	m_activeTextureUnit = -1;
+	m_enabledBits = 0;
+	m_knownBits = 0;
+	m_depthMask = -1;
+	m_colorMask = -1;
+	m_depthFunc = INVALID_NAME;
+	m_blendSource = INVALID_NAME;
+	m_blendDestination = INVALID_NAME;
+}
+
+/***********************************************************
+ *  ForgetProgram()
+ *
+ *  This method is used for dropping the shadowed uniforms
+ *  of a program that is about to be deleted, since GL may
+ *  hand the same name to a new program.
+ ***********************************************************/
+void GLStateCache::ForgetProgram(GLuint program)
+{
+	for (size_t i = 0; i < m_programs.size(); i++)
+	{
+		if (m_programs[i].program == program)
+		{
+			m_programs.erase(m_programs.begin() + i);
+			break;
+		}
+	}
+
+	if (m_program == program)
+	{
+		m_program = INVALID_NAME;
+	}
+	// the index of the active program may have moved
+	m_currentProgram = (m_program == INVALID_NAME) ? -1 : FindProgramState(m_program);
+}
+
+/***********************************************************
+ *  FindProgramState()
+ *
+ *  This method is used for finding the shadow of a program,
+ *  adding it the first time the program is used.
+ ***********************************************************/
+int GLStateCache::FindProgramState(GLuint program)
+{
+	for (size_t i = 0; i < m_programs.size(); i++)
+	{
+		if (m_programs[i].program == program)
+		{
+			return((int)i);
+		}
+	}
+
+	PROGRAM_STATE state;
+	state.program = program;
+	m_programs.push_back(state);
+	return((int)m_programs.size() - 1);
+}
+
+/***********************************************************
+ *  UseProgram()
+ *
+ *  This method is used for making a program active.
+ ***********************************************************/
+void GLStateCache::UseProgram(GLuint program)
+{
+	if (m_program == program)
+	{
+		CountSkipped();
+		return;
+	}
+
+	glUseProgram(program);
+	m_program = program;
+	m_currentProgram = (0 == program) ? -1 : FindProgramState(program);
+	CountIssued(PerformanceCounters::COUNTER_STATE_CHANGES);
+}
+
+/***********************************************************
+ *  GetUniformLocation()
+ *
+ *  This method is used for getting a uniform location of
+ *  the active program. Each name is only looked up in GL
+ *  once per program.
+ ***********************************************************/
+GLint GLStateCache::GetUniformLocation(const char* name)
+{
+	if ((m_currentProgram < 0) || (NULL == name))
+	{
+		return(-1);
+	}
+
+	std::vector<NAMED_LOCATION>& locations = m_programs[m_currentProgram].locations;
+	for (size_t i = 0; i < locations.size(); i++)
+	{
+		if (locations[i].name == name)
+		{
+			return(locations[i].location);
+		}
+	}
+
+	NAMED_LOCATION entry;
+	entry.name = name;
+	entry.location = glGetUniformLocation(m_program, name);
+	locations.push_back(entry);
+
+	return(entry.location);
+}
+
+/***********************************************************
+ *  UpdateUniform()
+ *
+ *  This method is used for comparing a new uniform value
+ *  with the value last set into the location. Values of a
+ *  program the cache did not make active, and locations
+ *  out of range, are always sent.
+ ***********************************************************/
+bool GLStateCache::UpdateUniform(GLint location, const float* values, int size)
+{
+	if ((m_currentProgram < 0) || (location >= MAX_SHADOWED_LOCATION))
+	{
+		return(true);
+	}
+
+	std::vector<UNIFORM_VALUE>& uniforms = m_programs[m_currentProgram].uniforms;
+	if (location >= (GLint)uniforms.size())
+	{
+		UNIFORM_VALUE unknown;
+		unknown.size = 0;
+		uniforms.resize(location + 1, unknown);
+	}
+
+	UNIFORM_VALUE& shadow = uniforms[location];
+	if ((shadow.size == size) && (memcmp(shadow.values, values, size * sizeof(float)) == 0))
+	{
+		return(false);
+	}
+
+	shadow.size = size;
+	memcpy(shadow.values, values, size * sizeof(float));
+	return(true);
+}
+
+/***********************************************************
+ *  SetUniform()
+ *
+ *  These methods are used for setting a uniform of the
+ *  active program. Location -1 is ignored like GL does.
+ ***********************************************************/
+void GLStateCache::SetUniform(GLint location, int value)
+{
+	if (location < 0)
+	{
+		return;
+	}
+
+	// integers are compared by their bits
+	float bits;
+	memcpy(&bits, &value, sizeof(bits));
+	if (UpdateUniform(location, &bits, 1) == false)
+	{
+		CountSkipped();
+		return;
+	}
+
+	glUniform1i(location, value);
+	CountIssued(PerformanceCounters::COUNTER_UNIFORM_UPLOADS);
+}
+
+void GLStateCache::SetUniform(GLint location, float value)
+{
+	if (location < 0)
+	{
+		return;
+	}
+
+	if (UpdateUniform(location, &value, 1) == false)
+	{
+		CountSkipped();
+		return;
+	}
+
+	glUniform1f(location, value);
+	CountIssued(PerformanceCounters::COUNTER_UNIFORM_UPLOADS);
+}
+
+void GLStateCache::SetUniform(GLint location, const glm::vec2& value)
+{
+	if (location < 0)
+	{
+		return;
+	}
+
+	if (UpdateUniform(location, glm::value_ptr(value), 2) == false)
+	{
+		CountSkipped();
+		return;
+	}
+
+	glUniform2fv(location, 1, glm::value_ptr(value));
+	CountIssued(PerformanceCounters::COUNTER_UNIFORM_UPLOADS);
+}
+
+void GLStateCache::SetUniform(GLint location, const glm::vec3& value)
+{
+	if (location < 0)
+	{
+		return;
+	}
+
+	if (UpdateUniform(location, glm::value_ptr(value), 3) == false)
+	{
+		CountSkipped();
+		return;
+	}
+
+	glUniform3fv(location, 1, glm::value_ptr(value));
+	CountIssued(PerformanceCounters::COUNTER_UNIFORM_UPLOADS);
+}
+
+void GLStateCache::SetUniform(GLint location, const glm::vec4& value)
+{
+	if (location < 0)
+	{
+		return;
+	}
+
+	if (UpdateUniform(location, glm::value_ptr(value), 4) == false)
+	{
+		CountSkipped();
+		return;
+	}
+
+	glUniform4fv(location, 1, glm::value_ptr(value));
+	CountIssued(PerformanceCounters::COUNTER_UNIFORM_UPLOADS);
+}
+
+void GLStateCache::SetUniform(GLint location, const glm::mat4& value)
+{
+	if (location < 0)
+	{
+		return;
+	}
+
+	if (UpdateUniform(location, glm::value_ptr(value), 16) == false)
+	{
+		CountSkipped();
+		return;
+	}
+
+	glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+	CountIssued(PerformanceCounters::COUNTER_UNIFORM_UPLOADS);
+}
+
+/***********************************************************
+ *  BindTexture()
+ *
+ *  This method is used for binding a 2D texture to a
+ *  texture unit. The active unit is only switched when the
+ *  binding actually changes.
+ ***********************************************************/
+void GLStateCache::BindTexture(int unit, GLuint texture)
+{
+	if ((unit < 0) || (unit >= MAX_TEXTURE_UNITS))
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		m_activeTextureUnit = unit;
+		CountIssued(PerformanceCounters::COUNTER_TEXTURE_BINDS);
+		return;
+	}
+
+	if (m_textures[unit] == texture)
+	{
+		CountSkipped();
+		return;
+	}
+
+	if (m_activeTextureUnit != unit)
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		m_activeTextureUnit = unit;
+		CountIssued(PerformanceCounters::COUNTER_STATE_CHANGES);
+	}
+	glBindTexture(GL_TEXTURE_2D, texture);
+	m_textures[unit] = texture;
+	CountIssued(PerformanceCounters::COUNTER_TEXTURE_BINDS);
+}
+
+/***********************************************************
+ *  BindVertexArray()
+ *
+ *  This method is used for binding a vertex array.
+ ***********************************************************/
+void GLStateCache::BindVertexArray(GLuint vertexArray)
+{
+	if (m_vertexArray == vertexArray)
+	{
+		CountSkipped();
+		return;
+	}
+
+	glBindVertexArray(vertexArray);
+	m_vertexArray = vertexArray;
+	CountIssued(PerformanceCounters::COUNTER_STATE_CHANGES);
+}
+
+/***********************************************************
+ *  SetEnabled()
+ *
+ *  This method is used for turning a capability on or off.
+ ***********************************************************/
+void GLStateCache::SetEnabled(GLenum capability, bool bEnabled)
+{
+	unsigned int bit = GetCapabilityBit(capability);
+	if ((0 != bit) && ((m_knownBits & bit) != 0) && (((m_enabledBits & bit) != 0) == bEnabled))
+	{
+		CountSkipped();
+		return;
+	}
+
+	if (bEnabled == true)
+	{
+		glEnable(capability);
+		m_enabledBits |= bit;
+	}
+	else
+	{
+		glDisable(capability);
+		m_enabledBits &= ~bit;
+	}
+	m_knownBits |= bit;
+	CountIssued(PerformanceCounters::COUNTER_STATE_CHANGES);
+}
+
+/***********************************************************
+ *  SetDepthMask()
+ *
+ *  This method is used for turning depth writes on or off.
+ ***********************************************************/
+void GLStateCache::SetDepthMask(bool bWrite)
+{
+	int mask = bWrite ? 1 : 0;
+	if (m_depthMask == mask)
+	{
+		CountSkipped();
+		return;
+	}
+
+	glDepthMask(bWrite ? GL_TRUE : GL_FALSE);
+	m_depthMask = mask;
+	CountIssued(PerformanceCounters::COUNTER_STATE_CHANGES);
+}
+
+/***********************************************************
+ *  SetColorMask()
+ *
+ *  This method is used for turning all color writes on or
+ *  off together.
+ ***********************************************************/
+void GLStateCache::SetColorMask(bool bWrite)
+{
+	int mask = bWrite ? 1 : 0;
+	if (m_colorMask == mask)
+	{
+		CountSkipped();
+		return;
+	}
+
+	GLboolean write = bWrite ? GL_TRUE : GL_FALSE;
+	glColorMask(write, write, write, write);
+	m_colorMask = mask;
+	CountIssued(PerformanceCounters::COUNTER_STATE_CHANGES);
+}
+
+/***********************************************************
+ *  SetDepthFunc()
+ *
+ *  This method is used for setting the depth comparison.
+ ***********************************************************/
+void GLStateCache::SetDepthFunc(GLenum function)
+{
+	if (m_depthFunc == function)
+	{
+		CountSkipped();
+		return;
+	}
+
+	glDepthFunc(function);
+	m_depthFunc = function;
+	CountIssued(PerformanceCounters::COUNTER_STATE_CHANGES);
+}
+
+/***********************************************************
+ *  SetBlendFunc()
+ *
+ *  This method is used for setting the blend factors.
+ ***********************************************************/
+void GLStateCache::SetBlendFunc(GLenum source, GLenum destination)
+{
+	if ((m_blendSource == source) && (m_blendDestination == destination))
+	{
+		CountSkipped();
+		return;
+	}
+
+	glBlendFunc(source, destination);
+	m_blendSource = source;
+	m_blendDestination = destination;
+	CountIssued(PerformanceCounters::COUNTER_STATE_CHANGES);
+}
@@ -0,0 +1,155 @@
+///////////////////////////////////////////////////////////////////////////////
+// glstatecache.h
+// ============
+// skip GL calls that would not change the current state
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+/***********************************************************
+ *  GLStateCache
+ *
+ *  This class is used for keeping a CPU copy of the GL
+ *  state the renderer changes per draw - the active
+ *  program, its uniform values by location, the texture
+ *  bound to each unit, the vertex array, the enable bits,
+ *  the depth and color masks and the blend function. A
+ *  call that would set the value GL already has is not
+ *  sent to the driver, and is counted instead.
+ *
+ *  State starts out unknown, so the first call always goes
+ *  through. Code that changes the tracked state without the
+ *  cache must call Invalidate() afterwards. Uniform values
+ *  belong to the program object, so they are kept across
+ *  Invalidate() - a deleted program must be forgotten with
+ *  ForgetProgram() before its name can be reused.
+ *
+ *  One cache belongs to one GL context and its thread.
+ ***********************************************************/
+class GLStateCache
+{
+public:
+	// texture units that are tracked
+	static const int MAX_TEXTURE_UNITS = 32;
+	// uniform locations at or above this are not shadowed
+	static const int MAX_SHADOWED_LOCATION = 256;
+	// name of an object that is not known
+	static const GLuint INVALID_NAME = 0xFFFFFFFF;
+
+	// calls sent to the driver and calls that were dropped
+	struct CACHE_STATS
+	{
+		long long issuedCalls;
+		long long skippedCalls;
+	};
+
+	// constructor
+	GLStateCache();
+	// destructor
+	~GLStateCache();
+
+private:
+	// last value set into one uniform location
+	struct UNIFORM_VALUE
+	{
+		// number of floats in the value, 0 while unknown
+		int size;
+		float values[16];
+	};
+
+	// a uniform location looked up by name
+	struct NAMED_LOCATION
+	{
+		const char* name;
+		GLint location;
+	};
+
+	// shadowed uniforms of one program
+	struct PROGRAM_STATE
+	{
+		GLuint program;
+		std::vector<UNIFORM_VALUE> uniforms;
+		std::vector<NAMED_LOCATION> locations;
+	};
+
+	std::vector<PROGRAM_STATE> m_programs;
+	// index into m_programs of the active program, -1 when unknown
+	int m_currentProgram;
+
+	// bound objects, INVALID_NAME while unknown
+	GLuint m_program;
+	GLuint m_vertexArray;
+	GLuint m_textures[MAX_TEXTURE_UNITS];
+	int m_activeTextureUnit;
+
+	// tracked capabilities that are enabled, and the ones
+	// whose value is known at all
+	unsigned int m_enabledBits;
+	unsigned int m_knownBits;
+
+	// -1 while unknown
+	int m_depthMask;
+	int m_colorMask;
+	GLenum m_depthFunc;
+	GLenum m_blendSource;
+	GLenum m_blendDestination;
+
+	CACHE_STATS m_stats;
+
+	// find or add the shadow of a program
+	int FindProgramState(GLuint program);
+	// compare a uniform with its shadow and remember the new
+	// value, false when the location already holds it
+	bool UpdateUniform(GLint location, const float* values, int size);
+	// record a call that was sent or dropped
+	void CountIssued(int counter);
+	void CountSkipped();
+
+public:
+	// forget the context state after GL was called directly,
+	// the uniform values of the programs are kept
+	void Invalidate();
+	// forget the uniform values of a program being deleted
+	void ForgetProgram(GLuint program);
+
+	// make a program active
+	void UseProgram(GLuint program);
+	// get the program the cache last made active
+	GLuint GetProgram() const { return m_program; }
+	// get a uniform location of the active program, the name
+	// must stay valid since lookups are cached by its address
+	GLint GetUniformLocation(const char* name);
+
+	// set a uniform of the active program by location
+	void SetUniform(GLint location, int value);
+	void SetUniform(GLint location, float value);
+	void SetUniform(GLint location, const glm::vec2& value);
+	void SetUniform(GLint location, const glm::vec3& value);
+	void SetUniform(GLint location, const glm::vec4& value);
+	void SetUniform(GLint location, const glm::mat4& value);
+
+	// bind a 2D texture to a texture unit
+	void BindTexture(int unit, GLuint texture);
+	// bind a vertex array
+	void BindVertexArray(GLuint vertexArray);
+
+	// turn a capability like GL_BLEND on or off
+	void SetEnabled(GLenum capability, bool bEnabled);
+	// turn depth writes on or off
+	void SetDepthMask(bool bWrite);
+	// turn all color writes on or off
+	void SetColorMask(bool bWrite);
+	// set the depth comparison
+	void SetDepthFunc(GLenum function);
+	// set the blend factors
+	void SetBlendFunc(GLenum source, GLenum destination);
+
+	// get the number of calls sent and dropped so far
+	CACHE_STATS GetStats() const { return m_stats; }
+};
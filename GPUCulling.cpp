@@ -0,0 +1,588 @@
+///////////////////////////////////////////////////////////////////////////////
+// gpuculling.cpp
+// ============
+// cull many objects in a compute shader into indirect draws
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "GPUCulling.h"
+#include "MemoryAccounting.h"
+#include "PerformanceCounters.h"
+
+#include <algorithm>
+#include <iostream>
+
+// declaration of global variables
+namespace
+{
+	const char* const g_CullShaderPath = "shaders/cullComputeShader.glsl";
+	const char* const g_PyramidShaderPath = "shaders/depthPyramidComputeShader.glsl";
+
+	// uniform names, kept as constants since the state cache
+	// remembers the lookups by their address
+	const char* g_InstanceCountName = "instanceCount";
+	const char* g_FrustumPlanesName = "frustumPlanes";
+	const char* g_DepthPyramidName = "depthPyramid";
+	const char* g_UseDepthPyramidName = "useDepthPyramid";
+	const char* g_PyramidLevelsName = "pyramidLevels";
+	const char* g_PyramidViewProjectionName = "pyramidViewProjection";
+	const char* g_DepthSizeName = "depthSize";
+	const char* g_SourceDepthName = "sourceDepth";
+	const char* g_SourceLevelName = "sourceLevel";
+	const char* g_SourceSizeName = "sourceSize";
+
+	// image unit the pyramid levels are written through
+	const GLuint g_PyramidImageUnit = 0;
+
+	// names used for the memory accounting
+	const char* const g_InstanceBufferName = "cullInstances";
+	const char* const g_VisibleBufferName = "cullVisibleInstances";
+	const char* const g_CommandBufferName = "cullCommands";
+	const char* const g_DepthCopyName = "cullDepthCopy";
+	const char* const g_PyramidName = "cullDepthPyramid";
+	const long long g_DepthCopyBytesPerTexel = 4;
+	const long long g_PyramidBytesPerTexel = 4;
+
+	// number of mip levels of a pyramid whose base is the size
+	long long CalculatePyramidBytes(int width, int height)
+	{
+		long long bytes = 0;
+		while (true)
+		{
+			bytes += (long long)width * height * g_PyramidBytesPerTexel;
+			if ((width == 1) && (height == 1))
+			{
+				break;
+			}
+			width = std::max((width + 1) / 2, 1);
+			height = std::max((height + 1) / 2, 1);
+		}
+		return(bytes);
+	}
+}
+
+// out of class definitions for the integral constants
+const GLuint GPUCuller::INSTANCE_BUFFER_BINDING;
+const GLuint GPUCuller::VISIBLE_BUFFER_BINDING;
+const GLuint GPUCuller::COMMAND_BUFFER_BINDING;
+const int GPUCuller::WORKGROUP_SIZE;
+const int GPUCuller::PYRAMID_WORKGROUP_SIZE;
+const int GPUCuller::PYRAMID_TEXTURE_UNIT;
+
+/***********************************************************
+ *  GPUCuller()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+GPUCuller::GPUCuller(GLStateCache* pStateCache)
+{
+	m_cullProgram = 0;
+	m_pyramidProgram = 0;
+	m_bAvailable = false;
+	m_instanceBuffer = 0;
+	m_visibleBuffer = 0;
+	m_commandBuffer = 0;
+	m_commandTemplateBuffer = 0;
+	m_instanceCount = 0;
+	m_batchCount = 0;
+	m_instanceBytes = 0;
+	m_commandBytes = 0;
+	m_readbackBuffer = 0;
+	m_readbackFence = NULL;
+	m_depthCopyTexture = 0;
+	m_depthCopyFramebuffer = 0;
+	m_pyramidTexture = 0;
+	m_depthWidth = 0;
+	m_depthHeight = 0;
+	m_pyramidLevels = 0;
+	m_renderWidth = 0;
+	m_renderHeight = 0;
+	m_pyramidViewProjection = glm::mat4(1.0f);
+	m_bPyramidValid = false;
+	m_bPyramidFailed = false;
+	m_pStateCache = pStateCache;
+}
+
+/***********************************************************
+ *  ~GPUCuller()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+GPUCuller::~GPUCuller()
+{
+	DestroyBuffers();
+	DestroyPyramid();
+	m_pStateCache = NULL;
+}
+
+/***********************************************************
+ *  Initialize()
+ *
+ *  This method is used for building the compute programs.
+ *  The instancing permutation reads two storage buffers in
+ *  the vertex shader, which GL 4.3 does not guarantee, so
+ *  the limit is checked as well.
+ ***********************************************************/
+bool GPUCuller::Initialize(ResourceManager* pResourceManager)
+{
+	m_bAvailable = false;
+	if ((NULL == pResourceManager) || (GLEW_VERSION_4_3 != GL_TRUE))
+	{
+		std::cout << "GPU culling disabled, compute shaders are not supported" << std::endl;
+		return(false);
+	}
+
+	GLint vertexStorageBlocks = 0;
+	glGetIntegerv(GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS, &vertexStorageBlocks);
+	if (vertexStorageBlocks < 2)
+	{
+		std::cout << "GPU culling disabled, no storage buffers in vertex shaders" << std::endl;
+		return(false);
+	}
+
+	m_cullProgramHandle = pResourceManager->LoadComputeProgram(g_CullShaderPath, "");
+	m_pyramidProgramHandle = pResourceManager->LoadComputeProgram(g_PyramidShaderPath, "");
+	m_cullProgram = m_cullProgramHandle.GetID();
+	m_pyramidProgram = m_pyramidProgramHandle.GetID();
+	if ((0 == m_cullProgram) || (0 == m_pyramidProgram))
+	{
+		std::cout << "GPU culling disabled, no compute programs" << std::endl;
+		return(false);
+	}
+
+	glGenBuffers(1, &m_instanceBuffer);
+	glGenBuffers(1, &m_visibleBuffer);
+	glGenBuffers(1, &m_commandBuffer);
+	glGenBuffers(1, &m_commandTemplateBuffer);
+	glGenBuffers(1, &m_readbackBuffer);
+
+	m_bAvailable = true;
+	return(true);
+}
+
+/***********************************************************
+ *  DestroyBuffers()
+ *
+ *  This method is used for freeing the object buffers.
+ ***********************************************************/
+void GPUCuller::DestroyBuffers()
+{
+	if (0 != m_instanceBuffer)
+	{
+		glDeleteBuffers(1, &m_instanceBuffer);
+		glDeleteBuffers(1, &m_visibleBuffer);
+		glDeleteBuffers(1, &m_commandBuffer);
+		glDeleteBuffers(1, &m_commandTemplateBuffer);
+		glDeleteBuffers(1, &m_readbackBuffer);
+	}
+	if (NULL != m_readbackFence)
+	{
+		glDeleteSync(m_readbackFence);
+	}
+	MemoryAccounting::Free(MemoryAccounting::CATEGORY_STORAGE_BUFFER, g_InstanceBufferName, m_instanceBytes);
+	MemoryAccounting::Free(MemoryAccounting::CATEGORY_STORAGE_BUFFER, g_VisibleBufferName, m_instanceCount * (long long)sizeof(GLuint));
+	MemoryAccounting::Free(MemoryAccounting::CATEGORY_STORAGE_BUFFER, g_CommandBufferName, m_commandBytes * 3);
+
+	m_instanceBuffer = 0;
+	m_visibleBuffer = 0;
+	m_commandBuffer = 0;
+	m_commandTemplateBuffer = 0;
+	m_readbackBuffer = 0;
+	m_readbackFence = NULL;
+	m_readbackCommands.clear();
+	m_instanceCount = 0;
+	m_batchCount = 0;
+	m_instanceBytes = 0;
+	m_commandBytes = 0;
+}
+
+/***********************************************************
+ *  SetInstances()
+ *
+ *  This method is used for uploading every object and the
+ *  draw arguments of every batch. It is only called when
+ *  the objects change, never per frame.
+ ***********************************************************/
+void GPUCuller::SetInstances(
+	const std::vector<GPU_INSTANCE>& instances,
+	const std::vector<INDIRECT_COMMAND>& commands)
+{
+	if (m_bAvailable == false)
+	{
+		return;
+	}
+
+	MemoryAccounting::Free(MemoryAccounting::CATEGORY_STORAGE_BUFFER, g_InstanceBufferName, m_instanceBytes);
+	MemoryAccounting::Free(MemoryAccounting::CATEGORY_STORAGE_BUFFER, g_VisibleBufferName, m_instanceCount * (long long)sizeof(GLuint));
+	MemoryAccounting::Free(MemoryAccounting::CATEGORY_STORAGE_BUFFER, g_CommandBufferName, m_commandBytes * 3);
+
+	// a copy still on its way holds the old batches
+	if (NULL != m_readbackFence)
+	{
+		glDeleteSync(m_readbackFence);
+		m_readbackFence = NULL;
+	}
+	m_readbackCommands.assign(commands.size(), INDIRECT_COMMAND());
+
+	m_instanceCount = (int)instances.size();
+	m_batchCount = (int)commands.size();
+	m_instanceBytes = (long long)instances.size() * sizeof(GPU_INSTANCE);
+	m_commandBytes = (long long)commands.size() * sizeof(INDIRECT_COMMAND);
+
+	// a zero sized buffer cannot be bound to a storage block
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<long long>(m_instanceBytes, 16),
+		instances.empty() ? NULL : &instances[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_visibleBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<long long>(m_instanceCount * (long long)sizeof(GLuint), 16),
+		NULL, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_commandBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<long long>(m_commandBytes, 16),
+		NULL, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_commandTemplateBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<long long>(m_commandBytes, 16),
+		commands.empty() ? NULL : &commands[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_readbackBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<long long>(m_commandBytes, 16),
+		NULL, GL_STREAM_READ);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	PerformanceCounters::Add(PerformanceCounters::COUNTER_BYTES_UPLOADED, m_instanceBytes + m_commandBytes);
+
+	MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_STORAGE_BUFFER, g_InstanceBufferName, m_instanceBytes);
+	MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_STORAGE_BUFFER, g_VisibleBufferName, m_instanceCount * (long long)sizeof(GLuint));
+	MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_STORAGE_BUFFER, g_CommandBufferName, m_commandBytes * 3);
+}
+
+/***********************************************************
+ *  Cull()
+ *
+ *  This method is used for filling the draw arguments of
+ *  every batch with the objects that can be seen from the
+ *  passed in view. The instance counts start from the
+ *  template, the compute shader appends the visible
+ *  objects, and the barrier makes the results visible to
+ *  the indirect draws and the vertex shaders. The draw
+ *  arguments are also copied for counting, when the last
+ *  copy has been read.
+ ***********************************************************/
+void GPUCuller::Cull(const glm::mat4& viewProjection)
+{
+	if ((m_bAvailable == false) || (0 == m_batchCount))
+	{
+		return;
+	}
+
+	ReadVisibleCounts();
+
+	glBindBuffer(GL_COPY_READ_BUFFER, m_commandTemplateBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_commandBuffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)m_commandBytes);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BUFFER_BINDING, m_instanceBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE_BUFFER_BINDING, m_visibleBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMAND_BUFFER_BINDING, m_commandBuffer);
+
+	m_pStateCache->UseProgram(m_cullProgram);
+	m_pStateCache->SetUniform(m_pStateCache->GetUniformLocation(g_InstanceCountName), m_instanceCount);
+
+	// the planes of the current view, pointing inwards, from
+	// the rows of the view projection matrix
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+	{
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+	glm::vec4 planes[6] =
+	{
+		rows[3] + rows[0], rows[3] - rows[0],
+		rows[3] + rows[1], rows[3] - rows[1],
+		rows[3] + rows[2], rows[3] - rows[2]
+	};
+	// the elements of a uniform array have consecutive locations
+	GLint planesLocation = m_pStateCache->GetUniformLocation(g_FrustumPlanesName);
+	for (int i = 0; (i < 6) && (planesLocation >= 0); i++)
+	{
+		float length = glm::length(glm::vec3(planes[i]));
+		m_pStateCache->SetUniform(planesLocation + i, planes[i] / std::max(length, 1e-6f));
+	}
+
+	bool bUsePyramid = (m_bPyramidValid == true) && (m_bPyramidFailed == false);
+	m_pStateCache->SetUniform(m_pStateCache->GetUniformLocation(g_UseDepthPyramidName), bUsePyramid ? 1 : 0);
+	if (bUsePyramid == true)
+	{
+		m_pStateCache->BindTexture(PYRAMID_TEXTURE_UNIT, m_pyramidTexture);
+		m_pStateCache->SetUniform(m_pStateCache->GetUniformLocation(g_DepthPyramidName), PYRAMID_TEXTURE_UNIT);
+		m_pStateCache->SetUniform(m_pStateCache->GetUniformLocation(g_PyramidLevelsName), m_pyramidLevels);
+		m_pStateCache->SetUniform(m_pStateCache->GetUniformLocation(g_PyramidViewProjectionName), m_pyramidViewProjection);
+		m_pStateCache->SetUniform(m_pStateCache->GetUniformLocation(g_DepthSizeName),
+			glm::vec2((float)m_renderWidth, (float)m_renderHeight));
+	}
+
+	glDispatchCompute((GLuint)((m_instanceCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE), 1, 1);
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	if (NULL == m_readbackFence)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, m_commandBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_readbackBuffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)m_commandBytes);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		m_readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+}
+
+/***********************************************************
+ *  ReadVisibleCounts()
+ *
+ *  This method is used for reading the copied draw arguments
+ *  once the fence after the copy has passed. It never waits,
+ *  so the counts are from a few frames back.
+ ***********************************************************/
+void GPUCuller::ReadVisibleCounts()
+{
+	if (NULL == m_readbackFence)
+	{
+		return;
+	}
+
+	GLenum status = glClientWaitSync(m_readbackFence, 0, 0);
+	if ((status != GL_ALREADY_SIGNALED) && (status != GL_CONDITION_SATISFIED))
+	{
+		return;
+	}
+	glDeleteSync(m_readbackFence);
+	m_readbackFence = NULL;
+
+	glBindBuffer(GL_COPY_READ_BUFFER, m_readbackBuffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)m_commandBytes, &m_readbackCommands[0]);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+/***********************************************************
+ *  GetVisibleInstances()
+ *
+ *  This method is used for getting the instances of a batch
+ *  that passed the last cull read back, zero until the
+ *  first one arrives.
+ ***********************************************************/
+int GPUCuller::GetVisibleInstances(int batch) const
+{
+	if ((batch < 0) || (batch >= (int)m_readbackCommands.size()))
+	{
+		return(0);
+	}
+
+	return((int)m_readbackCommands[batch].instanceCount);
+}
+
+/***********************************************************
+ *  DrawBatch()
+ *
+ *  This method is used for drawing the visible instances of
+ *  one batch with the draw arguments the cull wrote.
+ ***********************************************************/
+void GPUCuller::DrawBatch(int batch, GLenum indexType)
+{
+	if ((m_bAvailable == false) || (batch < 0) || (batch >= m_batchCount))
+	{
+		return;
+	}
+
+	glDrawElementsIndirect(
+		GL_TRIANGLES,
+		indexType,
+		(const void*)((size_t)batch * sizeof(INDIRECT_COMMAND)));
+}
+
+/***********************************************************
+ *  DestroyPyramid()
+ *
+ *  This method is used for freeing the depth copy and the
+ *  pyramid.
+ ***********************************************************/
+void GPUCuller::DestroyPyramid()
+{
+	if (0 != m_pyramidTexture)
+	{
+		glDeleteFramebuffers(1, &m_depthCopyFramebuffer);
+		glDeleteTextures(1, &m_depthCopyTexture);
+		glDeleteTextures(1, &m_pyramidTexture);
+
+		MemoryAccounting::Free(MemoryAccounting::CATEGORY_TEXTURE, g_DepthCopyName,
+			(long long)m_depthWidth * m_depthHeight * g_DepthCopyBytesPerTexel);
+		MemoryAccounting::Free(MemoryAccounting::CATEGORY_TEXTURE, g_PyramidName,
+			CalculatePyramidBytes((m_depthWidth + 1) / 2, (m_depthHeight + 1) / 2));
+	}
+
+	m_depthCopyFramebuffer = 0;
+	m_depthCopyTexture = 0;
+	m_pyramidTexture = 0;
+	m_depthWidth = 0;
+	m_depthHeight = 0;
+	m_pyramidLevels = 0;
+	m_renderWidth = 0;
+	m_renderHeight = 0;
+	m_bPyramidValid = false;
+}
+
+/***********************************************************
+ *  CreatePyramid()
+ *
+ *  This method is used for creating the texture the depth
+ *  buffer is copied into, in the format of the scene depth
+ *  buffers, and the pyramid whose first level is half that
+ *  size, rounded up.
+ ***********************************************************/
+bool GPUCuller::CreatePyramid(int width, int height)
+{
+	DestroyPyramid();
+	// deleting the old textures unbound them behind the cache,
+	// and the new ones may get the same names
+	m_pStateCache->Invalidate();
+
+	glGenTextures(1, &m_depthCopyTexture);
+	m_pStateCache->BindTexture(PYRAMID_TEXTURE_UNIT, m_depthCopyTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	int pyramidWidth = (width + 1) / 2;
+	int pyramidHeight = (height + 1) / 2;
+	m_pyramidLevels = 1;
+	for (int size = std::max(pyramidWidth, pyramidHeight); size > 1; size = (size + 1) / 2)
+	{
+		m_pyramidLevels++;
+	}
+
+	glGenTextures(1, &m_pyramidTexture);
+	m_pStateCache->BindTexture(PYRAMID_TEXTURE_UNIT, m_pyramidTexture);
+	glTexStorage2D(GL_TEXTURE_2D, m_pyramidLevels, GL_R32F, pyramidWidth, pyramidHeight);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	m_pStateCache->BindTexture(PYRAMID_TEXTURE_UNIT, 0);
+
+	GLint sceneFramebuffer = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &sceneFramebuffer);
+	glGenFramebuffers(1, &m_depthCopyFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_depthCopyFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_depthCopyTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)sceneFramebuffer);
+
+	m_depthWidth = width;
+	m_depthHeight = height;
+	MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_TEXTURE, g_DepthCopyName,
+		(long long)width * height * g_DepthCopyBytesPerTexel);
+	MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_TEXTURE, g_PyramidName,
+		CalculatePyramidBytes(pyramidWidth, pyramidHeight));
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "Could not create depth pyramid target, status:" << status << std::endl;
+		DestroyPyramid();
+		return(false);
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  BuildDepthPyramid()
+ *
+ *  This method is used for copying the depth of the frame
+ *  just drawn into the bound framebuffer and reducing it
+ *  into the pyramid, one dispatch per level. The pyramid
+ *  is used by the culling of the next frame. When the
+ *  copy fails once, for example because the depth formats
+ *  differ, the culling stays with the frustum.
+ *
+ *  The textures are created for the full target and only
+ *  recreated when the target size changes. A scaled frame
+ *  copies and reduces just the corner it was drawn into.
+ ***********************************************************/
+void GPUCuller::BuildDepthPyramid(
+	int targetWidth,
+	int targetHeight,
+	int width,
+	int height,
+	const glm::mat4& viewProjection)
+{
+	if ((m_bAvailable == false) || (m_bPyramidFailed == true) ||
+		(0 == m_batchCount) || (width <= 0) || (height <= 0))
+	{
+		return;
+	}
+
+	// the corner never reaches past the target
+	targetWidth = std::max(targetWidth, width);
+	targetHeight = std::max(targetHeight, height);
+
+	bool bCreated = false;
+	if ((targetWidth != m_depthWidth) || (targetHeight != m_depthHeight))
+	{
+		if (CreatePyramid(targetWidth, targetHeight) == false)
+		{
+			m_bPyramidFailed = true;
+			return;
+		}
+		bCreated = true;
+	}
+
+	GLint sceneFramebuffer = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &sceneFramebuffer);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, (GLuint)sceneFramebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_depthCopyFramebuffer);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)sceneFramebuffer);
+
+	// the copy only fails for a framebuffer whose depth is
+	// not like the others, which does not change later
+	if ((bCreated == true) && (glGetError() != GL_NO_ERROR))
+	{
+		std::cout << "GPU culling uses the frustum only, the depth buffer cannot be copied" << std::endl;
+		m_bPyramidFailed = true;
+		DestroyPyramid();
+		return;
+	}
+
+	m_pStateCache->UseProgram(m_pyramidProgram);
+	GLint sourceDepthLocation = m_pStateCache->GetUniformLocation(g_SourceDepthName);
+	GLint sourceLevelLocation = m_pStateCache->GetUniformLocation(g_SourceLevelName);
+	GLint sourceSizeLocation = m_pStateCache->GetUniformLocation(g_SourceSizeName);
+	m_pStateCache->SetUniform(sourceDepthLocation, PYRAMID_TEXTURE_UNIT);
+
+	int sourceWidth = width;
+	int sourceHeight = height;
+	for (int level = 0; level < m_pyramidLevels; level++)
+	{
+		// level 0 reads the depth copy, the others the level above
+		m_pStateCache->BindTexture(PYRAMID_TEXTURE_UNIT, (0 == level) ? m_depthCopyTexture : m_pyramidTexture);
+		m_pStateCache->SetUniform(sourceLevelLocation, (0 == level) ? 0 : level - 1);
+		m_pStateCache->SetUniform(sourceSizeLocation, glm::vec2((float)sourceWidth, (float)sourceHeight));
+
+		int levelWidth = std::max((sourceWidth + 1) / 2, 1);
+		int levelHeight = std::max((sourceHeight + 1) / 2, 1);
+		glBindImageTexture(g_PyramidImageUnit, m_pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		glDispatchCompute(
+			(GLuint)((levelWidth + PYRAMID_WORKGROUP_SIZE - 1) / PYRAMID_WORKGROUP_SIZE),
+			(GLuint)((levelHeight + PYRAMID_WORKGROUP_SIZE - 1) / PYRAMID_WORKGROUP_SIZE),
+			1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+		sourceWidth = levelWidth;
+		sourceHeight = levelHeight;
+	}
+	m_pStateCache->BindTexture(PYRAMID_TEXTURE_UNIT, 0);
+
+	m_renderWidth = width;
+	m_renderHeight = height;
+	m_pyramidViewProjection = viewProjection;
+	m_bPyramidValid = true;
+}
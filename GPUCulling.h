@@ -0,0 +1,177 @@
+///////////////////////////////////////////////////////////////////////////////
+// gpuculling.h
+// ============
+// cull many objects in a compute shader into indirect draws
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "ResourceManager.h"
+#include "GLStateCache.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+/***********************************************************
+ *  GPUCuller
+ *
+ *  This class is used for drawing large numbers of objects
+ *  whose visibility the CPU never looks at. The transforms
+ *  and world-space bounds of every object are uploaded
+ *  once into a storage buffer, and the objects are grouped
+ *  into batches that share a mesh and shader settings.
+ *
+ *  Each frame a compute shader tests every object against
+ *  the view frustum and against a depth pyramid, where
+ *  each texel holds the farthest depth of the pixels below
+ *  it, built from the depth of the previous frame. The
+ *  objects that pass are appended to the visible list of
+ *  their batch, and the instance count of the batch in the
+ *  indirect draw buffer is raised, so each batch is drawn
+ *  with a single indirect call. The vertex shader of the
+ *  instancing permutation reads the transform through the
+ *  visible list.
+ *
+ *  The previous depth is tested with the view it was drawn
+ *  with, so an object that comes into view from behind an
+ *  occluder shows one frame late. After a camera cut the
+ *  pyramid is skipped for a frame.
+ *
+ *  One culler belongs to one GL context, the state goes
+ *  through the state cache of that context.
+ ***********************************************************/
+class GPUCuller
+{
+public:
+	// storage buffer binding points, after the light buffers
+	static const GLuint INSTANCE_BUFFER_BINDING = 3;
+	static const GLuint VISIBLE_BUFFER_BINDING = 4;
+	static const GLuint COMMAND_BUFFER_BINDING = 5;
+	// invocations per work group of the cull shader
+	static const int WORKGROUP_SIZE = 64;
+	// invocations per side of a work group of the pyramid shader
+	static const int PYRAMID_WORKGROUP_SIZE = 8;
+	// texture unit the pyramid is sampled from, above the
+	// units used by the scene textures and lightmaps
+	static const int PYRAMID_TEXTURE_UNIT = GLStateCache::MAX_TEXTURE_UNITS - 1;
+
+	// one culled object, laid out as the std430 struct
+	struct GPU_INSTANCE
+	{
+		glm::mat4 model;
+		glm::vec4 boundsMin;	// world-space bounds, w unused
+		glm::vec4 boundsMax;
+		GLuint batch;
+		GLuint padding[3];
+	};
+
+	// arguments of glDrawElementsIndirect, the base instance
+	// is the first slot of the batch in the visible list
+	struct INDIRECT_COMMAND
+	{
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	// constructor
+	GPUCuller(GLStateCache* pStateCache);
+	// destructor
+	~GPUCuller();
+
+private:
+	// compute programs and their uniform locations
+	ResourceHandle m_cullProgramHandle;
+	ResourceHandle m_pyramidProgramHandle;
+	GLuint m_cullProgram;
+	GLuint m_pyramidProgram;
+	bool m_bAvailable;
+
+	// object data, visible lists and draw arguments
+	GLuint m_instanceBuffer;
+	GLuint m_visibleBuffer;
+	GLuint m_commandBuffer;
+	// draw arguments with every instance count at zero, copied
+	// over the command buffer before each cull
+	GLuint m_commandTemplateBuffer;
+	int m_instanceCount;
+	int m_batchCount;
+	long long m_instanceBytes;
+	long long m_commandBytes;
+	// copy of the draw arguments read back without waiting,
+	// only for counting what the batches draw
+	GLuint m_readbackBuffer;
+	GLsync m_readbackFence;
+	std::vector<INDIRECT_COMMAND> m_readbackCommands;
+
+	// copy of the scene depth and the pyramid built from it,
+	// allocated at the full target size
+	GLuint m_depthCopyTexture;
+	GLuint m_depthCopyFramebuffer;
+	GLuint m_pyramidTexture;
+	int m_depthWidth;
+	int m_depthHeight;
+	int m_pyramidLevels;
+	// size of the corner the last depth was copied from
+	int m_renderWidth;
+	int m_renderHeight;
+	// view the pyramid was built with, and whether it can be used
+	glm::mat4 m_pyramidViewProjection;
+	bool m_bPyramidValid;
+	// set when the depth buffer could not be copied
+	bool m_bPyramidFailed;
+
+	// state of the context the culling runs in
+	GLStateCache* m_pStateCache;
+
+	// free the object buffers
+	void DestroyBuffers();
+	// free the depth copy and the pyramid
+	void DestroyPyramid();
+	// create the depth copy and the pyramid for a depth size
+	bool CreatePyramid(int width, int height);
+	// take the draw arguments of the last copy the GPU finished
+	void ReadVisibleCounts();
+
+public:
+	// build the compute programs, false when the driver cannot
+	// run them and the objects must be drawn the CPU way
+	bool Initialize(ResourceManager* pResourceManager);
+	// check whether the culling can be used
+	bool IsAvailable() const { return m_bAvailable; }
+
+	// replace every object, the instances must be ordered by
+	// batch and each command must reserve their slots
+	void SetInstances(
+		const std::vector<GPU_INSTANCE>& instances,
+		const std::vector<INDIRECT_COMMAND>& commands);
+	// get the number of batches set
+	int GetBatchCount() const { return m_batchCount; }
+
+	// cull the objects for the view, filling the draw arguments
+	void Cull(const glm::mat4& viewProjection);
+	// draw the visible instances of a batch, with its mesh bound
+	// and the instancing program active
+	void DrawBatch(int batch, GLenum indexType);
+	// get the visible instances of a batch in a recent frame,
+	// the counts arrive a few frames after the cull
+	int GetVisibleInstances(int batch) const;
+
+	// build the pyramid from the depth of the bound framebuffer,
+	// after the frame has been drawn with the passed in view,
+	// from the corner of the target the frame was drawn into
+	void BuildDepthPyramid(
+		int targetWidth,
+		int targetHeight,
+		int width,
+		int height,
+		const glm::mat4& viewProjection);
+	// forget the pyramid when the next view does not follow
+	// from the last one
+	void InvalidateDepthPyramid() { m_bPyramidValid = false; }
+};
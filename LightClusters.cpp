@@ -0,0 +1,453 @@
+///////////////////////////////////////////////////////////////////////////////
+// lightclusters.cpp
+// ============
+// assign scene light sources to 3D view-space clusters for forward shading
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "LightClusters.h"
+#include "MemoryAccounting.h"
+#include "PerformanceCounters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+// declaration of global variables
+namespace
+{
+	// uniform names of the cluster grid settings, set into
+	// every program that shades with the clusters
+	const char* g_ClusterGridName = "clusterGridSize";
+	const char* g_ClusterScreenName = "clusterScreenSize";
+	const char* g_ClusterDepthName = "clusterDepthRange";
+
+	// names of the storage buffers in the memory reports
+	const char* g_LightBufferName = "lightSources";
+	const char* g_ClusterBufferName = "clusterRanges";
+	const char* g_IndexBufferName = "lightIndices";
+}
+
+// out of class definitions for the integral constants
+const int LightClusterManager::CLUSTER_GRID_X;
+const int LightClusterManager::CLUSTER_GRID_Y;
+const int LightClusterManager::CLUSTER_GRID_Z;
+const int LightClusterManager::TOTAL_CLUSTERS;
+const GLuint LightClusterManager::LIGHT_BUFFER_BINDING;
+const GLuint LightClusterManager::CLUSTER_BUFFER_BINDING;
+const GLuint LightClusterManager::INDEX_BUFFER_BINDING;
+
+/***********************************************************
+ *  LightClusterManager()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+LightClusterManager::LightClusterManager()
+{
+	m_lightBuffer = 0;
+	m_clusterBuffer = 0;
+	m_indexBuffer = 0;
+	m_lightBufferSize = 0;
+	m_indexBufferSize = 0;
+	m_bLightsDirty = true;
+	m_zNear = 0.1f;
+	m_zFar = 100.0f;
+	m_viewportWidth = 1;
+	m_viewportHeight = 1;
+
+	m_clusterRanges.resize(TOTAL_CLUSTERS);
+}
+
+/***********************************************************
+ *  ~LightClusterManager()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+LightClusterManager::~LightClusterManager()
+{
+	if (0 != m_lightBuffer)
+	{
+		glDeleteBuffers(1, &m_lightBuffer);
+		MemoryAccounting::Free(MemoryAccounting::CATEGORY_STORAGE_BUFFER, g_LightBufferName, m_lightBufferSize);
+		m_lightBuffer = 0;
+	}
+	if (0 != m_clusterBuffer)
+	{
+		glDeleteBuffers(1, &m_clusterBuffer);
+		MemoryAccounting::Free(
+			MemoryAccounting::CATEGORY_STORAGE_BUFFER,
+			g_ClusterBufferName,
+			TOTAL_CLUSTERS * sizeof(CLUSTER_RANGE));
+		m_clusterBuffer = 0;
+	}
+	if (0 != m_indexBuffer)
+	{
+		glDeleteBuffers(1, &m_indexBuffer);
+		MemoryAccounting::Free(MemoryAccounting::CATEGORY_STORAGE_BUFFER, g_IndexBufferName, m_indexBufferSize);
+		m_indexBuffer = 0;
+	}
+}
+
+/***********************************************************
+ *  AddLight()
+ *
+ *  This method is used for adding a light source to the
+ *  scene. The range is the distance at which the light has
+ *  faded out completely and bounds the clusters it touches.
+ ***********************************************************/
+int LightClusterManager::AddLight(
+	glm::vec3 position,
+	glm::vec3 ambientColor,
+	glm::vec3 diffuseColor,
+	glm::vec3 specularColor,
+	float focalStrength,
+	float specularIntensity,
+	float range)
+{
+	LIGHT_SOURCE light;
+
+	light.positionRadius = glm::vec4(position, range);
+	light.ambientColor = glm::vec4(ambientColor, 0.0f);
+	light.diffuseColor = glm::vec4(diffuseColor, focalStrength);
+	light.specularColor = glm::vec4(specularColor, specularIntensity);
+
+	m_lightSources.push_back(light);
+	m_bLightsDirty = true;
+
+	return((int)m_lightSources.size() - 1);
+}
+
+/***********************************************************
+ *  ClearLights()
+ *
+ *  This method is used for removing all the light sources.
+ ***********************************************************/
+void LightClusterManager::ClearLights()
+{
+	m_lightSources.clear();
+	m_bLightsDirty = true;
+}
+
+/***********************************************************
+ *  DepthToSlice()
+ *
+ *  This method is used for converting a positive view-space
+ *  depth into a cluster slice. Slices are spaced
+ *  exponentially so near clusters stay small.
+ ***********************************************************/
+int LightClusterManager::DepthToSlice(float viewDepth) const
+{
+	if (viewDepth <= m_zNear)
+	{
+		return(0);
+	}
+
+	float slice = std::log(viewDepth / m_zNear) * CLUSTER_GRID_Z / std::log(m_zFar / m_zNear);
+
+	return(std::min((int)slice, CLUSTER_GRID_Z - 1));
+}
+
+/***********************************************************
+ *  ComputeLightClusterBounds()
+ *
+ *  This method is used for finding the range of clusters
+ *  that the sphere of influence of a light overlaps. The
+ *  screen rectangle comes from projecting the corners of
+ *  the view-space bounding box of the sphere.
+ ***********************************************************/
+bool LightClusterManager::ComputeLightClusterBounds(
+	const LIGHT_SOURCE& light,
+	const glm::mat4& view,
+	const glm::mat4& projection,
+	glm::ivec3& minCluster,
+	glm::ivec3& maxCluster) const
+{
+	glm::vec4 viewCenter = view * glm::vec4(
+		light.positionRadius.x,
+		light.positionRadius.y,
+		light.positionRadius.z,
+		1.0f);
+	float radius = light.positionRadius.w;
+
+	// view space looks down -Z so depths are negated
+	float nearDepth = -viewCenter.z - radius;
+	float farDepth = -viewCenter.z + radius;
+
+	// the light is completely outside of the depth range
+	if ((farDepth < m_zNear) || (nearDepth > m_zFar))
+	{
+		return(false);
+	}
+
+	minCluster.z = DepthToSlice(nearDepth);
+	maxCluster.z = DepthToSlice(farDepth);
+
+	// default to covering the whole screen, which is used when
+	// the bounding box reaches behind the camera
+	minCluster.x = 0;
+	minCluster.y = 0;
+	maxCluster.x = CLUSTER_GRID_X - 1;
+	maxCluster.y = CLUSTER_GRID_Y - 1;
+
+	glm::vec2 ndcMin(1.0f, 1.0f);
+	glm::vec2 ndcMax(-1.0f, -1.0f);
+	bool bBehindCamera = false;
+
+	for (int corner = 0; (corner < 8) && (bBehindCamera == false); corner++)
+	{
+		glm::vec4 cornerPosition(
+			viewCenter.x + ((corner & 1) ? radius : -radius),
+			viewCenter.y + ((corner & 2) ? radius : -radius),
+			viewCenter.z + ((corner & 4) ? radius : -radius),
+			1.0f);
+		glm::vec4 clipPosition = projection * cornerPosition;
+
+		if (clipPosition.w <= 0.0001f)
+		{
+			bBehindCamera = true;
+		}
+		else
+		{
+			ndcMin.x = std::min(ndcMin.x, clipPosition.x / clipPosition.w);
+			ndcMin.y = std::min(ndcMin.y, clipPosition.y / clipPosition.w);
+			ndcMax.x = std::max(ndcMax.x, clipPosition.x / clipPosition.w);
+			ndcMax.y = std::max(ndcMax.y, clipPosition.y / clipPosition.w);
+		}
+	}
+
+	if (bBehindCamera == false)
+	{
+		// the light is completely off screen
+		if ((ndcMax.x < -1.0f) || (ndcMin.x > 1.0f) ||
+			(ndcMax.y < -1.0f) || (ndcMin.y > 1.0f))
+		{
+			return(false);
+		}
+
+		minCluster.x = (int)((std::max(ndcMin.x, -1.0f) * 0.5f + 0.5f) * CLUSTER_GRID_X);
+		minCluster.y = (int)((std::max(ndcMin.y, -1.0f) * 0.5f + 0.5f) * CLUSTER_GRID_Y);
+		maxCluster.x = (int)((std::min(ndcMax.x, 1.0f) * 0.5f + 0.5f) * CLUSTER_GRID_X);
+		maxCluster.y = (int)((std::min(ndcMax.y, 1.0f) * 0.5f + 0.5f) * CLUSTER_GRID_Y);
+
+		maxCluster.x = std::min(maxCluster.x, CLUSTER_GRID_X - 1);
+		maxCluster.y = std::min(maxCluster.y, CLUSTER_GRID_Y - 1);
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  UpdateClusters()
+ *
+ *  This method is used for binning every light source into
+ *  the clusters it can reach. A counting pass sizes each
+ *  cluster, then a filling pass writes the light indices,
+ *  so no per-cluster lists are allocated.
+ ***********************************************************/
+void LightClusterManager::UpdateClusters(
+	const glm::mat4& view,
+	const glm::mat4& projection,
+	float zNear,
+	float zFar,
+	int viewportWidth,
+	int viewportHeight)
+{
+	int lightCount = (int)m_lightSources.size();
+
+	m_zNear = zNear;
+	m_zFar = zFar;
+	m_viewportWidth = std::max(viewportWidth, 1);
+	m_viewportHeight = std::max(viewportHeight, 1);
+
+	m_lightMinCluster.resize(lightCount);
+	m_lightMaxCluster.resize(lightCount);
+
+	for (int i = 0; i < TOTAL_CLUSTERS; i++)
+	{
+		m_clusterRanges[i].offset = 0;
+		m_clusterRanges[i].count = 0;
+	}
+
+	// counting pass - find the bounds of each light and the
+	// number of lights that land in each cluster
+	for (int i = 0; i < lightCount; i++)
+	{
+		bool bVisible = ComputeLightClusterBounds(
+			m_lightSources[i],
+			view,
+			projection,
+			m_lightMinCluster[i],
+			m_lightMaxCluster[i]);
+
+		if (bVisible == false)
+		{
+			// an empty range is skipped by the filling pass
+			m_lightMinCluster[i] = glm::ivec3(0, 0, 0);
+			m_lightMaxCluster[i] = glm::ivec3(-1, -1, -1);
+			continue;
+		}
+
+		for (int z = m_lightMinCluster[i].z; z <= m_lightMaxCluster[i].z; z++)
+		{
+			for (int y = m_lightMinCluster[i].y; y <= m_lightMaxCluster[i].y; y++)
+			{
+				for (int x = m_lightMinCluster[i].x; x <= m_lightMaxCluster[i].x; x++)
+				{
+					int cluster = x + (y * CLUSTER_GRID_X) + (z * CLUSTER_GRID_X * CLUSTER_GRID_Y);
+					m_clusterRanges[cluster].count++;
+				}
+			}
+		}
+	}
+
+	// convert the counts into offsets into the index list
+	GLuint totalIndices = 0;
+	for (int i = 0; i < TOTAL_CLUSTERS; i++)
+	{
+		m_clusterRanges[i].offset = totalIndices;
+		totalIndices += m_clusterRanges[i].count;
+		m_clusterRanges[i].count = 0;
+	}
+	m_lightIndices.resize(totalIndices);
+
+	// filling pass - write each light index into its clusters
+	for (int i = 0; i < lightCount; i++)
+	{
+		for (int z = m_lightMinCluster[i].z; z <= m_lightMaxCluster[i].z; z++)
+		{
+			for (int y = m_lightMinCluster[i].y; y <= m_lightMaxCluster[i].y; y++)
+			{
+				for (int x = m_lightMinCluster[i].x; x <= m_lightMaxCluster[i].x; x++)
+				{
+					int cluster = x + (y * CLUSTER_GRID_X) + (z * CLUSTER_GRID_X * CLUSTER_GRID_Y);
+					CLUSTER_RANGE& range = m_clusterRanges[cluster];
+					m_lightIndices[range.offset + range.count] = (GLuint)i;
+					range.count++;
+				}
+			}
+		}
+	}
+}
+
+/***********************************************************
+ *  UploadBuffer()
+ *
+ *  This method is used for copying data into a storage
+ *  buffer. The buffer is only reallocated when it needs
+ *  to grow, otherwise the old contents are overwritten.
+ *  Empty data still allocates a few bytes, because a zero
+ *  sized buffer cannot be bound to a storage block.
+ ***********************************************************/
+void LightClusterManager::UploadBuffer(
+	const char* bufferName,
+	GLuint buffer,
+	GLsizeiptr& allocatedSize,
+	const void* data,
+	GLsizeiptr size)
+{
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	if ((size > allocatedSize) || (0 == allocatedSize))
+	{
+		MemoryAccounting::Free(MemoryAccounting::CATEGORY_STORAGE_BUFFER, bufferName, allocatedSize);
+
+		// grow by half again to avoid reallocating every frame
+		allocatedSize = std::max(size, allocatedSize + (allocatedSize / 2));
+		allocatedSize = std::max<GLsizeiptr>(allocatedSize, 16);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, allocatedSize, NULL, GL_DYNAMIC_DRAW);
+
+		MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_STORAGE_BUFFER, bufferName, allocatedSize);
+	}
+	if (size > 0)
+	{
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, data);
+		PerformanceCounters::Add(PerformanceCounters::COUNTER_BYTES_UPLOADED, size);
+	}
+}
+
+/***********************************************************
+ *  BindClusterData()
+ *
+ *  This method is used for uploading the light and cluster
+ *  data into the storage buffers and binding them to the
+ *  shader binding points. Binding points are shared by all
+ *  programs, so this only needs to happen once per frame.
+ ***********************************************************/
+void LightClusterManager::BindClusterData()
+{
+	if (0 == m_lightBuffer)
+	{
+		glGenBuffers(1, &m_lightBuffer);
+		glGenBuffers(1, &m_clusterBuffer);
+		glGenBuffers(1, &m_indexBuffer);
+
+		// the cluster grid never changes size
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_clusterBuffer);
+		glBufferData(
+			GL_SHADER_STORAGE_BUFFER,
+			TOTAL_CLUSTERS * sizeof(CLUSTER_RANGE),
+			NULL,
+			GL_DYNAMIC_DRAW);
+		MemoryAccounting::Allocate(
+			MemoryAccounting::CATEGORY_STORAGE_BUFFER,
+			g_ClusterBufferName,
+			TOTAL_CLUSTERS * sizeof(CLUSTER_RANGE));
+	}
+
+	// the light definitions only change when lights are edited
+	if (m_bLightsDirty == true)
+	{
+		UploadBuffer(
+			g_LightBufferName,
+			m_lightBuffer,
+			m_lightBufferSize,
+			m_lightSources.empty() ? NULL : &m_lightSources[0],
+			m_lightSources.size() * sizeof(LIGHT_SOURCE));
+		m_bLightsDirty = false;
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_clusterBuffer);
+	glBufferSubData(
+		GL_SHADER_STORAGE_BUFFER,
+		0,
+		TOTAL_CLUSTERS * sizeof(CLUSTER_RANGE),
+		&m_clusterRanges[0]);
+	PerformanceCounters::Add(
+		PerformanceCounters::COUNTER_BYTES_UPLOADED,
+		TOTAL_CLUSTERS * sizeof(CLUSTER_RANGE));
+
+	UploadBuffer(
+		g_IndexBufferName,
+		m_indexBuffer,
+		m_indexBufferSize,
+		m_lightIndices.empty() ? NULL : &m_lightIndices[0],
+		m_lightIndices.size() * sizeof(GLuint));
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_BUFFER_BINDING, m_lightBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_BUFFER_BINDING, m_clusterBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INDEX_BUFFER_BINDING, m_indexBuffer);
+}
+
+/***********************************************************
+ *  SetClusterUniforms()
+ *
+ *  This method is used for setting the cluster grid size,
+ *  viewport size and depth range into the active program.
+ *  Uniforms belong to a program, so every program that
+ *  does lighting needs them.
+ ***********************************************************/
+void LightClusterManager::SetClusterUniforms(GLStateCache* pStateCache)
+{
+	if (NULL != pStateCache)
+	{
+		pStateCache->SetUniform(
+			pStateCache->GetUniformLocation(g_ClusterGridName),
+			glm::vec3((float)CLUSTER_GRID_X, (float)CLUSTER_GRID_Y, (float)CLUSTER_GRID_Z));
+		pStateCache->SetUniform(
+			pStateCache->GetUniformLocation(g_ClusterScreenName),
+			glm::vec2((float)m_viewportWidth, (float)m_viewportHeight));
+		pStateCache->SetUniform(
+			pStateCache->GetUniformLocation(g_ClusterDepthName),
+			glm::vec2(m_zNear, m_zFar));
+	}
+}
@@ -0,0 +1,137 @@
+///////////////////////////////////////////////////////////////////////////////
+// lightclusters.h
+// ============
+// assign scene light sources to 3D view-space clusters for forward shading
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "GLStateCache.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+/***********************************************************
+ *  LightClusterManager
+ *
+ *  This class owns the scene light sources and, once per
+ *  frame, bins them into a grid of view-space clusters.
+ *  The lights, the per-cluster light ranges and the light
+ *  index list are uploaded into shader storage buffers so
+ *  that each fragment only loops over the lights that can
+ *  reach its own cluster.
+ ***********************************************************/
+class LightClusterManager
+{
+public:
+	// constructor
+	LightClusterManager();
+	// destructor
+	~LightClusterManager();
+
+	// number of clusters along each axis of the view frustum
+	static const int CLUSTER_GRID_X = 16;
+	static const int CLUSTER_GRID_Y = 9;
+	static const int CLUSTER_GRID_Z = 24;
+	static const int TOTAL_CLUSTERS = CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z;
+
+	// shader storage buffer binding points used by the shaders
+	static const GLuint LIGHT_BUFFER_BINDING = 0;
+	static const GLuint CLUSTER_BUFFER_BINDING = 1;
+	static const GLuint INDEX_BUFFER_BINDING = 2;
+
+	// light source layout, matches the std430 struct in the
+	// fragment shader - the w components carry the scalars
+	struct LIGHT_SOURCE
+	{
+		glm::vec4 positionRadius;		// xyz = position, w = range
+		glm::vec4 ambientColor;			// w unused
+		glm::vec4 diffuseColor;			// w = focal strength
+		glm::vec4 specularColor;		// w = specular intensity
+	};
+
+	// per cluster offset and count into the light index list
+	struct CLUSTER_RANGE
+	{
+		GLuint offset;
+		GLuint count;
+	};
+
+private:
+	// all of the defined light sources
+	std::vector<LIGHT_SOURCE> m_lightSources;
+	// cluster ranges rebuilt every frame
+	std::vector<CLUSTER_RANGE> m_clusterRanges;
+	// flattened light indices referenced by the cluster ranges
+	std::vector<GLuint> m_lightIndices;
+	// cluster bounds covered by each light, kept between the
+	// counting pass and the filling pass
+	std::vector<glm::ivec3> m_lightMinCluster;
+	std::vector<glm::ivec3> m_lightMaxCluster;
+
+	// storage buffer objects
+	GLuint m_lightBuffer;
+	GLuint m_clusterBuffer;
+	GLuint m_indexBuffer;
+	// allocated sizes of the storage buffers in bytes
+	GLsizeiptr m_lightBufferSize;
+	GLsizeiptr m_indexBufferSize;
+	// light list changed since the last upload
+	bool m_bLightsDirty;
+
+	// depth range and viewport used for the current clusters
+	float m_zNear;
+	float m_zFar;
+	int m_viewportWidth;
+	int m_viewportHeight;
+
+	// calculate the cluster bounds touched by one light
+	bool ComputeLightClusterBounds(
+		const LIGHT_SOURCE& light,
+		const glm::mat4& view,
+		const glm::mat4& projection,
+		glm::ivec3& minCluster,
+		glm::ivec3& maxCluster) const;
+	// convert a positive view depth into a cluster slice
+	int DepthToSlice(float viewDepth) const;
+	// upload a block of data into a storage buffer, growing it if needed
+	void UploadBuffer(
+		const char* bufferName,
+		GLuint buffer,
+		GLsizeiptr& allocatedSize,
+		const void* data,
+		GLsizeiptr size);
+
+public:
+	// add a light source, returns its index
+	int AddLight(
+		glm::vec3 position,
+		glm::vec3 ambientColor,
+		glm::vec3 diffuseColor,
+		glm::vec3 specularColor,
+		float focalStrength,
+		float specularIntensity,
+		float range);
+	// remove all the defined light sources
+	void ClearLights();
+	// get the number of defined light sources
+	int GetLightCount() const { return (int)m_lightSources.size(); }
+	// get the defined light sources
+	const std::vector<LIGHT_SOURCE>& GetLights() const { return m_lightSources; }
+
+	// bin the lights into the view-space clusters
+	void UpdateClusters(
+		const glm::mat4& view,
+		const glm::mat4& projection,
+		float zNear,
+		float zFar,
+		int viewportWidth,
+		int viewportHeight);
+	// upload the cluster data into the storage buffers
+	void BindClusterData();
+	// set the cluster uniforms into the active shader program
+	void SetClusterUniforms(GLStateCache* pStateCache);
+};
@@ -0,0 +1,457 @@
+///////////////////////////////////////////////////////////////////////////////
+// lightmaps.cpp
+// ============
+// bake and cache the static lighting of objects that never move
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Lightmaps.h"
+#include "MappedFile.h"
+#include "ShaderCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// declaration of global variables
+namespace
+{
+	// identifies a baked lightmap file, "LMAP" in little endian
+	const unsigned int g_LightmapFileMagic = 0x50414D4C;
+	// bumped whenever the baking or the file layout change
+	const unsigned int g_LightmapFileVersion = 1;
+
+	// lightmap resolution along the largest world-space extent
+	// of the object, kept inside the size limits
+	const float g_TexelsPerUnit = 8.0f;
+	const int g_MinLightmapSize = 32;
+	const int g_MaxLightmapSize = 512;
+	// rings of empty texels filled around each chart
+	const int g_DilationPasses = 4;
+
+	// header at the start of every baked lightmap file
+	struct LIGHTMAP_FILE_HEADER
+	{
+		unsigned int magic;
+		unsigned int version;
+		unsigned long long key;
+		int width;
+		int height;
+	};
+
+	/***********************************************************
+	 *  HashVector()
+	 *
+	 *  This function is used for adding the contents of a
+	 *  vector to a running hash.
+	 ***********************************************************/
+	template <typename T>
+	unsigned long long HashVector(const std::vector<T>& values, unsigned long long key)
+	{
+		if (values.empty() == true)
+		{
+			return(key);
+		}
+		return(ShaderProgramCache::HashBytes(&values[0], values.size() * sizeof(T), key));
+	}
+}
+
+/***********************************************************
+ *  LightmapBaker()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+LightmapBaker::LightmapBaker(const char* cacheDirectory, int threadCount)
+{
+	m_cacheDirectory = cacheDirectory;
+
+	if (threadCount <= 0)
+	{
+		threadCount = (int)std::thread::hardware_concurrency();
+	}
+	m_threadCount = std::max(threadCount, 1);
+}
+
+/***********************************************************
+ *  ~LightmapBaker()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+LightmapBaker::~LightmapBaker()
+{
+}
+
+/***********************************************************
+ *  GetCacheFilePath()
+ *
+ *  This method is used for calculating the path of a baked
+ *  lightmap file in the cache directory.
+ ***********************************************************/
+std::string LightmapBaker::GetCacheFilePath(const char* name) const
+{
+	return(m_cacheDirectory + "/" + name + ".lightmap");
+}
+
+/***********************************************************
+ *  LoadLightmap()
+ *
+ *  This method is used for reading a baked lightmap from
+ *  the cache directory. Files with another key or a wrong
+ *  size are rejected so the lightmap gets rebaked.
+ ***********************************************************/
+bool LightmapBaker::LoadLightmap(const char* name, unsigned long long key, LIGHTMAP& lightmap) const
+{
+	std::string path = GetCacheFilePath(name);
+	MappedFile file;
+	if ((file.Open(path.c_str()) == false) || (file.GetSize() < sizeof(LIGHTMAP_FILE_HEADER)))
+	{
+		return(false);
+	}
+
+	LIGHTMAP_FILE_HEADER header;
+	memcpy(&header, file.GetData(), sizeof(header));
+
+	if ((header.magic != g_LightmapFileMagic) ||
+		(header.version != g_LightmapFileVersion) ||
+		(header.key != key) ||
+		(header.width <= 0) || (header.width > g_MaxLightmapSize) ||
+		(header.height <= 0) || (header.height > g_MaxLightmapSize))
+	{
+		return(false);
+	}
+
+	size_t texelCount = (size_t)header.width * header.height * 3;
+	if (file.GetSize() != (sizeof(header) + (texelCount * sizeof(float))))
+	{
+		return(false);
+	}
+
+	lightmap.width = header.width;
+	lightmap.height = header.height;
+	lightmap.texels.resize(texelCount);
+	memcpy(&lightmap.texels[0], file.GetData() + sizeof(header), texelCount * sizeof(float));
+
+	std::cout << "INFO: Lightmap loaded from cache:" << path << std::endl;
+
+	return(true);
+}
+
+/***********************************************************
+ *  SaveLightmap()
+ *
+ *  This method is used for writing a baked lightmap into
+ *  the cache directory. The file is written under a
+ *  temporary name first so a crash never leaves a partial
+ *  file.
+ ***********************************************************/
+void LightmapBaker::SaveLightmap(const char* name, unsigned long long key, const LIGHTMAP& lightmap) const
+{
+#ifdef _WIN32
+	_mkdir(m_cacheDirectory.c_str());
+#else
+	mkdir(m_cacheDirectory.c_str(), 0755);
+#endif
+
+	std::string path = GetCacheFilePath(name);
+	std::string tempPath = path + ".tmp";
+
+	std::ofstream file(tempPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Could not write lightmap cache file:" << path << std::endl;
+		return;
+	}
+
+	LIGHTMAP_FILE_HEADER header;
+	memset(&header, 0, sizeof(header));
+	header.magic = g_LightmapFileMagic;
+	header.version = g_LightmapFileVersion;
+	header.key = key;
+	header.width = lightmap.width;
+	header.height = lightmap.height;
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(&lightmap.texels[0]), lightmap.texels.size() * sizeof(float));
+	file.close();
+	bool bWritten = !file.fail();
+
+	remove(path.c_str());
+	if ((bWritten == false) || (rename(tempPath.c_str(), path.c_str()) != 0))
+	{
+		remove(tempPath.c_str());
+		std::cout << "Could not write lightmap cache file:" << path << std::endl;
+	}
+}
+
+/***********************************************************
+ *  BakeRows()
+ *
+ *  This method is used for lighting the texels of a range
+ *  of lightmap rows. Every triangle is rasterized in the
+ *  lightmap layout, and each texel center it covers gets
+ *  the ambient and diffuse terms of every light at the
+ *  matching world position, exactly like the fragment
+ *  shader evaluates them.
+ ***********************************************************/
+void LightmapBaker::BakeRows(BAKE_JOB& job, int firstRow, int endRow)
+{
+	const MeshLibrary::MESH_GEOMETRY& geometry = *job.pGeometry;
+	const std::vector<LightClusterManager::LIGHT_SOURCE>& lights = *job.pLights;
+	LIGHTMAP& lightmap = *job.pLightmap;
+	glm::vec2 size((float)lightmap.width, (float)lightmap.height);
+
+	for (size_t i = 0; i + 2 < geometry.indices.size(); i += 3)
+	{
+		unsigned int corners[3] = { geometry.indices[i], geometry.indices[i + 1], geometry.indices[i + 2] };
+		glm::vec2 texel[3];
+		for (int j = 0; j < 3; j++)
+		{
+			texel[j] = geometry.lightmapCoordinates[corners[j]] * size;
+		}
+
+		float area = ((texel[1].x - texel[0].x) * (texel[2].y - texel[0].y)) -
+			((texel[2].x - texel[0].x) * (texel[1].y - texel[0].y));
+		if (std::fabs(area) < 1.0e-8f)
+		{
+			continue;
+		}
+
+		glm::vec2 texelMin = glm::min(texel[0], glm::min(texel[1], texel[2]));
+		glm::vec2 texelMax = glm::max(texel[0], glm::max(texel[1], texel[2]));
+		int minX = std::max((int)std::floor(texelMin.x), 0);
+		int maxX = std::min((int)std::ceil(texelMax.x), lightmap.width - 1);
+		int minY = std::max((int)std::floor(texelMin.y), firstRow);
+		int maxY = std::min((int)std::ceil(texelMax.y), endRow - 1);
+
+		for (int y = minY; y <= maxY; y++)
+		{
+			for (int x = minX; x <= maxX; x++)
+			{
+				glm::vec2 center(x + 0.5f, y + 0.5f);
+
+				// barycentric weights, positive inside either winding
+				float weights[3];
+				for (int j = 0; j < 3; j++)
+				{
+					const glm::vec2& a = texel[(j + 1) % 3];
+					const glm::vec2& b = texel[(j + 2) % 3];
+					weights[j] = (((b.x - a.x) * (center.y - a.y)) - ((center.x - a.x) * (b.y - a.y))) / area;
+				}
+				if ((weights[0] < 0.0f) || (weights[1] < 0.0f) || (weights[2] < 0.0f))
+				{
+					continue;
+				}
+
+				glm::vec3 position(0.0f);
+				glm::vec3 normal(0.0f);
+				for (int j = 0; j < 3; j++)
+				{
+					position += geometry.positions[corners[j]] * weights[j];
+					normal += geometry.normals[corners[j]] * weights[j];
+				}
+				glm::vec3 worldPosition = glm::vec3(job.model * glm::vec4(position, 1.0f));
+				glm::vec3 worldNormal = job.normalMatrix * normal;
+				float normalLength = glm::length(worldNormal);
+				worldNormal = (normalLength > 0.0f) ? (worldNormal / normalLength) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+				glm::vec3 lighting(0.0f);
+				for (size_t k = 0; k < lights.size(); k++)
+				{
+					const LightClusterManager::LIGHT_SOURCE& light = lights[k];
+					glm::vec3 lightOffset = glm::vec3(light.positionRadius) - worldPosition;
+					float lightDistance = glm::length(lightOffset);
+
+					// smooth falloff that reaches zero at the light range
+					float falloff = glm::clamp(1.0f - std::pow(lightDistance / light.positionRadius.w, 4.0f), 0.0f, 1.0f);
+					float attenuation = falloff * falloff;
+
+					glm::vec3 ambient = glm::vec3(light.ambientColor) * job.material.ambientColor * job.material.ambientStrength;
+					glm::vec3 lightDirection = lightOffset / std::max(lightDistance, 0.0001f);
+					float impact = std::max(glm::dot(worldNormal, lightDirection), 0.0f);
+					glm::vec3 diffuse = impact * glm::vec3(light.diffuseColor) * job.material.diffuseColor;
+
+					lighting += (ambient + diffuse) * attenuation;
+				}
+
+				size_t index = ((size_t)y * lightmap.width) + x;
+				lightmap.texels[(index * 3) + 0] = lighting.r;
+				lightmap.texels[(index * 3) + 1] = lighting.g;
+				lightmap.texels[(index * 3) + 2] = lighting.b;
+				job.covered[index] = 1;
+			}
+		}
+	}
+}
+
+/***********************************************************
+ *  DilateLightmap()
+ *
+ *  This method is used for growing the charts into the
+ *  empty texels around them. Each pass gives every empty
+ *  texel next to a filled one the average of its filled
+ *  neighbours, so the texels that bilinear filtering reads
+ *  beyond a chart edge continue its lighting.
+ ***********************************************************/
+void LightmapBaker::DilateLightmap(BAKE_JOB& job)
+{
+	LIGHTMAP& lightmap = *job.pLightmap;
+	int width = lightmap.width;
+	int height = lightmap.height;
+
+	for (int pass = 0; pass < g_DilationPasses; pass++)
+	{
+		std::vector<float> source = lightmap.texels;
+		std::vector<unsigned char> covered = job.covered;
+
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				size_t index = ((size_t)y * width) + x;
+				if (covered[index] != 0)
+				{
+					continue;
+				}
+
+				glm::vec3 sum(0.0f);
+				int count = 0;
+				for (int dy = -1; dy <= 1; dy++)
+				{
+					for (int dx = -1; dx <= 1; dx++)
+					{
+						int nx = x + dx;
+						int ny = y + dy;
+						if ((nx < 0) || (ny < 0) || (nx >= width) || (ny >= height))
+						{
+							continue;
+						}
+
+						size_t neighbour = ((size_t)ny * width) + nx;
+						if (covered[neighbour] != 0)
+						{
+							sum += glm::vec3(source[neighbour * 3], source[(neighbour * 3) + 1], source[(neighbour * 3) + 2]);
+							count++;
+						}
+					}
+				}
+
+				if (count > 0)
+				{
+					sum /= (float)count;
+					lightmap.texels[(index * 3) + 0] = sum.r;
+					lightmap.texels[(index * 3) + 1] = sum.g;
+					lightmap.texels[(index * 3) + 2] = sum.b;
+					job.covered[index] = 1;
+				}
+			}
+		}
+	}
+}
+
+/***********************************************************
+ *  GetLightmap()
+ *
+ *  This method is used for getting the baked lighting of a
+ *  static object. A cached bake with the same key is read
+ *  back, otherwise the object is baked on every thread and
+ *  the result is written to the cache.
+ ***********************************************************/
+bool LightmapBaker::GetLightmap(
+	const char* name,
+	const MeshLibrary::MESH_GEOMETRY& geometry,
+	const glm::mat4& model,
+	const BAKE_MATERIAL& material,
+	const std::vector<LightClusterManager::LIGHT_SOURCE>& lights,
+	LIGHTMAP& lightmap)
+{
+	if ((geometry.positions.empty() == true) ||
+		(geometry.lightmapCoordinates.size() != geometry.positions.size()) ||
+		(geometry.normals.size() != geometry.positions.size()))
+	{
+		return(false);
+	}
+
+	// the key covers every input, so any change rebakes
+	int settings[] = { (int)g_LightmapFileVersion, g_MinLightmapSize, g_MaxLightmapSize, g_DilationPasses };
+	unsigned long long key = ShaderProgramCache::HashBytes(settings, sizeof(settings));
+	key = ShaderProgramCache::HashBytes(&g_TexelsPerUnit, sizeof(g_TexelsPerUnit), key);
+	key = HashVector(geometry.positions, key);
+	key = HashVector(geometry.normals, key);
+	key = HashVector(geometry.lightmapCoordinates, key);
+	key = HashVector(geometry.indices, key);
+	key = ShaderProgramCache::HashBytes(&model, sizeof(model), key);
+	key = ShaderProgramCache::HashBytes(&material, sizeof(material), key);
+	key = HashVector(lights, key);
+
+	if (LoadLightmap(name, key, lightmap) == true)
+	{
+		return(true);
+	}
+
+	// size the lightmap by the extent of the placed object
+	glm::vec3 worldMin = glm::vec3(model * glm::vec4(geometry.positions[0], 1.0f));
+	glm::vec3 worldMax = worldMin;
+	for (size_t i = 1; i < geometry.positions.size(); i++)
+	{
+		glm::vec3 worldPosition = glm::vec3(model * glm::vec4(geometry.positions[i], 1.0f));
+		worldMin = glm::min(worldMin, worldPosition);
+		worldMax = glm::max(worldMax, worldPosition);
+	}
+	glm::vec3 extent = worldMax - worldMin;
+	float largestExtent = std::max(extent.x, std::max(extent.y, extent.z));
+	int size = (int)std::ceil(largestExtent * g_TexelsPerUnit);
+	size = std::min(std::max(size, g_MinLightmapSize), g_MaxLightmapSize);
+
+	lightmap.width = size;
+	lightmap.height = size;
+	lightmap.texels.assign((size_t)size * size * 3, 0.0f);
+
+	BAKE_JOB job;
+	job.pGeometry = &geometry;
+	job.model = model;
+	job.normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+	job.material = material;
+	job.pLights = &lights;
+	job.pLightmap = &lightmap;
+	job.covered.assign((size_t)size * size, 0);
+
+	// every thread lights its own band of rows, the calling
+	// thread takes the first band
+	int threadCount = std::min(m_threadCount, size);
+	int rowsPerThread = (size + threadCount - 1) / threadCount;
+	std::vector<std::thread> workers;
+	for (int i = 1; i < threadCount; i++)
+	{
+		int firstRow = i * rowsPerThread;
+		int endRow = std::min(firstRow + rowsPerThread, size);
+		if (firstRow < endRow)
+		{
+			workers.push_back(std::thread(BakeRows, std::ref(job), firstRow, endRow));
+		}
+	}
+	BakeRows(job, 0, std::min(rowsPerThread, size));
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+
+	DilateLightmap(job);
+
+	std::cout << "INFO: Baked lightmap " << name << ", " << size << "x" << size
+		<< " texels on " << threadCount << " threads" << std::endl;
+
+	SaveLightmap(name, key, lightmap);
+
+	return(true);
+}
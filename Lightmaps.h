@@ -0,0 +1,102 @@
+///////////////////////////////////////////////////////////////////////////////
+// lightmaps.h
+// ============
+// bake and cache the static lighting of objects that never move
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "MeshLibrary.h"
+#include "LightClusters.h"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+/***********************************************************
+ *  LightmapBaker
+ *
+ *  This class is used for precomputing the lighting of
+ *  static objects under static lights. The ambient and
+ *  diffuse terms of the fragment shader are evaluated for
+ *  every texel of the mesh lightmap layout and multiplied
+ *  by the material, so at runtime only the view dependent
+ *  specular term is left to evaluate per fragment.
+ *
+ *  Rows of the lightmap are split between threads. Texels
+ *  just outside the charts are filled from their neighbours
+ *  so bilinear filtering along chart edges stays clean.
+ *
+ *  Each bake is stored in the cache directory under its
+ *  name, keyed by everything that went into it, so later
+ *  launches only read it back. Moving the object or
+ *  changing a light or the material rebakes it.
+ ***********************************************************/
+class LightmapBaker
+{
+public:
+	// material terms that are baked, like OBJECT_MATERIAL
+	struct BAKE_MATERIAL
+	{
+		glm::vec3 ambientColor;
+		float ambientStrength;
+		glm::vec3 diffuseColor;
+	};
+
+	// baked lighting, RGB float texels with the bottom row first
+	struct LIGHTMAP
+	{
+		int width;
+		int height;
+		std::vector<float> texels;
+	};
+
+	// constructor, 0 threads uses every core
+	LightmapBaker(const char* cacheDirectory, int threadCount);
+	// destructor
+	~LightmapBaker();
+
+private:
+	// folder where the baked lightmaps are stored
+	std::string m_cacheDirectory;
+	// threads sharing each bake
+	int m_threadCount;
+
+	// everything one bake reads, shared by its threads
+	struct BAKE_JOB
+	{
+		const MeshLibrary::MESH_GEOMETRY* pGeometry;
+		glm::mat4 model;
+		glm::mat3 normalMatrix;
+		BAKE_MATERIAL material;
+		const std::vector<LightClusterManager::LIGHT_SOURCE>* pLights;
+		LIGHTMAP* pLightmap;
+		// texels covered by a chart, the rest get dilated
+		std::vector<unsigned char> covered;
+	};
+
+	// calculate the cache file path for a lightmap
+	std::string GetCacheFilePath(const char* name) const;
+	// read a baked lightmap with the passed in key from disk
+	bool LoadLightmap(const char* name, unsigned long long key, LIGHTMAP& lightmap) const;
+	// write a baked lightmap to disk
+	void SaveLightmap(const char* name, unsigned long long key, const LIGHTMAP& lightmap) const;
+	// light the texels of a range of rows
+	static void BakeRows(BAKE_JOB& job, int firstRow, int endRow);
+	// spread the chart texels into the empty texels around them
+	static void DilateLightmap(BAKE_JOB& job);
+
+public:
+	// get the lighting of a static object, baking it when
+	// there is no valid cached copy - false when the mesh
+	// has no lightmap layout
+	bool GetLightmap(
+		const char* name,
+		const MeshLibrary::MESH_GEOMETRY& geometry,
+		const glm::mat4& model,
+		const BAKE_MATERIAL& material,
+		const std::vector<LightClusterManager::LIGHT_SOURCE>& lights,
+		LIGHTMAP& lightmap);
+};
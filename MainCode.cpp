@@ -11,8 +11,29 @@
 
 #include "SceneManager.h"
 #include "ViewManager.h"
-#include "ShapeMeshes.h"
 #include "ShaderManager.h"
+#include "ShaderCache.h"
+#include "ShaderPermutations.h"
+#include "ResourceManager.h"
+#include "AllocationTracking.h"
+#include "MemoryAccounting.h"
+#include "DynamicResolution.h"
+#include "StressTest.h"
+#include "FrameCapture.h"
+#include "RenderGraph.h"
+#include "SoftwareRasterizer.h"
+#include "PerformanceCounters.h"
+#include "StartupGraph.h"
+#include "BatchRenderer.h"
+#include "AssetPack.h"
+#include "FramePacer.h"
+#include "ChunkStreamer.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
 
 // Namespace for declaring global variables
 namespace
@@ -29,12 +50,89 @@ namespace
 	ShaderManager* g_ShaderManager = nullptr;
 	// view manager object for managing the 3D view setup and projection to 2D
 	ViewManager* g_ViewManager = nullptr;
+	// shader program cache for skipping shader compiles on later launches
+	ShaderProgramCache* g_ShaderCache = nullptr;
+	// shared textures, meshes and programs with ref-counted handles
+	ResourceManager* g_ResourceManager = nullptr;
+	// specialized shader programs for each used feature combination
+	ShaderPermutationSet* g_ShaderPermutations = nullptr;
+	// renders the scene below window resolution to hold the frame budget
+	DynamicResolution* g_DynamicResolution = nullptr;
+	// object count sweep, only created when asked for on the command line
+	StressTest* g_StressTest = nullptr;
+	// records the window to a video or image sequence
+	FrameCapture* g_FrameCapture = nullptr;
+	// decides when each frame starts and is presented
+	FramePacer* g_FramePacer = nullptr;
+	// orders the passes of each frame from the resources they use
+	RenderGraph* g_RenderGraph = nullptr;
+	// streams a large world around the camera, only created
+	// when asked for on the command line
+	ChunkStreamer* g_ChunkStreamer = nullptr;
+
+	// frames allowed to allocate while containers reach their
+	// steady-state capacity and lazy shader programs are built
+	const int g_AllocationWarmupFrames = 10;
+
+	// how often the memory accounting is written out
+	const double g_MemoryReportInterval = 10.0;
+	const char* const g_MemoryReportFile = "memoryreport.json";
+
+	// GPU time each frame should stay under, in milliseconds, and
+	// the range the per axis render scale may move within
+	const float g_FrameTimeBudget = 16.0f;
+	const float g_MinResolutionScale = 0.5f;
+	const float g_MaxResolutionScale = 1.0f;
+	const DynamicResolution::UPSCALE_FILTER g_UpscaleFilter = DynamicResolution::FILTER_SHARPEN;
+
+	// object counts measured by the stress test, started with
+	// --stress for a grid or --stress-random for a scattered layout,
+	// adding --stress-animated makes every copy hop or turn on its own clip
+	const int g_StressTestSteps[] = { 100, 1000, 10000, 100000 };
+	const char* const g_StressReportFile = "stressreport.json";
+
+	// recording started with --capture <path> or toggled with F9,
+	// a .y4m or .rgb path gives a video and any other a folder
+	const char* const g_DefaultCapturePath = "capture.y4m";
+	// rate of the recording, the capture drops or repeats the
+	// rendered frames to hold it whatever the frame pacing
+	const int g_CaptureFramesPerSecond = 60;
+
+	// --software <output.ppm> renders on the CPU without a window,
+	// --software-threads <count> limits the threads it uses
+	const int g_SoftwareWidth = 1000;
+	const int g_SoftwareHeight = 800;
+	const int g_SoftwareFrames = 30;
+
+	// --batch <jobs.txt> renders a list of camera views offscreen,
+	// --batch-threads <count> sets the number of GL contexts
+	const int g_BatchWidth = 1000;
+	const int g_BatchHeight = 800;
+
+	// --pack <path> reads the assets from a pack built by the
+	// AssetPacker tool, by default this one next to the executable
+	const char* const g_DefaultAssetPackName = "assets.pack";
+
+	// --pacing vsync|adaptive|cap|uncapped picks the frame pacing,
+	// --fps <rate> sets the rate of the cap and implies it, and
+	// --low-latency reads the input as late as the frame allows
+	const FramePacer::PACING_MODE g_DefaultPacingMode = FramePacer::PACING_VSYNC;
+	const double g_DefaultTargetFramesPerSecond = 60.0;
+
+	// --world <folder> walks through a world streamed from disk,
+	// a warehouse is generated there when it holds none yet, and
+	// --world-generate <chunks per side> writes a new one first
+	const int g_DefaultWorldChunksPerSide = 64;
 }
 
 // Function declarations - all functions that are called manually
 // need to be pre-declared at the beginning of the source code.
 bool InitializeGLFW();
 bool InitializeGLEW();
+bool RunStartup();
+int RenderSoftwareFrames(const char* outputPath, int threadCount);
+int RenderBatch(const char* jobsPath, int threadCount);
+std::string GetDefaultAssetPackPath(const char* executablePath);
 
 
 /***********************************************************
@@ -45,43 +143,205 @@ bool InitializeGLEW();
  ***********************************************************/
 int main(int argc, char* argv[])
 {
-	// if GLFW fails initialization, then terminate the application
-	if (InitializeGLFW() == false)
+	// a machine without a GPU renders the scene on the CPU
+	// and never opens a window
+	const char* softwarePath = NULL;
+	int softwareThreads = 0;
+	const char* batchPath = NULL;
+	int batchThreads = 0;
+	const char* packPath = NULL;
+	for (int i = 1; i < argc - 1; i++)
 	{
-		return(EXIT_FAILURE);
+		if (strcmp(argv[i], "--software") == 0)
+		{
+			softwarePath = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--software-threads") == 0)
+		{
+			softwareThreads = atoi(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--batch") == 0)
+		{
+			batchPath = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--batch-threads") == 0)
+		{
+			batchThreads = atoi(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--pack") == 0)
+		{
+			packPath = argv[i + 1];
+		}
 	}
 
-	// try to create a new shader manager object
-	g_ShaderManager = new ShaderManager();
-	// try to create a new view manager object
-	g_ViewManager = new ViewManager(
-		g_ShaderManager);
+	// every loader reads from the pack when there is one, so
+	// only the loose files depend on the working directory
+	std::string assetPackPath = (NULL != packPath) ?
+		std::string(packPath) : GetDefaultAssetPackPath((argc > 0) ? argv[0] : NULL);
+	if (AssetPack::Mount(assetPackPath.c_str()) == false)
+	{
+		std::cout << "INFO: No asset pack at " << assetPackPath << ", loading the loose files" << std::endl;
+	}
 
-	// try to create the main display window
-	g_Window = g_ViewManager->CreateDisplayWindow(WINDOW_TITLE);
+	if (NULL != softwarePath)
+	{
+		return(RenderSoftwareFrames(softwarePath, softwareThreads));
+	}
+	// a batch of catalog shots renders offscreen on every core
+	// and never opens the interactive window
+	if (NULL != batchPath)
+	{
+		return(RenderBatch(batchPath, batchThreads));
+	}
+
+	// none of the managers touch GL when they are created, so
+	// the startup work can use them before the window exists
+	g_ShaderManager = new ShaderManager();
+	g_ViewManager = new ViewManager();
+	g_ShaderCache = new ShaderProgramCache("shadercache");
+	g_ResourceManager = new ResourceManager(g_ShaderCache);
+	g_ShaderPermutations = new ShaderPermutationSet(
+		g_ResourceManager,
+		"shaders/vertexShader.glsl",
+		"shaders/fragmentShader.glsl");
+	g_DynamicResolution = new DynamicResolution();
+	g_SceneManager = new SceneManager(g_ShaderManager, g_ShaderPermutations, g_ResourceManager);
 
-	// if GLEW fails initialization, then terminate the application
-	if (InitializeGLEW() == false)
+	// create the window, build the shaders and load the scene,
+	// overlapping the CPU work with the GL work
+	if (RunStartup() == false)
 	{
 		return(EXIT_FAILURE);
 	}
+	MemoryAccounting::WriteReport(std::cout);
 
-	// load the shader code from the external GLSL files
-	g_ShaderManager->LoadShaders(
-		"../../Utilities/shaders/vertexShader.glsl",
-		"../../Utilities/shaders/fragmentShader.glsl");
-	g_ShaderManager->use();
+	// choose how the frames are paced
+	FramePacer::PACING_MODE pacingMode = g_DefaultPacingMode;
+	double targetFramesPerSecond = g_DefaultTargetFramesPerSecond;
+	bool bPacingGiven = false;
+	bool bLowLatency = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if ((strcmp(argv[i], "--pacing") == 0) && (i < argc - 1))
+		{
+			if (FramePacer::ParseMode(argv[i + 1], pacingMode) == false)
+			{
+				std::cout << "Unknown frame pacing:" << argv[i + 1] << std::endl;
+				pacingMode = g_DefaultPacingMode;
+			}
+			bPacingGiven = true;
+		}
+		else if ((strcmp(argv[i], "--fps") == 0) && (i < argc - 1))
+		{
+			targetFramesPerSecond = atof(argv[i + 1]);
+			if (targetFramesPerSecond <= 0.0)
+			{
+				std::cout << "Invalid target frame rate:" << argv[i + 1] << std::endl;
+				targetFramesPerSecond = g_DefaultTargetFramesPerSecond;
+			}
+			else if (bPacingGiven == false)
+			{
+				pacingMode = FramePacer::PACING_FRAME_CAP;
+			}
+		}
+		else if (strcmp(argv[i], "--low-latency") == 0)
+		{
+			bLowLatency = true;
+		}
+	}
+	g_FramePacer = new FramePacer();
+	g_FramePacer->Configure(pacingMode, targetFramesPerSecond, bLowLatency);
 
-	// try to create a new scene manager object and prepare the 3D scene
-	g_SceneManager = new SceneManager(g_ShaderManager);
-	g_SceneManager->PrepareScene();
+	// start the stress test when it was asked for
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--stress-animated") == 0)
+		{
+			g_SceneManager->SetStressAnimation(true);
+		}
+	}
+	for (int i = 1; i < argc; i++)
+	{
+		bool bGrid = (strcmp(argv[i], "--stress") == 0);
+		bool bRandom = (strcmp(argv[i], "--stress-random") == 0);
+		if ((bGrid == true) || (bRandom == true))
+		{
+			g_StressTest = new StressTest(
+				g_SceneManager,
+				bRandom ? SceneManager::STRESS_RANDOM : SceneManager::STRESS_GRID);
+			for (size_t step = 0; step < sizeof(g_StressTestSteps) / sizeof(g_StressTestSteps[0]); step++)
+			{
+				g_StressTest->AddStep(g_StressTestSteps[step]);
+			}
+			// measure at the full window resolution and without
+			// the frame rate held down by the pacing
+			g_DynamicResolution->SetScaleLimits(1.0f, 1.0f);
+			g_FramePacer->Configure(FramePacer::PACING_UNCAPPED, 0.0, false);
+			break;
+		}
+	}
+	g_FramePacer->Apply(g_Window);
 
-	// loop will keep running until the application is closed 
-	// or until an error has occurred
-	while (!glfwWindowShouldClose(g_Window))
+	// stream a world around the camera when one was passed
+	const char* worldPath = NULL;
+	int worldChunksPerSide = 0;
+	for (int i = 1; i < argc - 1; i++)
+	{
+		if (strcmp(argv[i], "--world") == 0)
+		{
+			worldPath = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--world-generate") == 0)
+		{
+			worldChunksPerSide = atoi(argv[i + 1]);
+		}
+	}
+	if (NULL != worldPath)
 	{
+		if ((worldChunksPerSide > 0) || (ChunkStreamer::HasWorld(worldPath) == false))
+		{
+			ChunkStreamer::WriteWarehouse(worldPath,
+				(worldChunksPerSide > 0) ? worldChunksPerSide : g_DefaultWorldChunksPerSide);
+		}
+
+		g_ChunkStreamer = new ChunkStreamer(g_ResourceManager);
+		if (g_ChunkStreamer->Open(worldPath, ChunkStreamer::GetDefaultSettings()) == true)
+		{
+			g_SceneManager->SetChunkStreamer(g_ChunkStreamer);
+		}
+	}
+
+	// start recording right away when a capture path was passed
+	g_FrameCapture = new FrameCapture();
+	const char* capturePath = g_DefaultCapturePath;
+	for (int i = 1; i < argc - 1; i++)
+	{
+		if (strcmp(argv[i], "--capture") == 0)
+		{
+			capturePath = argv[i + 1];
+			int captureWidth = 0;
+			int captureHeight = 0;
+			glfwGetFramebufferSize(g_Window, &captureWidth, &captureHeight);
+			g_FrameCapture->Start(capturePath, captureWidth, captureHeight, g_CaptureFramesPerSecond);
+			break;
+		}
+	}
+
+	// declare the passes of a frame, the graph orders them and
+	// culls the capture pass while nothing is being recorded
+	int framebufferWidth = 0;
+	int framebufferHeight = 0;
+	g_RenderGraph = new RenderGraph();
+	int sceneColor = g_RenderGraph->ImportTexture("sceneColor", 0);
+	int backbuffer = g_RenderGraph->ImportTexture("backbuffer", 0);
+
+	int scenePass = g_RenderGraph->AddPass("scene", [&framebufferWidth, &framebufferHeight]()
+	{
+		// bind the scaled render target for the scene
+		g_DynamicResolution->BeginFrame(framebufferWidth, framebufferHeight);
+
 		// Enable z-depth
-		glEnable(GL_DEPTH_TEST);
+		g_SceneManager->GetStateCache()->SetEnabled(GL_DEPTH_TEST, true);
 
 		// Clear the frame and z buffers
 		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -89,19 +349,192 @@ int main(int argc, char* argv[])
 
 		// convert from 3D object space to 2D view
 		g_ViewManager->PrepareSceneView();
+		if (g_ViewManager->IsCameraCut() == true)
+		{
+			g_SceneManager->SetCameraCut();
+		}
+		g_SceneManager->SetSceneView(
+			g_ViewManager->GetViewMatrix(),
+			g_ViewManager->GetProjectionMatrix(),
+			g_ViewManager->GetNearPlane(),
+			g_ViewManager->GetFarPlane(),
+			g_DynamicResolution->GetRenderWidth(),
+			g_DynamicResolution->GetRenderHeight());
+		g_SceneManager->SetRenderTargetSize(framebufferWidth, framebufferHeight);
 
 		// refresh the 3D scene
-		g_SceneManager->RenderScene();
+		g_SceneManager->UpdateAnimations(glfwGetTime());
+		if (NULL != g_StressTest)
+		{
+			g_StressTest->RenderFrame();
+			if (g_StressTest->IsFinished() == true)
+			{
+				g_StressTest->WriteReport(std::cout);
+				g_StressTest->WriteJSON(g_StressReportFile);
+				glfwSetWindowShouldClose(g_Window, GLFW_TRUE);
+			}
+		}
+		else
+		{
+			g_SceneManager->RenderScene();
+		}
+	});
+	g_RenderGraph->Write(scenePass, sceneColor);
 
+	// upscale the rendered scene into the window
+	int upscalePass = g_RenderGraph->AddPass("upscale", []()
+	{
+		g_DynamicResolution->EndFrame();
+	});
+	g_RenderGraph->Read(upscalePass, sceneColor);
+	g_RenderGraph->Write(upscalePass, backbuffer);
+	g_RenderGraph->SetSideEffect(upscalePass, true);
 
-		// Flips the the back buffer with the front buffer every frame.
-		glfwSwapBuffers(g_Window);
+	// queue a readback of the finished frame for the recording
+	int capturePass = g_RenderGraph->AddPass("capture", [&framebufferWidth, &framebufferHeight]()
+	{
+		g_FrameCapture->CaptureFrame(framebufferWidth, framebufferHeight, glfwGetTime());
+	});
+	g_RenderGraph->Read(capturePass, backbuffer);
+
+	g_RenderGraph->SetSideEffect(capturePass, g_FrameCapture->IsRecording());
+	g_RenderGraph->Compile();
+	g_RenderGraph->WriteSchedule(std::cout);
+
+	// make the frame counters readable by other processes,
+	// creating the segment allocates so it happens up front
+	PerformanceCounters::Publish();
+
+	int frameCount = 0;
+	double lastMemoryReportTime = -g_MemoryReportInterval;
+	bool bCaptureKeyDown = false;
+	double lastFrameTime = glfwGetTime();
+
+	// loop will keep running until the application is closed 
+	// or until an error has occurred
+	while (!glfwWindowShouldClose(g_Window))
+	{
+		// wait for the slot of the frame, in the low latency mode
+		// this is the wait, so the events below are the newest
+		g_FramePacer->WaitForInput();
 
 		// query the latest GLFW events
 		glfwPollEvents();
+
+		// write the memory accounting out every few seconds, this
+		// is done outside of the frame scope below since the
+		// report itself allocates
+		if (glfwGetTime() - lastMemoryReportTime >= g_MemoryReportInterval)
+		{
+			MemoryAccounting::WriteJSON(g_MemoryReportFile);
+			lastMemoryReportTime = glfwGetTime();
+		}
+		// the arena grows inside a frame, but prints it here
+		g_SceneManager->ReportFrameArenaGrowth(std::cout);
+
+		// start or stop the recording on a press of F9, also
+		// outside of the frame scope since both allocate
+		bool bCaptureKey = (glfwGetKey(g_Window, GLFW_KEY_F9) == GLFW_PRESS);
+		if ((bCaptureKey == true) && (bCaptureKeyDown == false))
+		{
+			if (g_FrameCapture->IsRecording() == true)
+			{
+				g_FrameCapture->Stop();
+			}
+			else
+			{
+				int captureWidth = 0;
+				int captureHeight = 0;
+				glfwGetFramebufferSize(g_Window, &captureWidth, &captureHeight);
+				g_FrameCapture->Start(capturePath, captureWidth, captureHeight, g_CaptureFramesPerSecond);
+			}
+		}
+		bCaptureKeyDown = bCaptureKey;
+
+		// load and drop the world chunks around the camera of the
+		// last frame, outside of the frame scope since it allocates
+		g_SceneManager->UpdateStreaming(g_ViewManager->GetCameraPosition(), g_ViewManager->GetCameraVelocity());
+
+		// rebuild the schedule when passes were turned on or off
+		g_RenderGraph->SetSideEffect(capturePass, g_FrameCapture->IsRecording());
+		if (g_RenderGraph->IsDirty() == true)
+		{
+			g_RenderGraph->Compile();
+		}
+
+		// counts the heap allocations of this frame when the
+		// build defines ENABLE_ALLOCATION_TRACKING
+		AllocationScope frameScope("frame", AllocationTracker::IsEnabled());
+
+		// run the scheduled passes of the frame
+		glfwGetFramebufferSize(g_Window, &framebufferWidth, &framebufferHeight);
+		g_RenderGraph->Execute();
+		// the scene pass recreates its target when the window resizes
+		g_RenderGraph->SetImportedID(sceneColor, g_DynamicResolution->GetColorTexture());
+
+		// Flips the the back buffer with the front buffer every frame.
+		glfwSwapBuffers(g_Window);
+		g_FramePacer->EndFrame();
+
+		// free the GPU resources released during the frame
+		g_ResourceManager->CollectGarbage();
+
+		// publish the counters of the frame, timed from the end
+		// of the previous frame so the whole loop is covered
+		double frameTime = glfwGetTime();
+		PerformanceCounters::EndFrame((frameTime - lastFrameTime) * 1000.0);
+		lastFrameTime = frameTime;
+
+		// once warmed up, rendering a frame must not touch the heap,
+		// the stress test allocates each time the object count grows
+		assert((NULL != g_StressTest) ||
+			(frameCount < g_AllocationWarmupFrames) ||
+			(frameScope.GetStats().allocations == 0));
+		frameCount++;
+	}
+
+	// print the final footprint, the peaks show the worst case
+	MemoryAccounting::WriteReport(std::cout);
+	g_FramePacer->WriteReport(std::cout);
+	if (NULL != g_ChunkStreamer)
+	{
+		g_ChunkStreamer->WriteReport(std::cout);
+	}
+	PerformanceCounters::Shutdown();
+
+	// free the transient targets of the frame passes
+	if (NULL != g_RenderGraph)
+	{
+		delete g_RenderGraph;
+		g_RenderGraph = NULL;
+	}
+
+	// finish the recording while the GL context is still alive
+	if (NULL != g_FrameCapture)
+	{
+		delete g_FrameCapture;
+		g_FrameCapture = NULL;
 	}
 
 	// clear the allocated manager objects from memory
+	if (NULL != g_FramePacer)
+	{
+		delete g_FramePacer;
+		g_FramePacer = NULL;
+	}
+	if (NULL != g_StressTest)
+	{
+		delete g_StressTest;
+		g_StressTest = NULL;
+	}
+	// the streamer stops its loading thread and gives its
+	// textures back before the resource manager goes
+	if (NULL != g_ChunkStreamer)
+	{
+		g_SceneManager->SetChunkStreamer(NULL);
+		delete g_ChunkStreamer;
+		g_ChunkStreamer = NULL;
+	}
 	if (NULL != g_SceneManager)
 	{
 		delete g_SceneManager;
@@ -117,11 +550,300 @@ int main(int argc, char* argv[])
 		delete g_ShaderManager;
 		g_ShaderManager = NULL;
 	}
+	if (NULL != g_ShaderPermutations)
+	{
+		delete g_ShaderPermutations;
+		g_ShaderPermutations = NULL;
+	}
+	if (NULL != g_DynamicResolution)
+	{
+		delete g_DynamicResolution;
+		g_DynamicResolution = NULL;
+	}
+	// the resource manager goes after every handle owner
+	if (NULL != g_ResourceManager)
+	{
+		delete g_ResourceManager;
+		g_ResourceManager = NULL;
+	}
+	if (NULL != g_ShaderCache)
+	{
+		delete g_ShaderCache;
+		g_ShaderCache = NULL;
+	}
 
 	// Terminates the program successfully
 	exit(EXIT_SUCCESS); 
 }
 
+/***********************************************************
+ *	RunStartup()
+ *
+ *  This function is used to load everything the first
+ *  frame needs as a graph of tasks. Decoding the images,
+ *  building the meshes and defining the scene run on worker
+ *  threads from the start, while this thread creates the
+ *  window and then uploads each result as soon as it is
+ *  ready. The shader permutations are all started at once,
+ *  so a driver with parallel compiles builds them together.
+ *  The timeline of the tasks is written at the end.
+ ***********************************************************/
+bool RunStartup()
+{
+	StartupGraph startup(0);
+
+	// CPU only work, started before the window exists - a
+	// failed decode or build is retried and reported by the
+	// load on the GL thread
+	std::vector<int> decodeTasks;
+	for (int i = 0; i < g_SceneManager->GetSceneTextureCount(); i++)
+	{
+		decodeTasks.push_back(startup.AddTask("decode texture " + std::to_string(i), StartupGraph::THREAD_WORKER, [i]()
+		{
+			g_SceneManager->DecodeSceneTexture(i);
+			return(StartupGraph::TASK_DONE);
+		}));
+	}
+
+	std::vector<int> meshTasks;
+	for (int i = 0; i < MeshLibrary::TOTAL_BASIC_MESHES; i++)
+	{
+		SceneManager::MESH_TYPE mesh = (SceneManager::MESH_TYPE)i;
+		meshTasks.push_back(startup.AddTask(std::string("prepare mesh ") + MeshLibrary::GetMeshName((MeshLibrary::BASIC_MESH)i), StartupGraph::THREAD_WORKER, [mesh]()
+		{
+			g_SceneManager->PrepareMesh(mesh);
+			return(StartupGraph::TASK_DONE);
+		}));
+	}
+
+	int sceneData = startup.AddTask("scene data", StartupGraph::THREAD_WORKER, []()
+	{
+		g_SceneManager->PrepareSceneData();
+		return(StartupGraph::TASK_DONE);
+	});
+
+	// the window creates the GL context on this thread, every
+	// following task needs it
+	int window = startup.AddTask("window", StartupGraph::THREAD_CONTEXT, []()
+	{
+		if (InitializeGLFW() == false)
+		{
+			return(StartupGraph::TASK_FAILED);
+		}
+
+		// try to create the main display window
+		g_Window = g_ViewManager->CreateDisplayWindow(WINDOW_TITLE);
+
+		// if GLEW fails initialization, then terminate the application
+		if (InitializeGLEW() == false)
+		{
+			return(StartupGraph::TASK_FAILED);
+		}
+		return(StartupGraph::TASK_DONE);
+	});
+
+	// load the shader programs from the external GLSL files - the
+	// project shaders are needed for the clustered lighting, each
+	// feature combination is compiled into its own program and the
+	// linked binaries are cached to skip compiling next launch
+	int compileShaders = startup.AddTask("compile shaders", StartupGraph::THREAD_CONTEXT, []()
+	{
+		for (unsigned int i = 0; i < ShaderPermutationSet::TOTAL_PERMUTATIONS; i++)
+		{
+			if (ShaderPermutationSet::IsUsefulCombination(i) == true)
+			{
+				g_ShaderPermutations->PrefetchProgram(i);
+			}
+		}
+		return(StartupGraph::TASK_DONE);
+	});
+	startup.AddDependency(compileShaders, window);
+
+	// wait for the driver without blocking the uploads
+	int linkShaders = startup.AddTask("link shaders", StartupGraph::THREAD_CONTEXT, []()
+	{
+		if (g_ShaderPermutations->ArePrefetchedProgramsReady() == false)
+		{
+			return(StartupGraph::TASK_PENDING);
+		}
+
+		for (unsigned int i = 0; i < ShaderPermutationSet::TOTAL_PERMUTATIONS; i++)
+		{
+			if (ShaderPermutationSet::IsUsefulCombination(i) == true)
+			{
+				g_ShaderPermutations->GetProgram(i);
+			}
+		}
+
+		GLuint programID = g_ShaderPermutations->GetProgram(
+			ShaderPermutationSet::FEATURE_TEXTURE |
+			ShaderPermutationSet::FEATURE_LIGHTING);
+		if (0 == programID)
+		{
+			return(StartupGraph::TASK_FAILED);
+		}
+		g_ShaderManager->m_programID = programID;
+		g_ShaderManager->use();
+		return(StartupGraph::TASK_DONE);
+	});
+	startup.AddDependency(linkShaders, compileShaders);
+
+	// the scene is rendered straight into the window when the
+	// upscale program is not available
+	int dynamicResolution = startup.AddTask("dynamic resolution", StartupGraph::THREAD_CONTEXT, []()
+	{
+		g_DynamicResolution->SetFrameTimeBudget(g_FrameTimeBudget);
+		g_DynamicResolution->SetScaleLimits(g_MinResolutionScale, g_MaxResolutionScale);
+		g_DynamicResolution->Initialize(g_ResourceManager, g_UpscaleFilter);
+		return(StartupGraph::TASK_DONE);
+	});
+	startup.AddDependency(dynamicResolution, window);
+
+	// upload each texture and mesh as soon as it is decoded
+	std::vector<int> uploadTasks;
+	for (size_t i = 0; i < decodeTasks.size(); i++)
+	{
+		int index = (int)i;
+		int upload = startup.AddTask("upload texture " + std::to_string(index), StartupGraph::THREAD_CONTEXT, [index]()
+		{
+			g_SceneManager->LoadSceneTexture(index);
+			return(StartupGraph::TASK_DONE);
+		});
+		startup.AddDependency(upload, window);
+		startup.AddDependency(upload, decodeTasks[i]);
+		uploadTasks.push_back(upload);
+	}
+	for (size_t i = 0; i < meshTasks.size(); i++)
+	{
+		SceneManager::MESH_TYPE mesh = (SceneManager::MESH_TYPE)i;
+		int upload = startup.AddTask(std::string("upload mesh ") + MeshLibrary::GetMeshName((MeshLibrary::BASIC_MESH)i), StartupGraph::THREAD_CONTEXT, [mesh]()
+		{
+			g_SceneManager->LoadMesh(mesh);
+			return(StartupGraph::TASK_DONE);
+		});
+		startup.AddDependency(upload, window);
+		startup.AddDependency(upload, meshTasks[i]);
+		uploadTasks.push_back(upload);
+	}
+
+	// finish the scene once everything it uses is loaded
+	int sceneResources = startup.AddTask("scene resources", StartupGraph::THREAD_CONTEXT, []()
+	{
+		g_SceneManager->PrepareSceneResources();
+		// the upscale pass draws into the same context as the scene
+		g_DynamicResolution->SetStateCache(g_SceneManager->GetStateCache());
+		return(StartupGraph::TASK_DONE);
+	});
+	startup.AddDependency(sceneResources, sceneData);
+	startup.AddDependency(sceneResources, linkShaders);
+	startup.AddDependency(sceneResources, dynamicResolution);
+	for (size_t i = 0; i < uploadTasks.size(); i++)
+	{
+		startup.AddDependency(sceneResources, uploadTasks[i]);
+	}
+
+	bool bStarted = startup.Run();
+	startup.WriteTimeline(std::cout);
+
+	return(bStarted);
+}
+
+/***********************************************************
+ *	RenderSoftwareFrames()
+ *
+ *  This function is used to render the scene from the
+ *  starting camera on the CPU, timing a few frames and
+ *  writing the last one into the passed in image file.
+ ***********************************************************/
+int RenderSoftwareFrames(const char* outputPath, int threadCount)
+{
+	SoftwareRasterizer rasterizer(threadCount);
+	if (rasterizer.Resize(g_SoftwareWidth, g_SoftwareHeight) == false)
+	{
+		return(EXIT_FAILURE);
+	}
+
+	// the scene records its draws for the rasterizer, so it
+	// needs no shaders and no GL resources
+	SceneManager scene(NULL, NULL, NULL);
+	scene.SetSoftwareRasterizer(&rasterizer);
+	scene.PrepareScene();
+
+	glm::mat4 view;
+	glm::mat4 projection;
+	float zNear = 0.0f;
+	float zFar = 0.0f;
+	ViewManager::GetDefaultSceneView(
+		g_SoftwareWidth, g_SoftwareHeight, view, projection, zNear, zFar);
+	scene.SetSceneView(
+		view, projection, zNear, zFar, g_SoftwareWidth, g_SoftwareHeight);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; i < g_SoftwareFrames; i++)
+	{
+		scene.UpdateAnimations(0.0);
+		scene.RenderScene();
+	}
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+	std::cout << "INFO: Software rendered " << g_SoftwareWidth << "x" << g_SoftwareHeight
+		<< " in " << (elapsed.count() / g_SoftwareFrames) << " ms per frame on "
+		<< rasterizer.GetThreadCount() << " threads" << std::endl;
+
+	if (rasterizer.WriteImage(outputPath) == false)
+	{
+		return(EXIT_FAILURE);
+	}
+	return(EXIT_SUCCESS);
+}
+
+/***********************************************************
+ *	RenderBatch()
+ *
+ *  This function is used to render every camera view in
+ *  the passed in job list into its image file, with one
+ *  offscreen GL context per worker thread, and to report
+ *  the throughput.
+ ***********************************************************/
+int RenderBatch(const char* jobsPath, int threadCount)
+{
+	BatchRenderer batch(threadCount, g_BatchWidth, g_BatchHeight);
+	if (batch.LoadJobs(jobsPath) == false)
+	{
+		return(EXIT_FAILURE);
+	}
+
+	if (InitializeGLFW() == false)
+	{
+		return(EXIT_FAILURE);
+	}
+
+	bool bRendered = batch.Run();
+	batch.WriteReport(std::cout);
+	glfwTerminate();
+
+	return((bRendered == true) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/***********************************************************
+ *	GetDefaultAssetPackPath()
+ *
+ *  This function is used to get the path of the asset pack
+ *  in the directory of the executable, from the path the
+ *  program was started with.
+ ***********************************************************/
+std::string GetDefaultAssetPackPath(const char* executablePath)
+{
+	std::string path = (NULL != executablePath) ? executablePath : "";
+	size_t separator = path.find_last_of("/\\");
+	if (separator == std::string::npos)
+	{
+		return(g_DefaultAssetPackName);
+	}
+
+	return(path.substr(0, separator + 1) + g_DefaultAssetPackName);
+}
+
 /***********************************************************
  *	InitializeGLFW()
  * 
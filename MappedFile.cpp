@@ -0,0 +1,168 @@
+///////////////////////////////////////////////////////////////////////////////
+// mappedfile.cpp
+// ============
+// map a whole file read-only into memory
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/***********************************************************
+ *  MappedFile()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+MappedFile::MappedFile()
+{
+	m_data = NULL;
+	m_size = 0;
+#ifdef _WIN32
+	m_fileHandle = NULL;
+	m_mappingHandle = NULL;
+#else
+	m_fileDescriptor = -1;
+#endif
+}
+
+/***********************************************************
+ *  ~MappedFile()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+/***********************************************************
+ *  Open()
+ *
+ *  This method is used for mapping the passed in file
+ *  read-only. Empty files cannot be mapped and fail.
+ ***********************************************************/
+bool MappedFile::Open(const char* filename)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(
+		filename,
+		GENERIC_READ,
+		FILE_SHARE_READ,
+		NULL,
+		OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL,
+		NULL);
+	if (INVALID_HANDLE_VALUE == file)
+	{
+		return(false);
+	}
+
+	LARGE_INTEGER fileSize;
+	if ((GetFileSizeEx(file, &fileSize) == FALSE) || (fileSize.QuadPart <= 0))
+	{
+		CloseHandle(file);
+		return(false);
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (NULL == mapping)
+	{
+		CloseHandle(file);
+		return(false);
+	}
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (NULL == view)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return(false);
+	}
+
+	m_fileHandle = file;
+	m_mappingHandle = mapping;
+	m_data = static_cast<const unsigned char*>(view);
+	m_size = (size_t)fileSize.QuadPart;
+#else
+	int fileDescriptor = open(filename, O_RDONLY);
+	if (fileDescriptor < 0)
+	{
+		return(false);
+	}
+
+	struct stat fileStatus;
+	if ((fstat(fileDescriptor, &fileStatus) != 0) || (fileStatus.st_size <= 0))
+	{
+		close(fileDescriptor);
+		return(false);
+	}
+
+	void* view = mmap(NULL, (size_t)fileStatus.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	if (MAP_FAILED == view)
+	{
+		close(fileDescriptor);
+		return(false);
+	}
+
+	m_fileDescriptor = fileDescriptor;
+	m_data = static_cast<const unsigned char*>(view);
+	m_size = (size_t)fileStatus.st_size;
+#endif
+
+	return(true);
+}
+
+/***********************************************************
+ *  Close()
+ *
+ *  This method is used for unmapping the file. Pointers
+ *  into the mapped data are invalid afterwards.
+ ***********************************************************/
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (NULL != m_data)
+	{
+		UnmapViewOfFile(m_data);
+	}
+	if (NULL != m_mappingHandle)
+	{
+		CloseHandle(m_mappingHandle);
+	}
+	if (NULL != m_fileHandle)
+	{
+		CloseHandle(m_fileHandle);
+	}
+	m_fileHandle = NULL;
+	m_mappingHandle = NULL;
+#else
+	if (NULL != m_data)
+	{
+		munmap(const_cast<unsigned char*>(m_data), m_size);
+	}
+	if (m_fileDescriptor >= 0)
+	{
+		close(m_fileDescriptor);
+	}
+	m_fileDescriptor = -1;
+#endif
+
+	m_data = NULL;
+	m_size = 0;
+}
@@ -0,0 +1,57 @@
+///////////////////////////////////////////////////////////////////////////////
+// mappedfile.h
+// ============
+// map a whole file read-only into memory
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+
+/***********************************************************
+ *  MappedFile
+ *
+ *  This class is used for reading a file through the
+ *  virtual memory system instead of copying it into a
+ *  buffer. Pages are only loaded when they are touched and
+ *  are shared with the OS file cache.
+ ***********************************************************/
+class MappedFile
+{
+public:
+	// constructor
+	MappedFile();
+	// destructor
+	~MappedFile();
+
+private:
+	// start and size of the mapped view
+	const unsigned char* m_data;
+	size_t m_size;
+#ifdef _WIN32
+	// file and mapping handles
+	void* m_fileHandle;
+	void* m_mappingHandle;
+#else
+	// file descriptor
+	int m_fileDescriptor;
+#endif
+
+	// disable copying, the object owns the mapping
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+public:
+	// map the file, closing any previously mapped file
+	bool Open(const char* filename);
+	// unmap the file
+	void Close();
+
+	// check whether a file is mapped
+	bool IsOpen() const { return (NULL != m_data); }
+	// get the mapped bytes
+	const unsigned char* GetData() const { return m_data; }
+	// get the number of mapped bytes
+	size_t GetSize() const { return m_size; }
+};
@@ -0,0 +1,316 @@
+///////////////////////////////////////////////////////////////////////////////
+// memoryaccounting.cpp
+// ============
+// track GPU and CPU memory use by resource category and tag
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "MemoryAccounting.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+
+// declaration of global variables
+namespace
+{
+	// current and peak bytes of one category or tag
+	struct MEMORY_USAGE
+	{
+		long long bytes;
+		long long peakBytes;
+
+		MEMORY_USAGE() : bytes(0), peakBytes(0) {}
+	};
+
+	// names of the categories used in the reports
+	const char* g_CategoryNames[MemoryAccounting::TOTAL_CATEGORIES] =
+	{
+		"texture",
+		"vertexBuffer",
+		"indexBuffer",
+		"uniformBuffer",
+		"storageBuffer",
+		"cpuStaging",
+		"streamedData"
+	};
+
+	// guards all of the accounting data below
+	std::mutex g_AccountingMutex;
+	MEMORY_USAGE g_Total;
+	MEMORY_USAGE g_Categories[MemoryAccounting::TOTAL_CATEGORIES];
+	// usage per tag, looked up with the tag text itself so
+	// accounting a known tag never builds a string
+	typedef std::map<std::string, MEMORY_USAGE, std::less<> > TAG_USAGE_MAP;
+	TAG_USAGE_MAP g_Tags[MemoryAccounting::TOTAL_CATEGORIES];
+
+	/***********************************************************
+	 *  ApplyChange()
+	 *
+	 *  This function is used for adding a signed change to a
+	 *  usage record and raising its peak when needed.
+	 ***********************************************************/
+	void ApplyChange(MEMORY_USAGE& usage, long long bytes)
+	{
+		usage.bytes += bytes;
+		usage.peakBytes = std::max(usage.peakBytes, usage.bytes);
+	}
+
+	/***********************************************************
+	 *  RecordChange()
+	 *
+	 *  This function is used for applying a change to the
+	 *  tag, its category and the total.
+	 ***********************************************************/
+	void RecordChange(MemoryAccounting::MEMORY_CATEGORY category, const char* tag, long long bytes)
+	{
+		if ((category < 0) || (category >= MemoryAccounting::TOTAL_CATEGORIES) || (0 == bytes))
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(g_AccountingMutex);
+
+		// only the first change of a tag inserts it
+		const char* tagName = (NULL != tag) ? tag : "untagged";
+		TAG_USAGE_MAP::iterator usage = g_Tags[category].find(tagName);
+		if (usage == g_Tags[category].end())
+		{
+			usage = g_Tags[category].insert(std::make_pair(std::string(tagName), MEMORY_USAGE())).first;
+		}
+		ApplyChange(usage->second, bytes);
+		ApplyChange(g_Categories[category], bytes);
+		ApplyChange(g_Total, bytes);
+	}
+
+	/***********************************************************
+	 *  WriteJSONString()
+	 *
+	 *  This function is used for writing a quoted JSON string,
+	 *  escaping the characters that file paths may contain.
+	 ***********************************************************/
+	void WriteJSONString(std::ostream& output, const std::string& text)
+	{
+		output << '"';
+		for (size_t i = 0; i < text.size(); i++)
+		{
+			char character = text[i];
+			if ((character == '"') || (character == '\\'))
+			{
+				output << '\\' << character;
+			}
+			else if ((unsigned char)character < 0x20)
+			{
+				output << ' ';
+			}
+			else
+			{
+				output << character;
+			}
+		}
+		output << '"';
+	}
+}
+
+/***********************************************************
+ *  Allocate()
+ *
+ *  This function is used for adding memory that was
+ *  allocated for the passed in category and tag.
+ ***********************************************************/
+void MemoryAccounting::Allocate(MEMORY_CATEGORY category, const char* tag, long long bytes)
+{
+	RecordChange(category, tag, bytes);
+}
+
+/***********************************************************
+ *  Free()
+ *
+ *  This function is used for removing memory that was
+ *  freed for the passed in category and tag.
+ ***********************************************************/
+void MemoryAccounting::Free(MEMORY_CATEGORY category, const char* tag, long long bytes)
+{
+	RecordChange(category, tag, -bytes);
+}
+
+/***********************************************************
+ *  GetCategoryBytes()
+ *
+ *  This function is used for getting the bytes currently
+ *  used by the passed in category.
+ ***********************************************************/
+long long MemoryAccounting::GetCategoryBytes(MEMORY_CATEGORY category)
+{
+	if ((category < 0) || (category >= TOTAL_CATEGORIES))
+	{
+		return(0);
+	}
+
+	std::lock_guard<std::mutex> lock(g_AccountingMutex);
+	return(g_Categories[category].bytes);
+}
+
+/***********************************************************
+ *  GetCategoryPeakBytes()
+ *
+ *  This function is used for getting the high-water mark
+ *  of the passed in category.
+ ***********************************************************/
+long long MemoryAccounting::GetCategoryPeakBytes(MEMORY_CATEGORY category)
+{
+	if ((category < 0) || (category >= TOTAL_CATEGORIES))
+	{
+		return(0);
+	}
+
+	std::lock_guard<std::mutex> lock(g_AccountingMutex);
+	return(g_Categories[category].peakBytes);
+}
+
+/***********************************************************
+ *  GetTotalBytes()
+ *
+ *  This function is used for getting the bytes currently
+ *  used by all of the categories together.
+ ***********************************************************/
+long long MemoryAccounting::GetTotalBytes()
+{
+	std::lock_guard<std::mutex> lock(g_AccountingMutex);
+	return(g_Total.bytes);
+}
+
+/***********************************************************
+ *  GetTotalPeakBytes()
+ *
+ *  This function is used for getting the high-water mark
+ *  of all of the categories together.
+ ***********************************************************/
+long long MemoryAccounting::GetTotalPeakBytes()
+{
+	std::lock_guard<std::mutex> lock(g_AccountingMutex);
+	return(g_Total.peakBytes);
+}
+
+/***********************************************************
+ *  CalculateTextureBytes()
+ *
+ *  This function is used for calculating the size of a 2D
+ *  texture. With mipmaps every level down to 1x1 is added,
+ *  halving each dimension per level.
+ ***********************************************************/
+long long MemoryAccounting::CalculateTextureBytes(int width, int height, int bytesPerTexel, bool bMipmapped)
+{
+	long long bytes = 0;
+
+	while ((width > 0) && (height > 0))
+	{
+		bytes += (long long)width * height * bytesPerTexel;
+
+		if ((bMipmapped == false) || ((width == 1) && (height == 1)))
+		{
+			break;
+		}
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+
+	return(bytes);
+}
+
+/***********************************************************
+ *  WriteReport()
+ *
+ *  This function is used for printing the current and peak
+ *  bytes of every category, followed by its tags.
+ ***********************************************************/
+void MemoryAccounting::WriteReport(std::ostream& output)
+{
+	std::lock_guard<std::mutex> lock(g_AccountingMutex);
+
+	output << "MEMORY: total " << g_Total.bytes << " bytes, peak " << g_Total.peakBytes << " bytes" << std::endl;
+	for (int i = 0; i < TOTAL_CATEGORIES; i++)
+	{
+		if (g_Categories[i].peakBytes == 0)
+		{
+			continue;
+		}
+
+		output << "  " << g_CategoryNames[i] << ": " << g_Categories[i].bytes
+			<< " bytes, peak " << g_Categories[i].peakBytes << " bytes" << std::endl;
+
+		TAG_USAGE_MAP::const_iterator tag = g_Tags[i].begin();
+		for (; tag != g_Tags[i].end(); ++tag)
+		{
+			output << "    " << tag->first << ": " << tag->second.bytes
+				<< " bytes, peak " << tag->second.peakBytes << " bytes" << std::endl;
+		}
+	}
+}
+
+/***********************************************************
+ *  WriteJSON()
+ *
+ *  This function is used for writing the full accounting
+ *  into a JSON file. The file is written under a temporary
+ *  name and then renamed, so a tool polling the file never
+ *  reads a half written report.
+ ***********************************************************/
+bool MemoryAccounting::WriteJSON(const char* filename)
+{
+	std::string path = filename;
+	std::string tempPath = path + ".tmp";
+
+	std::ofstream file(tempPath.c_str(), std::ios::out | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Could not write memory report:" << path << std::endl;
+		return(false);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(g_AccountingMutex);
+
+		file << "{\n";
+		file << "  \"totalBytes\": " << g_Total.bytes << ",\n";
+		file << "  \"peakTotalBytes\": " << g_Total.peakBytes << ",\n";
+		file << "  \"categories\": [\n";
+		for (int i = 0; i < TOTAL_CATEGORIES; i++)
+		{
+			file << "    { \"name\": \"" << g_CategoryNames[i] << "\", \"bytes\": " << g_Categories[i].bytes
+				<< ", \"peakBytes\": " << g_Categories[i].peakBytes << ", \"tags\": [";
+
+			TAG_USAGE_MAP::const_iterator tag = g_Tags[i].begin();
+			for (; tag != g_Tags[i].end(); ++tag)
+			{
+				file << ((tag == g_Tags[i].begin()) ? "\n" : ",\n");
+				file << "      { \"tag\": ";
+				WriteJSONString(file, tag->first);
+				file << ", \"bytes\": " << tag->second.bytes << ", \"peakBytes\": " << tag->second.peakBytes << " }";
+			}
+
+			file << (g_Tags[i].empty() ? "] }" : "\n    ] }");
+			file << (((i + 1) < TOTAL_CATEGORIES) ? ",\n" : "\n");
+		}
+		file << "  ]\n";
+		file << "}\n";
+	}
+
+	file.close();
+	bool bWritten = !file.fail();
+
+	remove(path.c_str());
+	if ((bWritten == false) || (rename(tempPath.c_str(), path.c_str()) != 0))
+	{
+		remove(tempPath.c_str());
+		std::cout << "Could not write memory report:" << path << std::endl;
+		return(false);
+	}
+
+	return(true);
+}
@@ -0,0 +1,57 @@
+///////////////////////////////////////////////////////////////////////////////
+// memoryaccounting.h
+// ============
+// track GPU and CPU memory use by resource category and tag
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <ostream>
+
+/***********************************************************
+ *  Memory accounting
+ *
+ *  Code that creates, grows or frees a memory resource
+ *  reports the change in bytes under a category and a tag,
+ *  usually the file or buffer name. The totals, current and
+ *  peak, can be printed or written as JSON at any time.
+ *  All functions are safe to call from any thread.
+ ***********************************************************/
+namespace MemoryAccounting
+{
+	// kinds of memory that are accounted separately
+	enum MEMORY_CATEGORY
+	{
+		CATEGORY_TEXTURE,			// texture levels including mipmaps
+		CATEGORY_VERTEX_BUFFER,
+		CATEGORY_INDEX_BUFFER,
+		CATEGORY_UNIFORM_BUFFER,
+		CATEGORY_STORAGE_BUFFER,
+		CATEGORY_CPU_STAGING,		// CPU copies used while loading or uploading
+		CATEGORY_STREAMED_DATA,		// world chunks held around the camera
+		TOTAL_CATEGORIES
+	};
+
+	// add memory that was allocated for the tag
+	void Allocate(MEMORY_CATEGORY category, const char* tag, long long bytes);
+	// remove memory that was freed for the tag
+	void Free(MEMORY_CATEGORY category, const char* tag, long long bytes);
+
+	// get the bytes currently used by a category
+	long long GetCategoryBytes(MEMORY_CATEGORY category);
+	// get the most bytes a category used at one time
+	long long GetCategoryPeakBytes(MEMORY_CATEGORY category);
+	// get the bytes currently used by all categories
+	long long GetTotalBytes();
+	// get the most bytes used by all categories at one time
+	long long GetTotalPeakBytes();
+
+	// calculate the size of a 2D texture and its mipmap chain
+	long long CalculateTextureBytes(int width, int height, int bytesPerTexel, bool bMipmapped);
+
+	// print a readable summary with the per-tag breakdown
+	void WriteReport(std::ostream& output);
+	// write the full accounting into a JSON file
+	bool WriteJSON(const char* filename);
+}
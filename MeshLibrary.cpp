@@ -0,0 +1,1143 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshlibrary.cpp
+// ============
+// generate, optimize, quantize and cache the basic scene meshes
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "MeshLibrary.h"
+#include "MeshOptimizer.h"
+#include "MappedFile.h"
+#include "AssetPack.h"
+#include "ShaderCache.h"
+
+#include <glm/gtx/transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// declaration of global variables
+namespace
+{
+	const float g_Pi = 3.14159265358979f;
+
+	// identifies a packed mesh file, "SMSH" in little endian
+	const unsigned int g_MeshFileMagic = 0x48534D53;
+	// bumped whenever the generators or the packing change
+	const unsigned int g_MeshFileVersion = 2;
+	// cache size used for the optimization report
+	const int g_ReportCacheSize = 16;
+	// stride for touching the pages of a mapped cache file
+	const size_t g_PageSize = 4096;
+
+	// tessellation of the curved meshes
+	const int g_SphereStacks = 30;
+	const int g_SphereSectors = 30;
+	const int g_CircleSectors = 36;
+	const int g_TorusMainSegments = 30;
+	const int g_TorusTubeSegments = 30;
+	const float g_TorusMainRadius = 1.0f;
+	const float g_TorusTubeRadius = 0.1f;
+
+	// empty border around each lightmap chart, as a fraction of
+	// its cell, so bilinear filtering never mixes two charts
+	const float g_LightmapChartPadding = 0.05f;
+
+	const char* g_MeshNames[MeshLibrary::TOTAL_BASIC_MESHES] =
+	{
+		"plane",
+		"sphere",
+		"halfSphere",
+		"torus",
+		"cylinder",
+		"cone",
+		"box"
+	};
+
+	// full precision vertex used while building a mesh
+	struct MESH_VERTEX
+	{
+		glm::vec3 position;
+		glm::vec3 normal;
+		glm::vec2 textureCoordinate;
+		glm::vec2 lightmapCoordinate;
+	};
+
+	// packed vertex stored in the cache and uploaded to the GPU
+	struct PACKED_VERTEX
+	{
+		unsigned short position[3];
+		unsigned short padding;
+		short normal[2];
+		unsigned short textureCoordinate[2];
+		unsigned short lightmapCoordinate[2];
+	};
+
+	// header at the start of every packed mesh file
+	struct MESH_FILE_HEADER
+	{
+		unsigned int magic;
+		unsigned int version;
+		unsigned long long key;
+		unsigned int vertexCount;
+		unsigned int indexCount;
+		unsigned int indexSize;			// 2 or 4 bytes
+		float boundsMin[3];
+		float boundsMax[3];
+		float dequantizeOffset[3];
+		float dequantizeScale[3];
+	};
+
+	/***********************************************************
+	 *  AddVertex()
+	 *
+	 *  This function is used for appending a vertex to a mesh
+	 *  and returning its index.
+	 ***********************************************************/
+	unsigned int AddVertex(
+		std::vector<MESH_VERTEX>& vertices,
+		const glm::vec3& position,
+		const glm::vec3& normal,
+		const glm::vec2& textureCoordinate)
+	{
+		MESH_VERTEX vertex;
+		vertex.position = position;
+		vertex.normal = normal;
+		vertex.textureCoordinate = textureCoordinate;
+		vertex.lightmapCoordinate = glm::vec2(0.0f);
+		vertices.push_back(vertex);
+
+		return((unsigned int)(vertices.size() - 1));
+	}
+
+	/***********************************************************
+	 *  AddTriangle()
+	 *
+	 *  This function is used for appending a counter-clockwise
+	 *  triangle to a mesh.
+	 ***********************************************************/
+	void AddTriangle(std::vector<unsigned int>& indices, unsigned int a, unsigned int b, unsigned int c)
+	{
+		indices.push_back(a);
+		indices.push_back(b);
+		indices.push_back(c);
+	}
+
+	/***********************************************************
+	 *  AddQuad()
+	 *
+	 *  This function is used for appending a flat quad around
+	 *  a center, spanned by two half-axes whose cross product
+	 *  points along the normal.
+	 ***********************************************************/
+	void AddQuad(
+		std::vector<MESH_VERTEX>& vertices,
+		std::vector<unsigned int>& indices,
+		const glm::vec3& center,
+		const glm::vec3& uAxis,
+		const glm::vec3& vAxis)
+	{
+		glm::vec3 normal = glm::normalize(glm::cross(uAxis, vAxis));
+
+		unsigned int first = AddVertex(vertices, center - uAxis - vAxis, normal, glm::vec2(0.0f, 0.0f));
+		AddVertex(vertices, center + uAxis - vAxis, normal, glm::vec2(1.0f, 0.0f));
+		AddVertex(vertices, center + uAxis + vAxis, normal, glm::vec2(1.0f, 1.0f));
+		AddVertex(vertices, center - uAxis + vAxis, normal, glm::vec2(0.0f, 1.0f));
+
+		AddTriangle(indices, first, first + 1, first + 2);
+		AddTriangle(indices, first, first + 2, first + 3);
+	}
+
+	/***********************************************************
+	 *  AddDisk()
+	 *
+	 *  This function is used for appending a flat circular cap
+	 *  of radius 1 at the passed in height, facing up or down.
+	 ***********************************************************/
+	void AddDisk(
+		std::vector<MESH_VERTEX>& vertices,
+		std::vector<unsigned int>& indices,
+		float height,
+		bool bFacingUp)
+	{
+		glm::vec3 normal(0.0f, bFacingUp ? 1.0f : -1.0f, 0.0f);
+		unsigned int center = AddVertex(vertices, glm::vec3(0.0f, height, 0.0f), normal, glm::vec2(0.5f, 0.5f));
+
+		for (int i = 0; i <= g_CircleSectors; i++)
+		{
+			float angle = (2.0f * g_Pi * i) / g_CircleSectors;
+			float x = std::cos(angle);
+			float z = -std::sin(angle);
+			AddVertex(vertices, glm::vec3(x, height, z), normal, glm::vec2(0.5f + (0.5f * x), 0.5f - (0.5f * z)));
+		}
+
+		for (int i = 0; i < g_CircleSectors; i++)
+		{
+			unsigned int current = center + 1 + i;
+			if (bFacingUp == true)
+			{
+				AddTriangle(indices, center, current, current + 1);
+			}
+			else
+			{
+				AddTriangle(indices, center, current + 1, current);
+			}
+		}
+	}
+
+	/***********************************************************
+	 *  GenerateSphere()
+	 *
+	 *  This function is used for generating a sphere of radius
+	 *  1 around the origin, or only its upper half closed by a
+	 *  cap at y = 0.
+	 ***********************************************************/
+	void GenerateSphere(
+		std::vector<MESH_VERTEX>& vertices,
+		std::vector<unsigned int>& indices,
+		bool bUpperHalfOnly)
+	{
+		int stacks = (bUpperHalfOnly == true) ? (g_SphereStacks / 2) : g_SphereStacks;
+
+		for (int i = 0; i <= stacks; i++)
+		{
+			float polar = (g_Pi * i) / g_SphereStacks;
+			float y = std::cos(polar);
+			float ringRadius = std::sin(polar);
+
+			for (int j = 0; j <= g_SphereSectors; j++)
+			{
+				float angle = (2.0f * g_Pi * j) / g_SphereSectors;
+				glm::vec3 position(ringRadius * std::cos(angle), y, -ringRadius * std::sin(angle));
+				AddVertex(
+					vertices,
+					position,
+					position,
+					glm::vec2((float)j / g_SphereSectors, 1.0f - ((float)i / g_SphereStacks)));
+			}
+		}
+
+		for (int i = 0; i < stacks; i++)
+		{
+			unsigned int upper = i * (g_SphereSectors + 1);
+			unsigned int lower = upper + g_SphereSectors + 1;
+
+			for (int j = 0; j < g_SphereSectors; j++, upper++, lower++)
+			{
+				// the rings at the poles collapse into a point
+				if (i != 0)
+				{
+					AddTriangle(indices, upper, lower, upper + 1);
+				}
+				if (i != (g_SphereStacks - 1))
+				{
+					AddTriangle(indices, upper + 1, lower, lower + 1);
+				}
+			}
+		}
+
+		if (bUpperHalfOnly == true)
+		{
+			AddDisk(vertices, indices, 0.0f, false);
+		}
+	}
+
+	/***********************************************************
+	 *  GenerateCylinder()
+	 *
+	 *  This function is used for generating a closed cylinder
+	 *  of radius 1 from y = 0 to y = 1.
+	 ***********************************************************/
+	void GenerateCylinder(std::vector<MESH_VERTEX>& vertices, std::vector<unsigned int>& indices)
+	{
+		unsigned int first = (unsigned int)vertices.size();
+
+		for (int i = 0; i <= g_CircleSectors; i++)
+		{
+			float angle = (2.0f * g_Pi * i) / g_CircleSectors;
+			glm::vec3 normal(std::cos(angle), 0.0f, -std::sin(angle));
+			float u = (float)i / g_CircleSectors;
+			AddVertex(vertices, glm::vec3(normal.x, 0.0f, normal.z), normal, glm::vec2(u, 0.0f));
+			AddVertex(vertices, glm::vec3(normal.x, 1.0f, normal.z), normal, glm::vec2(u, 1.0f));
+		}
+
+		for (int i = 0; i < g_CircleSectors; i++)
+		{
+			unsigned int bottom = first + (i * 2);
+			unsigned int top = bottom + 1;
+			AddTriangle(indices, bottom, bottom + 2, top);
+			AddTriangle(indices, bottom + 2, top + 2, top);
+		}
+
+		AddDisk(vertices, indices, 1.0f, true);
+		AddDisk(vertices, indices, 0.0f, false);
+	}
+
+	/***********************************************************
+	 *  GenerateCone()
+	 *
+	 *  This function is used for generating a closed cone with
+	 *  a base of radius 1 at y = 0 and the tip at y = 1. The
+	 *  base ring is shared by neighbouring side triangles, but
+	 *  each one gets its own tip vertex so the normals along
+	 *  the slope stay smooth.
+	 ***********************************************************/
+	void GenerateCone(std::vector<MESH_VERTEX>& vertices, std::vector<unsigned int>& indices)
+	{
+		unsigned int firstBase = (unsigned int)vertices.size();
+
+		// the slope is 45 degrees, so the normals lean up by half
+		for (int i = 0; i <= g_CircleSectors; i++)
+		{
+			float angle = (2.0f * g_Pi * i) / g_CircleSectors;
+			AddVertex(
+				vertices,
+				glm::vec3(std::cos(angle), 0.0f, -std::sin(angle)),
+				glm::normalize(glm::vec3(std::cos(angle), 1.0f, -std::sin(angle))),
+				glm::vec2((float)i / g_CircleSectors, 0.0f));
+		}
+
+		for (int i = 0; i < g_CircleSectors; i++)
+		{
+			float middleAngle = (2.0f * g_Pi * (i + 0.5f)) / g_CircleSectors;
+			unsigned int tip = AddVertex(
+				vertices,
+				glm::vec3(0.0f, 1.0f, 0.0f),
+				glm::normalize(glm::vec3(std::cos(middleAngle), 1.0f, -std::sin(middleAngle))),
+				glm::vec2((i + 0.5f) / g_CircleSectors, 1.0f));
+
+			AddTriangle(indices, firstBase + i, firstBase + i + 1, tip);
+		}
+
+		AddDisk(vertices, indices, 0.0f, false);
+	}
+
+	/***********************************************************
+	 *  GenerateTorus()
+	 *
+	 *  This function is used for generating a torus around the
+	 *  Z axis, lying in the XY plane.
+	 ***********************************************************/
+	void GenerateTorus(std::vector<MESH_VERTEX>& vertices, std::vector<unsigned int>& indices)
+	{
+		for (int i = 0; i <= g_TorusMainSegments; i++)
+		{
+			float mainAngle = (2.0f * g_Pi * i) / g_TorusMainSegments;
+			glm::vec3 ringCenter(g_TorusMainRadius * std::cos(mainAngle), g_TorusMainRadius * std::sin(mainAngle), 0.0f);
+
+			for (int j = 0; j <= g_TorusTubeSegments; j++)
+			{
+				float tubeAngle = (2.0f * g_Pi * j) / g_TorusTubeSegments;
+				glm::vec3 normal(
+					std::cos(tubeAngle) * std::cos(mainAngle),
+					std::cos(tubeAngle) * std::sin(mainAngle),
+					std::sin(tubeAngle));
+				AddVertex(
+					vertices,
+					ringCenter + (normal * g_TorusTubeRadius),
+					normal,
+					glm::vec2((float)i / g_TorusMainSegments, (float)j / g_TorusTubeSegments));
+			}
+		}
+
+		for (int i = 0; i < g_TorusMainSegments; i++)
+		{
+			unsigned int current = i * (g_TorusTubeSegments + 1);
+			unsigned int next = current + g_TorusTubeSegments + 1;
+
+			for (int j = 0; j < g_TorusTubeSegments; j++, current++, next++)
+			{
+				AddTriangle(indices, current, next, current + 1);
+				AddTriangle(indices, current + 1, next, next + 1);
+			}
+		}
+	}
+
+	/***********************************************************
+	 *  FindChartRoot()
+	 *
+	 *  This function is used for finding the vertex that
+	 *  represents the chart of a vertex, shortening the path
+	 *  on the way.
+	 ***********************************************************/
+	unsigned int FindChartRoot(std::vector<unsigned int>& parents, unsigned int vertex)
+	{
+		while (parents[vertex] != vertex)
+		{
+			parents[vertex] = parents[parents[vertex]];
+			vertex = parents[vertex];
+		}
+
+		return(vertex);
+	}
+
+	/***********************************************************
+	 *  GenerateLightmapCoordinates()
+	 *
+	 *  This function is used for giving every vertex a unique
+	 *  place in a lightmap. The generators never share
+	 *  vertices between the parts they add, like the faces of
+	 *  the box or the caps of the cylinder, and the texture
+	 *  coordinates inside each part already cover the unit
+	 *  square without overlapping. So each connected part
+	 *  becomes a chart, and the charts are laid out in a grid
+	 *  with a padded cell each.
+	 ***********************************************************/
+	void GenerateLightmapCoordinates(std::vector<MESH_VERTEX>& vertices, const std::vector<unsigned int>& indices)
+	{
+		std::vector<unsigned int> parents(vertices.size());
+		for (size_t i = 0; i < parents.size(); i++)
+		{
+			parents[i] = (unsigned int)i;
+		}
+
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			unsigned int a = FindChartRoot(parents, indices[i]);
+			unsigned int b = FindChartRoot(parents, indices[i + 1]);
+			unsigned int c = FindChartRoot(parents, indices[i + 2]);
+			parents[b] = a;
+			parents[c] = a;
+		}
+
+		// number the charts in the order of their first vertex
+		std::vector<int> chartOfRoot(vertices.size(), -1);
+		std::vector<int> charts(vertices.size());
+		int chartCount = 0;
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			unsigned int root = FindChartRoot(parents, (unsigned int)i);
+			if (chartOfRoot[root] < 0)
+			{
+				chartOfRoot[root] = chartCount++;
+			}
+			charts[i] = chartOfRoot[root];
+		}
+
+		int columns = std::max(1, (int)std::ceil(std::sqrt((float)chartCount)));
+		int rows = std::max(1, (chartCount + columns - 1) / columns);
+		float inner = 1.0f - (2.0f * g_LightmapChartPadding);
+
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			glm::vec2 local = glm::clamp(vertices[i].textureCoordinate, glm::vec2(0.0f), glm::vec2(1.0f));
+			glm::vec2 cell((float)(charts[i] % columns), (float)(charts[i] / columns));
+			vertices[i].lightmapCoordinate =
+				(cell + glm::vec2(g_LightmapChartPadding) + (local * inner)) / glm::vec2((float)columns, (float)rows);
+		}
+	}
+
+	/***********************************************************
+	 *  GenerateMesh()
+	 *
+	 *  This function is used for generating the full precision
+	 *  geometry of a basic mesh, with its lightmap layout.
+	 ***********************************************************/
+	void GenerateMesh(
+		MeshLibrary::BASIC_MESH mesh,
+		std::vector<MESH_VERTEX>& vertices,
+		std::vector<unsigned int>& indices)
+	{
+		switch (mesh)
+		{
+		case MeshLibrary::MESH_PLANE:
+			// 2 x 2 units in the XZ plane, facing up
+			AddQuad(vertices, indices, glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+			break;
+		case MeshLibrary::MESH_SPHERE:
+			GenerateSphere(vertices, indices, false);
+			break;
+		case MeshLibrary::MESH_HALF_SPHERE:
+			GenerateSphere(vertices, indices, true);
+			break;
+		case MeshLibrary::MESH_TORUS:
+			GenerateTorus(vertices, indices);
+			break;
+		case MeshLibrary::MESH_CYLINDER:
+			GenerateCylinder(vertices, indices);
+			break;
+		case MeshLibrary::MESH_CONE:
+			GenerateCone(vertices, indices);
+			break;
+		case MeshLibrary::MESH_BOX:
+			// unit cube around the origin
+			AddQuad(vertices, indices, glm::vec3(0.5f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -0.5f), glm::vec3(0.0f, 0.5f, 0.0f));
+			AddQuad(vertices, indices, glm::vec3(-0.5f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.5f), glm::vec3(0.0f, 0.5f, 0.0f));
+			AddQuad(vertices, indices, glm::vec3(0.0f, 0.5f, 0.0f), glm::vec3(0.5f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -0.5f));
+			AddQuad(vertices, indices, glm::vec3(0.0f, -0.5f, 0.0f), glm::vec3(0.5f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.5f));
+			AddQuad(vertices, indices, glm::vec3(0.0f, 0.0f, 0.5f), glm::vec3(0.5f, 0.0f, 0.0f), glm::vec3(0.0f, 0.5f, 0.0f));
+			AddQuad(vertices, indices, glm::vec3(0.0f, 0.0f, -0.5f), glm::vec3(-0.5f, 0.0f, 0.0f), glm::vec3(0.0f, 0.5f, 0.0f));
+			break;
+		default:
+			break;
+		}
+
+		GenerateLightmapCoordinates(vertices, indices);
+	}
+
+	/***********************************************************
+	 *  FloatToHalf()
+	 *
+	 *  This function is used for converting a float into a
+	 *  16-bit half float, rounding to nearest. Values too
+	 *  small for a normal half are flushed to zero.
+	 ***********************************************************/
+	unsigned short FloatToHalf(float value)
+	{
+		unsigned int bits = 0;
+		memcpy(&bits, &value, sizeof(bits));
+
+		unsigned int sign = (bits >> 16) & 0x8000u;
+		int exponent = (int)((bits >> 23) & 0xFFu) - 127 + 15;
+		unsigned int mantissa = bits & 0x7FFFFFu;
+
+		if (exponent <= 0)
+		{
+			return((unsigned short)sign);
+		}
+		if (exponent >= 31)
+		{
+			return((unsigned short)(sign | 0x7C00u));
+		}
+
+		// a carry out of the mantissa correctly bumps the exponent
+		unsigned int half = sign | ((unsigned int)exponent << 10) | (mantissa >> 13);
+		if (mantissa & 0x1000u)
+		{
+			half++;
+		}
+
+		return((unsigned short)half);
+	}
+
+	/***********************************************************
+	 *  PackSignedNormalized()
+	 *
+	 *  This function is used for packing a value between -1
+	 *  and 1 into a signed normalized 16-bit integer.
+	 ***********************************************************/
+	short PackSignedNormalized(float value)
+	{
+		value = std::min(std::max(value, -1.0f), 1.0f);
+		return((short)std::floor((value * 32767.0f) + 0.5f));
+	}
+
+	/***********************************************************
+	 *  EncodeOctahedral()
+	 *
+	 *  This function is used for mapping a unit vector onto
+	 *  the octahedron and unfolding it into a square, so two
+	 *  components are enough to store a normal. The shader
+	 *  reverses this mapping.
+	 ***********************************************************/
+	glm::vec2 EncodeOctahedral(const glm::vec3& normal)
+	{
+		float sum = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+		glm::vec2 encoded(normal.x / sum, normal.y / sum);
+
+		if (normal.z < 0.0f)
+		{
+			glm::vec2 folded(
+				(1.0f - std::fabs(encoded.y)) * ((encoded.x >= 0.0f) ? 1.0f : -1.0f),
+				(1.0f - std::fabs(encoded.x)) * ((encoded.y >= 0.0f) ? 1.0f : -1.0f));
+			encoded = folded;
+		}
+
+		return(encoded);
+	}
+
+	/***********************************************************
+	 *  CalculateMeshKey()
+	 *
+	 *  This function is used for calculating the key stored in
+	 *  a packed mesh file. The key covers the generator
+	 *  settings, so changing the tessellation or the packing
+	 *  invalidates old files.
+	 ***********************************************************/
+	unsigned long long CalculateMeshKey(MeshLibrary::BASIC_MESH mesh)
+	{
+		int settings[] =
+		{
+			(int)mesh, (int)g_MeshFileVersion,
+			g_SphereStacks, g_SphereSectors, g_CircleSectors,
+			g_TorusMainSegments, g_TorusTubeSegments
+		};
+		float radii[] = { g_TorusMainRadius, g_TorusTubeRadius };
+		unsigned long long key = ShaderProgramCache::HashBytes(settings, sizeof(settings));
+		key = ShaderProgramCache::HashBytes(radii, sizeof(radii), key);
+
+		return(key);
+	}
+
+	/***********************************************************
+	 *  CheckMeshImage()
+	 *
+	 *  This function is used for checking that a packed mesh
+	 *  image belongs to the key and is complete.
+	 ***********************************************************/
+	bool CheckMeshImage(unsigned long long key, const unsigned char* data, size_t size)
+	{
+		if ((NULL == data) || (size < sizeof(MESH_FILE_HEADER)))
+		{
+			return(false);
+		}
+
+		MESH_FILE_HEADER header;
+		memcpy(&header, data, sizeof(header));
+
+		if ((header.magic != g_MeshFileMagic) ||
+			(header.version != g_MeshFileVersion) ||
+			(header.key != key) ||
+			((header.indexSize != 2) && (header.indexSize != 4)))
+		{
+			return(false);
+		}
+
+		size_t vertexBytes = (size_t)header.vertexCount * sizeof(PACKED_VERTEX);
+		size_t indexBytes = (size_t)header.indexCount * header.indexSize;
+
+		return(size == (sizeof(header) + vertexBytes + indexBytes));
+	}
+
+	/***********************************************************
+	 *  TouchPages()
+	 *
+	 *  This function is used for reading one byte of every
+	 *  page of a mapped image, so the disk reads happen on the
+	 *  calling thread and not during the upload.
+	 ***********************************************************/
+	unsigned int TouchPages(const unsigned char* data, size_t size)
+	{
+		unsigned int checksum = 0;
+		for (size_t i = 0; i < size; i += g_PageSize)
+		{
+			checksum += data[i];
+		}
+		return(checksum);
+	}
+}
+
+/***********************************************************
+ *  MeshLibrary()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+MeshLibrary::MeshLibrary(ResourceManager* pResourceManager, const char* cacheDirectory)
+{
+	m_pResourceManager = pResourceManager;
+	m_cacheDirectory = cacheDirectory;
+
+	for (int i = 0; i < TOTAL_BASIC_MESHES; i++)
+	{
+		m_meshes[i].vertexArray = 0;
+		m_meshes[i].indexCount = 0;
+		m_meshes[i].indexType = GL_UNSIGNED_SHORT;
+		m_meshes[i].boundsMin = glm::vec3(0.0f);
+		m_meshes[i].boundsMax = glm::vec3(0.0f);
+		m_meshes[i].dequantize = glm::mat4(1.0f);
+		m_bLoaded[i] = false;
+		m_bFailed[i] = false;
+		m_bGeometryBuilt[i] = false;
+		m_preparedChecksums[i] = 0;
+	}
+}
+
+/***********************************************************
+ *  ~MeshLibrary()
+ *
+ *  The destructor for the class - the vertex arrays are
+ *  freed by the resource manager
+ ***********************************************************/
+MeshLibrary::~MeshLibrary()
+{
+	for (int i = 0; i < TOTAL_BASIC_MESHES; i++)
+	{
+		m_meshes[i].handle.Reset();
+	}
+	m_pResourceManager = NULL;
+}
+
+/***********************************************************
+ *  GetMeshName()
+ *
+ *  This method is used for getting the name of a mesh.
+ ***********************************************************/
+const char* MeshLibrary::GetMeshName(BASIC_MESH mesh)
+{
+	if ((mesh < 0) || (mesh >= TOTAL_BASIC_MESHES))
+	{
+		return("unknown");
+	}
+
+	return(g_MeshNames[mesh]);
+}
+
+/***********************************************************
+ *  GetCacheFilePath()
+ *
+ *  This method is used for calculating the path of the
+ *  packed mesh file in the cache directory.
+ ***********************************************************/
+std::string MeshLibrary::GetCacheFilePath(BASIC_MESH mesh)
+{
+	return(m_cacheDirectory + "/" + GetMeshName(mesh) + ".mesh");
+}
+
+/***********************************************************
+ *  BuildMeshImage()
+ *
+ *  This method is used for generating a mesh, reordering
+ *  it for the vertex cache and the vertex fetch, packing
+ *  the vertices and laying everything out exactly like the
+ *  cache file.
+ ***********************************************************/
+bool MeshLibrary::BuildMeshImage(BASIC_MESH mesh, unsigned long long key, std::vector<unsigned char>& image)
+{
+	std::vector<MESH_VERTEX> vertices;
+	std::vector<unsigned int> indices;
+
+	GenerateMesh(mesh, vertices, indices);
+	if ((vertices.empty() == true) || (indices.empty() == true))
+	{
+		return(false);
+	}
+
+	float acmrBefore = MeshOptimizer::CalculateACMR(indices, g_ReportCacheSize);
+	MeshOptimizer::OptimizeVertexCache(indices, (unsigned int)vertices.size());
+	float acmrAfter = MeshOptimizer::CalculateACMR(indices, g_ReportCacheSize);
+
+	std::vector<unsigned int> newOrder;
+	MeshOptimizer::OptimizeVertexFetch(indices, (unsigned int)vertices.size(), newOrder);
+
+	// the bounds define the range of the packed positions
+	glm::vec3 boundsMin = vertices[newOrder[0]].position;
+	glm::vec3 boundsMax = boundsMin;
+	for (size_t i = 1; i < newOrder.size(); i++)
+	{
+		boundsMin = glm::min(boundsMin, vertices[newOrder[i]].position);
+		boundsMax = glm::max(boundsMax, vertices[newOrder[i]].position);
+	}
+
+	// a flat axis keeps a scale of 1, all packed values are 0
+	glm::vec3 scale = boundsMax - boundsMin;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (scale[axis] < 1.0e-6f)
+		{
+			scale[axis] = 1.0f;
+		}
+	}
+
+	MESH_FILE_HEADER header;
+	memset(&header, 0, sizeof(header));
+	header.magic = g_MeshFileMagic;
+	header.version = g_MeshFileVersion;
+	header.key = key;
+	header.vertexCount = (unsigned int)newOrder.size();
+	header.indexCount = (unsigned int)indices.size();
+	header.indexSize = (header.vertexCount <= 0xFFFFu) ? 2 : 4;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		header.boundsMin[axis] = boundsMin[axis];
+		header.boundsMax[axis] = boundsMax[axis];
+		header.dequantizeOffset[axis] = boundsMin[axis];
+		header.dequantizeScale[axis] = scale[axis];
+	}
+
+	size_t vertexBytes = header.vertexCount * sizeof(PACKED_VERTEX);
+	size_t indexBytes = header.indexCount * header.indexSize;
+	image.resize(sizeof(header) + vertexBytes + indexBytes);
+	memcpy(&image[0], &header, sizeof(header));
+
+	PACKED_VERTEX* packedVertices = reinterpret_cast<PACKED_VERTEX*>(&image[sizeof(header)]);
+	for (unsigned int i = 0; i < header.vertexCount; i++)
+	{
+		const MESH_VERTEX& vertex = vertices[newOrder[i]];
+		PACKED_VERTEX& packed = packedVertices[i];
+
+		glm::vec3 unitPosition = (vertex.position - boundsMin) / scale;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float value = std::min(std::max(unitPosition[axis], 0.0f), 1.0f);
+			packed.position[axis] = (unsigned short)std::floor((value * 65535.0f) + 0.5f);
+		}
+		packed.padding = 0;
+
+		// the normal is stored for the packed space, so the
+		// inverse transpose of model * dequantize restores it
+		glm::vec2 octahedral = EncodeOctahedral(glm::normalize(vertex.normal * scale));
+		packed.normal[0] = PackSignedNormalized(octahedral.x);
+		packed.normal[1] = PackSignedNormalized(octahedral.y);
+
+		packed.textureCoordinate[0] = FloatToHalf(vertex.textureCoordinate.x);
+		packed.textureCoordinate[1] = FloatToHalf(vertex.textureCoordinate.y);
+
+		for (int axis = 0; axis < 2; axis++)
+		{
+			float value = std::min(std::max(vertex.lightmapCoordinate[axis], 0.0f), 1.0f);
+			packed.lightmapCoordinate[axis] = (unsigned short)std::floor((value * 65535.0f) + 0.5f);
+		}
+	}
+
+	unsigned char* indexData = &image[sizeof(header) + vertexBytes];
+	for (unsigned int i = 0; i < header.indexCount; i++)
+	{
+		if (header.indexSize == 2)
+		{
+			unsigned short index = (unsigned short)indices[i];
+			memcpy(indexData + (i * 2), &index, 2);
+		}
+		else
+		{
+			memcpy(indexData + (i * 4), &indices[i], 4);
+		}
+	}
+
+	std::cout << "INFO: Built mesh " << GetMeshName(mesh) << ", " << header.vertexCount << " vertices, "
+		<< (header.indexCount / 3) << " triangles, ACMR " << acmrBefore << " -> " << acmrAfter
+		<< ", " << (header.vertexCount * sizeof(MESH_VERTEX)) << " -> " << vertexBytes << " vertex bytes" << std::endl;
+
+	return(true);
+}
+
+/***********************************************************
+ *  SaveMeshImage()
+ *
+ *  This method is used for writing a packed mesh into the
+ *  cache directory. The file is written under a temporary
+ *  name first so a crash never leaves a partial file.
+ ***********************************************************/
+void MeshLibrary::SaveMeshImage(BASIC_MESH mesh, const std::vector<unsigned char>& image)
+{
+#ifdef _WIN32
+	_mkdir(m_cacheDirectory.c_str());
+#else
+	mkdir(m_cacheDirectory.c_str(), 0755);
+#endif
+
+	std::string path = GetCacheFilePath(mesh);
+	std::string tempPath = path + ".tmp";
+
+	std::ofstream file(tempPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Could not write mesh cache file:" << path << std::endl;
+		return;
+	}
+
+	file.write(reinterpret_cast<const char*>(&image[0]), image.size());
+	file.close();
+	bool bWritten = !file.fail();
+
+	remove(path.c_str());
+	if ((bWritten == false) || (rename(tempPath.c_str(), path.c_str()) != 0))
+	{
+		remove(tempPath.c_str());
+		std::cout << "Could not write mesh cache file:" << path << std::endl;
+	}
+}
+
+/***********************************************************
+ *  UploadMeshImage()
+ *
+ *  This method is used for checking a packed mesh image,
+ *  from a mapped cache file or a fresh build, and uploading
+ *  it into a vertex array. Images with another key or a
+ *  wrong size are rejected so the mesh gets rebuilt.
+ ***********************************************************/
+bool MeshLibrary::UploadMeshImage(
+	BASIC_MESH mesh,
+	unsigned long long key,
+	const unsigned char* data,
+	size_t size)
+{
+	if (CheckMeshImage(key, data, size) == false)
+	{
+		return(false);
+	}
+
+	MESH_FILE_HEADER header;
+	memcpy(&header, data, sizeof(header));
+
+	size_t vertexBytes = (size_t)header.vertexCount * sizeof(PACKED_VERTEX);
+	size_t indexBytes = (size_t)header.indexCount * header.indexSize;
+
+	const ResourceManager::VERTEX_ATTRIBUTE attributes[] =
+	{
+		{ 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 0 },
+		{ 1, 2, GL_SHORT, GL_TRUE, 8 },
+		{ 2, 2, GL_HALF_FLOAT, GL_FALSE, 12 },
+		{ 3, 2, GL_UNSIGNED_SHORT, GL_TRUE, 16 }
+	};
+
+	MESH_INFO& info = m_meshes[mesh];
+	info.handle = m_pResourceManager->CreateMesh(
+		GetMeshName(mesh),
+		data + sizeof(header),
+		vertexBytes,
+		data + sizeof(header) + vertexBytes,
+		indexBytes,
+		attributes,
+		4,
+		sizeof(PACKED_VERTEX));
+	if (info.handle.IsValid() == false)
+	{
+		return(false);
+	}
+
+	info.vertexArray = info.handle.GetID();
+	info.indexCount = (GLsizei)header.indexCount;
+	info.indexType = (header.indexSize == 2) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	info.boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+	info.boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+	info.dequantize = glm::translate(glm::vec3(
+		header.dequantizeOffset[0],
+		header.dequantizeOffset[1],
+		header.dequantizeOffset[2]));
+	info.dequantize = glm::scale(info.dequantize, glm::vec3(
+		header.dequantizeScale[0],
+		header.dequantizeScale[1],
+		header.dequantizeScale[2]));
+
+	return(true);
+}
+
+/***********************************************************
+ *  LoadMesh()
+ *
+ *  This method is used for loading a mesh from the asset
+ *  pack or the mapped cache file, or building, caching and
+ *  uploading it when neither holds a valid image.
+ ***********************************************************/
+bool MeshLibrary::LoadMesh(BASIC_MESH mesh)
+{
+	// without a GL context only the bounds are needed, for
+	// the draws the software rasterizer records
+	if (NULL == m_pResourceManager)
+	{
+		const MESH_GEOMETRY* pGeometry = GetMeshGeometry(mesh);
+		if (NULL == pGeometry)
+		{
+			return(false);
+		}
+
+		MESH_INFO& info = m_meshes[mesh];
+		info.boundsMin = pGeometry->positions[0];
+		info.boundsMax = pGeometry->positions[0];
+		for (size_t i = 1; i < pGeometry->positions.size(); i++)
+		{
+			info.boundsMin = glm::min(info.boundsMin, pGeometry->positions[i]);
+			info.boundsMax = glm::max(info.boundsMax, pGeometry->positions[i]);
+		}
+		info.indexCount = (GLsizei)pGeometry->indices.size();
+		info.dequantize = glm::mat4(1.0f);
+		return(true);
+	}
+
+	unsigned long long key = CalculateMeshKey(mesh);
+
+	// a mesh prepared on a worker thread only needs its upload
+	if ((m_preparedFiles[mesh].IsOpen() == true) || (m_preparedImages[mesh].empty() == false))
+	{
+		bool bUploaded = false;
+		if (m_preparedFiles[mesh].IsOpen() == true)
+		{
+			bUploaded = UploadMeshImage(mesh, key, m_preparedFiles[mesh].GetData(), m_preparedFiles[mesh].GetSize());
+		}
+		else
+		{
+			bUploaded = UploadMeshImage(mesh, key, &m_preparedImages[mesh][0], m_preparedImages[mesh].size());
+		}
+		m_preparedFiles[mesh].Close();
+		std::vector<unsigned char>().swap(m_preparedImages[mesh]);
+
+		if (bUploaded == true)
+		{
+			return(true);
+		}
+	}
+
+	// a stored mesh in the asset pack is uploaded straight
+	// from the mapping
+	std::string path = GetCacheFilePath(mesh);
+	std::vector<unsigned char> unpacked;
+	const unsigned char* packedData = NULL;
+	size_t packedSize = 0;
+	if ((AssetPack::Read(path.c_str(), unpacked, packedData, packedSize) == true) &&
+		(UploadMeshImage(mesh, key, packedData, packedSize) == true))
+	{
+		std::cout << "INFO: Mesh loaded from asset pack:" << path << std::endl;
+		return(true);
+	}
+
+	MappedFile file;
+	if ((file.Open(path.c_str()) == true) &&
+		(UploadMeshImage(mesh, key, file.GetData(), file.GetSize()) == true))
+	{
+		std::cout << "INFO: Mesh loaded from cache:" << path << std::endl;
+		return(true);
+	}
+	file.Close();
+
+	std::vector<unsigned char> image;
+	if (BuildMeshImage(mesh, key, image) == false)
+	{
+		return(false);
+	}
+
+	SaveMeshImage(mesh, image);
+
+	return(UploadMeshImage(mesh, key, &image[0], image.size()));
+}
+
+/***********************************************************
+ *  PrepareMesh()
+ *
+ *  This method is used for doing the CPU side of loading a
+ *  mesh ahead of its first use - mapping and reading the
+ *  cache file, or building and caching the packed image -
+ *  so GetMesh() only has to upload it. Different meshes
+ *  can be prepared on different threads at the same time,
+ *  but each must be prepared before GetMesh() is called
+ *  for it.
+ ***********************************************************/
+bool MeshLibrary::PrepareMesh(BASIC_MESH mesh)
+{
+	if ((mesh < 0) || (mesh >= TOTAL_BASIC_MESHES) || (NULL == m_pResourceManager))
+	{
+		return(false);
+	}
+
+	unsigned long long key = CalculateMeshKey(mesh);
+	std::string path = GetCacheFilePath(mesh);
+
+	// a compressed mesh in the asset pack is unpacked into the
+	// prepared image, a stored one is uploaded by LoadMesh()
+	// straight from the mapping
+	const unsigned char* packedData = NULL;
+	size_t packedSize = 0;
+	if ((AssetPack::Read(path.c_str(), m_preparedImages[mesh], packedData, packedSize) == true) &&
+		(CheckMeshImage(key, packedData, packedSize) == true))
+	{
+		m_preparedChecksums[mesh] = TouchPages(packedData, packedSize);
+
+		std::cout << "INFO: Mesh loaded from asset pack:" << path << std::endl;
+		return(true);
+	}
+	std::vector<unsigned char>().swap(m_preparedImages[mesh]);
+
+	MappedFile& file = m_preparedFiles[mesh];
+	if ((file.Open(path.c_str()) == true) &&
+		(CheckMeshImage(key, file.GetData(), file.GetSize()) == true))
+	{
+		// touch every page so the disk reads happen here and
+		// not during the upload
+		m_preparedChecksums[mesh] = TouchPages(file.GetData(), file.GetSize());
+
+		std::cout << "INFO: Mesh loaded from cache:" << path << std::endl;
+		return(true);
+	}
+	file.Close();
+
+	if (BuildMeshImage(mesh, key, m_preparedImages[mesh]) == false)
+	{
+		std::vector<unsigned char>().swap(m_preparedImages[mesh]);
+		return(false);
+	}
+
+	SaveMeshImage(mesh, m_preparedImages[mesh]);
+
+	return(true);
+}
+
+/***********************************************************
+ *  GetMesh()
+ *
+ *  This method is used for getting a mesh for drawing. The
+ *  mesh is loaded by the first draw that needs it.
+ ***********************************************************/
+const MeshLibrary::MESH_INFO* MeshLibrary::GetMesh(BASIC_MESH mesh)
+{
+	if ((mesh < 0) || (mesh >= TOTAL_BASIC_MESHES))
+	{
+		return(NULL);
+	}
+
+	if ((m_bLoaded[mesh] == false) && (m_bFailed[mesh] == false))
+	{
+		m_bLoaded[mesh] = LoadMesh(mesh);
+		if (m_bLoaded[mesh] == false)
+		{
+			std::cout << "Could not load mesh:" << GetMeshName(mesh) << std::endl;
+			m_bFailed[mesh] = true;
+		}
+	}
+
+	return((m_bLoaded[mesh] == true) ? &m_meshes[mesh] : NULL);
+}
+
+/***********************************************************
+ *  DrawMesh()
+ *
+ *  This method is used for drawing a loaded mesh with the
+ *  currently active program.
+ ***********************************************************/
+void MeshLibrary::DrawMesh(const MESH_INFO& mesh, GLStateCache* pStateCache)
+{
+	pStateCache->BindVertexArray(mesh.vertexArray);
+	glDrawElements(GL_TRIANGLES, mesh.indexCount, mesh.indexType, (void*)0);
+}
+
+/***********************************************************
+ *  GetMeshGeometry()
+ *
+ *  This method is used for getting the full precision CPU
+ *  geometry of a mesh. It is generated and reordered for
+ *  the vertex cache on first use, but not packed, so no
+ *  dequantize matrix is needed.
+ ***********************************************************/
+const MeshLibrary::MESH_GEOMETRY* MeshLibrary::GetMeshGeometry(BASIC_MESH mesh)
+{
+	if ((mesh < 0) || (mesh >= TOTAL_BASIC_MESHES))
+	{
+		return(NULL);
+	}
+
+	MESH_GEOMETRY& geometry = m_geometry[mesh];
+	if (m_bGeometryBuilt[mesh] == false)
+	{
+		m_bGeometryBuilt[mesh] = true;
+
+		std::vector<MESH_VERTEX> vertices;
+		GenerateMesh(mesh, vertices, geometry.indices);
+		MeshOptimizer::OptimizeVertexCache(geometry.indices, (unsigned int)vertices.size());
+
+		geometry.positions.resize(vertices.size());
+		geometry.normals.resize(vertices.size());
+		geometry.textureCoordinates.resize(vertices.size());
+		geometry.lightmapCoordinates.resize(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			geometry.positions[i] = vertices[i].position;
+			geometry.normals[i] = vertices[i].normal;
+			geometry.textureCoordinates[i] = vertices[i].textureCoordinate;
+			geometry.lightmapCoordinates[i] = vertices[i].lightmapCoordinate;
+		}
+	}
+
+	if ((geometry.positions.empty() == true) || (geometry.indices.empty() == true))
+	{
+		return(NULL);
+	}
+	return(&geometry);
+}
@@ -0,0 +1,140 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshlibrary.h
+// ============
+// generate, optimize, quantize and cache the basic scene meshes
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "ResourceManager.h"
+#include "GLStateCache.h"
+#include "MappedFile.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+/***********************************************************
+ *  MeshLibrary
+ *
+ *  This class provides the basic shapes used by the scene.
+ *  Each mesh is only created the first time a draw needs
+ *  it. The first launch generates the mesh, reorders it for
+ *  the vertex cache and vertex fetch, packs the vertices
+ *  into 20 bytes and writes the result to a cache file.
+ *  Later launches map that file and upload it directly.
+ *  The reading or building can be done ahead of time on a
+ *  worker thread with PrepareMesh().
+ *
+ *  Packed vertex layout:
+ *    location 0 - position, 3 x unsigned 16-bit normalized
+ *                 into the mesh bounds
+ *    location 1 - normal, octahedral 2 x signed 16-bit
+ *    location 2 - texture coordinate, 2 x half float
+ *    location 3 - lightmap coordinate, 2 x unsigned 16-bit
+ *                 normalized, unique over the whole mesh
+ *  The dequantize matrix maps the packed positions back to
+ *  object space and must be applied after the model matrix.
+ *
+ *  Without a resource manager there is no GL context, and
+ *  the meshes only carry their bounds. The software
+ *  rasterizer draws those from the full precision geometry,
+ *  and the lightmap baker lights it.
+ ***********************************************************/
+class MeshLibrary
+{
+	// the micro-benchmarks time the mesh build directly
+	friend class BenchmarkAccess;
+
+public:
+	// basic meshes provided by the library
+	enum BASIC_MESH
+	{
+		MESH_PLANE,
+		MESH_SPHERE,
+		MESH_HALF_SPHERE,
+		MESH_TORUS,
+		MESH_CYLINDER,
+		MESH_CONE,
+		MESH_BOX,
+		TOTAL_BASIC_MESHES
+	};
+
+	// everything needed for drawing a loaded mesh
+	struct MESH_INFO
+	{
+		ResourceHandle handle;		// keeps the vertex array alive
+		GLuint vertexArray;
+		GLsizei indexCount;
+		GLenum indexType;
+		glm::vec3 boundsMin;		// object-space bounds
+		glm::vec3 boundsMax;
+		glm::mat4 dequantize;		// packed position to object space
+	};
+
+	// full precision copy of a mesh for drawing on the CPU
+	struct MESH_GEOMETRY
+	{
+		std::vector<glm::vec3> positions;	// object space
+		std::vector<glm::vec3> normals;
+		std::vector<glm::vec2> textureCoordinates;
+		std::vector<glm::vec2> lightmapCoordinates;
+		std::vector<unsigned int> indices;
+	};
+
+	// constructor
+	MeshLibrary(ResourceManager* pResourceManager, const char* cacheDirectory);
+	// destructor
+	~MeshLibrary();
+
+private:
+	// manager that owns the uploaded vertex arrays
+	ResourceManager* m_pResourceManager;
+	// folder where the packed meshes are stored
+	std::string m_cacheDirectory;
+	// loaded meshes indexed by mesh type
+	MESH_INFO m_meshes[TOTAL_BASIC_MESHES];
+	bool m_bLoaded[TOTAL_BASIC_MESHES];
+	// set when a mesh failed so it is not retried every frame
+	bool m_bFailed[TOTAL_BASIC_MESHES];
+	// CPU geometry, only built for the software rasterizer
+	// and the lightmap baker
+	MESH_GEOMETRY m_geometry[TOTAL_BASIC_MESHES];
+	bool m_bGeometryBuilt[TOTAL_BASIC_MESHES];
+	// mapped cache files or built images waiting for their
+	// upload, filled by PrepareMesh()
+	MappedFile m_preparedFiles[TOTAL_BASIC_MESHES];
+	std::vector<unsigned char> m_preparedImages[TOTAL_BASIC_MESHES];
+	// sum of the touched bytes, kept so the reads stay
+	unsigned int m_preparedChecksums[TOTAL_BASIC_MESHES];
+
+	// calculate the cache file path for a mesh
+	std::string GetCacheFilePath(BASIC_MESH mesh);
+	// generate, optimize and pack a mesh into a cache file image
+	bool BuildMeshImage(BASIC_MESH mesh, unsigned long long key, std::vector<unsigned char>& image);
+	// write a cache file image to disk
+	void SaveMeshImage(BASIC_MESH mesh, const std::vector<unsigned char>& image);
+	// check a cache file image and upload it
+	bool UploadMeshImage(BASIC_MESH mesh, unsigned long long key, const unsigned char* data, size_t size);
+	// load a mesh from the cache or build it
+	bool LoadMesh(BASIC_MESH mesh);
+
+public:
+	// get a mesh, loading it on first use - returns NULL
+	// when the mesh could not be loaded
+	const MESH_INFO* GetMesh(BASIC_MESH mesh);
+	// read or build a mesh ahead of GetMesh(), safe on any
+	// thread for a mesh that is not being used elsewhere
+	bool PrepareMesh(BASIC_MESH mesh);
+	// draw a loaded mesh with the active program
+	void DrawMesh(const MESH_INFO& mesh, GLStateCache* pStateCache);
+	// get the CPU geometry of a mesh, building it on first use -
+	// returns NULL when the mesh has no geometry
+	const MESH_GEOMETRY* GetMeshGeometry(BASIC_MESH mesh);
+
+	// get the name of a mesh used for files and reports
+	static const char* GetMeshName(BASIC_MESH mesh);
+};
@@ -0,0 +1,309 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshoptimizer.cpp
+// ============
+// reorder triangle meshes for the GPU vertex cache and vertex fetch
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "MeshOptimizer.h"
+
+#include <cmath>
+
+// declaration of global variables
+namespace
+{
+	// size of the modelled post-transform cache, larger than
+	// the real hardware cache which the scoring tolerates well
+	const int g_CacheSize = 32;
+	// scoring weights from Tom Forsyth's linear-speed vertex
+	// cache optimization
+	const float g_CacheDecayPower = 1.5f;
+	const float g_LastTriangleScore = 0.75f;
+	const float g_ValenceBoostScale = 2.0f;
+	const float g_ValenceBoostPower = 0.5f;
+
+	// per vertex state used while ordering the triangles
+	struct VERTEX_STATE
+	{
+		int cachePosition;			// -1 when not in the cache
+		float score;
+		int remainingTriangles;		// triangles not yet emitted
+		int firstTriangle;			// offset into the adjacency list
+	};
+
+	/***********************************************************
+	 *  CalculateVertexScore()
+	 *
+	 *  This function is used for scoring a vertex by how
+	 *  recently it was used and how few triangles still need
+	 *  it, so nearly finished vertices get emitted first.
+	 ***********************************************************/
+	float CalculateVertexScore(int cachePosition, int remainingTriangles)
+	{
+		if (remainingTriangles == 0)
+		{
+			return(-1.0f);
+		}
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			if (cachePosition < 3)
+			{
+				// the vertices of the last triangle get a fixed
+				// score so the next triangle does not just reuse
+				// the same edge
+				score = g_LastTriangleScore;
+			}
+			else
+			{
+				float scaler = 1.0f / (g_CacheSize - 3);
+				score = 1.0f - ((cachePosition - 3) * scaler);
+				score = std::pow(score, g_CacheDecayPower);
+			}
+		}
+
+		score += g_ValenceBoostScale * std::pow((float)remainingTriangles, -g_ValenceBoostPower);
+
+		return(score);
+	}
+}
+
+/***********************************************************
+ *  OptimizeVertexCache()
+ *
+ *  This function is used for reordering the triangles so
+ *  that consecutive triangles share vertices that are still
+ *  in the post-transform cache. Each step emits the
+ *  triangle with the best summed vertex score among the
+ *  triangles touching the cache, which keeps the work close
+ *  to linear in the triangle count.
+ ***********************************************************/
+void MeshOptimizer::OptimizeVertexCache(std::vector<unsigned int>& indices, unsigned int vertexCount)
+{
+	int triangleCount = (int)(indices.size() / 3);
+	if ((triangleCount == 0) || (vertexCount == 0))
+	{
+		return;
+	}
+
+	// build the vertex to triangle adjacency
+	std::vector<VERTEX_STATE> vertices(vertexCount);
+	for (unsigned int i = 0; i < vertexCount; i++)
+	{
+		vertices[i].cachePosition = -1;
+		vertices[i].score = 0.0f;
+		vertices[i].remainingTriangles = 0;
+		vertices[i].firstTriangle = 0;
+	}
+	for (size_t i = 0; i < (size_t)triangleCount * 3; i++)
+	{
+		vertices[indices[i]].remainingTriangles++;
+	}
+
+	int offset = 0;
+	for (unsigned int i = 0; i < vertexCount; i++)
+	{
+		vertices[i].firstTriangle = offset;
+		offset += vertices[i].remainingTriangles;
+	}
+
+	std::vector<int> adjacency(offset);
+	std::vector<int> adjacencyCount(vertexCount, 0);
+	for (int triangle = 0; triangle < triangleCount; triangle++)
+	{
+		for (int corner = 0; corner < 3; corner++)
+		{
+			unsigned int vertex = indices[(triangle * 3) + corner];
+			adjacency[vertices[vertex].firstTriangle + adjacencyCount[vertex]] = triangle;
+			adjacencyCount[vertex]++;
+		}
+	}
+
+	for (unsigned int i = 0; i < vertexCount; i++)
+	{
+		vertices[i].score = CalculateVertexScore(-1, vertices[i].remainingTriangles);
+	}
+
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<bool> bEmitted(triangleCount, false);
+	for (int triangle = 0; triangle < triangleCount; triangle++)
+	{
+		triangleScores[triangle] =
+			vertices[indices[(triangle * 3) + 0]].score +
+			vertices[indices[(triangle * 3) + 1]].score +
+			vertices[indices[(triangle * 3) + 2]].score;
+	}
+
+	std::vector<unsigned int> newIndices;
+	newIndices.reserve(indices.size());
+
+	// the cache holds three extra entries while a triangle is added
+	std::vector<int> cache;
+	cache.reserve(g_CacheSize + 3);
+	std::vector<int> newCache;
+	newCache.reserve(g_CacheSize + 3);
+
+	int bestTriangle = -1;
+	int nextUnemitted = 0;
+
+	for (int emitted = 0; emitted < triangleCount; emitted++)
+	{
+		if (bestTriangle < 0)
+		{
+			// nothing in the cache is connected, so fall back to
+			// the best remaining triangle of the whole mesh
+			float bestScore = -1.0f;
+			while ((nextUnemitted < triangleCount) && (bEmitted[nextUnemitted] == true))
+			{
+				nextUnemitted++;
+			}
+			for (int triangle = nextUnemitted; triangle < triangleCount; triangle++)
+			{
+				if ((bEmitted[triangle] == false) && (triangleScores[triangle] > bestScore))
+				{
+					bestScore = triangleScores[triangle];
+					bestTriangle = triangle;
+				}
+			}
+		}
+
+		// emit the triangle and remove it from its vertices
+		bEmitted[bestTriangle] = true;
+		newCache.clear();
+		for (int corner = 0; corner < 3; corner++)
+		{
+			unsigned int vertex = indices[(bestTriangle * 3) + corner];
+			newIndices.push_back(vertex);
+			newCache.push_back((int)vertex);
+
+			VERTEX_STATE& state = vertices[vertex];
+			int* triangles = &adjacency[state.firstTriangle];
+			for (int i = 0; i < state.remainingTriangles; i++)
+			{
+				if (triangles[i] == bestTriangle)
+				{
+					triangles[i] = triangles[state.remainingTriangles - 1];
+					break;
+				}
+			}
+			state.remainingTriangles--;
+		}
+
+		// move the emitted vertices to the front of the cache
+		for (size_t i = 0; i < cache.size(); i++)
+		{
+			int vertex = cache[i];
+			if ((vertex != newCache[0]) && (vertex != newCache[1]) && (vertex != newCache[2]))
+			{
+				newCache.push_back(vertex);
+			}
+		}
+		cache.swap(newCache);
+
+		// rescore the cached vertices and the vertices pushed out
+		for (size_t i = 0; i < cache.size(); i++)
+		{
+			VERTEX_STATE& state = vertices[cache[i]];
+			int position = ((int)i < g_CacheSize) ? (int)i : -1;
+			state.cachePosition = position;
+			state.score = CalculateVertexScore(position, state.remainingTriangles);
+		}
+		if ((int)cache.size() > g_CacheSize)
+		{
+			cache.resize(g_CacheSize);
+		}
+
+		// pick the best triangle touching the cache
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (size_t i = 0; i < cache.size(); i++)
+		{
+			VERTEX_STATE& state = vertices[cache[i]];
+			const int* triangles = &adjacency[state.firstTriangle];
+			for (int j = 0; j < state.remainingTriangles; j++)
+			{
+				int triangle = triangles[j];
+				float score =
+					vertices[indices[(triangle * 3) + 0]].score +
+					vertices[indices[(triangle * 3) + 1]].score +
+					vertices[indices[(triangle * 3) + 2]].score;
+				triangleScores[triangle] = score;
+				if (score > bestScore)
+				{
+					bestScore = score;
+					bestTriangle = triangle;
+				}
+			}
+		}
+	}
+
+	indices.swap(newIndices);
+}
+
+/***********************************************************
+ *  OptimizeVertexFetch()
+ *
+ *  This function is used for renumbering the vertices in
+ *  the order the index list first uses them. The caller
+ *  builds the new vertex array from the returned order.
+ ***********************************************************/
+void MeshOptimizer::OptimizeVertexFetch(
+	std::vector<unsigned int>& indices,
+	unsigned int vertexCount,
+	std::vector<unsigned int>& newOrder)
+{
+	const unsigned int unassigned = 0xFFFFFFFFu;
+	std::vector<unsigned int> remap(vertexCount, unassigned);
+
+	newOrder.clear();
+	newOrder.reserve(vertexCount);
+
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		unsigned int vertex = indices[i];
+		if (remap[vertex] == unassigned)
+		{
+			remap[vertex] = (unsigned int)newOrder.size();
+			newOrder.push_back(vertex);
+		}
+		indices[i] = remap[vertex];
+	}
+}
+
+/***********************************************************
+ *  CalculateACMR()
+ *
+ *  This function is used for simulating a FIFO vertex
+ *  cache and returning the average number of vertices
+ *  transformed per triangle, between 0.5 and 3.
+ ***********************************************************/
+float MeshOptimizer::CalculateACMR(const std::vector<unsigned int>& indices, int cacheSize)
+{
+	if ((indices.size() < 3) || (cacheSize <= 0))
+	{
+		return(0.0f);
+	}
+
+	std::vector<unsigned int> cache(cacheSize, 0xFFFFFFFFu);
+	int cacheHead = 0;
+	int misses = 0;
+
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		bool bHit = false;
+		for (int j = 0; (j < cacheSize) && (bHit == false); j++)
+		{
+			bHit = (cache[j] == indices[i]);
+		}
+
+		if (bHit == false)
+		{
+			cache[cacheHead] = indices[i];
+			cacheHead = (cacheHead + 1) % cacheSize;
+			misses++;
+		}
+	}
+
+	return((float)misses / (float)(indices.size() / 3));
+}
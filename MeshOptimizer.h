@@ -0,0 +1,37 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshoptimizer.h
+// ============
+// reorder triangle meshes for the GPU vertex cache and vertex fetch
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+
+/***********************************************************
+ *  Mesh optimization
+ *
+ *  These functions work on indexed triangle lists. The
+ *  triangle order is first changed so vertices are reused
+ *  while they are still in the post-transform cache, then
+ *  the vertices are renumbered in the order they are first
+ *  used so the vertex fetch reads memory sequentially.
+ ***********************************************************/
+namespace MeshOptimizer
+{
+	// reorder the triangles for the post-transform vertex cache
+	void OptimizeVertexCache(std::vector<unsigned int>& indices, unsigned int vertexCount);
+
+	// renumber the vertices in the order of first use, the new
+	// order lists the old index of each new vertex and unused
+	// vertices are left out
+	void OptimizeVertexFetch(
+		std::vector<unsigned int>& indices,
+		unsigned int vertexCount,
+		std::vector<unsigned int>& newOrder);
+
+	// calculate the average vertex transforms per triangle for
+	// a FIFO cache of the passed in size, lower is better
+	float CalculateACMR(const std::vector<unsigned int>& indices, int cacheSize);
+}
@@ -0,0 +1,529 @@
+///////////////////////////////////////////////////////////////////////////////
+// occlusionculling.cpp
+// ============
+// skip objects hidden behind large occluders using hardware queries
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OcclusionCulling.h"
+#include "PerformanceCounters.h"
+
+#include <algorithm>
+#include <iostream>
+
+// declaration of global variables
+namespace
+{
+	// entries the table starts with, enough for the desk
+	const int g_InitialObjects = 256;
+
+	/***********************************************************
+	 *  HashKey()
+	 *
+	 *  This function is used for spreading the object keys,
+	 *  which mostly differ in their low bits, over the table.
+	 ***********************************************************/
+	size_t HashKey(unsigned long long key, size_t tableMask)
+	{
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdULL;
+		key ^= key >> 33;
+		return((size_t)key & tableMask);
+	}
+}
+
+// out of class definitions for the integral constants
+const int OcclusionCuller::QUERY_FRAMES;
+const int OcclusionCuller::OCCLUDED_RESULTS_TO_CULL;
+const int OcclusionCuller::FORGET_FRAMES;
+
+/***********************************************************
+ *  OcclusionCuller()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+OcclusionCuller::OcclusionCuller(GLStateCache* pStateCache)
+{
+	m_pStateCache = pStateCache;
+	m_frameIndex = 0;
+	m_culledCount = 0;
+	m_boundsProgram = 0;
+	m_boundsVAO = 0;
+	m_viewProjectionLocation = -1;
+	m_boundsMinLocation = -1;
+	m_boundsMaxLocation = -1;
+}
+
+/***********************************************************
+ *  ~OcclusionCuller()
+ *
+ *  The destructor for the class - the bounds program and
+ *  cube are freed by the resource manager
+ ***********************************************************/
+OcclusionCuller::~OcclusionCuller()
+{
+	DestroyQueries();
+
+	m_boundsProgramHandle.Reset();
+	m_boundsMeshHandle.Reset();
+	m_boundsProgram = 0;
+	m_boundsVAO = 0;
+}
+
+/***********************************************************
+ *  DestroyQueries()
+ *
+ *  This method is used for freeing the query objects of
+ *  every tracked object.
+ ***********************************************************/
+void OcclusionCuller::DestroyQueries()
+{
+	for (size_t i = 0; i < m_objects.size(); i++)
+	{
+		glDeleteQueries(QUERY_FRAMES, m_objects[i].queries);
+	}
+	m_objects.clear();
+	m_freeObjects.clear();
+	m_keyTable.clear();
+}
+
+/***********************************************************
+ *  GrowObjects()
+ *
+ *  This method is used for adding entries, each with its
+ *  own query objects, and growing the key table with them.
+ ***********************************************************/
+void OcclusionCuller::GrowObjects(int objectCount)
+{
+	int firstObject = (int)m_objects.size();
+	if (objectCount <= firstObject)
+	{
+		return;
+	}
+
+	m_objects.resize(objectCount);
+	m_freeObjects.reserve(objectCount);
+	for (int i = objectCount - 1; i >= firstObject; i--)
+	{
+		OBJECT_QUERY& object = m_objects[i];
+		glGenQueries(QUERY_FRAMES, object.queries);
+		object.key = 0;
+		object.bInUse = false;
+		for (int slot = 0; slot < QUERY_FRAMES; slot++)
+		{
+			object.bIssued[slot] = false;
+		}
+		object.occludedResults = 0;
+		object.bVisible = true;
+		object.lastTestedFrame = 0;
+		m_freeObjects.push_back(i);
+	}
+
+	size_t tableSize = 1;
+	while (tableSize < (size_t)objectCount * 2)
+	{
+		tableSize *= 2;
+	}
+	m_keyTable.resize(tableSize);
+	RebuildKeyTable();
+}
+
+/***********************************************************
+ *  RebuildKeyTable()
+ *
+ *  This method is used for filling the key table again
+ *  from the entries in use, after entries were forgotten.
+ ***********************************************************/
+void OcclusionCuller::RebuildKeyTable()
+{
+	std::fill(m_keyTable.begin(), m_keyTable.end(), -1);
+
+	size_t tableMask = m_keyTable.size() - 1;
+	for (size_t i = 0; i < m_objects.size(); i++)
+	{
+		if (m_objects[i].bInUse == true)
+		{
+			size_t index = HashKey(m_objects[i].key, tableMask);
+			while (m_keyTable[index] >= 0)
+			{
+				index = (index + 1) & tableMask;
+			}
+			m_keyTable[index] = (int)i;
+		}
+	}
+}
+
+/***********************************************************
+ *  FindObject()
+ *
+ *  This method is used for looking up the entry of an
+ *  object by its key.
+ ***********************************************************/
+int OcclusionCuller::FindObject(unsigned long long key) const
+{
+	if (m_keyTable.empty() == true)
+	{
+		return(-1);
+	}
+
+	size_t tableMask = m_keyTable.size() - 1;
+	size_t index = HashKey(key, tableMask);
+	while (m_keyTable[index] >= 0)
+	{
+		if (m_objects[m_keyTable[index]].key == key)
+		{
+			return(m_keyTable[index]);
+		}
+		index = (index + 1) & tableMask;
+	}
+
+	return(-1);
+}
+
+/***********************************************************
+ *  AcquireObject()
+ *
+ *  This method is used for getting the entry of an object,
+ *  starting a visible history for an object seen for the
+ *  first time. The entries only grow when Reserve() was
+ *  not told about enough objects.
+ ***********************************************************/
+int OcclusionCuller::AcquireObject(unsigned long long key)
+{
+	int objectIndex = FindObject(key);
+	if (objectIndex >= 0)
+	{
+		return(objectIndex);
+	}
+
+	if (m_freeObjects.empty() == true)
+	{
+		GrowObjects(std::max((int)m_objects.size() * 2, g_InitialObjects));
+	}
+
+	objectIndex = m_freeObjects.back();
+	m_freeObjects.pop_back();
+
+	OBJECT_QUERY& object = m_objects[objectIndex];
+	object.key = key;
+	object.bInUse = true;
+	for (int slot = 0; slot < QUERY_FRAMES; slot++)
+	{
+		object.bIssued[slot] = false;
+	}
+	object.occludedResults = 0;
+	object.bVisible = true;
+	object.lastTestedFrame = m_frameIndex;
+
+	size_t tableMask = m_keyTable.size() - 1;
+	size_t index = HashKey(key, tableMask);
+	while (m_keyTable[index] >= 0)
+	{
+		index = (index + 1) & tableMask;
+	}
+	m_keyTable[index] = objectIndex;
+
+	return(objectIndex);
+}
+
+/***********************************************************
+ *  Reserve()
+ *
+ *  This method is used for creating the entries and query
+ *  objects of the passed in number of objects ahead of
+ *  time, so the frames that first test them do not.
+ ***********************************************************/
+void OcclusionCuller::Reserve(int objectCount)
+{
+	if (0 == m_boundsProgram)
+	{
+		return;
+	}
+
+	GrowObjects(std::max(objectCount, g_InitialObjects));
+}
+
+/***********************************************************
+ *  Initialize()
+ *
+ *  This method is used for building the program and the
+ *  unit cube that are used for drawing bounding boxes.
+ ***********************************************************/
+bool OcclusionCuller::Initialize(ResourceManager* pResourceManager)
+{
+	if (NULL == pResourceManager)
+	{
+		return(false);
+	}
+
+	m_boundsProgramHandle = pResourceManager->LoadProgram(
+		"shaders/boundsVertexShader.glsl",
+		"shaders/boundsFragmentShader.glsl",
+		"");
+	m_boundsProgram = m_boundsProgramHandle.GetID();
+	if (0 == m_boundsProgram)
+	{
+		std::cout << "Occlusion culling disabled, no bounds program" << std::endl;
+		return(false);
+	}
+
+	m_viewProjectionLocation = glGetUniformLocation(m_boundsProgram, "viewProjection");
+	m_boundsMinLocation = glGetUniformLocation(m_boundsProgram, "boundsMin");
+	m_boundsMaxLocation = glGetUniformLocation(m_boundsProgram, "boundsMax");
+
+	// unit cube, scaled into each bounding box by the shader
+	const GLfloat vertices[] =
+	{
+		0.0f, 0.0f, 0.0f,
+		1.0f, 0.0f, 0.0f,
+		1.0f, 1.0f, 0.0f,
+		0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 1.0f,
+		1.0f, 0.0f, 1.0f,
+		1.0f, 1.0f, 1.0f,
+		0.0f, 1.0f, 1.0f
+	};
+	const GLubyte indices[] =
+	{
+		0, 2, 1, 0, 3, 2,		// back
+		4, 5, 6, 4, 6, 7,		// front
+		0, 4, 7, 0, 7, 3,		// left
+		1, 2, 6, 1, 6, 5,		// right
+		0, 1, 5, 0, 5, 4,		// bottom
+		3, 7, 6, 3, 6, 2		// top
+	};
+
+	const ResourceManager::VERTEX_ATTRIBUTE positionAttribute = { 0, 3, GL_FLOAT, GL_FALSE, 0 };
+
+	m_boundsMeshHandle = pResourceManager->CreateMesh(
+		"boundsCube",
+		vertices,
+		sizeof(vertices),
+		indices,
+		sizeof(indices),
+		&positionAttribute,
+		1,
+		3 * sizeof(GLfloat));
+	m_boundsVAO = m_boundsMeshHandle.GetID();
+
+	if (0 == m_boundsVAO)
+	{
+		return(false);
+	}
+
+	GrowObjects(g_InitialObjects);
+	return(true);
+}
+
+/***********************************************************
+ *  BeginFrame()
+ *
+ *  This method is used for collecting the query results of
+ *  earlier frames. Only results the GPU already has are
+ *  read, so this never stalls. The newest available result
+ *  decides the visibility and any older ones are dropped.
+ ***********************************************************/
+void OcclusionCuller::BeginFrame()
+{
+	m_frameIndex++;
+	m_culledCount = 0;
+
+	if (0 == m_boundsProgram)
+	{
+		return;
+	}
+
+	bool bForgotten = false;
+	for (size_t i = 0; i < m_objects.size(); i++)
+	{
+		OBJECT_QUERY& object = m_objects[i];
+		if (object.bInUse == false)
+		{
+			continue;
+		}
+
+		// an object that left the scene or the view frees its
+		// entry, its queries are restarted by the next object
+		if (m_frameIndex - object.lastTestedFrame > (unsigned int)FORGET_FRAMES)
+		{
+			object.bInUse = false;
+			m_freeObjects.push_back((int)i);
+			bForgotten = true;
+			continue;
+		}
+
+		bool bResultFound = false;
+
+		// check the queries from the newest to the oldest
+		for (int age = 1; age < QUERY_FRAMES; age++)
+		{
+			int slot = (int)((m_frameIndex + QUERY_FRAMES - age) % QUERY_FRAMES);
+			if (object.bIssued[slot] == false)
+			{
+				continue;
+			}
+
+			if (bResultFound == true)
+			{
+				// a newer result was already used
+				object.bIssued[slot] = false;
+				continue;
+			}
+
+			GLuint available = GL_FALSE;
+			glGetQueryObjectuiv(object.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available == GL_TRUE)
+			{
+				GLuint anySamplesPassed = GL_FALSE;
+				glGetQueryObjectuiv(object.queries[slot], GL_QUERY_RESULT, &anySamplesPassed);
+				object.bIssued[slot] = false;
+				bResultFound = true;
+
+				if (anySamplesPassed != GL_FALSE)
+				{
+					object.occludedResults = 0;
+				}
+				else
+				{
+					object.occludedResults++;
+				}
+			}
+		}
+
+		object.bVisible = (object.occludedResults < OCCLUDED_RESULTS_TO_CULL);
+		if ((object.bVisible == false) && (object.lastTestedFrame + 1 == m_frameIndex))
+		{
+			m_culledCount++;
+		}
+	}
+
+	// the probe sequences may run through the freed entries
+	if (bForgotten == true)
+	{
+		RebuildKeyTable();
+	}
+}
+
+/***********************************************************
+ *  Reset()
+ *
+ *  This method is used for making every known object
+ *  visible again and ignoring the queries still in flight,
+ *  which were tested against the depth of another view.
+ *  The entries and their queries are kept for reuse.
+ ***********************************************************/
+void OcclusionCuller::Reset()
+{
+	for (size_t i = 0; i < m_objects.size(); i++)
+	{
+		OBJECT_QUERY& object = m_objects[i];
+		for (int slot = 0; slot < QUERY_FRAMES; slot++)
+		{
+			object.bIssued[slot] = false;
+		}
+		object.occludedResults = 0;
+		object.bVisible = true;
+	}
+	m_culledCount = 0;
+}
+
+/***********************************************************
+ *  IsVisible()
+ *
+ *  This method is used for checking whether an object
+ *  should be drawn in the current frame. Unknown objects
+ *  are always visible.
+ ***********************************************************/
+bool OcclusionCuller::IsVisible(unsigned long long key) const
+{
+	int objectIndex = FindObject(key);
+	if (objectIndex < 0)
+	{
+		return(true);
+	}
+
+	return(m_objects[objectIndex].bVisible);
+}
+
+/***********************************************************
+ *  BeginQueries()
+ *
+ *  This method is used for activating the bounds program
+ *  and turning off color and depth writes, so the bounding
+ *  boxes are only tested against the depth buffer.
+ ***********************************************************/
+void OcclusionCuller::BeginQueries(const glm::mat4& viewProjection, const glm::vec3& cameraPosition)
+{
+	if (0 == m_boundsProgram)
+	{
+		return;
+	}
+
+	m_cameraPosition = cameraPosition;
+
+	m_pStateCache->UseProgram(m_boundsProgram);
+	m_pStateCache->SetUniform(m_viewProjectionLocation, viewProjection);
+	m_pStateCache->BindVertexArray(m_boundsVAO);
+	m_pStateCache->SetColorMask(false);
+	m_pStateCache->SetDepthMask(false);
+}
+
+/***********************************************************
+ *  IssueQuery()
+ *
+ *  This method is used for drawing a bounding box inside
+ *  an occlusion query. When the camera is inside the box
+ *  its faces would be clipped away, so no query is issued
+ *  and the object simply stays visible.
+ ***********************************************************/
+void OcclusionCuller::IssueQuery(unsigned long long key, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	if (0 == m_boundsProgram)
+	{
+		return;
+	}
+
+	OBJECT_QUERY& object = m_objects[AcquireObject(key)];
+	object.lastTestedFrame = m_frameIndex;
+	int slot = (int)(m_frameIndex % QUERY_FRAMES);
+
+	// keep a margin for the near plane around the camera
+	const float margin = 0.2f;
+	if ((m_cameraPosition.x > boundsMin.x - margin) && (m_cameraPosition.x < boundsMax.x + margin) &&
+		(m_cameraPosition.y > boundsMin.y - margin) && (m_cameraPosition.y < boundsMax.y + margin) &&
+		(m_cameraPosition.z > boundsMin.z - margin) && (m_cameraPosition.z < boundsMax.z + margin))
+	{
+		object.occludedResults = 0;
+		object.bIssued[slot] = false;
+		return;
+	}
+
+	m_pStateCache->SetUniform(m_boundsMinLocation, boundsMin);
+	m_pStateCache->SetUniform(m_boundsMaxLocation, boundsMax);
+
+	glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, object.queries[slot]);
+	glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, (void*)0);
+	glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+	PerformanceCounters::Add(PerformanceCounters::COUNTER_DRAW_CALLS, 1);
+	PerformanceCounters::Add(PerformanceCounters::COUNTER_TRIANGLES, 12);
+
+	object.bIssued[slot] = true;
+}
+
+/***********************************************************
+ *  EndQueries()
+ *
+ *  This method is used for restoring the color and depth
+ *  writes after the bounding box queries.
+ ***********************************************************/
+void OcclusionCuller::EndQueries()
+{
+	if (0 == m_boundsProgram)
+	{
+		return;
+	}
+
+	// the next scene draw binds its own vertex array
+	m_pStateCache->SetColorMask(true);
+	m_pStateCache->SetDepthMask(true);
+}
@@ -0,0 +1,124 @@
+///////////////////////////////////////////////////////////////////////////////
+// occlusionculling.h
+// ============
+// skip objects hidden behind large occluders using hardware queries
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "ResourceManager.h"
+#include "GLStateCache.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+/***********************************************************
+ *  OcclusionCuller
+ *
+ *  This class is used for testing the bounding boxes of
+ *  scene objects against the depth of a cheap occluder
+ *  pre-pass with occlusion queries. Query results are only
+ *  read once the GPU has them, one or two frames later, so
+ *  the CPU never waits on the GPU. Objects that stay hidden
+ *  for several results in a row are reported as culled.
+ *
+ *  Objects are known by a key the scene keeps the same for
+ *  the same object from frame to frame, so the history of
+ *  an object survives other objects coming and going. An
+ *  object that is not tested for a while is forgotten and
+ *  its queries are reused for the next new object.
+ ***********************************************************/
+class OcclusionCuller
+{
+public:
+	// constructor
+	OcclusionCuller(GLStateCache* pStateCache);
+	// destructor
+	~OcclusionCuller();
+
+	// number of frames a query can be in flight
+	static const int QUERY_FRAMES = 3;
+	// hidden results needed in a row before an object is culled
+	static const int OCCLUDED_RESULTS_TO_CULL = 2;
+	// frames an object may go untested before it is forgotten
+	static const int FORGET_FRAMES = 60;
+
+private:
+	// query objects and visibility history of one object
+	struct OBJECT_QUERY
+	{
+		unsigned long long key;
+		bool bInUse;
+		GLuint queries[QUERY_FRAMES];
+		bool bIssued[QUERY_FRAMES];
+		int occludedResults;
+		bool bVisible;
+		unsigned int lastTestedFrame;
+	};
+
+	// query state of the known objects, and the unused entries
+	std::vector<OBJECT_QUERY> m_objects;
+	std::vector<int> m_freeObjects;
+	// open addressed table from object key to entry, -1 for
+	// empty, a power of two at least twice the entries
+	std::vector<int> m_keyTable;
+	// frame counter used for picking the query slot
+	unsigned int m_frameIndex;
+	// number of objects culled in the current frame
+	int m_culledCount;
+
+	// program and unit cube used for drawing the bounding boxes
+	ResourceHandle m_boundsProgramHandle;
+	ResourceHandle m_boundsMeshHandle;
+	GLuint m_boundsProgram;
+	GLuint m_boundsVAO;
+	GLint m_viewProjectionLocation;
+	GLint m_boundsMinLocation;
+	GLint m_boundsMaxLocation;
+
+	// camera position used for the current queries
+	glm::vec3 m_cameraPosition;
+	// state of the context the queries are drawn in
+	GLStateCache* m_pStateCache;
+
+	// free all of the query objects
+	void DestroyQueries();
+	// find the entry of an object, -1 when it is not known
+	int FindObject(unsigned long long key) const;
+	// find the entry of an object, taking a free one for a new
+	// object - grows the entries when none is free
+	int AcquireObject(unsigned long long key);
+	// add entries with their queries
+	void GrowObjects(int objectCount);
+	// refill the key table from the entries in use
+	void RebuildKeyTable();
+
+public:
+	// create the bounding box program and geometry
+	bool Initialize(ResourceManager* pResourceManager);
+
+	// make room for the passed in number of objects, outside
+	// of the frame, so new objects do not allocate
+	void Reserve(int objectCount);
+
+	// collect the available results of earlier frames and
+	// forget the objects that were not tested for a while
+	void BeginFrame();
+	// drop the history of every object, when the next view
+	// does not follow from the last one
+	void Reset();
+	// check whether an object should be drawn this frame
+	bool IsVisible(unsigned long long key) const;
+	// get the number of objects culled this frame
+	int GetCulledCount() const { return m_culledCount; }
+
+	// prepare the state for issuing bounding box queries
+	void BeginQueries(const glm::mat4& viewProjection, const glm::vec3& cameraPosition);
+	// test one world-space bounding box against the depth buffer
+	void IssueQuery(unsigned long long key, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	// restore the state changed for the queries
+	void EndQueries();
+};
@@ -0,0 +1,405 @@
+///////////////////////////////////////////////////////////////////////////////
+// performancecounters.cpp
+// ============
+// publish live render counters through shared memory
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "PerformanceCounters.h"
+
+#include <atomic>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// declaration of global variables
+namespace
+{
+	// names of the counters used in the segment and reports
+	const char* g_CounterNames[PerformanceCounters::TOTAL_COUNTERS] =
+	{
+		"frameTimeMicroseconds",
+		"drawCalls",
+		"triangles",
+		"uniformUploads",
+		"textureBinds",
+		"stateChanges",
+		"culledObjects",
+		"bytesUploaded",
+		"redundantCalls",
+		"pacingJitter"
+	};
+
+	// exclusive upper limits of the frame time buckets, the
+	// last bucket takes every longer frame
+	const long long g_BucketLimits[PerformanceCounters::HISTOGRAM_BUCKETS] =
+	{
+		4000, 8000, 12000, 16700, 20000, 25000,
+		33400, 50000, 66700, 100000, 250000, 0
+	};
+
+#ifdef _WIN32
+	const char* const g_SharedName = "Local\\cs330_counters";
+#else
+	const char* const g_SharedName = "/cs330_counters";
+#endif
+
+	// how often a reader retries while the writer is busy
+	const int g_ReadAttempts = 64;
+
+	// counters of the frame being rendered
+	std::atomic<long long> g_FrameCounters[PerformanceCounters::TOTAL_COUNTERS];
+	// the published segment, NULL when it was not created
+	PerformanceCounters::SHARED_COUNTERS* g_pShared = NULL;
+#ifdef _WIN32
+	HANDLE g_MappingHandle = NULL;
+#endif
+	// frames finished so far, selects the history row
+	unsigned long long g_FrameNumber = 0;
+}
+
+/***********************************************************
+ *  Add()
+ *
+ *  This function is used for adding to a counter of the
+ *  frame being rendered. The add is relaxed because the
+ *  frame values are only read at the frame boundary.
+ ***********************************************************/
+void PerformanceCounters::Add(COUNTER counter, long long value)
+{
+	if ((counter < 0) || (counter >= TOTAL_COUNTERS))
+	{
+		return;
+	}
+
+	g_FrameCounters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+/***********************************************************
+ *  GetCounterName()
+ *
+ *  This function is used for getting the name of a counter.
+ ***********************************************************/
+const char* PerformanceCounters::GetCounterName(COUNTER counter)
+{
+	if ((counter < 0) || (counter >= TOTAL_COUNTERS))
+	{
+		return("unknown");
+	}
+
+	return(g_CounterNames[counter]);
+}
+
+/***********************************************************
+ *  Publish()
+ *
+ *  This function is used for creating the shared memory
+ *  segment and filling in the parts of the layout that
+ *  never change.
+ ***********************************************************/
+bool PerformanceCounters::Publish()
+{
+	if (NULL != g_pShared)
+	{
+		return(true);
+	}
+
+	void* pMemory = NULL;
+#ifdef _WIN32
+	g_MappingHandle = CreateFileMappingA(
+		INVALID_HANDLE_VALUE,
+		NULL,
+		PAGE_READWRITE,
+		0,
+		(DWORD)sizeof(SHARED_COUNTERS),
+		g_SharedName);
+	if (NULL != g_MappingHandle)
+	{
+		pMemory = MapViewOfFile(g_MappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(SHARED_COUNTERS));
+		if (NULL == pMemory)
+		{
+			CloseHandle(g_MappingHandle);
+			g_MappingHandle = NULL;
+		}
+	}
+	unsigned int processId = (unsigned int)GetCurrentProcessId();
+#else
+	int descriptor = shm_open(g_SharedName, O_CREAT | O_RDWR, 0644);
+	if (descriptor >= 0)
+	{
+		if (ftruncate(descriptor, sizeof(SHARED_COUNTERS)) == 0)
+		{
+			pMemory = mmap(NULL, sizeof(SHARED_COUNTERS), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+			if (MAP_FAILED == pMemory)
+			{
+				pMemory = NULL;
+			}
+		}
+		// the mapping stays valid after the descriptor is closed
+		close(descriptor);
+	}
+	unsigned int processId = (unsigned int)getpid();
+#endif
+
+	if (NULL == pMemory)
+	{
+		std::cout << "Could not create the performance counter segment:" << g_SharedName << std::endl;
+		return(false);
+	}
+
+	g_pShared = static_cast<SHARED_COUNTERS*>(pMemory);
+	memset(pMemory, 0, sizeof(SHARED_COUNTERS));
+	g_pShared->size = (unsigned int)sizeof(SHARED_COUNTERS);
+	g_pShared->counterCount = TOTAL_COUNTERS;
+	g_pShared->historyFrames = HISTORY_FRAMES;
+	g_pShared->histogramBuckets = HISTOGRAM_BUCKETS;
+	g_pShared->processId = processId;
+	for (int i = 0; i < TOTAL_COUNTERS; i++)
+	{
+		strncpy(g_pShared->counterNames[i], g_CounterNames[i], NAME_LENGTH - 1);
+	}
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		g_pShared->bucketLimits[i] = g_BucketLimits[i];
+	}
+
+	// readers check the magic last, so it is written once the
+	// rest of the header is in place
+	g_pShared->version = SHARED_VERSION;
+	std::atomic_thread_fence(std::memory_order_release);
+	g_pShared->magic = SHARED_MAGIC;
+
+	std::cout << "INFO: Publishing performance counters in " << g_SharedName << std::endl;
+
+	return(true);
+}
+
+/***********************************************************
+ *  EndFrame()
+ *
+ *  This function is used for taking the counters of the
+ *  finished frame and writing them into the segment. The
+ *  sequence is made odd for the duration of the write, so
+ *  readers never keep a half written frame.
+ ***********************************************************/
+void PerformanceCounters::EndFrame(double frameMilliseconds)
+{
+	Add(COUNTER_FRAME_TIME, (long long)(frameMilliseconds * 1000.0));
+
+	long long values[TOTAL_COUNTERS];
+	for (int i = 0; i < TOTAL_COUNTERS; i++)
+	{
+		values[i] = g_FrameCounters[i].exchange(0, std::memory_order_relaxed);
+	}
+
+	if (NULL == g_pShared)
+	{
+		g_FrameNumber++;
+		return;
+	}
+
+	int bucket = HISTOGRAM_BUCKETS - 1;
+	for (int i = 0; i < HISTOGRAM_BUCKETS - 1; i++)
+	{
+		if (values[COUNTER_FRAME_TIME] < g_BucketLimits[i])
+		{
+			bucket = i;
+			break;
+		}
+	}
+
+	// only this thread writes the sequence, the fence keeps the
+	// frame writes after the odd value
+	g_pShared->sequence.fetch_add(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	long long* pHistory = g_pShared->history[g_FrameNumber % HISTORY_FRAMES];
+	for (int i = 0; i < TOTAL_COUNTERS; i++)
+	{
+		g_pShared->lastFrame[i] = values[i];
+		g_pShared->totals[i] += values[i];
+		pHistory[i] = values[i];
+	}
+	g_pShared->frameTimeHistogram[bucket]++;
+	g_FrameNumber++;
+	g_pShared->frameNumber = g_FrameNumber;
+
+	g_pShared->sequence.fetch_add(1, std::memory_order_release);
+}
+
+/***********************************************************
+ *  Shutdown()
+ *
+ *  This function is used for unmapping and removing the
+ *  shared memory segment.
+ ***********************************************************/
+void PerformanceCounters::Shutdown()
+{
+	if (NULL == g_pShared)
+	{
+		return;
+	}
+
+	// readers that still have it mapped see a stale layout
+	g_pShared->magic = 0;
+
+#ifdef _WIN32
+	UnmapViewOfFile(g_pShared);
+	CloseHandle(g_MappingHandle);
+	g_MappingHandle = NULL;
+#else
+	munmap(g_pShared, sizeof(SHARED_COUNTERS));
+	shm_unlink(g_SharedName);
+#endif
+	g_pShared = NULL;
+}
+
+/***********************************************************
+ *  SharedCounterReader()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+PerformanceCounters::SharedCounterReader::SharedCounterReader()
+{
+	m_pShared = NULL;
+#ifdef _WIN32
+	m_mappingHandle = NULL;
+#endif
+}
+
+/***********************************************************
+ *  ~SharedCounterReader()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+PerformanceCounters::SharedCounterReader::~SharedCounterReader()
+{
+	Close();
+}
+
+/***********************************************************
+ *  Open()
+ *
+ *  This method is used for mapping the segment published
+ *  by a running process, read only.
+ ***********************************************************/
+bool PerformanceCounters::SharedCounterReader::Open()
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, g_SharedName);
+	if (NULL == mapping)
+	{
+		return(false);
+	}
+
+	void* pMemory = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(SHARED_COUNTERS));
+	if (NULL == pMemory)
+	{
+		CloseHandle(mapping);
+		return(false);
+	}
+	m_mappingHandle = mapping;
+#else
+	int descriptor = shm_open(g_SharedName, O_RDONLY, 0);
+	if (descriptor < 0)
+	{
+		return(false);
+	}
+
+	struct stat fileStatus;
+	void* pMemory = NULL;
+	if ((fstat(descriptor, &fileStatus) == 0) && (fileStatus.st_size >= (off_t)sizeof(SHARED_COUNTERS)))
+	{
+		pMemory = mmap(NULL, sizeof(SHARED_COUNTERS), PROT_READ, MAP_SHARED, descriptor, 0);
+		if (MAP_FAILED == pMemory)
+		{
+			pMemory = NULL;
+		}
+	}
+	close(descriptor);
+
+	if (NULL == pMemory)
+	{
+		return(false);
+	}
+#endif
+
+	m_pShared = static_cast<const SHARED_COUNTERS*>(pMemory);
+
+	return(true);
+}
+
+/***********************************************************
+ *  Close()
+ *
+ *  This method is used for unmapping the segment.
+ ***********************************************************/
+void PerformanceCounters::SharedCounterReader::Close()
+{
+	if (NULL == m_pShared)
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(m_pShared);
+	CloseHandle(m_mappingHandle);
+	m_mappingHandle = NULL;
+#else
+	munmap(const_cast<SHARED_COUNTERS*>(m_pShared), sizeof(SHARED_COUNTERS));
+#endif
+	m_pShared = NULL;
+}
+
+/***********************************************************
+ *  Read()
+ *
+ *  This method is used for copying the segment while the
+ *  writer is between frames. The copy is retried when the
+ *  sequence was odd or moved on while copying.
+ ***********************************************************/
+bool PerformanceCounters::SharedCounterReader::Read(SHARED_COUNTERS& snapshot) const
+{
+	if (NULL == m_pShared)
+	{
+		return(false);
+	}
+
+	for (int attempt = 0; attempt < g_ReadAttempts; attempt++)
+	{
+		unsigned int sequenceBefore = m_pShared->sequence.load(std::memory_order_acquire);
+		if ((sequenceBefore & 1u) != 0)
+		{
+			continue;
+		}
+
+		memcpy((void*)&snapshot, (const void*)m_pShared, sizeof(SHARED_COUNTERS));
+
+		// the fence keeps the copy before the second load
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (m_pShared->sequence.load(std::memory_order_relaxed) == sequenceBefore)
+		{
+			return((snapshot.magic == SHARED_MAGIC) &&
+				(snapshot.version == SHARED_VERSION) &&
+				(snapshot.size == sizeof(SHARED_COUNTERS)));
+		}
+	}
+
+	return(false);
+}
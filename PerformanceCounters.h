@@ -0,0 +1,146 @@
+///////////////////////////////////////////////////////////////////////////////
+// performancecounters.h
+// ============
+// publish live render counters through shared memory
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+
+/***********************************************************
+ *  Performance counters
+ *
+ *  Code on any thread adds to the counters of the frame
+ *  being rendered with a relaxed atomic add, so counting
+ *  never takes a lock. At the end of every frame the render
+ *  thread moves the frame values into a named shared memory
+ *  segment, where another process can read them without
+ *  attaching to or slowing down the renderer.
+ *
+ *  Shared memory layout, SHARED_COUNTERS below, all fields
+ *  little endian and naturally aligned:
+ *    magic, version, size      - identify the layout
+ *    counterCount, historyFrames, histogramBuckets
+ *    sequence                  - odd while the segment is
+ *                                being written, readers
+ *                                retry until it is even and
+ *                                unchanged around their copy
+ *    processId                 - writer process
+ *    frameNumber               - frames published so far
+ *    lastFrame[counter]        - values of the newest frame
+ *    totals[counter]           - sums over every frame
+ *    history[frame][counter]   - the newest historyFrames
+ *                                frames, the frame number
+ *                                modulo historyFrames picks
+ *                                the row
+ *    bucketLimits[bucket]      - exclusive upper frame time
+ *                                of each bucket, microseconds
+ *    frameTimeHistogram[bucket]- frames per bucket, the last
+ *                                bucket has no upper limit
+ *    counterNames[counter]     - zero terminated names
+ *
+ *  The segment is "/cs330_counters" as POSIX shared memory,
+ *  or "Local\cs330_counters" as a Windows file mapping.
+ ***********************************************************/
+namespace PerformanceCounters
+{
+	// values counted for every frame
+	enum COUNTER
+	{
+		COUNTER_FRAME_TIME,			// microseconds from frame to frame
+		COUNTER_DRAW_CALLS,
+		COUNTER_TRIANGLES,
+		COUNTER_UNIFORM_UPLOADS,
+		COUNTER_TEXTURE_BINDS,
+		COUNTER_STATE_CHANGES,		// programs, blending, depth and masks
+		COUNTER_CULLED_OBJECTS,
+		COUNTER_BYTES_UPLOADED,		// buffer and texture data sent to the GPU
+		COUNTER_REDUNDANT_CALLS,	// GL calls the state cache dropped
+		COUNTER_PACING_JITTER,		// microseconds from the paced frame interval
+		TOTAL_COUNTERS
+	};
+
+	// identifies the layout, "PCNT" in little endian
+	const unsigned int SHARED_MAGIC = 0x544E4350;
+	// bumped whenever the layout changes
+	const unsigned int SHARED_VERSION = 3;
+	// newest frames kept for the readers
+	const int HISTORY_FRAMES = 256;
+	// buckets of the frame time histogram
+	const int HISTOGRAM_BUCKETS = 12;
+	// longest counter name including the terminator
+	const int NAME_LENGTH = 32;
+
+	// the segment published every frame
+	struct SHARED_COUNTERS
+	{
+		unsigned int magic;
+		unsigned int version;
+		unsigned int size;
+		unsigned int counterCount;
+		unsigned int historyFrames;
+		unsigned int histogramBuckets;
+		std::atomic<unsigned int> sequence;
+		unsigned int processId;
+		unsigned long long frameNumber;
+		long long lastFrame[TOTAL_COUNTERS];
+		long long totals[TOTAL_COUNTERS];
+		long long history[HISTORY_FRAMES][TOTAL_COUNTERS];
+		long long bucketLimits[HISTOGRAM_BUCKETS];
+		unsigned long long frameTimeHistogram[HISTOGRAM_BUCKETS];
+		char counterNames[TOTAL_COUNTERS][NAME_LENGTH];
+	};
+	// the sequence is shared with other processes, so it has to
+	// be a plain lock-free integer inside a plain layout
+	static_assert(ATOMIC_INT_LOCK_FREE == 2, "the shared sequence needs a lock-free atomic");
+	static_assert(sizeof(std::atomic<unsigned int>) == sizeof(unsigned int), "the shared sequence changes the layout");
+	static_assert(std::is_standard_layout<SHARED_COUNTERS>::value, "the shared counters need a standard layout");
+
+	// add to a counter of the frame being rendered, safe to
+	// call from any thread and never blocks
+	void Add(COUNTER counter, long long value);
+
+	// create the shared memory segment, false when it could
+	// not be created - the counters still work without it
+	bool Publish();
+	// move the counters of the finished frame into the
+	// segment and start the next frame, render thread only
+	void EndFrame(double frameMilliseconds);
+	// remove the shared memory segment
+	void Shutdown();
+
+	// get the name of a counter used in the segment and reports
+	const char* GetCounterName(COUNTER counter);
+
+	// read only view of the segment of a running process
+	class SharedCounterReader
+	{
+	public:
+		// constructor
+		SharedCounterReader();
+		// destructor
+		~SharedCounterReader();
+
+	private:
+		const SHARED_COUNTERS* m_pShared;
+#ifdef _WIN32
+		void* m_mappingHandle;
+#endif
+
+		// disable copying, the reader owns the mapping
+		SharedCounterReader(const SharedCounterReader&);
+		SharedCounterReader& operator=(const SharedCounterReader&);
+
+	public:
+		// map the segment, false when no process publishes it
+		bool Open();
+		// unmap the segment
+		void Close();
+		// copy a consistent snapshot of the segment, false when
+		// the layout does not match or the writer kept changing it
+		bool Read(SHARED_COUNTERS& snapshot) const;
+	};
+}
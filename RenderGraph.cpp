@@ -0,0 +1,966 @@
+///////////////////////////////////////////////////////////////////////////////
+// rendergraph.cpp
+// ============
+// order the render passes of a frame from their declared resource use
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "RenderGraph.h"
+#include "MemoryAccounting.h"
+
+#include <iostream>
+
+// declaration of global variables
+namespace
+{
+	const char* g_TransientTextureName = "renderGraphTextures";
+	const char* g_TransientBufferName = "renderGraphBuffers";
+
+	// most color targets one pass can write
+	const int g_MaxColorAttachments = 8;
+
+	/***********************************************************
+	 *  IsDepthFormat()
+	 *
+	 *  This function is used for checking if a texture format
+	 *  is attached as depth, and if it also holds stencil.
+	 ***********************************************************/
+	bool IsDepthFormat(GLenum internalFormat, bool& bStencil)
+	{
+		bStencil = false;
+		switch (internalFormat)
+		{
+		case GL_DEPTH24_STENCIL8:
+		case GL_DEPTH32F_STENCIL8:
+			bStencil = true;
+			return(true);
+		case GL_DEPTH_COMPONENT16:
+		case GL_DEPTH_COMPONENT24:
+		case GL_DEPTH_COMPONENT32:
+		case GL_DEPTH_COMPONENT32F:
+			return(true);
+		default:
+			return(false);
+		}
+	}
+
+	/***********************************************************
+	 *  ContainsIndex()
+	 *
+	 *  This function is used for checking if a list of pass or
+	 *  resource indices holds the passed in one.
+	 ***********************************************************/
+	bool ContainsIndex(const std::vector<int>& indices, int index)
+	{
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			if (indices[i] == index)
+			{
+				return(true);
+			}
+		}
+		return(false);
+	}
+}
+
+// out of class definition for the integral constant
+const int RenderGraph::INVALID_ID;
+
+/***********************************************************
+ *  RenderGraph()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+RenderGraph::RenderGraph()
+{
+	m_bDirty = true;
+	m_bCompiled = false;
+}
+
+/***********************************************************
+ *  ~RenderGraph()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+RenderGraph::~RenderGraph()
+{
+	DestroyPassFramebuffers();
+	for (size_t i = 0; i < m_physicalResources.size(); i++)
+	{
+		m_physicalResources[i].bAssigned = false;
+	}
+	ReleaseUnassignedResources();
+}
+
+/***********************************************************
+ *  GetTexelBytes()
+ *
+ *  This method is used for getting the size of one texel of
+ *  a texture format, for the memory accounting.
+ ***********************************************************/
+int RenderGraph::GetTexelBytes(GLenum internalFormat)
+{
+	switch (internalFormat)
+	{
+	case GL_R8:
+		return(1);
+	case GL_RG8:
+	case GL_R16F:
+	case GL_DEPTH_COMPONENT16:
+		return(2);
+	case GL_RGBA32F:
+		return(16);
+	case GL_RGBA16F:
+	case GL_RG32F:
+	case GL_DEPTH32F_STENCIL8:
+		return(8);
+	default:
+		return(4);
+	}
+}
+
+/***********************************************************
+ *  AddResource()
+ *
+ *  This method is used for adding a resource of either kind
+ *  to the graph.
+ ***********************************************************/
+int RenderGraph::AddResource(const char* name, RESOURCE_TYPE type, bool bImported)
+{
+	RESOURCE resource;
+	resource.name = name;
+	resource.type = type;
+	resource.bImported = bImported;
+	resource.importedID = 0;
+	resource.texture.width = 0;
+	resource.texture.height = 0;
+	resource.texture.internalFormat = GL_RGBA8;
+	resource.bufferSize = 0;
+	resource.physical = INVALID_ID;
+	resource.firstUse = INVALID_ID;
+	resource.lastUse = INVALID_ID;
+	m_resources.push_back(resource);
+
+	m_bDirty = true;
+	return((int)m_resources.size() - 1);
+}
+
+/***********************************************************
+ *  IsValidPass()
+ *
+ *  This method is used for checking a pass index passed in
+ *  by the caller.
+ ***********************************************************/
+bool RenderGraph::IsValidPass(int pass) const
+{
+	if ((pass < 0) || (pass >= (int)m_passes.size()))
+	{
+		std::cout << "Render graph pass does not exist:" << pass << std::endl;
+		return(false);
+	}
+	return(true);
+}
+
+/***********************************************************
+ *  IsValidResource()
+ *
+ *  This method is used for checking a resource index passed
+ *  in by the caller.
+ ***********************************************************/
+bool RenderGraph::IsValidResource(int resource) const
+{
+	if ((resource < 0) || (resource >= (int)m_resources.size()))
+	{
+		std::cout << "Render graph resource does not exist:" << resource << std::endl;
+		return(false);
+	}
+	return(true);
+}
+
+/***********************************************************
+ *  CreateTexture()
+ *
+ *  This method is used for adding a texture the graph owns.
+ *  It is only allocated while passes use it.
+ ***********************************************************/
+int RenderGraph::CreateTexture(const char* name, const TEXTURE_DESC& desc)
+{
+	int resource = AddResource(name, RESOURCE_TEXTURE, false);
+	m_resources[resource].texture = desc;
+	return(resource);
+}
+
+/***********************************************************
+ *  CreateBuffer()
+ *
+ *  This method is used for adding a buffer the graph owns.
+ ***********************************************************/
+int RenderGraph::CreateBuffer(const char* name, GLsizeiptr size)
+{
+	int resource = AddResource(name, RESOURCE_BUFFER, false);
+	m_resources[resource].bufferSize = size;
+	return(resource);
+}
+
+/***********************************************************
+ *  ImportTexture()
+ *
+ *  This method is used for adding a texture owned outside
+ *  of the graph, so the passes using it can be ordered.
+ ***********************************************************/
+int RenderGraph::ImportTexture(const char* name, GLuint texture)
+{
+	int resource = AddResource(name, RESOURCE_TEXTURE, true);
+	m_resources[resource].importedID = texture;
+	return(resource);
+}
+
+/***********************************************************
+ *  ImportBuffer()
+ *
+ *  This method is used for adding a buffer owned outside of
+ *  the graph.
+ ***********************************************************/
+int RenderGraph::ImportBuffer(const char* name, GLuint buffer)
+{
+	int resource = AddResource(name, RESOURCE_BUFFER, true);
+	m_resources[resource].importedID = buffer;
+	return(resource);
+}
+
+/***********************************************************
+ *  SetTextureSize()
+ *
+ *  This method is used for resizing a transient texture.
+ *  The graph is only recompiled when the size changed.
+ ***********************************************************/
+void RenderGraph::SetTextureSize(int resource, int width, int height)
+{
+	if (IsValidResource(resource) == false)
+	{
+		return;
+	}
+
+	TEXTURE_DESC& texture = m_resources[resource].texture;
+	if ((texture.width != width) || (texture.height != height))
+	{
+		texture.width = width;
+		texture.height = height;
+		m_bDirty = true;
+	}
+}
+
+/***********************************************************
+ *  SetImportedID()
+ *
+ *  This method is used for changing the GL object behind an
+ *  imported resource. The order does not depend on it, so
+ *  the graph does not need to be recompiled.
+ ***********************************************************/
+void RenderGraph::SetImportedID(int resource, GLuint ID)
+{
+	if ((IsValidResource(resource) == true) && (m_resources[resource].bImported == true))
+	{
+		m_resources[resource].importedID = ID;
+	}
+}
+
+/***********************************************************
+ *  AddPass()
+ *
+ *  This method is used for adding a pass to the graph. The
+ *  passed in function records the GL work of the pass.
+ ***********************************************************/
+int RenderGraph::AddPass(const char* name, std::function<void()> execute)
+{
+	PASS pass;
+	pass.name = name;
+	pass.execute = execute;
+	pass.bSideEffect = false;
+	pass.bEnabled = true;
+	pass.bCulled = false;
+	pass.framebuffer = 0;
+	pass.viewportWidth = 0;
+	pass.viewportHeight = 0;
+	m_passes.push_back(pass);
+
+	m_bDirty = true;
+	return((int)m_passes.size() - 1);
+}
+
+/***********************************************************
+ *  Read()
+ *
+ *  This method is used for declaring a resource the pass
+ *  reads, which orders it after the passes writing it.
+ ***********************************************************/
+void RenderGraph::Read(int pass, int resource)
+{
+	if ((IsValidPass(pass) == false) || (IsValidResource(resource) == false))
+	{
+		return;
+	}
+	if (ContainsIndex(m_passes[pass].reads, resource) == false)
+	{
+		m_passes[pass].reads.push_back(resource);
+		m_bDirty = true;
+	}
+}
+
+/***********************************************************
+ *  Write()
+ *
+ *  This method is used for declaring a resource the pass
+ *  writes. Passes writing the same resource keep the order
+ *  they were added in.
+ ***********************************************************/
+void RenderGraph::Write(int pass, int resource)
+{
+	if ((IsValidPass(pass) == false) || (IsValidResource(resource) == false))
+	{
+		return;
+	}
+	if (ContainsIndex(m_passes[pass].writes, resource) == false)
+	{
+		m_passes[pass].writes.push_back(resource);
+		m_bDirty = true;
+	}
+}
+
+/***********************************************************
+ *  SetSideEffect()
+ *
+ *  This method is used for keeping a pass whose results are
+ *  used outside of the graph, like presenting or capture.
+ ***********************************************************/
+void RenderGraph::SetSideEffect(int pass, bool bSideEffect)
+{
+	if ((IsValidPass(pass) == true) && (m_passes[pass].bSideEffect != bSideEffect))
+	{
+		m_passes[pass].bSideEffect = bSideEffect;
+		m_bDirty = true;
+	}
+}
+
+/***********************************************************
+ *  SetPassEnabled()
+ *
+ *  This method is used for leaving a pass out of the graph
+ *  without removing it.
+ ***********************************************************/
+void RenderGraph::SetPassEnabled(int pass, bool bEnabled)
+{
+	if ((IsValidPass(pass) == true) && (m_passes[pass].bEnabled != bEnabled))
+	{
+		m_passes[pass].bEnabled = bEnabled;
+		m_bDirty = true;
+	}
+}
+
+/***********************************************************
+ *  CullPasses()
+ *
+ *  This method is used for culling the passes that do not
+ *  contribute to a side effect. Each pass counts the
+ *  resources it writes and each resource counts its
+ *  readers. Starting from the unread resources, a pass is
+ *  culled once none of its writes are read, which may in
+ *  turn leave its own inputs unread.
+ ***********************************************************/
+void RenderGraph::CullPasses()
+{
+	std::vector<int> passReferences(m_passes.size(), 0);
+	std::vector<int> resourceReferences(m_resources.size(), 0);
+	std::vector<int> unreadResources;
+
+	for (size_t p = 0; p < m_passes.size(); p++)
+	{
+		PASS& pass = m_passes[p];
+		pass.bCulled = (pass.bEnabled == false);
+		if (pass.bCulled == false)
+		{
+			passReferences[p] = (int)pass.writes.size();
+			for (size_t r = 0; r < pass.reads.size(); r++)
+			{
+				resourceReferences[pass.reads[r]]++;
+			}
+		}
+	}
+
+	for (size_t r = 0; r < m_resources.size(); r++)
+	{
+		if (resourceReferences[r] == 0)
+		{
+			unreadResources.push_back((int)r);
+		}
+	}
+
+	// passes writing nothing only live for their side effect
+	for (size_t p = 0; p < m_passes.size(); p++)
+	{
+		PASS& pass = m_passes[p];
+		if ((pass.bCulled == false) && (passReferences[p] == 0) && (pass.bSideEffect == false))
+		{
+			pass.bCulled = true;
+			for (size_t r = 0; r < pass.reads.size(); r++)
+			{
+				if (--resourceReferences[pass.reads[r]] == 0)
+				{
+					unreadResources.push_back(pass.reads[r]);
+				}
+			}
+		}
+	}
+
+	while (unreadResources.empty() == false)
+	{
+		int resource = unreadResources.back();
+		unreadResources.pop_back();
+
+		for (size_t p = 0; p < m_passes.size(); p++)
+		{
+			PASS& pass = m_passes[p];
+			if ((pass.bCulled == true) || (ContainsIndex(pass.writes, resource) == false))
+			{
+				continue;
+			}
+			if ((--passReferences[p] > 0) || (pass.bSideEffect == true))
+			{
+				continue;
+			}
+
+			pass.bCulled = true;
+			for (size_t r = 0; r < pass.reads.size(); r++)
+			{
+				if (--resourceReferences[pass.reads[r]] == 0)
+				{
+					unreadResources.push_back(pass.reads[r]);
+				}
+			}
+		}
+	}
+}
+
+/***********************************************************
+ *  SortPasses()
+ *
+ *  This method is used for ordering the live passes. The
+ *  writers of a resource run in the order they were added,
+ *  and its readers run after the last of them. Among the
+ *  passes that are ready, the one added first runs first.
+ ***********************************************************/
+bool RenderGraph::SortPasses()
+{
+	size_t passCount = m_passes.size();
+	std::vector<std::vector<int> > dependents(passCount);
+	std::vector<int> waitingOn(passCount, 0);
+
+	for (size_t r = 0; r < m_resources.size(); r++)
+	{
+		int lastWriter = INVALID_ID;
+		for (size_t p = 0; p < passCount; p++)
+		{
+			const PASS& pass = m_passes[p];
+			if ((pass.bCulled == true) || (ContainsIndex(pass.writes, (int)r) == false))
+			{
+				continue;
+			}
+			if (lastWriter != INVALID_ID)
+			{
+				dependents[lastWriter].push_back((int)p);
+				waitingOn[p]++;
+			}
+			lastWriter = (int)p;
+		}
+
+		for (size_t p = 0; p < passCount; p++)
+		{
+			const PASS& pass = m_passes[p];
+			if ((pass.bCulled == true) || (ContainsIndex(pass.reads, (int)r) == false) ||
+				(ContainsIndex(pass.writes, (int)r) == true))
+			{
+				continue;
+			}
+			if (lastWriter != INVALID_ID)
+			{
+				dependents[lastWriter].push_back((int)p);
+				waitingOn[p]++;
+			}
+			else if (m_resources[r].bImported == false)
+			{
+				std::cout << "Render graph pass " << pass.name << " reads "
+					<< m_resources[r].name << " before any pass writes it" << std::endl;
+			}
+		}
+	}
+
+	size_t livePasses = 0;
+	std::vector<bool> bScheduled(passCount, false);
+	for (size_t p = 0; p < passCount; p++)
+	{
+		if (m_passes[p].bCulled == false)
+		{
+			livePasses++;
+		}
+	}
+
+	m_schedule.clear();
+	while (m_schedule.size() < livePasses)
+	{
+		int ready = INVALID_ID;
+		for (size_t p = 0; p < passCount; p++)
+		{
+			if ((m_passes[p].bCulled == false) && (bScheduled[p] == false) && (waitingOn[p] == 0))
+			{
+				ready = (int)p;
+				break;
+			}
+		}
+		if (ready == INVALID_ID)
+		{
+			std::cout << "Render graph passes depend on each other in a cycle" << std::endl;
+			m_schedule.clear();
+			return(false);
+		}
+
+		bScheduled[ready] = true;
+		m_schedule.push_back(ready);
+		for (size_t d = 0; d < dependents[ready].size(); d++)
+		{
+			waitingOn[dependents[ready][d]]--;
+		}
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  AcquirePhysicalResource()
+ *
+ *  This method is used for finding a free GL object that
+ *  matches a transient, or creating one. Textures need the
+ *  same size and format, buffers the smallest one that is
+ *  large enough.
+ ***********************************************************/
+int RenderGraph::AcquirePhysicalResource(const RESOURCE& resource)
+{
+	int match = INVALID_ID;
+	for (size_t i = 0; i < m_physicalResources.size(); i++)
+	{
+		const PHYSICAL_RESOURCE& physical = m_physicalResources[i];
+		if ((physical.bInUse == true) || (physical.type != resource.type))
+		{
+			continue;
+		}
+
+		if (resource.type == RESOURCE_TEXTURE)
+		{
+			if ((physical.texture.width == resource.texture.width) &&
+				(physical.texture.height == resource.texture.height) &&
+				(physical.texture.internalFormat == resource.texture.internalFormat))
+			{
+				match = (int)i;
+				break;
+			}
+		}
+		else if ((physical.bufferSize >= resource.bufferSize) &&
+			((match == INVALID_ID) || (physical.bufferSize < m_physicalResources[match].bufferSize)))
+		{
+			match = (int)i;
+		}
+	}
+
+	if (match == INVALID_ID)
+	{
+		PHYSICAL_RESOURCE physical;
+		physical.type = resource.type;
+		physical.texture = resource.texture;
+		physical.bufferSize = resource.bufferSize;
+		physical.ID = 0;
+		physical.bInUse = false;
+		physical.bAssigned = false;
+
+		if (resource.type == RESOURCE_TEXTURE)
+		{
+			bool bStencil = false;
+			bool bDepth = IsDepthFormat(resource.texture.internalFormat, bStencil);
+			GLenum format = bDepth ? (bStencil ? GL_DEPTH_STENCIL : GL_DEPTH_COMPONENT) : GL_RGBA;
+			GLenum type = bStencil ? GL_UNSIGNED_INT_24_8 : (bDepth ? GL_FLOAT : GL_UNSIGNED_BYTE);
+			if (resource.texture.internalFormat == GL_DEPTH32F_STENCIL8)
+			{
+				type = GL_FLOAT_32_UNSIGNED_INT_24_8_REV;
+			}
+
+			glGenTextures(1, &physical.ID);
+			glBindTexture(GL_TEXTURE_2D, physical.ID);
+			glTexImage2D(GL_TEXTURE_2D, 0, resource.texture.internalFormat,
+				resource.texture.width, resource.texture.height, 0, format, type, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glBindTexture(GL_TEXTURE_2D, 0);
+
+			MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_TEXTURE, g_TransientTextureName,
+				(long long)resource.texture.width * resource.texture.height * GetTexelBytes(resource.texture.internalFormat));
+		}
+		else
+		{
+			glGenBuffers(1, &physical.ID);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, physical.ID);
+			glBufferData(GL_COPY_WRITE_BUFFER, resource.bufferSize, NULL, GL_DYNAMIC_DRAW);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+			MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_STORAGE_BUFFER, g_TransientBufferName,
+				(long long)resource.bufferSize);
+		}
+
+		m_physicalResources.push_back(physical);
+		match = (int)m_physicalResources.size() - 1;
+	}
+
+	m_physicalResources[match].bInUse = true;
+	m_physicalResources[match].bAssigned = true;
+	return(match);
+}
+
+/***********************************************************
+ *  AssignPhysicalResources()
+ *
+ *  This method is used for walking the schedule and giving
+ *  each transient a GL object at its first use. The object
+ *  is free for the next transient after its last use, so
+ *  only the transients alive at the same time take memory.
+ ***********************************************************/
+void RenderGraph::AssignPhysicalResources()
+{
+	for (size_t r = 0; r < m_resources.size(); r++)
+	{
+		m_resources[r].physical = INVALID_ID;
+		m_resources[r].firstUse = INVALID_ID;
+		m_resources[r].lastUse = INVALID_ID;
+	}
+	for (size_t i = 0; i < m_physicalResources.size(); i++)
+	{
+		m_physicalResources[i].bInUse = false;
+		m_physicalResources[i].bAssigned = false;
+	}
+
+	for (size_t step = 0; step < m_schedule.size(); step++)
+	{
+		const PASS& pass = m_passes[m_schedule[step]];
+		for (int list = 0; list < 2; list++)
+		{
+			const std::vector<int>& resources = (list == 0) ? pass.reads : pass.writes;
+			for (size_t r = 0; r < resources.size(); r++)
+			{
+				RESOURCE& resource = m_resources[resources[r]];
+				if (resource.firstUse == INVALID_ID)
+				{
+					resource.firstUse = (int)step;
+				}
+				resource.lastUse = (int)step;
+			}
+		}
+	}
+
+	for (size_t step = 0; step < m_schedule.size(); step++)
+	{
+		for (size_t r = 0; r < m_resources.size(); r++)
+		{
+			RESOURCE& resource = m_resources[r];
+			if ((resource.bImported == false) && (resource.firstUse == (int)step))
+			{
+				resource.physical = AcquirePhysicalResource(resource);
+			}
+		}
+		for (size_t r = 0; r < m_resources.size(); r++)
+		{
+			const RESOURCE& resource = m_resources[r];
+			if ((resource.physical != INVALID_ID) && (resource.lastUse == (int)step))
+			{
+				m_physicalResources[resource.physical].bInUse = false;
+			}
+		}
+	}
+}
+
+/***********************************************************
+ *  ReleaseUnassignedResources()
+ *
+ *  This method is used for deleting the GL objects that no
+ *  transient of the compiled graph uses any more.
+ ***********************************************************/
+void RenderGraph::ReleaseUnassignedResources()
+{
+	size_t kept = 0;
+	std::vector<int> remap(m_physicalResources.size(), INVALID_ID);
+	for (size_t i = 0; i < m_physicalResources.size(); i++)
+	{
+		PHYSICAL_RESOURCE& physical = m_physicalResources[i];
+		if (physical.bAssigned == true)
+		{
+			remap[i] = (int)kept;
+			m_physicalResources[kept++] = physical;
+			continue;
+		}
+
+		if (physical.type == RESOURCE_TEXTURE)
+		{
+			glDeleteTextures(1, &physical.ID);
+			MemoryAccounting::Free(MemoryAccounting::CATEGORY_TEXTURE, g_TransientTextureName,
+				(long long)physical.texture.width * physical.texture.height * GetTexelBytes(physical.texture.internalFormat));
+		}
+		else
+		{
+			glDeleteBuffers(1, &physical.ID);
+			MemoryAccounting::Free(MemoryAccounting::CATEGORY_STORAGE_BUFFER, g_TransientBufferName,
+				(long long)physical.bufferSize);
+		}
+	}
+	m_physicalResources.resize(kept);
+
+	for (size_t r = 0; r < m_resources.size(); r++)
+	{
+		if (m_resources[r].physical != INVALID_ID)
+		{
+			m_resources[r].physical = remap[m_resources[r].physical];
+		}
+	}
+}
+
+/***********************************************************
+ *  DestroyPassFramebuffers()
+ *
+ *  This method is used for deleting the pass targets.
+ ***********************************************************/
+void RenderGraph::DestroyPassFramebuffers()
+{
+	for (size_t p = 0; p < m_passes.size(); p++)
+	{
+		PASS& pass = m_passes[p];
+		if (0 != pass.framebuffer)
+		{
+			glDeleteFramebuffers(1, &pass.framebuffer);
+			pass.framebuffer = 0;
+		}
+		pass.viewportWidth = 0;
+		pass.viewportHeight = 0;
+	}
+}
+
+/***********************************************************
+ *  CreatePassFramebuffers()
+ *
+ *  This method is used for creating a framebuffer for each
+ *  scheduled pass writing transient textures, with color
+ *  targets in the order they were declared. Passes writing
+ *  only imported textures bind their own target.
+ ***********************************************************/
+bool RenderGraph::CreatePassFramebuffers()
+{
+	DestroyPassFramebuffers();
+
+	bool bComplete = true;
+	for (size_t step = 0; step < m_schedule.size(); step++)
+	{
+		PASS& pass = m_passes[m_schedule[step]];
+		GLenum drawBuffers[g_MaxColorAttachments];
+		int colorCount = 0;
+
+		for (size_t w = 0; w < pass.writes.size(); w++)
+		{
+			const RESOURCE& resource = m_resources[pass.writes[w]];
+			if ((resource.bImported == true) || (resource.type != RESOURCE_TEXTURE))
+			{
+				continue;
+			}
+
+			if (0 == pass.framebuffer)
+			{
+				glGenFramebuffers(1, &pass.framebuffer);
+				glBindFramebuffer(GL_FRAMEBUFFER, pass.framebuffer);
+				pass.viewportWidth = resource.texture.width;
+				pass.viewportHeight = resource.texture.height;
+			}
+
+			GLuint texture = m_physicalResources[resource.physical].ID;
+			bool bStencil = false;
+			if (IsDepthFormat(resource.texture.internalFormat, bStencil) == true)
+			{
+				GLenum attachment = bStencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+				glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture, 0);
+			}
+			else if (colorCount < g_MaxColorAttachments)
+			{
+				drawBuffers[colorCount] = GL_COLOR_ATTACHMENT0 + colorCount;
+				glFramebufferTexture2D(GL_FRAMEBUFFER, drawBuffers[colorCount], GL_TEXTURE_2D, texture, 0);
+				colorCount++;
+			}
+		}
+
+		if (0 == pass.framebuffer)
+		{
+			continue;
+		}
+
+		if (colorCount > 0)
+		{
+			glDrawBuffers(colorCount, drawBuffers);
+		}
+		else
+		{
+			glDrawBuffer(GL_NONE);
+			glReadBuffer(GL_NONE);
+		}
+
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		if (status != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cout << "Could not create render graph target for pass " << pass.name
+				<< ", status:" << status << std::endl;
+			bComplete = false;
+		}
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	return(bComplete);
+}
+
+/***********************************************************
+ *  Compile()
+ *
+ *  This method is used for turning the declared passes into
+ *  a schedule. The passes are culled, ordered, and their
+ *  transients are given GL objects and targets.
+ ***********************************************************/
+bool RenderGraph::Compile()
+{
+	m_bDirty = false;
+	m_bCompiled = false;
+
+	CullPasses();
+	if (SortPasses() == false)
+	{
+		return(false);
+	}
+
+	AssignPhysicalResources();
+	ReleaseUnassignedResources();
+	if (CreatePassFramebuffers() == false)
+	{
+		return(false);
+	}
+
+	m_bCompiled = true;
+	return(true);
+}
+
+/***********************************************************
+ *  Execute()
+ *
+ *  This method is used for running the compiled passes in
+ *  order, binding the target of each one first.
+ ***********************************************************/
+void RenderGraph::Execute()
+{
+	if (m_bCompiled == false)
+	{
+		return;
+	}
+
+	for (size_t step = 0; step < m_schedule.size(); step++)
+	{
+		PASS& pass = m_passes[m_schedule[step]];
+		if (0 != pass.framebuffer)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, pass.framebuffer);
+			glViewport(0, 0, pass.viewportWidth, pass.viewportHeight);
+		}
+		if (pass.execute)
+		{
+			pass.execute();
+		}
+	}
+}
+
+/***********************************************************
+ *  GetTexture()
+ *
+ *  This method is used for getting the texture behind a
+ *  resource, for the passes binding it as an input.
+ ***********************************************************/
+GLuint RenderGraph::GetTexture(int resource) const
+{
+	if ((resource < 0) || (resource >= (int)m_resources.size()) ||
+		(m_resources[resource].type != RESOURCE_TEXTURE))
+	{
+		return(0);
+	}
+	if (m_resources[resource].bImported == true)
+	{
+		return(m_resources[resource].importedID);
+	}
+	if (m_resources[resource].physical == INVALID_ID)
+	{
+		return(0);
+	}
+	return(m_physicalResources[m_resources[resource].physical].ID);
+}
+
+/***********************************************************
+ *  GetBuffer()
+ *
+ *  This method is used for getting the buffer behind a
+ *  resource.
+ ***********************************************************/
+GLuint RenderGraph::GetBuffer(int resource) const
+{
+	if ((resource < 0) || (resource >= (int)m_resources.size()) ||
+		(m_resources[resource].type != RESOURCE_BUFFER))
+	{
+		return(0);
+	}
+	if (m_resources[resource].bImported == true)
+	{
+		return(m_resources[resource].importedID);
+	}
+	if (m_resources[resource].physical == INVALID_ID)
+	{
+		return(0);
+	}
+	return(m_physicalResources[m_resources[resource].physical].ID);
+}
+
+/***********************************************************
+ *  WriteSchedule()
+ *
+ *  This method is used for writing the compiled pass order,
+ *  the culled passes and the GL object each transient uses.
+ ***********************************************************/
+void RenderGraph::WriteSchedule(std::ostream& output) const
+{
+	output << "Render graph: " << m_schedule.size() << " of " << m_passes.size()
+		<< " passes scheduled" << std::endl;
+	for (size_t step = 0; step < m_schedule.size(); step++)
+	{
+		output << "  " << step << ": " << m_passes[m_schedule[step]].name << std::endl;
+	}
+	for (size_t p = 0; p < m_passes.size(); p++)
+	{
+		if (m_passes[p].bCulled == true)
+		{
+			output << "  culled: " << m_passes[p].name << std::endl;
+		}
+	}
+	for (size_t r = 0; r < m_resources.size(); r++)
+	{
+		const RESOURCE& resource = m_resources[r];
+		if (resource.physical != INVALID_ID)
+		{
+			output << "  " << resource.name << " -> transient " << resource.physical
+				<< " (passes " << resource.firstUse << "-" << resource.lastUse << ")" << std::endl;
+		}
+	}
+	output << "  " << m_physicalResources.size() << " transient objects allocated" << std::endl;
+}
@@ -0,0 +1,179 @@
+///////////////////////////////////////////////////////////////////////////////
+// rendergraph.h
+// ============
+// order the render passes of a frame from their declared resource use
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/***********************************************************
+ *  RenderGraph
+ *
+ *  This class is used for scheduling the passes of a frame.
+ *  Each pass declares the textures and buffers it reads and
+ *  writes, and compiling the graph orders the passes so
+ *  every read comes after the writes it depends on. Passes
+ *  whose results are never read are culled, unless they
+ *  are marked as having a side effect like presenting.
+ *
+ *  Transient resources are owned by the graph. They only
+ *  live from the first to the last pass using them, and
+ *  transients whose lifetimes do not overlap share one GL
+ *  object. Imported resources are owned elsewhere, the
+ *  graph only uses them for ordering.
+ *
+ *  Compiling allocates, so it is only done when the graph
+ *  changes. Executing a compiled graph does not allocate.
+ ***********************************************************/
+class RenderGraph
+{
+public:
+	// kinds of resources a pass can use
+	enum RESOURCE_TYPE
+	{
+		RESOURCE_TEXTURE,
+		RESOURCE_BUFFER
+	};
+
+	// size and format of a transient texture
+	struct TEXTURE_DESC
+	{
+		int width;
+		int height;
+		GLenum internalFormat;
+	};
+
+	// returned when a resource or pass could not be added
+	static const int INVALID_ID = -1;
+
+	// constructor
+	RenderGraph();
+	// destructor
+	~RenderGraph();
+
+private:
+	// a resource as declared by the passes
+	struct RESOURCE
+	{
+		std::string name;
+		RESOURCE_TYPE type;
+		bool bImported;
+		GLuint importedID;
+		TEXTURE_DESC texture;
+		GLsizeiptr bufferSize;
+		// assigned when compiling, transients only
+		int physical;
+		int firstUse;
+		int lastUse;
+	};
+
+	// a pass and the resources it uses
+	struct PASS
+	{
+		std::string name;
+		std::function<void()> execute;
+		std::vector<int> reads;
+		std::vector<int> writes;
+		bool bSideEffect;
+		bool bEnabled;
+		bool bCulled;
+		// target of the transient textures the pass writes
+		GLuint framebuffer;
+		int viewportWidth;
+		int viewportHeight;
+	};
+
+	// a GL object backing one or more transient resources
+	struct PHYSICAL_RESOURCE
+	{
+		RESOURCE_TYPE type;
+		TEXTURE_DESC texture;
+		GLsizeiptr bufferSize;
+		GLuint ID;
+		bool bInUse;		// taken at the current point of the schedule
+		bool bAssigned;		// backs a resource in the compiled graph
+	};
+
+	std::vector<RESOURCE> m_resources;
+	std::vector<PASS> m_passes;
+	std::vector<PHYSICAL_RESOURCE> m_physicalResources;
+	// pass indices in the order they are executed
+	std::vector<int> m_schedule;
+	bool m_bDirty;
+	bool m_bCompiled;
+
+	// disable copying, the graph owns GL objects
+	RenderGraph(const RenderGraph&);
+	RenderGraph& operator=(const RenderGraph&);
+
+	// add a resource of either kind
+	int AddResource(const char* name, RESOURCE_TYPE type, bool bImported);
+	// check a pass and resource index passed by the caller
+	bool IsValidPass(int pass) const;
+	bool IsValidResource(int resource) const;
+
+	// mark the passes that do not lead to a side effect
+	void CullPasses();
+	// order the live passes by their dependencies
+	bool SortPasses();
+	// give every used transient a GL object, sharing them
+	// between transients whose lifetimes do not overlap
+	void AssignPhysicalResources();
+	// find or create a GL object for a transient
+	int AcquirePhysicalResource(const RESOURCE& resource);
+	// create the targets of the passes writing transients
+	bool CreatePassFramebuffers();
+	// delete the pass targets
+	void DestroyPassFramebuffers();
+	// delete the GL objects no compiled resource uses
+	void ReleaseUnassignedResources();
+
+public:
+	// get the size in bytes of a texel of a texture format
+	static int GetTexelBytes(GLenum internalFormat);
+
+	// add a texture owned by the graph
+	int CreateTexture(const char* name, const TEXTURE_DESC& desc);
+	// add a buffer owned by the graph
+	int CreateBuffer(const char* name, GLsizeiptr size);
+	// add a texture or buffer owned elsewhere, 0 for the window
+	int ImportTexture(const char* name, GLuint texture);
+	int ImportBuffer(const char* name, GLuint buffer);
+
+	// change the size of a transient texture, like on resize
+	void SetTextureSize(int resource, int width, int height);
+	// change the GL object of an imported resource
+	void SetImportedID(int resource, GLuint ID);
+
+	// add a pass run by the passed in function
+	int AddPass(const char* name, std::function<void()> execute);
+	// declare the resources a pass reads and writes
+	void Read(int pass, int resource);
+	void Write(int pass, int resource);
+	// keep a pass even when nothing reads what it writes
+	void SetSideEffect(int pass, bool bSideEffect);
+	// leave a pass out of the graph
+	void SetPassEnabled(int pass, bool bEnabled);
+
+	// true when the graph changed since it was compiled
+	bool IsDirty() const { return m_bDirty; }
+	// cull, order and allocate, false when the graph has a cycle
+	bool Compile();
+	// run the compiled passes in order
+	void Execute();
+
+	// get the GL object of a resource in the compiled graph
+	GLuint GetTexture(int resource) const;
+	GLuint GetBuffer(int resource) const;
+
+	// write the compiled order and the shared transients
+	void WriteSchedule(std::ostream& output) const;
+};
@@ -0,0 +1,873 @@
+///////////////////////////////////////////////////////////////////////////////
+// resourcemanager.cpp
+// ============
+// share GPU textures, meshes and programs through ref-counted handles
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ResourceManager.h"
+#include "AssetPack.h"
+#include "MemoryAccounting.h"
+#include "PerformanceCounters.h"
+
+#ifndef STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#endif
+
+#include <fstream>
+#include <iostream>
+#include <mutex>
+
+// declaration of global variables
+namespace
+{
+	// names of the resource types for the reports
+	const char* g_ResourceTypeNames[] =
+	{
+		"texture",
+		"mesh",
+		"program"
+	};
+
+	// guards the global stb_image flip flag, images are
+	// decoded on several threads during startup
+	std::once_flag g_FlipOnLoadOnce;
+
+	/***********************************************************
+	 *  ReadBinaryFile()
+	 *
+	 *  This function is used for reading a whole file into
+	 *  memory so its content can be hashed before decoding.
+	 ***********************************************************/
+	bool ReadBinaryFile(const char* filename, std::vector<unsigned char>& data)
+	{
+		std::ifstream file(filename, std::ios::in | std::ios::binary | std::ios::ate);
+		if (!file.is_open())
+		{
+			return(false);
+		}
+
+		std::streamoff length = file.tellg();
+		if (length <= 0)
+		{
+			return(false);
+		}
+
+		data.resize((size_t)length);
+		file.seekg(0, std::ios::beg);
+		file.read(reinterpret_cast<char*>(&data[0]), length);
+
+		return(file.good());
+	}
+}
+
+/***********************************************************
+ *  ResourceHandle()
+ *
+ *  The constructor for an empty handle
+ ***********************************************************/
+ResourceHandle::ResourceHandle()
+{
+	m_pManager = NULL;
+	m_slot = -1;
+}
+
+/***********************************************************
+ *  ResourceHandle()
+ *
+ *  The constructor used by the manager - the manager has
+ *  already counted the reference this handle holds
+ ***********************************************************/
+ResourceHandle::ResourceHandle(ResourceManager* pManager, int slot)
+{
+	m_pManager = pManager;
+	m_slot = slot;
+}
+
+/***********************************************************
+ *  ResourceHandle()
+ *
+ *  The copy constructor for the class
+ ***********************************************************/
+ResourceHandle::ResourceHandle(const ResourceHandle& other)
+{
+	m_pManager = other.m_pManager;
+	m_slot = other.m_slot;
+
+	if (m_slot >= 0)
+	{
+		m_pManager->AddReference(m_slot);
+	}
+}
+
+/***********************************************************
+ *  ~ResourceHandle()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+ResourceHandle::~ResourceHandle()
+{
+	Reset();
+}
+
+/***********************************************************
+ *  operator=()
+ *
+ *  The assignment operator for the class - the new
+ *  reference is taken before the old one is dropped so
+ *  self assignment is safe
+ ***********************************************************/
+ResourceHandle& ResourceHandle::operator=(const ResourceHandle& other)
+{
+	if (other.m_slot >= 0)
+	{
+		other.m_pManager->AddReference(other.m_slot);
+	}
+
+	Reset();
+
+	m_pManager = other.m_pManager;
+	m_slot = other.m_slot;
+
+	return(*this);
+}
+
+/***********************************************************
+ *  Reset()
+ *
+ *  This method is used for dropping the reference held by
+ *  the handle and leaving it empty.
+ ***********************************************************/
+void ResourceHandle::Reset()
+{
+	if (m_slot >= 0)
+	{
+		m_pManager->ReleaseReference(m_slot);
+	}
+
+	m_pManager = NULL;
+	m_slot = -1;
+}
+
+/***********************************************************
+ *  GetID()
+ *
+ *  This method is used for getting the OpenGL name of the
+ *  referenced resource, or 0 for an empty handle.
+ ***********************************************************/
+GLuint ResourceHandle::GetID() const
+{
+	if (m_slot < 0)
+	{
+		return(0);
+	}
+
+	return(m_pManager->m_resources[m_slot].id);
+}
+
+/***********************************************************
+ *  ResourceManager()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+ResourceManager::ResourceManager(ShaderProgramCache* pShaderCache)
+{
+	m_pShaderCache = pShaderCache;
+	m_bindingGeneration = 0;
+}
+
+/***********************************************************
+ *  ~ResourceManager()
+ *
+ *  The destructor for the class - resources that still
+ *  have handles are reported as leaks and freed anyway
+ ***********************************************************/
+ResourceManager::~ResourceManager()
+{
+	CollectGarbage();
+
+	for (size_t i = 0; i < m_resources.size(); i++)
+	{
+		if (m_resources[i].refCount > 0)
+		{
+			std::cout << "WARNING: Resource still referenced at shutdown:" << m_resources[i].name
+				<< " (" << g_ResourceTypeNames[m_resources[i].type] << ", "
+				<< m_resources[i].refCount << " handles)" << std::endl;
+			DeleteResource((int)i);
+		}
+	}
+
+	m_resources.clear();
+	m_freeSlots.clear();
+	m_resourcesByKey.clear();
+	m_pShaderCache = NULL;
+}
+
+/***********************************************************
+ *  AddReference()
+ *
+ *  This method is used for adding a reference to the
+ *  resource in the passed in slot. A resource that was
+ *  released earlier in the frame is revived, since its
+ *  OpenGL objects have not been deleted yet.
+ ***********************************************************/
+void ResourceManager::AddReference(int slot)
+{
+	m_resources[slot].refCount++;
+}
+
+/***********************************************************
+ *  ReleaseReference()
+ *
+ *  This method is used for dropping a reference to the
+ *  resource in the passed in slot. The last reference
+ *  queues the resource for the next frame boundary.
+ ***********************************************************/
+void ResourceManager::ReleaseReference(int slot)
+{
+	RESOURCE_ENTRY& resource = m_resources[slot];
+
+	resource.refCount--;
+	if ((resource.refCount == 0) && (resource.bPendingFree == false))
+	{
+		resource.bPendingFree = true;
+		m_pendingFrees.push_back(slot);
+	}
+}
+
+/***********************************************************
+ *  FindResource()
+ *
+ *  This method is used for finding a live resource with
+ *  the passed in content hash, -1 when there is none.
+ ***********************************************************/
+int ResourceManager::FindResource(unsigned long long key)
+{
+	std::unordered_map<unsigned long long, int>::const_iterator found = m_resourcesByKey.find(key);
+	if (found == m_resourcesByKey.end())
+	{
+		return(-1);
+	}
+
+	return(found->second);
+}
+
+/***********************************************************
+ *  AddResource()
+ *
+ *  This method is used for storing a new resource, reusing
+ *  a free slot when possible. The resource starts with the
+ *  one reference that is handed to the caller.
+ ***********************************************************/
+int ResourceManager::AddResource(RESOURCE_TYPE type, unsigned long long key, const char* name)
+{
+	int slot = -1;
+	if (!m_freeSlots.empty())
+	{
+		slot = m_freeSlots.back();
+		m_freeSlots.pop_back();
+	}
+	else
+	{
+		slot = (int)m_resources.size();
+		m_resources.push_back(RESOURCE_ENTRY());
+	}
+
+	m_bindingGeneration++;
+
+	RESOURCE_ENTRY& resource = m_resources[slot];
+	resource.type = type;
+	resource.id = 0;
+	resource.vertexBuffer = 0;
+	resource.indexBuffer = 0;
+	resource.key = key;
+	resource.refCount = 1;
+	resource.bPendingFree = false;
+	resource.bHasAlpha = false;
+	resource.bytes = 0;
+	resource.indexBytes = 0;
+	resource.name = name;
+
+	m_resourcesByKey[key] = slot;
+
+	return(slot);
+}
+
+/***********************************************************
+ *  DeleteResource()
+ *
+ *  This method is used for deleting the OpenGL objects of
+ *  a resource and returning its slot to the free list.
+ ***********************************************************/
+void ResourceManager::DeleteResource(int slot)
+{
+	RESOURCE_ENTRY& resource = m_resources[slot];
+
+	switch (resource.type)
+	{
+	case RESOURCE_TEXTURE:
+		glDeleteTextures(1, &resource.id);
+		MemoryAccounting::Free(MemoryAccounting::CATEGORY_TEXTURE, resource.name.c_str(), resource.bytes);
+		break;
+	case RESOURCE_MESH:
+		glDeleteVertexArrays(1, &resource.id);
+		glDeleteBuffers(1, &resource.vertexBuffer);
+		glDeleteBuffers(1, &resource.indexBuffer);
+		MemoryAccounting::Free(MemoryAccounting::CATEGORY_VERTEX_BUFFER, resource.name.c_str(), resource.bytes);
+		MemoryAccounting::Free(MemoryAccounting::CATEGORY_INDEX_BUFFER, resource.name.c_str(), resource.indexBytes);
+		break;
+	case RESOURCE_PROGRAM:
+		glDeleteProgram(resource.id);
+		break;
+	}
+
+	m_resourcesByKey.erase(resource.key);
+	m_bindingGeneration++;
+
+	resource.id = 0;
+	resource.vertexBuffer = 0;
+	resource.indexBuffer = 0;
+	resource.refCount = 0;
+	resource.bPendingFree = false;
+	resource.name.clear();
+
+	m_freeSlots.push_back(slot);
+}
+
+/***********************************************************
+ *  ReadImage()
+ *
+ *  This method is used for reading the bytes of an image
+ *  file and hashing them. The hash lets an image that is
+ *  already loaded, even under another file name, be shared
+ *  without decoding it. An image in the asset pack is
+ *  decoded straight from the mapping. Safe to call from
+ *  any thread.
+ ***********************************************************/
+bool ResourceManager::ReadImage(const char* filename, DECODED_IMAGE& image)
+{
+	image.filename = filename;
+	image.key = 0;
+	image.texels = NULL;
+	image.width = 0;
+	image.height = 0;
+	image.channels = 0;
+	image.bHasAlpha = false;
+	image.encodedData = NULL;
+	image.encodedSize = 0;
+
+	if (AssetPack::Read(filename, image.fileData, image.encodedData, image.encodedSize) == false)
+	{
+		if (ReadBinaryFile(filename, image.fileData) == false)
+		{
+			std::cout << "Could not load image:" << filename << std::endl;
+			return(false);
+		}
+		image.encodedData = &image.fileData[0];
+		image.encodedSize = image.fileData.size();
+	}
+	if (0 == image.encodedSize)
+	{
+		std::cout << "Could not load image:" << filename << std::endl;
+		return(false);
+	}
+
+	const char* typeTag = "texture";
+	image.key = ShaderProgramCache::HashBytes(typeTag, 7);
+	image.key = ShaderProgramCache::HashBytes(image.encodedData, image.encodedSize, image.key);
+
+	return(true);
+}
+
+/***********************************************************
+ *  DecodeImage()
+ *
+ *  This method is used for decoding the bytes read by
+ *  ReadImage() into texels and checking them for see-
+ *  through texels. The encoded bytes are released once
+ *  decoded. Safe to call from any thread.
+ ***********************************************************/
+bool ResourceManager::DecodeImage(DECODED_IMAGE& image)
+{
+	if (NULL == image.encodedData)
+	{
+		return(false);
+	}
+
+	// indicate to always flip images vertically when loaded,
+	// the flag is global so it is only written once
+	std::call_once(g_FlipOnLoadOnce, []()
+	{
+		stbi_set_flip_vertically_on_load(true);
+	});
+
+	image.texels = stbi_load_from_memory(
+		image.encodedData,
+		(int)image.encodedSize,
+		&image.width,
+		&image.height,
+		&image.channels,
+		0);
+	image.encodedData = NULL;
+	image.encodedSize = 0;
+	std::vector<unsigned char>().swap(image.fileData);
+
+	if (NULL == image.texels)
+	{
+		std::cout << "Could not load image:" << image.filename << std::endl;
+		return(false);
+	}
+
+	if ((image.channels != 3) && (image.channels != 4))
+	{
+		std::cout << "Not implemented to handle image with " << image.channels << " channels" << std::endl;
+		stbi_image_free(image.texels);
+		image.texels = NULL;
+		return(false);
+	}
+
+	std::cout << "Successfully loaded image:" << image.filename << ", width:" << image.width << ", height:" << image.height << ", channels:" << image.channels << std::endl;
+
+	// the decoded texels are held in memory until the upload
+	MemoryAccounting::Allocate(
+		MemoryAccounting::CATEGORY_CPU_STAGING,
+		"textureDecode",
+		(long long)image.width * image.height * image.channels);
+
+	// an RGBA image only needs blending if some texel is
+	// actually see-through, fully opaque PNGs stay opaque
+	if (image.channels == 4)
+	{
+		int texelCount = image.width * image.height;
+		for (int i = 0; (i < texelCount) && (image.bHasAlpha == false); i++)
+		{
+			image.bHasAlpha = (image.texels[(i * 4) + 3] < 255);
+		}
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  FreeImage()
+ *
+ *  This method is used for releasing the memory of an
+ *  image that was read or decoded but is not uploaded.
+ ***********************************************************/
+void ResourceManager::FreeImage(DECODED_IMAGE& image)
+{
+	if (NULL != image.texels)
+	{
+		stbi_image_free(image.texels);
+		image.texels = NULL;
+		MemoryAccounting::Free(
+			MemoryAccounting::CATEGORY_CPU_STAGING,
+			"textureDecode",
+			(long long)image.width * image.height * image.channels);
+	}
+	image.encodedData = NULL;
+	image.encodedSize = 0;
+	std::vector<unsigned char>().swap(image.fileData);
+}
+
+/***********************************************************
+ *  UploadImage()
+ *
+ *  This method is used for creating a texture from a
+ *  decoded image and freeing its texels. An image that is
+ *  already loaded is shared instead of uploaded again.
+ ***********************************************************/
+ResourceHandle ResourceManager::UploadImage(DECODED_IMAGE& image, bool& bHasAlpha)
+{
+	bHasAlpha = false;
+
+	int slot = FindResource(image.key);
+	if (slot >= 0)
+	{
+		std::cout << "INFO: Sharing already loaded image:" << image.filename << " with " << m_resources[slot].name << std::endl;
+		FreeImage(image);
+		AddReference(slot);
+		bHasAlpha = m_resources[slot].bHasAlpha;
+		return(ResourceHandle(this, slot));
+	}
+
+	if (NULL == image.texels)
+	{
+		return(ResourceHandle());
+	}
+
+	GLenum internalFormat = GL_RGB8;
+	GLenum format = GL_RGB;
+	if (image.channels == 4)
+	{
+		// it supports transparency
+		internalFormat = GL_RGBA8;
+		format = GL_RGBA;
+	}
+
+	GLuint textureID = 0;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+
+	// set the texture wrapping parameters
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// set texture filtering parameters
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.texels);
+	PerformanceCounters::Add(
+		PerformanceCounters::COUNTER_BYTES_UPLOADED,
+		(long long)image.width * image.height * image.channels);
+
+	// generate the texture mipmaps for mapping textures to lower resolutions
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	bHasAlpha = image.bHasAlpha;
+
+	slot = AddResource(RESOURCE_TEXTURE, image.key, image.filename.c_str());
+	m_resources[slot].id = textureID;
+	m_resources[slot].bHasAlpha = bHasAlpha;
+	m_resources[slot].bytes = MemoryAccounting::CalculateTextureBytes(image.width, image.height, image.channels, true);
+	MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_TEXTURE, image.filename.c_str(), m_resources[slot].bytes);
+
+	// free the image data from local memory
+	FreeImage(image);
+
+	return(ResourceHandle(this, slot));
+}
+
+/***********************************************************
+ *  LoadTexture()
+ *
+ *  This method is used for loading a texture from an image
+ *  file. The file bytes are hashed before decoding, so an
+ *  image that is already loaded, even under another file
+ *  name, is shared instead of being uploaded again.
+ ***********************************************************/
+ResourceHandle ResourceManager::LoadTexture(const char* filename, bool& bHasAlpha)
+{
+	bHasAlpha = false;
+
+	DECODED_IMAGE image;
+	if (ReadImage(filename, image) == false)
+	{
+		return(ResourceHandle());
+	}
+
+	if ((FindResource(image.key) < 0) && (DecodeImage(image) == false))
+	{
+		return(ResourceHandle());
+	}
+
+	return(UploadImage(image, bHasAlpha));
+}
+
+/***********************************************************
+ *  CreateTexture()
+ *
+ *  This method is used for uploading texels that were
+ *  generated instead of loaded, like baked lighting. The
+ *  texture is filtered but has no mipmaps and clamps at
+ *  the edges. Textures with the same texels are shared.
+ ***********************************************************/
+ResourceHandle ResourceManager::CreateTexture(
+	const char* name,
+	int width,
+	int height,
+	GLenum internalFormat,
+	int texelBytes,
+	GLenum format,
+	GLenum type,
+	const void* texels,
+	size_t texelDataBytes)
+{
+	if ((NULL == texels) || (0 == texelDataBytes) || (width <= 0) || (height <= 0))
+	{
+		return(ResourceHandle());
+	}
+
+	int description[] = { width, height, (int)internalFormat, (int)format, (int)type };
+	const char* typeTag = "generated";
+	unsigned long long key = ShaderProgramCache::HashBytes(typeTag, 9);
+	key = ShaderProgramCache::HashBytes(description, sizeof(description), key);
+	key = ShaderProgramCache::HashBytes(texels, texelDataBytes, key);
+
+	int slot = FindResource(key);
+	if (slot >= 0)
+	{
+		AddReference(slot);
+		return(ResourceHandle(this, slot));
+	}
+
+	GLuint textureID = 0;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	// generated rows are tightly packed
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, texels);
+	PerformanceCounters::Add(PerformanceCounters::COUNTER_BYTES_UPLOADED, (long long)texelDataBytes);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	slot = AddResource(RESOURCE_TEXTURE, key, name);
+	m_resources[slot].id = textureID;
+	m_resources[slot].bHasAlpha = false;
+	m_resources[slot].bytes = MemoryAccounting::CalculateTextureBytes(width, height, texelBytes, false);
+	MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_TEXTURE, name, m_resources[slot].bytes);
+
+	return(ResourceHandle(this, slot));
+}
+
+/***********************************************************
+ *  CreateMesh()
+ *
+ *  This method is used for uploading vertex and index data
+ *  into a new vertex array. Meshes with the same data and
+ *  vertex layout share one vertex array.
+ ***********************************************************/
+ResourceHandle ResourceManager::CreateMesh(
+	const char* name,
+	const void* vertexData,
+	size_t vertexBytes,
+	const void* indexData,
+	size_t indexBytes,
+	const VERTEX_ATTRIBUTE* attributes,
+	int attributeCount,
+	GLsizei vertexStride)
+{
+	if ((NULL == vertexData) || (0 == vertexBytes) || (NULL == attributes))
+	{
+		return(ResourceHandle());
+	}
+
+	const char* typeTag = "mesh";
+	unsigned long long key = ShaderProgramCache::HashBytes(typeTag, 4);
+	key = ShaderProgramCache::HashBytes(vertexData, vertexBytes, key);
+	if (NULL != indexData)
+	{
+		key = ShaderProgramCache::HashBytes(indexData, indexBytes, key);
+	}
+	key = ShaderProgramCache::HashBytes(attributes, sizeof(VERTEX_ATTRIBUTE) * attributeCount, key);
+	key = ShaderProgramCache::HashBytes(&vertexStride, sizeof(vertexStride), key);
+
+	int slot = FindResource(key);
+	if (slot >= 0)
+	{
+		AddReference(slot);
+		return(ResourceHandle(this, slot));
+	}
+
+	GLuint vertexArray = 0;
+	GLuint vertexBuffer = 0;
+	GLuint indexBuffer = 0;
+
+	glGenVertexArrays(1, &vertexArray);
+	glBindVertexArray(vertexArray);
+
+	glGenBuffers(1, &vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertexData, GL_STATIC_DRAW);
+	PerformanceCounters::Add(PerformanceCounters::COUNTER_BYTES_UPLOADED, (long long)vertexBytes);
+
+	if (NULL != indexData)
+	{
+		glGenBuffers(1, &indexBuffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indexData, GL_STATIC_DRAW);
+		PerformanceCounters::Add(PerformanceCounters::COUNTER_BYTES_UPLOADED, (long long)indexBytes);
+	}
+
+	for (int i = 0; i < attributeCount; i++)
+	{
+		glVertexAttribPointer(
+			attributes[i].location,
+			attributes[i].components,
+			attributes[i].type,
+			attributes[i].bNormalized,
+			vertexStride,
+			(void*)(size_t)attributes[i].offset);
+		glEnableVertexAttribArray(attributes[i].location);
+	}
+
+	glBindVertexArray(0);
+
+	slot = AddResource(RESOURCE_MESH, key, name);
+	m_resources[slot].id = vertexArray;
+	m_resources[slot].vertexBuffer = vertexBuffer;
+	m_resources[slot].indexBuffer = indexBuffer;
+	m_resources[slot].bytes = (long long)vertexBytes;
+	m_resources[slot].indexBytes = (NULL != indexData) ? (long long)indexBytes : 0;
+	MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_VERTEX_BUFFER, name, m_resources[slot].bytes);
+	MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_INDEX_BUFFER, name, m_resources[slot].indexBytes);
+
+	return(ResourceHandle(this, slot));
+}
+
+/***********************************************************
+ *  LoadProgram()
+ *
+ *  This method is used for getting a linked program for
+ *  the passed in shader files and define lines. Programs
+ *  are shared by their files and defines, the shader cache
+ *  takes care of reusing the compiled binaries.
+ ***********************************************************/
+ResourceHandle ResourceManager::LoadProgram(
+	const char* vertexShaderPath,
+	const char* fragmentShaderPath,
+	const std::string& defines)
+{
+	if (NULL == m_pShaderCache)
+	{
+		return(ResourceHandle());
+	}
+
+	std::string description = std::string("program|") + vertexShaderPath + "|" + fragmentShaderPath + "|" + defines;
+	unsigned long long key = ShaderProgramCache::HashBytes(description.data(), description.size());
+
+	int slot = FindResource(key);
+	if (slot >= 0)
+	{
+		AddReference(slot);
+		return(ResourceHandle(this, slot));
+	}
+
+	GLuint programID = m_pShaderCache->LoadProgram(vertexShaderPath, fragmentShaderPath, defines);
+	if (0 == programID)
+	{
+		return(ResourceHandle());
+	}
+
+	slot = AddResource(RESOURCE_PROGRAM, key, fragmentShaderPath);
+	m_resources[slot].id = programID;
+
+	return(ResourceHandle(this, slot));
+}
+
+/***********************************************************
+ *  PrefetchProgram()
+ *
+ *  This method is used for starting to build a program that
+ *  LoadProgram() will be asked for later, so the driver can
+ *  compile it in the background. Programs that are already
+ *  loaded are skipped.
+ ***********************************************************/
+void ResourceManager::PrefetchProgram(
+	const char* vertexShaderPath,
+	const char* fragmentShaderPath,
+	const std::string& defines)
+{
+	if (NULL == m_pShaderCache)
+	{
+		return;
+	}
+
+	std::string description = std::string("program|") + vertexShaderPath + "|" + fragmentShaderPath + "|" + defines;
+	unsigned long long key = ShaderProgramCache::HashBytes(description.data(), description.size());
+
+	if (FindResource(key) < 0)
+	{
+		m_pShaderCache->PrefetchProgram(vertexShaderPath, fragmentShaderPath, defines);
+	}
+}
+
+/***********************************************************
+ *  ArePrefetchedProgramsReady()
+ *
+ *  This method is used for checking whether every
+ *  prefetched program can be loaded without waiting.
+ ***********************************************************/
+bool ResourceManager::ArePrefetchedProgramsReady()
+{
+	if (NULL == m_pShaderCache)
+	{
+		return(true);
+	}
+
+	return(m_pShaderCache->ArePrefetchedProgramsReady());
+}
+
+/***********************************************************
+ *  LoadComputeProgram()
+ *
+ *  This method is used for getting a linked compute program
+ *  for the passed in shader file and define lines, shared
+ *  the same way as the graphics programs.
+ ***********************************************************/
+ResourceHandle ResourceManager::LoadComputeProgram(
+	const char* computeShaderPath,
+	const std::string& defines)
+{
+	if (NULL == m_pShaderCache)
+	{
+		return(ResourceHandle());
+	}
+
+	std::string description = std::string("compute|") + computeShaderPath + "|" + defines;
+	unsigned long long key = ShaderProgramCache::HashBytes(description.data(), description.size());
+
+	int slot = FindResource(key);
+	if (slot >= 0)
+	{
+		AddReference(slot);
+		return(ResourceHandle(this, slot));
+	}
+
+	GLuint programID = m_pShaderCache->LoadComputeProgram(computeShaderPath, defines);
+	if (0 == programID)
+	{
+		return(ResourceHandle());
+	}
+
+	slot = AddResource(RESOURCE_PROGRAM, key, computeShaderPath);
+	m_resources[slot].id = programID;
+
+	return(ResourceHandle(this, slot));
+}
+
+/***********************************************************
+ *  CollectGarbage()
+ *
+ *  This method is used for deleting the resources whose
+ *  last handle was dropped since the previous call. It is
+ *  called at the frame boundary, after the swap, so no
+ *  pending draw can still reference the objects. Resources
+ *  that got a new handle in the meantime are kept.
+ ***********************************************************/
+void ResourceManager::CollectGarbage()
+{
+	for (size_t i = 0; i < m_pendingFrees.size(); i++)
+	{
+		int slot = m_pendingFrees[i];
+		if (m_resources[slot].refCount == 0)
+		{
+			DeleteResource(slot);
+		}
+		else
+		{
+			m_resources[slot].bPendingFree = false;
+		}
+	}
+
+	m_pendingFrees.clear();
+}
+
+/***********************************************************
+ *  GetLiveResourceCount()
+ *
+ *  This method is used for getting the number of resources
+ *  that currently own OpenGL objects.
+ ***********************************************************/
+int ResourceManager::GetLiveResourceCount() const
+{
+	return((int)(m_resources.size() - m_freeSlots.size()));
+}
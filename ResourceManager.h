@@ -0,0 +1,218 @@
+///////////////////////////////////////////////////////////////////////////////
+// resourcemanager.h
+// ============
+// share GPU textures, meshes and programs through ref-counted handles
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "ShaderCache.h"
+
+#include <GL/glew.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ResourceManager;
+
+/***********************************************************
+ *  ResourceHandle
+ *
+ *  This class is a counted reference to a resource owned
+ *  by the resource manager. Copying a handle adds a
+ *  reference and destroying or resetting it drops one.
+ *  The manager must outlive every handle it gave out.
+ ***********************************************************/
+class ResourceHandle
+{
+public:
+	// constructor for an empty handle
+	ResourceHandle();
+	// copy constructor, adds a reference
+	ResourceHandle(const ResourceHandle& other);
+	// destructor, drops the reference
+	~ResourceHandle();
+	// assignment, moves the reference to the other resource
+	ResourceHandle& operator=(const ResourceHandle& other);
+
+private:
+	friend class ResourceManager;
+
+	// constructor used by the manager, takes one reference
+	ResourceHandle(ResourceManager* pManager, int slot);
+
+	// manager that owns the resource
+	ResourceManager* m_pManager;
+	// slot of the resource in the manager, -1 when empty
+	int m_slot;
+
+public:
+	// drop the reference and make the handle empty
+	void Reset();
+	// check whether the handle refers to a resource
+	bool IsValid() const { return (m_slot >= 0); }
+	// get the OpenGL name - texture, vertex array or program
+	GLuint GetID() const;
+};
+
+/***********************************************************
+ *  ResourceManager
+ *
+ *  This class owns the GPU textures, meshes and programs.
+ *  Loading the same content again returns another handle
+ *  to the existing resource instead of a second upload.
+ *  When the last handle to a resource goes away it is only
+ *  queued, and the OpenGL objects are deleted at the next
+ *  frame boundary so no draw of the current frame can
+ *  still be using them.
+ ***********************************************************/
+class ResourceManager
+{
+public:
+	// kinds of resources owned by the manager
+	enum RESOURCE_TYPE
+	{
+		RESOURCE_TEXTURE,
+		RESOURCE_MESH,
+		RESOURCE_PROGRAM
+	};
+
+	// layout of one vertex attribute of a mesh
+	struct VERTEX_ATTRIBUTE
+	{
+		GLuint location;
+		GLint components;
+		GLenum type;
+		GLboolean bNormalized;
+		GLuint offset;
+	};
+
+	// an image file read and decoded on any thread, waiting
+	// for its upload on the GL thread
+	struct DECODED_IMAGE
+	{
+		std::string filename;
+		unsigned long long key;		// hash of the file bytes
+		std::vector<unsigned char> fileData;	// read or unpacked bytes
+		// file bytes until decoded, in fileData or in the asset pack
+		const unsigned char* encodedData;
+		size_t encodedSize;
+		unsigned char* texels;		// NULL until decoded
+		int width;
+		int height;
+		int channels;
+		bool bHasAlpha;
+	};
+
+	// constructor
+	ResourceManager(ShaderProgramCache* pShaderCache);
+	// destructor
+	~ResourceManager();
+
+private:
+	friend class ResourceHandle;
+
+	// bookkeeping for one owned resource
+	struct RESOURCE_ENTRY
+	{
+		RESOURCE_TYPE type;
+		GLuint id;					// texture, vertex array or program
+		GLuint vertexBuffer;		// meshes only
+		GLuint indexBuffer;			// meshes only
+		unsigned long long key;		// content hash used for sharing
+		int refCount;
+		bool bPendingFree;			// queued for the next frame boundary
+		bool bHasAlpha;				// textures only
+		long long bytes;			// texture levels or vertex data size
+		long long indexBytes;		// meshes only
+		std::string name;			// file or mesh name for reports
+	};
+
+	// cache used for building the programs
+	ShaderProgramCache* m_pShaderCache;
+	// resources indexed by handle slot
+	std::vector<RESOURCE_ENTRY> m_resources;
+	// slots that can be reused for new resources
+	std::vector<int> m_freeSlots;
+	// live resources by content hash
+	std::unordered_map<unsigned long long, int> m_resourcesByKey;
+	// resources without handles, deleted at the frame boundary
+	std::vector<int> m_pendingFrees;
+	// changes whenever objects are created or deleted
+	unsigned int m_bindingGeneration;
+
+	// add a reference to the resource in the slot
+	void AddReference(int slot);
+	// drop a reference, queueing the resource at zero
+	void ReleaseReference(int slot);
+	// find a live resource with the content hash
+	int FindResource(unsigned long long key);
+	// store a new resource and return its slot
+	int AddResource(RESOURCE_TYPE type, unsigned long long key, const char* name);
+	// delete the OpenGL objects of a resource
+	void DeleteResource(int slot);
+
+public:
+	// load a texture image from a file, flagging translucency
+	ResourceHandle LoadTexture(const char* filename, bool& bHasAlpha);
+	// read and hash an image file, safe on any thread
+	static bool ReadImage(const char* filename, DECODED_IMAGE& image);
+	// decode a read image, safe on any thread
+	static bool DecodeImage(DECODED_IMAGE& image);
+	// release an image that is not going to be uploaded
+	static void FreeImage(DECODED_IMAGE& image);
+	// upload a decoded image into a texture, flagging translucency
+	ResourceHandle UploadImage(DECODED_IMAGE& image, bool& bHasAlpha);
+	// upload texels generated on the CPU into a new texture
+	ResourceHandle CreateTexture(
+		const char* name,
+		int width,
+		int height,
+		GLenum internalFormat,
+		int texelBytes,
+		GLenum format,
+		GLenum type,
+		const void* texels,
+		size_t texelDataBytes);
+	// upload vertex and index data into a new vertex array
+	ResourceHandle CreateMesh(
+		const char* name,
+		const void* vertexData,
+		size_t vertexBytes,
+		const void* indexData,
+		size_t indexBytes,
+		const VERTEX_ATTRIBUTE* attributes,
+		int attributeCount,
+		GLsizei vertexStride);
+	// get a linked program for the shader files and defines
+	ResourceHandle LoadProgram(
+		const char* vertexShaderPath,
+		const char* fragmentShaderPath,
+		const std::string& defines);
+	// start building a program that will be loaded later
+	void PrefetchProgram(
+		const char* vertexShaderPath,
+		const char* fragmentShaderPath,
+		const std::string& defines);
+	// check whether the prefetched programs are all built
+	bool ArePrefetchedProgramsReady();
+	// get a linked compute program for the shader file and defines
+	ResourceHandle LoadComputeProgram(
+		const char* computeShaderPath,
+		const std::string& defines);
+
+	// delete the resources released since the last call,
+	// called once per frame after the buffers are swapped
+	void CollectGarbage();
+
+	// get the number of resources that are still alive
+	int GetLiveResourceCount() const;
+	// get the number of resources waiting to be deleted
+	int GetPendingFreeCount() const { return (int)m_pendingFrees.size(); }
+	// get a number that changes whenever the manager may have
+	// changed the texture or vertex array bindings - creating
+	// and deleting objects binds them outside of any state cache
+	unsigned int GetBindingGeneration() const { return m_bindingGeneration; }
+};
@@ -8,22 +8,165 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "SceneManager.h"
-
-#ifndef STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-#endif
+#include "PerformanceCounters.h"
 
 #include <glm/gtx/transform.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
 // declaration of global variables
 namespace
 {
 	const char* g_ModelName = "model";
 	const char* g_ColorValueName = "objectColor";
 	const char* g_TextureValueName = "objectTexture";
-	const char* g_UseTextureName = "bUseTexture";
-	const char* g_UseLightingName = "bUseLighting";
+	const char* g_ViewName = "view";
+	const char* g_ProjectionName = "projection";
+	const char* g_ViewPositionName = "viewPosition";
+	const char* g_UVScaleName = "UVscale";
+	const char* g_LightmapTextureName = "lightmapTexture";
+	const char* g_InstanceOffsetName = "instanceOffset";
+
+	const char* g_MaterialAmbientColorName = "material.ambientColor";
+	const char* g_MaterialAmbientStrengthName = "material.ambientStrength";
+	const char* g_MaterialDiffuseColorName = "material.diffuseColor";
+	const char* g_MaterialSpecularColorName = "material.specularColor";
+	const char* g_MaterialShininessName = "material.shininess";
+
+	// image files of the scene textures and the tags they are
+	// drawn with, listed up front so the images can be decoded
+	// on worker threads while the window is being created
+	struct SCENE_TEXTURE
+	{
+		const char* filename;
+		const char* tag;
+	};
+	const SCENE_TEXTURE g_SceneTextures[] =
+	{
+		{ "textures/wood.jpg", "woodTexture" },			//https://commons.wikimedia.org/wiki/File:Balsa_Wood_Texture.jpg
+		{ "textures/leather.jpg", "leatherTexture" },	//https://commons.wikimedia.org/wiki/File:Black_Leather.jpg
+		{ "textures/cube.jpg", "cubeTexture" },			//Made it myself in paint... not an artist
+		{ "textures/can.jpg", "canTexture" },
+		{ "textures/top.png", "topTexture" }
+	};
+	const int g_SceneTextureCount = sizeof(g_SceneTextures) / sizeof(g_SceneTextures[0]);
+
+	// starting size of the per-frame arena, grown when exceeded
+	const size_t g_FrameArenaSize = 64 * 1024;
+	// starting capacity of the recorded draw list
+	const size_t g_DrawCommandReserve = 256;
+
+	// number of the largest draws used as occluders each frame
+	const int g_MaxOccluders = 4;
+
+	// padding around the mesh bounds, keeps flat meshes
+	// like the plane from producing an empty query box
+	const float g_BoundsPadding = 0.01f;
+
+	// most threads used to evaluate the animations, besides
+	// the render thread
+	const int g_MaxAnimationWorkers = 3;
+
+	// distance between the generated stress test objects, and
+	// the distance behind the desk the first row starts at
+	const float g_StressSpacing = 3.0f;
+	const float g_StressStartDepth = 12.0f;
+	// looks the generated objects are given in turn
+	const char* const g_StressMaterials[] = { "plastic", "metal", "wood", "leather" };
+	const char* const g_StressTextures[] = { "cubeTexture", "woodTexture", "leatherTexture", "canTexture" };
+	const int g_StressMaterialCount = sizeof(g_StressMaterials) / sizeof(g_StressMaterials[0]);
+	const int g_StressTextureCount = sizeof(g_StressTextures) / sizeof(g_StressTextures[0]);
+	// height and length of the hop of the animated copies, and
+	// the time offset between neighbouring copies
+	const float g_StressHopHeight = 0.5f;
+	const float g_StressHopSeconds = 2.0f;
+	const float g_StressHopStagger = 0.37f;
+	// time for one turn of the copies on a turntable, and the
+	// scale and tint they pulse to halfway round
+	const float g_TurntableSeconds = 6.0f;
+	const float g_TurntablePulseScale = 1.15f;
+	const glm::vec4 g_TurntablePulseTint = glm::vec4(1.0f, 0.85f, 0.6f, 1.0f);
+
+	// most draws recorded for one prop, the pokeball
+	const int g_MaxDrawsPerProp = 7;
+
+	// sources of the object keys, kept in the top bits
+	const unsigned long long g_DeskObjectKeys = 1;
+	const unsigned long long g_StressObjectKeys = 2;
+	const unsigned long long g_ChunkObjectKeys = 3;
+
+	/***********************************************************
+	 *  IsSameBatch()
+	 *
+	 *  This function is used for checking whether two recorded
+	 *  draws can be drawn as instances of one batch, which
+	 *  needs every setting but the model to match.
+	 ***********************************************************/
+	bool IsSameBatch(const SceneManager::DRAW_COMMAND& first, const SceneManager::DRAW_COMMAND& second)
+	{
+		return((first.mesh == second.mesh) &&
+			(first.features == second.features) &&
+			(first.textureSlot == second.textureSlot) &&
+			(first.materialIndex == second.materialIndex) &&
+			(first.color == second.color) &&
+			(first.uvScale == second.uvScale) &&
+			(first.bTranslucent == second.bTranslucent));
+	}
+
+	/***********************************************************
+	 *  MakeObjectKey()
+	 *
+	 *  This function is used for building the key of the first
+	 *  draw of an object from its source, a group inside the
+	 *  source and the object index in the group. The draws of
+	 *  one object count up from there, up to eight of them.
+	 ***********************************************************/
+	unsigned long long MakeObjectKey(unsigned long long source, unsigned int group, unsigned int object)
+	{
+		return((source << 60) |
+			((unsigned long long)(group & 0x0FFFFFFF) << 32) |
+			((unsigned long long)(object & 0x1FFFFFFF) << 3));
+	}
+
+	/***********************************************************
+	 *  IsBoxOutsideView()
+	 *
+	 *  This function is used for checking whether a world-space
+	 *  box lies entirely outside one of the clip planes of the
+	 *  passed in view projection.
+	 ***********************************************************/
+	bool IsBoxOutsideView(const glm::mat4& viewProjection, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+	{
+		glm::vec4 corners[8];
+		for (int i = 0; i < 8; i++)
+		{
+			corners[i] = viewProjection * glm::vec4(
+				(i & 1) ? boundsMax.x : boundsMin.x,
+				(i & 2) ? boundsMax.y : boundsMin.y,
+				(i & 4) ? boundsMax.z : boundsMin.z,
+				1.0f);
+		}
+
+		// -w <= x, y, z <= w inside the view
+		for (int plane = 0; plane < 6; plane++)
+		{
+			int axis = plane / 2;
+			float sign = (plane & 1) ? -1.0f : 1.0f;
+			bool bAllOutside = true;
+			for (int i = 0; (i < 8) && (bAllOutside == true); i++)
+			{
+				bAllOutside = ((sign * corners[i][axis]) < -corners[i].w);
+			}
+			if (bAllOutside == true)
+			{
+				return(true);
+			}
+		}
+
+		return(false);
+	}
 }
 
 /***********************************************************
@@ -31,10 +174,91 @@ namespace
  *
  *  The constructor for the class
  ***********************************************************/
-SceneManager::SceneManager(ShaderManager *pShaderManager)
+SceneManager::SceneManager(
+	ShaderManager *pShaderManager,
+	ShaderPermutationSet* pShaderPermutations,
+	ResourceManager* pResourceManager)
 {
 	m_pShaderManager = pShaderManager;
-	m_basicMeshes = new ShapeMeshes();
+	m_pResourceManager = pResourceManager;
+	m_pShaderPermutations = pShaderPermutations;
+	m_bUseLighting = false;
+	m_preparedPermutations = 0;
+	m_stateCache = new GLStateCache();
+	m_bindingGeneration = 0;
+	for (int i = 0; i < ShaderPermutationSet::TOTAL_PERMUTATIONS; i++)
+	{
+		m_uniformLocations[i].program = 0;
+	}
+	m_pActiveUniforms = NULL;
+	m_meshLibrary = new MeshLibrary(pResourceManager, "meshcache");
+	m_loadedTextures = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		m_decodedTextures[i].key = 0;
+		m_decodedTextures[i].encodedData = NULL;
+		m_decodedTextures[i].encodedSize = 0;
+		m_decodedTextures[i].texels = NULL;
+		m_decodedTextures[i].width = 0;
+		m_decodedTextures[i].height = 0;
+		m_decodedTextures[i].channels = 0;
+		m_decodedTextures[i].bHasAlpha = false;
+	}
+	m_lightClusters = new LightClusterManager();
+	m_zNear = 0.1f;
+	m_zFar = 100.0f;
+	m_viewportWidth = 1;
+	m_viewportHeight = 1;
+	m_targetWidth = 0;
+	m_targetHeight = 0;
+
+	// default settings for the recorded draws
+	m_currentDraw.mesh = MESH_PLANE;
+	m_currentDraw.color = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+	m_currentDraw.uvScale = glm::vec2(1.0f, 1.0f);
+	m_currentDraw.textureSlot = -1;
+	m_currentDraw.materialIndex = -1;
+	m_currentDraw.lightmapSlot = -1;
+	m_currentDraw.features = 0;
+	m_currentDraw.viewDepth = 0.0f;
+	m_currentDraw.bTranslucent = false;
+	m_currentDraw.bOccluder = false;
+	m_currentDraw.objectKey = 0;
+	m_nextObjectKey = 0;
+	m_stressGeneration = 0;
+
+	m_occlusionCuller = new OcclusionCuller(m_stateCache);
+	m_bOcclusionCulling = true;
+	m_gpuCuller = new GPUCuller(m_stateCache);
+	m_bGPUCulling = false;
+	m_bStressObjectsDirty = false;
+
+	// the draw list keeps its capacity between frames, so
+	// only the frames that record more draws than ever
+	// before need to grow it
+	m_frameArena = new FrameArena(g_FrameArenaSize);
+	m_drawOrder = NULL;
+	m_occluderOrder = NULL;
+	m_drawCommands.reserve(g_DrawCommandReserve);
+	m_renderStats.draws = 0;
+	m_renderStats.triangles = 0;
+
+	// the render thread takes a share of every batch, so one
+	// core is left out of the worker count
+	int hardwareThreads = (int)std::thread::hardware_concurrency();
+	int animationWorkers = std::min(std::max(hardwareThreads - 1, 0), g_MaxAnimationWorkers);
+	m_animations = new AnimationSystem(animationWorkers);
+	m_stressClip = -1;
+	m_turntableClip = -1;
+	m_bAnimateStress = false;
+	m_pSoftwareRasterizer = NULL;
+
+	// the bake runs once, so it may use every core
+	m_lightmapBaker = new LightmapBaker("lightmapcache", 0);
+	m_nextLightmapTag = NULL;
+	m_bBakingLightmaps = false;
+	m_pChunkStreamer = NULL;
+	m_streamedTextureGeneration = 0;
 }
 
 /***********************************************************
@@ -44,83 +268,219 @@ SceneManager::SceneManager(ShaderManager *pShaderManager)
  ***********************************************************/
 SceneManager::~SceneManager()
 {
+	DestroyGLTextures();
+	for (int i = 0; i < 16; i++)
+	{
+		ResourceManager::FreeImage(m_decodedTextures[i]);
+	}
 	m_pShaderManager = NULL;
-	delete m_basicMeshes;
-	m_basicMeshes = NULL;
+	m_pResourceManager = NULL;
+	m_pShaderPermutations = NULL;
+	delete m_meshLibrary;
+	m_meshLibrary = NULL;
+	delete m_lightClusters;
+	m_lightClusters = NULL;
+	delete m_occlusionCuller;
+	m_occlusionCuller = NULL;
+	delete m_gpuCuller;
+	m_gpuCuller = NULL;
+	delete m_frameArena;
+	m_frameArena = NULL;
+	delete m_animations;
+	m_animations = NULL;
+	delete m_lightmapBaker;
+	m_lightmapBaker = NULL;
+	delete m_stateCache;
+	m_stateCache = NULL;
 }
 
 /***********************************************************
  *  CreateGLTexture()
  *
- *  This method is used for loading textures from image files,
- *  configuring the texture mapping parameters in OpenGL,
- *  generating the mipmaps, and loading the read texture into
- *  the next available texture slot in memory.
+ *  This method is used for loading textures from image files
+ *  through the resource manager and registering them in the
+ *  next available texture slot. An image that is already
+ *  loaded is shared instead of being uploaded again.
  ***********************************************************/
 bool SceneManager::CreateGLTexture(const char* filename, std::string tag)
 {
-	int width = 0;
-	int height = 0;
-	int colorChannels = 0;
-	GLuint textureID = 0;
-
-	// indicate to always flip images vertically when loaded
-	stbi_set_flip_vertically_on_load(true);
-
-	// try to parse the image data from the specified image file
-	unsigned char* image = stbi_load(
-		filename,
-		&width,
-		&height,
-		&colorChannels,
-		0);
-
-	// if the image was successfully read from the image file
-	if (image)
-	{
-		std::cout << "Successfully loaded image:" << filename << ", width:" << width << ", height:" << height << ", channels:" << colorChannels << std::endl;
-
-		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-
-		// set the texture wrapping parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		// set texture filtering parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		// if the loaded image is in RGB format
-		if (colorChannels == 3)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-		// if the loaded image is in RGBA format - it supports transparency
-		else if (colorChannels == 4)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-		else
+	if (m_loadedTextures >= 16)
+	{
+		std::cout << "No free texture slot for image:" << filename << std::endl;
+		return false;
+	}
+
+	bool bHasAlpha = false;
+
+	// the software rasterizer keeps its own decoded copy, the
+	// slot holds its texture index instead of a GL name
+	if (NULL != m_pSoftwareRasterizer)
+	{
+		int softwareTexture = m_pSoftwareRasterizer->LoadTexture(filename, bHasAlpha);
+		if (softwareTexture < 0)
 		{
-			std::cout << "Not implemented to handle image with " << colorChannels << " channels" << std::endl;
 			return false;
 		}
 
-		// generate the texture mipmaps for mapping textures to lower resolutions
-		glGenerateMipmap(GL_TEXTURE_2D);
+		m_textureIDs[m_loadedTextures].ID = (uint32_t)softwareTexture;
+		m_textureIDs[m_loadedTextures].tag = tag;
+		m_textureIDs[m_loadedTextures].bHasAlpha = bHasAlpha;
+		m_loadedTextures++;
+		return true;
+	}
 
-		// free the image data from local memory
-		stbi_image_free(image);
-		glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+	ResourceHandle texture = m_pResourceManager->LoadTexture(filename, bHasAlpha);
 
-		// register the loaded texture and associate it with the special tag string
-		m_textureIDs[m_loadedTextures].ID = textureID;
-		m_textureIDs[m_loadedTextures].tag = tag;
+	return(RegisterTexture(texture, tag, bHasAlpha));
+}
+
+/***********************************************************
+ *  RegisterTexture()
+ *
+ *  This method is used for registering a loaded texture in
+ *  the next available texture slot under its tag.
+ ***********************************************************/
+bool SceneManager::RegisterTexture(const ResourceHandle& texture, const std::string& tag, bool bHasAlpha)
+{
+	if (texture.IsValid() == false)
+	{
+		// Error loading the image
+		return false;
+	}
+
+	// reuse a slot emptied by UnregisterTexture() before
+	// taking a new one
+	int slot = 0;
+	while ((slot < m_loadedTextures) && (m_textureIDs[slot].tag.empty() == false))
+	{
+		slot++;
+	}
+
+	if (slot >= 16)
+	{
+		std::cout << "No free texture slot for texture:" << tag << std::endl;
+		return false;
+	}
+
+	// register the loaded texture and associate it with the special tag string
+	m_textureIDs[slot].ID = texture.GetID();
+	m_textureIDs[slot].tag = tag;
+	m_textureIDs[slot].bHasAlpha = bHasAlpha;
+	m_textureIDs[slot].handle = texture;
+	if (slot == m_loadedTextures)
+	{
 		m_loadedTextures++;
+	}
+
+	return true;
+}
+
+/***********************************************************
+ *  UnregisterTexture()
+ *
+ *  This method is used for emptying a texture slot. The
+ *  slot keeps its place, so the other slots keep their
+ *  texture units, and the next registered texture takes it.
+ ***********************************************************/
+void SceneManager::UnregisterTexture(int slot)
+{
+	if ((slot < 0) || (slot >= m_loadedTextures))
+	{
+		return;
+	}
+
+	m_textureIDs[slot].handle.Reset();
+	m_textureIDs[slot].ID = 0;
+	m_textureIDs[slot].tag.clear();
+	m_textureIDs[slot].bHasAlpha = false;
+}
+
+/***********************************************************
+ *  GetSceneTextureCount()
+ *
+ *  This method is used for getting the number of textures
+ *  the scene loads.
+ ***********************************************************/
+int SceneManager::GetSceneTextureCount() const
+{
+	return(g_SceneTextureCount);
+}
+
+/***********************************************************
+ *  DecodeSceneTexture()
+ *
+ *  This method is used for reading and decoding one of the
+ *  scene texture images ahead of LoadSceneTextures(). It
+ *  needs no GL context and different textures can be
+ *  decoded on different threads at the same time.
+ ***********************************************************/
+bool SceneManager::DecodeSceneTexture(int index)
+{
+	if ((index < 0) || (index >= g_SceneTextureCount) || (index >= 16) ||
+		(NULL == m_pResourceManager) || (NULL != m_pSoftwareRasterizer))
+	{
+		return false;
+	}
+
+	ResourceManager::DECODED_IMAGE& image = m_decodedTextures[index];
+	return((ResourceManager::ReadImage(g_SceneTextures[index].filename, image) == true) &&
+		(ResourceManager::DecodeImage(image) == true));
+}
+
+/***********************************************************
+ *  LoadSceneTexture()
+ *
+ *  This method is used for loading one of the scene
+ *  textures into its slot, uploading the decoded image
+ *  when it was decoded ahead of time. A texture that is
+ *  already loaded is skipped.
+ ***********************************************************/
+bool SceneManager::LoadSceneTexture(int index)
+{
+	if ((index < 0) || (index >= g_SceneTextureCount))
+	{
+		return false;
+	}
 
+	const SCENE_TEXTURE& texture = g_SceneTextures[index];
+	if (FindTextureSlot(texture.tag) >= 0)
+	{
 		return true;
 	}
 
-	std::cout << "Could not load image:" << filename << std::endl;
+	if ((index < 16) && (NULL != m_decodedTextures[index].texels) &&
+		(NULL != m_pResourceManager) && (NULL == m_pSoftwareRasterizer))
+	{
+		bool bHasAlpha = false;
+		ResourceHandle handle = m_pResourceManager->UploadImage(m_decodedTextures[index], bHasAlpha);
+		return(RegisterTexture(handle, texture.tag, bHasAlpha));
+	}
+
+	return(CreateGLTexture(texture.filename, texture.tag));
+}
+
+/***********************************************************
+ *  PrepareMesh()
+ *
+ *  This method is used for reading or building one of the
+ *  meshes ahead of its first draw. It needs no GL context
+ *  and different meshes can be prepared on different
+ *  threads at the same time.
+ ***********************************************************/
+bool SceneManager::PrepareMesh(MESH_TYPE mesh)
+{
+	return(m_meshLibrary->PrepareMesh((MeshLibrary::BASIC_MESH)mesh));
+}
 
-	// Error loading the image
-	return false;
+/***********************************************************
+ *  LoadMesh()
+ *
+ *  This method is used for uploading one of the meshes
+ *  before its first draw.
+ ***********************************************************/
+bool SceneManager::LoadMesh(MESH_TYPE mesh)
+{
+	return(NULL != m_meshLibrary->GetMesh((MeshLibrary::BASIC_MESH)mesh));
 }
 
 /***********************************************************
@@ -131,26 +491,36 @@ bool SceneManager::CreateGLTexture(const char* filename, std::string tag)
  ***********************************************************/
 void SceneManager::BindGLTextures()
 {
+	if (NULL != m_pSoftwareRasterizer)
+	{
+		return;
+	}
+
 	for (int i = 0; i < m_loadedTextures; i++)
 	{
 		// bind textures on corresponding texture units
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, m_textureIDs[i].ID);
+		m_stateCache->BindTexture(i, m_textureIDs[i].ID);
 	}
 }
 
 /***********************************************************
  *  DestroyGLTextures()
  *
- *  This method is used for freeing the memory in all the
- *  used texture memory slots.
+ *  This method is used for releasing the textures in all
+ *  the used texture memory slots.
  ***********************************************************/
 void SceneManager::DestroyGLTextures()
 {
+	// the manager frees each texture at the frame boundary
+	// once no other scene holds a handle to it
 	for (int i = 0; i < m_loadedTextures; i++)
 	{
-		glGenTextures(1, &m_textureIDs[i].ID);
+		m_textureIDs[i].handle.Reset();
+		m_textureIDs[i].ID = 0;
+		m_textureIDs[i].tag.clear();
 	}
+	m_loadedTextures = 0;
+	m_streamedTextureSlots.clear();
 }
 
 /***********************************************************
@@ -159,7 +529,7 @@ void SceneManager::DestroyGLTextures()
  *  This method is used for getting an ID for the previously
  *  loaded texture bitmap associated with the passed in tag.
  ***********************************************************/
-int SceneManager::FindTextureID(std::string tag)
+int SceneManager::FindTextureID(const char* tag)
 {
 	int textureID = -1;
 	int index = 0;
@@ -167,7 +537,9 @@ int SceneManager::FindTextureID(std::string tag)
 
 	while ((index < m_loadedTextures) && (bFound == false))
 	{
-		if (m_textureIDs[index].tag.compare(tag) == 0)
+		// an emptied slot matches no tag
+		if ((m_textureIDs[index].tag.empty() == false) &&
+			(m_textureIDs[index].tag.compare(tag) == 0))
 		{
 			textureID = m_textureIDs[index].ID;
 			bFound = true;
@@ -185,7 +557,7 @@ int SceneManager::FindTextureID(std::string tag)
  *  This method is used for getting a slot index for the previously
  *  loaded texture bitmap associated with the passed in tag.
  ***********************************************************/
-int SceneManager::FindTextureSlot(std::string tag)
+int SceneManager::FindTextureSlot(const char* tag)
 {
 	int textureSlot = -1;
 	int index = 0;
@@ -193,7 +565,9 @@ int SceneManager::FindTextureSlot(std::string tag)
 
 	while ((index < m_loadedTextures) && (bFound == false))
 	{
-		if (m_textureIDs[index].tag.compare(tag) == 0)
+		// an emptied slot matches no tag
+		if ((m_textureIDs[index].tag.empty() == false) &&
+			(m_textureIDs[index].tag.compare(tag) == 0))
 		{
 			textureSlot = index;
 			bFound = true;
@@ -211,7 +585,7 @@ int SceneManager::FindTextureSlot(std::string tag)
  *  This method is used for getting a material from the previously
  *  defined materials list that is associated with the passed in tag.
  ***********************************************************/
-bool SceneManager::FindMaterial(std::string tag, OBJECT_MATERIAL& material)
+bool SceneManager::FindMaterial(const char* tag, OBJECT_MATERIAL& material)
 {
 	if (m_objectMaterials.size() == 0)
 	{
@@ -240,11 +614,39 @@ bool SceneManager::FindMaterial(std::string tag, OBJECT_MATERIAL& material)
 	return(true);
 }
 
+/***********************************************************
+ *  FindMaterialIndex()
+ *
+ *  This method is used for getting the index of a material
+ *  in the previously defined materials list that is
+ *  associated with the passed in tag.
+ ***********************************************************/
+int SceneManager::FindMaterialIndex(const char* tag)
+{
+	int materialIndex = -1;
+	int index = 0;
+	bool bFound = false;
+
+	while ((index < (int)m_objectMaterials.size()) && (bFound == false))
+	{
+		if (m_objectMaterials[index].tag.compare(tag) == 0)
+		{
+			materialIndex = index;
+			bFound = true;
+		}
+		else
+			index++;
+	}
+
+	return(materialIndex);
+}
+
 /***********************************************************
  *  SetTransformations()
  *
  *  This method is used for setting the transform buffer
- *  using the passed in transformation values.
+ *  using the passed in transformation values. The model
+ *  matrix is kept for the next recorded draw.
  ***********************************************************/
 void SceneManager::SetTransformations(
 	glm::vec3 scaleXYZ,
@@ -272,17 +674,15 @@ void SceneManager::SetTransformations(
 
 	modelView = translation * rotationX * rotationY * rotationZ * scale;
 
-	if (NULL != m_pShaderManager)
-	{
-		m_pShaderManager->setMat4Value(g_ModelName, modelView);
-	}
+	m_currentDraw.model = modelView;
 }
 
 /***********************************************************
  *  SetShaderColor()
  *
  *  This method is used for setting the passed in color
- *  into the shader for the next draw command
+ *  into the shader for the next draw command. Setting a
+ *  color turns texturing off until a texture is set.
  ***********************************************************/
 void SceneManager::SetShaderColor(
 	float redColorValue,
@@ -298,11 +698,8 @@ void SceneManager::SetShaderColor(
 	currentColor.b = blueColorValue;
 	currentColor.a = alphaValue;
 
-	if (NULL != m_pShaderManager)
-	{
-		m_pShaderManager->setIntValue(g_UseTextureName, false);
-		m_pShaderManager->setVec4Value(g_ColorValueName, currentColor);
-	}
+	m_currentDraw.color = currentColor;
+	m_currentDraw.textureSlot = -1;
 }
 
 /***********************************************************
@@ -312,16 +709,10 @@ void SceneManager::SetShaderColor(
  *  associated with the passed in ID into the shader.
  ***********************************************************/
 void SceneManager::SetShaderTexture(
-	std::string textureTag)
+	const char* textureTag)
 {
-	if (NULL != m_pShaderManager)
-	{
-		m_pShaderManager->setIntValue(g_UseTextureName, true);
-
-		int textureID = -1;
-		textureID = FindTextureSlot(textureTag);
-		m_pShaderManager->setSampler2DValue(g_TextureValueName, textureID);
-	}
+	// an unknown tag leaves the draw untextured
+	m_currentDraw.textureSlot = FindTextureSlot(textureTag);
 }
 
 /***********************************************************
@@ -332,36 +723,679 @@ void SceneManager::SetShaderTexture(
  ***********************************************************/
 void SceneManager::SetTextureUVScale(float u, float v)
 {
-	if (NULL != m_pShaderManager)
+	m_currentDraw.uvScale = glm::vec2(u, v);
+}
+
+/***********************************************************
+ *  SetShaderMaterial()
+ *
+ *  This method is used for passing the material values
+ *  into the shader.
+ ***********************************************************/
+void SceneManager::SetShaderMaterial(
+	const char* materialTag)
+{
+	int materialIndex = FindMaterialIndex(materialTag);
+
+	// an unknown tag keeps the previously set material
+	if (materialIndex >= 0)
+	{
+		m_currentDraw.materialIndex = materialIndex;
+	}
+}
+
+/***********************************************************
+ *  SetShaderLightmap()
+ *
+ *  This method is used for marking the next draw as static,
+ *  so its ambient and diffuse lighting come from a lightmap
+ *  baked under the scene lights. The tag names the bake,
+ *  and each static object needs its own.
+ ***********************************************************/
+void SceneManager::SetShaderLightmap(
+	const char* lightmapTag)
+{
+	m_nextLightmapTag = lightmapTag;
+}
+
+/***********************************************************
+ *  BakeLightmap()
+ *
+ *  This method is used for baking the lightmap with the
+ *  passed in tag for the mesh, placement and material of
+ *  the draw, or reading that bake back from the cache, and
+ *  registering it like a loaded texture.
+ ***********************************************************/
+void SceneManager::BakeLightmap(const char* tag, const DRAW_COMMAND& command)
+{
+	if (FindLightmapSlot(tag) >= 0)
+	{
+		return;
+	}
+
+	// a failed bake is remembered so the draws skip it
+	LIGHTMAP_INFO info;
+	info.tag = tag;
+	info.textureSlot = -1;
+
+	const MeshLibrary::MESH_GEOMETRY* pGeometry =
+		m_meshLibrary->GetMeshGeometry((MeshLibrary::BASIC_MESH)command.mesh);
+	if ((NULL == m_pResourceManager) || (NULL == pGeometry) ||
+		(command.materialIndex < 0))
+	{
+		std::cout << "Could not bake lightmap:" << tag << std::endl;
+		m_lightmaps.push_back(info);
+		return;
+	}
+
+	const OBJECT_MATERIAL& material = m_objectMaterials[command.materialIndex];
+	LightmapBaker::BAKE_MATERIAL bakeMaterial;
+	bakeMaterial.ambientColor = material.ambientColor;
+	bakeMaterial.ambientStrength = material.ambientStrength;
+	bakeMaterial.diffuseColor = material.diffuseColor;
+
+	LightmapBaker::LIGHTMAP lightmap;
+	ResourceHandle texture;
+	if (m_lightmapBaker->GetLightmap(
+		tag, *pGeometry, command.model, bakeMaterial, m_lightClusters->GetLights(), lightmap) == true)
+	{
+		texture = m_pResourceManager->CreateTexture(
+			tag,
+			lightmap.width,
+			lightmap.height,
+			GL_RGB16F,
+			6,
+			GL_RGB,
+			GL_FLOAT,
+			&lightmap.texels[0],
+			lightmap.texels.size() * sizeof(float));
+	}
+	if (RegisterTexture(texture, tag, false) == false)
+	{
+		std::cout << "Could not bake lightmap:" << tag << std::endl;
+		m_lightmaps.push_back(info);
+		return;
+	}
+
+	info.textureSlot = FindTextureSlot(tag);
+	m_lightmaps.push_back(info);
+}
+
+/***********************************************************
+ *  FindLightmapSlot()
+ *
+ *  This method is used for getting the texture slot of the
+ *  lightmap with the passed in tag, -1 when it was not
+ *  baked or the bake failed.
+ ***********************************************************/
+int SceneManager::FindLightmapSlot(const char* tag)
+{
+	for (size_t i = 0; i < m_lightmaps.size(); i++)
+	{
+		if (m_lightmaps[i].tag.compare(tag) == 0)
+		{
+			return(m_lightmaps[i].textureSlot);
+		}
+	}
+
+	return(-1);
+}
+
+/***********************************************************
+ *  DrawMesh()
+ *
+ *  This method is used for recording a draw of the passed
+ *  in basic mesh with the current transformation, color,
+ *  texture and material settings. The shader permutation
+ *  is picked from the features the draw actually uses, and
+ *  the draw is classified as opaque or translucent. The
+ *  first draw of a mesh loads it.
+ ***********************************************************/
+void SceneManager::DrawMesh(MESH_TYPE mesh)
+{
+	const MeshLibrary::MESH_INFO* pMesh = m_meshLibrary->GetMesh((MeshLibrary::BASIC_MESH)mesh);
+	if (NULL == pMesh)
+	{
+		return;
+	}
+
+	DRAW_COMMAND command = m_currentDraw;
+
+	command.mesh = mesh;
+	command.objectKey = m_nextObjectKey++;
+	command.features = 0;
+	if (command.textureSlot >= 0)
+	{
+		command.features |= ShaderPermutationSet::FEATURE_TEXTURE;
+		// textured draws take their alpha from the texture
+		command.bTranslucent = m_textureIDs[command.textureSlot].bHasAlpha;
+	}
+	else
+	{
+		command.bTranslucent = (command.color.a < 1.0f);
+	}
+	if (m_bUseLighting == true)
+	{
+		command.features |= ShaderPermutationSet::FEATURE_LIGHTING;
+	}
+
+	// a static object lit through a material can use baked lighting
+	command.lightmapSlot = -1;
+	if (NULL != m_nextLightmapTag)
+	{
+		if ((m_bUseLighting == true) && (command.materialIndex >= 0) && (NULL == m_pSoftwareRasterizer))
+		{
+			// only the startup pass bakes, the frames look up
+			if (m_bBakingLightmaps == true)
+			{
+				BakeLightmap(m_nextLightmapTag, command);
+			}
+			command.lightmapSlot = FindLightmapSlot(m_nextLightmapTag);
+		}
+		m_nextLightmapTag = NULL;
+	}
+	if (command.lightmapSlot >= 0)
+	{
+		command.features |= ShaderPermutationSet::FEATURE_LIGHTMAP;
+	}
+
+	// depth of the object origin, used for sorting the draws
+	glm::vec4 viewOrigin = m_viewMatrix * command.model[3];
+	command.viewDepth = -viewOrigin.z;
+
+	// transform the mesh bounds into a world-space box by
+	// moving the center and summing the absolute axis extents
+	glm::vec3 localMin = pMesh->boundsMin - glm::vec3(g_BoundsPadding);
+	glm::vec3 localMax = pMesh->boundsMax + glm::vec3(g_BoundsPadding);
+	glm::vec3 localCenter = (localMin + localMax) * 0.5f;
+	glm::vec3 localExtent = (localMax - localMin) * 0.5f;
+	glm::vec3 worldCenter = glm::vec3(command.model * glm::vec4(localCenter, 1.0f));
+	glm::vec3 worldExtent =
+		glm::abs(glm::vec3(command.model[0])) * localExtent.x +
+		glm::abs(glm::vec3(command.model[1])) * localExtent.y +
+		glm::abs(glm::vec3(command.model[2])) * localExtent.z;
+	command.boundsMin = worldCenter - worldExtent;
+	command.boundsMax = worldCenter + worldExtent;
+	command.bOccluder = false;
+
+	m_drawCommands.push_back(command);
+}
+
+/***********************************************************
+ *  UseShaderPermutation()
+ *
+ *  This method is used for activating the specialized
+ *  program for the passed in feature flags. The first time
+ *  a program is used in a frame it gets the frame uniforms.
+ ***********************************************************/
+bool SceneManager::UseShaderPermutation(unsigned int features)
+{
+	if ((NULL == m_pShaderManager) || (NULL == m_pShaderPermutations))
+	{
+		return(false);
+	}
+
+	GLuint programID = m_pShaderPermutations->GetProgram(features);
+	if (0 == programID)
+	{
+		return(false);
+	}
+
+	m_stateCache->UseProgram(programID);
+
+	UNIFORM_LOCATIONS& locations = m_uniformLocations[features];
+	if (locations.program != programID)
+	{
+		locations.program = programID;
+		locations.model = m_stateCache->GetUniformLocation(g_ModelName);
+		locations.color = m_stateCache->GetUniformLocation(g_ColorValueName);
+		locations.texture = m_stateCache->GetUniformLocation(g_TextureValueName);
+		locations.uvScale = m_stateCache->GetUniformLocation(g_UVScaleName);
+		locations.view = m_stateCache->GetUniformLocation(g_ViewName);
+		locations.projection = m_stateCache->GetUniformLocation(g_ProjectionName);
+		locations.viewPosition = m_stateCache->GetUniformLocation(g_ViewPositionName);
+		locations.ambientColor = m_stateCache->GetUniformLocation(g_MaterialAmbientColorName);
+		locations.ambientStrength = m_stateCache->GetUniformLocation(g_MaterialAmbientStrengthName);
+		locations.diffuseColor = m_stateCache->GetUniformLocation(g_MaterialDiffuseColorName);
+		locations.specularColor = m_stateCache->GetUniformLocation(g_MaterialSpecularColorName);
+		locations.shininess = m_stateCache->GetUniformLocation(g_MaterialShininessName);
+		locations.lightmapTexture = m_stateCache->GetUniformLocation(g_LightmapTextureName);
+		locations.instanceOffset = m_stateCache->GetUniformLocation(g_InstanceOffsetName);
+	}
+	m_pActiveUniforms = &locations;
+
+	if ((m_preparedPermutations & (1u << features)) == 0)
+	{
+		SetFrameUniforms(features);
+		m_preparedPermutations |= (1u << features);
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  SetFrameUniforms()
+ *
+ *  This method is used for setting the uniforms that stay
+ *  the same for every draw in the frame into the active
+ *  program.
+ ***********************************************************/
+void SceneManager::SetFrameUniforms(unsigned int features)
+{
+	m_stateCache->SetUniform(m_pActiveUniforms->view, m_viewMatrix);
+	m_stateCache->SetUniform(m_pActiveUniforms->projection, m_projectionMatrix);
+
+	if (features & ShaderPermutationSet::FEATURE_LIGHTING)
+	{
+		m_stateCache->SetUniform(m_pActiveUniforms->viewPosition, m_viewPosition);
+		m_lightClusters->SetClusterUniforms(m_stateCache);
+	}
+}
+
+/***********************************************************
+ *  SetDrawUniforms()
+ *
+ *  This method is used for setting the per draw uniforms
+ *  of a recorded draw into the active program. Only the
+ *  uniforms that exist in the active permutation are set.
+ ***********************************************************/
+void SceneManager::SetDrawUniforms(const DRAW_COMMAND& command, const MeshLibrary::MESH_INFO& mesh)
+{
+	// the packed vertex positions are expanded to the mesh
+	// bounds before the model transformation
+	const UNIFORM_LOCATIONS& locations = *m_pActiveUniforms;
+	m_stateCache->SetUniform(locations.model, command.model * mesh.dequantize);
+
+	if (command.features & ShaderPermutationSet::FEATURE_TEXTURE)
+	{
+		m_stateCache->SetUniform(locations.texture, command.textureSlot);
+		m_stateCache->SetUniform(locations.uvScale, command.uvScale);
+	}
+	else
+	{
+		m_stateCache->SetUniform(locations.color, command.color);
+	}
+
+	if ((command.features & ShaderPermutationSet::FEATURE_LIGHTING) &&
+		(command.materialIndex >= 0))
+	{
+		const OBJECT_MATERIAL& material = m_objectMaterials[command.materialIndex];
+		m_stateCache->SetUniform(locations.ambientColor, material.ambientColor);
+		m_stateCache->SetUniform(locations.ambientStrength, material.ambientStrength);
+		m_stateCache->SetUniform(locations.diffuseColor, material.diffuseColor);
+		m_stateCache->SetUniform(locations.specularColor, material.specularColor);
+		m_stateCache->SetUniform(locations.shininess, material.shininess);
+	}
+
+	if (command.features & ShaderPermutationSet::FEATURE_LIGHTMAP)
+	{
+		m_stateCache->SetUniform(locations.lightmapTexture, command.lightmapSlot);
+	}
+}
+
+/***********************************************************
+ *  SubmitDrawCommand()
+ *
+ *  This method is used for setting the per draw uniforms
+ *  of a recorded draw into the active program and drawing
+ *  its mesh.
+ ***********************************************************/
+void SceneManager::SubmitDrawCommand(const DRAW_COMMAND& command)
+{
+	const MeshLibrary::MESH_INFO* pMesh = m_meshLibrary->GetMesh((MeshLibrary::BASIC_MESH)command.mesh);
+	if (NULL == pMesh)
+	{
+		return;
+	}
+
+	SetDrawUniforms(command, *pMesh);
+	m_meshLibrary->DrawMesh(*pMesh, m_stateCache);
+
+	m_renderStats.draws++;
+	m_renderStats.triangles += pMesh->indexCount / 3;
+	PerformanceCounters::Add(PerformanceCounters::COUNTER_DRAW_CALLS, 1);
+	PerformanceCounters::Add(PerformanceCounters::COUNTER_TRIANGLES, pMesh->indexCount / 3);
+}
+
+/***********************************************************
+ *  SubmitInstancedBatch()
+ *
+ *  This method is used for drawing the instances of a batch
+ *  that survived the GPU culling with one indirect draw.
+ *  The number of instances is only known to the GPU, so
+ *  the triangles are counted with the instances read back
+ *  from a few frames before.
+ ***********************************************************/
+void SceneManager::SubmitInstancedBatch(int batch)
+{
+	const INSTANCED_BATCH& instanced = m_instancedBatches[batch];
+	const MeshLibrary::MESH_INFO* pMesh = m_meshLibrary->GetMesh((MeshLibrary::BASIC_MESH)instanced.settings.mesh);
+	unsigned int features = instanced.settings.features | ShaderPermutationSet::FEATURE_INSTANCING;
+	if ((NULL == pMesh) || (UseShaderPermutation(features) == false))
+	{
+		return;
+	}
+
+	SetDrawUniforms(instanced.settings, *pMesh);
+	m_stateCache->SetUniform(m_pActiveUniforms->instanceOffset, instanced.firstInstance);
+	m_stateCache->BindVertexArray(pMesh->vertexArray);
+	m_gpuCuller->DrawBatch(batch, pMesh->indexType);
+
+	long long triangles = (long long)(pMesh->indexCount / 3) * m_gpuCuller->GetVisibleInstances(batch);
+	m_renderStats.draws++;
+	m_renderStats.triangles += triangles;
+	PerformanceCounters::Add(PerformanceCounters::COUNTER_DRAW_CALLS, 1);
+	PerformanceCounters::Add(PerformanceCounters::COUNTER_TRIANGLES, triangles);
+}
+
+/***********************************************************
+ *  RenderOcclusionPrePass()
+ *
+ *  This method is used for drawing the depth of the draws
+ *  that cover the most of the screen, then testing the
+ *  bounding box of every other draw against that depth
+ *  with occlusion queries. The query results are used in
+ *  later frames to skip the draws that stayed hidden.
+ ***********************************************************/
+void SceneManager::RenderOcclusionPrePass()
+{
+	int drawCount = (int)m_drawCommands.size();
+
+	m_occlusionCuller->BeginFrame();
+
+	// rank the opaque draws in front of the camera by their
+	// approximate screen size and keep the largest ones
+	m_occluderOrder = m_frameArena->AllocateArray<int>(drawCount);
+	int candidateCount = 0;
+	for (int i = 0; i < drawCount; i++)
+	{
+		const DRAW_COMMAND& command = m_drawCommands[i];
+		float radius = glm::length(command.boundsMax - command.boundsMin) * 0.5f;
+		if ((command.bTranslucent == false) && (command.viewDepth + radius > m_zNear))
+		{
+			m_occluderOrder[candidateCount++] = i;
+		}
+	}
+
+	const std::vector<DRAW_COMMAND>& commands = m_drawCommands;
+	float zNear = m_zNear;
+	int occluderCount = std::min(candidateCount, g_MaxOccluders);
+	std::partial_sort(
+		m_occluderOrder,
+		m_occluderOrder + occluderCount,
+		m_occluderOrder + candidateCount,
+		[&commands, zNear](int a, int b)
+		{
+			float radiusA = glm::length(commands[a].boundsMax - commands[a].boundsMin);
+			float radiusB = glm::length(commands[b].boundsMax - commands[b].boundsMin);
+			return((radiusA / std::max(commands[a].viewDepth, zNear)) >
+				(radiusB / std::max(commands[b].viewDepth, zNear)));
+		});
+
+	// the depth-only pass uses the cheapest permutation, the
+	// invariant positions match the later color pass exactly
+	m_stateCache->SetColorMask(false);
+	for (int i = 0; i < occluderCount; i++)
+	{
+		DRAW_COMMAND& command = m_drawCommands[m_occluderOrder[i]];
+		command.bOccluder = true;
+
+		DRAW_COMMAND depthCommand = command;
+		depthCommand.features = 0;
+		if (UseShaderPermutation(depthCommand.features) == true)
+		{
+			SubmitDrawCommand(depthCommand);
+		}
+	}
+	m_stateCache->SetColorMask(true);
+
+	// test every other draw against the occluder depth
+	m_occlusionCuller->BeginQueries(m_projectionMatrix * m_viewMatrix, m_viewPosition);
+	for (int i = 0; i < drawCount; i++)
+	{
+		if (m_drawCommands[i].bOccluder == false)
+		{
+			m_occlusionCuller->IssueQuery(
+				m_drawCommands[i].objectKey,
+				m_drawCommands[i].boundsMin,
+				m_drawCommands[i].boundsMax);
+		}
+	}
+	m_occlusionCuller->EndQueries();
+}
+
+/***********************************************************
+ *  SortDrawCommands()
+ *
+ *  This method is used for ordering all of the recorded
+ *  draws. Opaque draws go first, grouped by shader
+ *  permutation so each program is only activated once, and
+ *  front-to-back inside each group for the most early
+ *  depth rejection. Translucent draws follow back-to-front.
+ ***********************************************************/
+int SceneManager::SortDrawCommands()
+{
+	int drawCount = (int)m_drawCommands.size();
+
+	m_drawOrder = m_frameArena->AllocateArray<int>(drawCount);
+	for (int i = 0; i < drawCount; i++)
+	{
+		m_drawOrder[i] = i;
+	}
+
+	// std::sort with the recording order as the last key keeps
+	// the order stable without the temporary buffer that
+	// std::stable_sort allocates on every call
+	const std::vector<DRAW_COMMAND>& commands = m_drawCommands;
+	std::sort(
+		m_drawOrder,
+		m_drawOrder + drawCount,
+		[&commands](int a, int b)
+		{
+			const DRAW_COMMAND& first = commands[a];
+			const DRAW_COMMAND& second = commands[b];
+
+			// all opaque draws come before the translucent ones
+			if (first.bTranslucent != second.bTranslucent)
+			{
+				return(second.bTranslucent);
+			}
+			// translucent draws are ordered back-to-front
+			if (first.bTranslucent == true)
+			{
+				if (first.viewDepth != second.viewDepth)
+				{
+					return(first.viewDepth > second.viewDepth);
+				}
+				return(a < b);
+			}
+			// opaque draws by permutation, then front-to-back
+			if (first.features != second.features)
+			{
+				return(first.features < second.features);
+			}
+			if (first.viewDepth != second.viewDepth)
+			{
+				return(first.viewDepth < second.viewDepth);
+			}
+			return(a < b);
+		});
+
+	return(drawCount);
+}
+
+/***********************************************************
+ *  FlushDrawCommands()
+ *
+ *  This method is used for submitting all of the recorded
+ *  draws in the sorted order. Opaque draws are drawn with
+ *  blending turned off, translucent draws with blending on
+ *  and depth writes off. Draws hidden behind the occluders
+ *  in earlier frames are skipped. The GPU culled batches
+ *  are drawn before the opaque draws and after the
+ *  translucent ones, and the depth of the finished frame
+ *  is kept for culling them in the next frame.
+ ***********************************************************/
+void SceneManager::FlushDrawCommands()
+{
+	int drawCount = SortDrawCommands();
+
+	// meshes and lightmaps loaded while recording were bound
+	// behind the state cache, so it starts over
+	if ((NULL != m_pResourceManager) &&
+		(m_pResourceManager->GetBindingGeneration() != m_bindingGeneration))
+	{
+		m_bindingGeneration = m_pResourceManager->GetBindingGeneration();
+		m_stateCache->Invalidate();
+		BindGLTextures();
+	}
+
+	m_stateCache->SetEnabled(GL_BLEND, false);
+	m_stateCache->SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	bool bBlending = false;
+
+	glm::mat4 viewProjection = m_projectionMatrix * m_viewMatrix;
+	if (m_bGPUCulling == true)
+	{
+		m_gpuCuller->Cull(viewProjection);
+	}
+
+	m_preparedPermutations = 0;
+	if (m_bOcclusionCulling == true)
+	{
+		RenderOcclusionPrePass();
+	}
+
+	// the occluders are drawn again at the same depth
+	m_stateCache->SetDepthFunc(GL_LEQUAL);
+
+	// the culled batches have no draw order of their own, the
+	// translucent ones are blended in the order they were made
+	for (int i = 0; (m_bGPUCulling == true) && (i < (int)m_instancedBatches.size()); i++)
+	{
+		if (m_instancedBatches[i].settings.bTranslucent == false)
+		{
+			SubmitInstancedBatch(i);
+		}
+	}
+
+	for (int i = 0; i < drawCount; i++)
+	{
+		const DRAW_COMMAND& command = m_drawCommands[m_drawOrder[i]];
+
+		if ((m_bOcclusionCulling == true) &&
+			(command.bOccluder == false) &&
+			(m_occlusionCuller->IsVisible(command.objectKey) == false))
+		{
+			PerformanceCounters::Add(PerformanceCounters::COUNTER_CULLED_OBJECTS, 1);
+			continue;
+		}
+
+		if ((command.bTranslucent == true) && (bBlending == false))
+		{
+			// translucent surfaces are tested against the depth
+			// buffer but do not hide what is drawn behind them
+			m_stateCache->SetEnabled(GL_BLEND, true);
+			m_stateCache->SetDepthMask(false);
+			bBlending = true;
+		}
+
+		if (UseShaderPermutation(command.features) == true)
+		{
+			SubmitDrawCommand(command);
+		}
+	}
+
+	for (int i = 0; (m_bGPUCulling == true) && (i < (int)m_instancedBatches.size()); i++)
+	{
+		if (m_instancedBatches[i].settings.bTranslucent == false)
+		{
+			continue;
+		}
+		if (bBlending == false)
+		{
+			m_stateCache->SetEnabled(GL_BLEND, true);
+			m_stateCache->SetDepthMask(false);
+			bBlending = true;
+		}
+		SubmitInstancedBatch(i);
+	}
+
+	// depth writes must be back on for the next depth clear
+	if (bBlending == true)
 	{
-		m_pShaderManager->setVec2Value("UVscale", glm::vec2(u, v));
+		m_stateCache->SetDepthMask(true);
 	}
+	m_stateCache->SetDepthFunc(GL_LESS);
+
+	if (m_bGPUCulling == true)
+	{
+		m_gpuCuller->BuildDepthPyramid(
+			m_targetWidth,
+			m_targetHeight,
+			m_viewportWidth,
+			m_viewportHeight,
+			viewProjection);
+	}
+
+	m_drawCommands.clear();
 }
 
 /***********************************************************
- *  SetShaderMaterial()
+ *  FlushSoftwareDraws()
  *
- *  This method is used for passing the material values
- *  into the shader.
+ *  This method is used for drawing the recorded draws with
+ *  the software rasterizer, in the same order and with the
+ *  same settings the GL path submits them with.
  ***********************************************************/
-void SceneManager::SetShaderMaterial(
-	std::string materialTag)
+void SceneManager::FlushSoftwareDraws()
 {
-	if (m_objectMaterials.size() > 0)
+	int drawCount = SortDrawCommands();
+
+	m_pSoftwareRasterizer->BeginFrame(
+		m_viewMatrix,
+		m_projectionMatrix,
+		m_viewPosition,
+		m_lightClusters->GetLights());
+
+	for (int i = 0; i < drawCount; i++)
 	{
-		OBJECT_MATERIAL material;
-		bool bReturn = false;
+		const DRAW_COMMAND& command = m_drawCommands[m_drawOrder[i]];
+
+		SoftwareRasterizer::DRAW draw;
+		draw.pGeometry = m_meshLibrary->GetMeshGeometry((MeshLibrary::BASIC_MESH)command.mesh);
+		draw.model = command.model;
+		draw.color = command.color;
+		draw.uvScale = command.uvScale;
+		draw.texture = (command.features & ShaderPermutationSet::FEATURE_TEXTURE) ?
+			(int)m_textureIDs[command.textureSlot].ID : -1;
+		draw.bLighting = ((command.features & ShaderPermutationSet::FEATURE_LIGHTING) != 0) &&
+			(command.materialIndex >= 0);
+		if (draw.bLighting == true)
+		{
+			const OBJECT_MATERIAL& material = m_objectMaterials[command.materialIndex];
+			draw.material.ambientColor = material.ambientColor;
+			draw.material.ambientStrength = material.ambientStrength;
+			draw.material.diffuseColor = material.diffuseColor;
+			draw.material.specularColor = material.specularColor;
+			draw.material.shininess = material.shininess;
+		}
+		draw.bTranslucent = command.bTranslucent;
+		m_pSoftwareRasterizer->AddDraw(draw);
 
-		bReturn = FindMaterial(materialTag, material);
-		if (bReturn == true)
+		if (NULL != draw.pGeometry)
 		{
-			m_pShaderManager->setVec3Value("material.ambientColor", material.ambientColor);
-			m_pShaderManager->setFloatValue("material.ambientStrength", material.ambientStrength);
-			m_pShaderManager->setVec3Value("material.diffuseColor", material.diffuseColor);
-			m_pShaderManager->setVec3Value("material.specularColor", material.specularColor);
-			m_pShaderManager->setFloatValue("material.shininess", material.shininess);
+			m_renderStats.draws++;
+			m_renderStats.triangles += (long long)(draw.pGeometry->indices.size() / 3);
+			PerformanceCounters::Add(PerformanceCounters::COUNTER_DRAW_CALLS, 1);
+			PerformanceCounters::Add(
+				PerformanceCounters::COUNTER_TRIANGLES,
+				(long long)(draw.pGeometry->indices.size() / 3));
 		}
 	}
+
+	m_pSoftwareRasterizer->EndFrame();
+	m_drawCommands.clear();
 }
 
 /**************************************************************/
@@ -378,12 +1412,13 @@ void SceneManager::LoadSceneTextures()
 	/*** 16 textures can be loaded per scene. Refer to the code in   ***/
 	/*** the OpenGL Sample for help.                                 ***/
 
-	// loaded the textures for the 3D scene, Added references to each texture
-	CreateGLTexture("textures/wood.jpg", "woodTexture");			//https://commons.wikimedia.org/wiki/File:Balsa_Wood_Texture.jpg
-	CreateGLTexture("textures/leather.jpg", "leatherTexture");		//https://commons.wikimedia.org/wiki/File:Black_Leather.jpg
-	CreateGLTexture("textures/cube.jpg", "cubeTexture");			//Made it myself in paint... not an artist
-	CreateGLTexture("textures/can.jpg", "canTexture");				
-	CreateGLTexture("textures/top.png", "topTexture");			
+	// loaded the textures for the 3D scene, the files and tags
+	// are listed in g_SceneTextures at the top of this file -
+	// textures already loaded during startup are skipped
+	for (int i = 0; i < g_SceneTextureCount; i++)
+	{
+		LoadSceneTexture(i);
+	}
 	// after the texture image data is loaded into memory, the
 	// loaded textures need to be bound to texture slots - there
 	// are a total of 16 available slots for scene textures
@@ -444,55 +1479,152 @@ void SceneManager::DefineObjectMaterials()
 	plasticMaterial.tag = "plastic";
 	m_objectMaterials.push_back(plasticMaterial);
 }
+
+/***********************************************************
+ *  DefineSceneAnimations()
+ *
+ *  This method is used for defining the keyframe clips the
+ *  animated stress test copies play. The objects that play
+ *  them are added with the copies.
+ ***********************************************************/
+void SceneManager::DefineSceneAnimations()
+{
+	// a copy hops up from where it stands and lands again,
+	// the position is an offset from its place in the layout
+	AnimationClip hopClip(true);
+	AnimationClip::KEYFRAME key;
+	key.position = glm::vec3(0.0f, 0.0f, 0.0f);
+	key.rotation = glm::vec3(0.0f, 0.0f, 0.0f);
+	key.scale = glm::vec3(1.0f, 1.0f, 1.0f);
+	key.color = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+	hopClip.AddKeyframe(0.0f, key);
+
+	key.position.y = g_StressHopHeight;
+	hopClip.AddKeyframe(g_StressHopSeconds * 0.5f, key);
+
+	key.position.y = 0.0f;
+	hopClip.AddKeyframe(g_StressHopSeconds, key);
+
+	m_stressClip = m_animations->AddClip(hopClip);
+
+	// a copy turns once round on its base like a display
+	// turntable, swelling and warming up halfway round - the
+	// last key is a full turn, so the loop has no seam
+	AnimationClip turntableClip(true);
+	key.position = glm::vec3(0.0f, 0.0f, 0.0f);
+	key.rotation = glm::vec3(0.0f, 0.0f, 0.0f);
+	key.scale = glm::vec3(1.0f, 1.0f, 1.0f);
+	key.color = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+	turntableClip.AddKeyframe(0.0f, key);
+
+	key.rotation.y = 180.0f;
+	key.scale = glm::vec3(g_TurntablePulseScale);
+	key.color = g_TurntablePulseTint;
+	turntableClip.AddKeyframe(g_TurntableSeconds * 0.5f, key);
+
+	key.rotation.y = 360.0f;
+	key.scale = glm::vec3(1.0f, 1.0f, 1.0f);
+	key.color = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+	turntableClip.AddKeyframe(g_TurntableSeconds, key);
+
+	m_turntableClip = m_animations->AddClip(turntableClip);
+}
+
+/***********************************************************
+ *  UpdateAnimations()
+ *
+ *  This method is used for evaluating every animated object
+ *  for the frame about to be rendered.
+ ***********************************************************/
+void SceneManager::UpdateAnimations(double time)
+{
+	m_animations->Evaluate(time);
+}
 void SceneManager::SetupSceneLights()
 {
-	// this line of code is NEEDED for telling the shaders to render 
-	// the 3D scene with custom lighting, if no light sources have
-	// been added then the display window will be black - to use the 
-	// default OpenGL lighting then comment out the following line
-	//m_pShaderManager->setBoolValue(g_UseLightingName, true);
+	// this flag is NEEDED for selecting the shader permutations that
+	// render the 3D scene with custom lighting, if no light sources
+	// have been added then the display window will be black - it is
+	// set at the bottom of this method
 
 	/*** STUDENTS - add the code BELOW for setting up light sources ***/
-	/*** Up to four light sources can be defined. Refer to the code ***/
-	/*** in the OpenGL Sample for help                              ***/
-
-// ***** Cool Blue from Above *******
-	m_pShaderManager->setVec3Value("lightSources[0].position", 0.0f, 10.0f, 0.0f); 
-	m_pShaderManager->setVec3Value("lightSources[0].ambientColor", 0.1f, 0.1f, 0.2f); 
-	m_pShaderManager->setVec3Value("lightSources[0].diffuseColor", 0.6f, 0.7f, 1.0f); 
-	m_pShaderManager->setVec3Value("lightSources[0].specularColor", 0.4f, 0.4f, 1.0f); 
-	m_pShaderManager->setFloatValue("lightSources[0].focalStrength", 0.5f); 
-	m_pShaderManager->setFloatValue("lightSources[0].specularIntensity", 0.4f); 
+	/*** Light sources are binned into view-space clusters, so any  ***/
+	/*** number can be defined. The range is the distance at which  ***/
+	/*** the light fades out and should be kept as small as possible***/
+
+	m_lightClusters->ClearLights();
+
+	// ***** Cool Blue from Above *******
+	m_lightClusters->AddLight(
+		glm::vec3(0.0f, 10.0f, 0.0f),		// position
+		glm::vec3(0.1f, 0.1f, 0.2f),		// ambient color
+		glm::vec3(0.6f, 0.7f, 1.0f),		// diffuse color
+		glm::vec3(0.4f, 0.4f, 1.0f),		// specular color
+		0.5f,								// focal strength
+		0.4f,								// specular intensity
+		100.0f);							// range
 
 	// ****** Warm Side Glow *****
-	m_pShaderManager->setVec3Value("lightSources[1].position", -7.0f, 4.0f, 2.0f);
-	m_pShaderManager->setVec3Value("lightSources[1].ambientColor", 0.02f, 0.015f, 0.01f); 
-	m_pShaderManager->setVec3Value("lightSources[1].diffuseColor", 0.8f, 0.4f, 0.1f); 
-	m_pShaderManager->setVec3Value("lightSources[1].specularColor", 0.6f, 0.3f, 0.2f); 
-	m_pShaderManager->setFloatValue("lightSources[1].focalStrength", 0.2f); 
-	m_pShaderManager->setFloatValue("lightSources[1].specularIntensity", 0.3f); 
+	m_lightClusters->AddLight(
+		glm::vec3(-7.0f, 4.0f, 2.0f),
+		glm::vec3(0.02f, 0.015f, 0.01f),
+		glm::vec3(0.8f, 0.4f, 0.1f),
+		glm::vec3(0.6f, 0.3f, 0.2f),
+		0.2f,
+		0.3f,
+		100.0f);
 
 	// ***** Rim Light ******
-	m_pShaderManager->setVec3Value("lightSources[2].position", 8.0f, -3.0f, 10.0f); 
-	m_pShaderManager->setVec3Value("lightSources[2].ambientColor", 0.02f, 0.02f, 0.05f); 
-	m_pShaderManager->setVec3Value("lightSources[2].diffuseColor", 0.2f, 0.3f, 0.7f); 
-	m_pShaderManager->setVec3Value("lightSources[2].specularColor", 0.2f, 0.2f, 0.8f); 
-	m_pShaderManager->setFloatValue("lightSources[2].focalStrength", 0.6f); 
-	m_pShaderManager->setFloatValue("lightSources[2].specularIntensity", 0.4f); 
+	m_lightClusters->AddLight(
+		glm::vec3(8.0f, -3.0f, 10.0f),
+		glm::vec3(0.02f, 0.02f, 0.05f),
+		glm::vec3(0.2f, 0.3f, 0.7f),
+		glm::vec3(0.2f, 0.2f, 0.8f),
+		0.6f,
+		0.4f,
+		100.0f);
 
 	// ***** Top Front Light) *****
-	m_pShaderManager->setVec3Value("lightSources[3].position", 12.0f, 6.0f, 10.0f); 
-	m_pShaderManager->setVec3Value("lightSources[3].ambientColor", 0.03f, 0.03f, 0.03f); 
-	m_pShaderManager->setVec3Value("lightSources[3].diffuseColor", 0.9f, 0.9f, 0.9f); 
-	m_pShaderManager->setVec3Value("lightSources[3].specularColor", 1.0f, 1.0f, 1.0f); 
-	m_pShaderManager->setFloatValue("lightSources[3].focalStrength", 0.2f); 
-	m_pShaderManager->setFloatValue("lightSources[3].specularIntensity", 0.2f); 
+	m_lightClusters->AddLight(
+		glm::vec3(12.0f, 6.0f, 10.0f),
+		glm::vec3(0.03f, 0.03f, 0.03f),
+		glm::vec3(0.9f, 0.9f, 0.9f),
+		glm::vec3(1.0f, 1.0f, 1.0f),
+		0.2f,
+		0.2f,
+		100.0f);
 
 	// ***** Enables shader lighting *****
-	m_pShaderManager->setBoolValue("bUseLighting", true);
+	m_bUseLighting = true;
 
 
 }
+/***********************************************************
+ *  SetSceneView()
+ *
+ *  This method is used for passing the view settings of the
+ *  current frame, which are needed for binning the light
+ *  sources into the view-space clusters.
+ ***********************************************************/
+void SceneManager::SetSceneView(
+	const glm::mat4& view,
+	const glm::mat4& projection,
+	float zNear,
+	float zFar,
+	int viewportWidth,
+	int viewportHeight)
+{
+	m_viewMatrix = view;
+	m_projectionMatrix = projection;
+	m_zNear = zNear;
+	m_zFar = zFar;
+	m_viewportWidth = viewportWidth;
+	m_viewportHeight = viewportHeight;
+
+	// the camera position is the translation of the inverse view
+	m_viewPosition = glm::vec3(glm::inverse(view)[3]);
+}
+
 /***********************************************************
  *  PrepareScene()
  *
@@ -502,20 +1634,80 @@ void SceneManager::SetupSceneLights()
  ***********************************************************/
 void SceneManager::PrepareScene()
 {
-	// load the textures for the 3D sceneaaa
-	LoadSceneTextures();
+	PrepareSceneData();
+	PrepareSceneResources();
+}
+
+/***********************************************************
+ *  PrepareSceneData()
+ *
+ *  This method is used for defining the lights, materials
+ *  and animations of the scene. It needs no GL context, so
+ *  it can run on a worker thread during startup.
+ ***********************************************************/
+void SceneManager::PrepareSceneData()
+{
 	SetupSceneLights();
 	DefineObjectMaterials();
+	DefineSceneAnimations();
+}
+
+/***********************************************************
+ *  PrepareSceneResources()
+ *
+ *  This method is used for loading the GL resources of the
+ *  scene, on the thread that owns the context.
+ ***********************************************************/
+void SceneManager::PrepareSceneResources()
+{
+	// load the textures for the 3D scene
+	LoadSceneTextures();
+	// the occlusion culling needs its own bounding box program
+	if ((NULL == m_pShaderPermutations) ||
+		(m_occlusionCuller->Initialize(m_pResourceManager) == false))
+	{
+		m_bOcclusionCulling = false;
+	}
+	// the stress objects are culled on the GPU when it can run
+	// the compute shaders, otherwise they are recorded and
+	// culled with the other draws every frame
+	if ((NULL == m_pSoftwareRasterizer) && (NULL != m_pShaderPermutations) &&
+		(m_gpuCuller->Initialize(m_pResourceManager) == true))
+	{
+		m_bGPUCulling = true;
+		m_bStressObjectsDirty = true;
+	}
+	// bake the static lighting, or read it from the cache,
+	// before the first frame instead of during it
+	BakeLightmaps();
+
 	// only one instance of a particular mesh needs to be
 	// loaded in memory no matter how many times it is drawn
-	// in the rendered 3D scene
-	/* Added necessary shapes to be loaded */
-	m_basicMeshes->LoadPlaneMesh();
-	m_basicMeshes->LoadSphereMesh();
-	m_basicMeshes->LoadTorusMesh();
-	m_basicMeshes->LoadCylinderMesh();
-	m_basicMeshes->LoadConeMesh();
-	m_basicMeshes->LoadBoxMesh();
+	// in the rendered 3D scene - the mesh library loads each
+	// shape the first time a draw uses it
+}
+
+/***********************************************************
+ *  BakeLightmaps()
+ *
+ *  This method is used for baking the lightmaps of the desk
+ *  at startup. The desk draws are recorded once so each
+ *  draw with a lightmap tag bakes it with its own mesh,
+ *  placement and material, and the recording is thrown
+ *  away after.
+ ***********************************************************/
+void SceneManager::BakeLightmaps()
+{
+	if (NULL != m_pSoftwareRasterizer)
+	{
+		return;
+	}
+
+	m_bBakingLightmaps = true;
+	RenderDesk();
+	m_bBakingLightmaps = false;
+
+	m_drawCommands.clear();
 }
 
 /***********************************************************
@@ -525,6 +1717,67 @@ void SceneManager::PrepareScene()
  *  transforming and drawing the basic 3D shapes
  ***********************************************************/
 void SceneManager::RenderScene()
+{
+	// release the transient data of the previous frame
+	m_frameArena->Reset();
+	m_renderStats.draws = 0;
+	m_renderStats.triangles = 0;
+
+	// bin the light sources into the clusters for this view,
+	// the software rasterizer lights with every light instead
+	if (NULL == m_pSoftwareRasterizer)
+	{
+		m_lightClusters->UpdateClusters(
+			m_viewMatrix,
+			m_projectionMatrix,
+			m_zNear,
+			m_zFar,
+			m_viewportWidth,
+			m_viewportHeight);
+		m_lightClusters->BindClusterData();
+
+		// the upscale pass binds its own texture between frames
+		BindGLTextures();
+	}
+
+	// the desk and the props standing on it
+	RenderDesk();
+
+	// the stress test copies of the props, when generated - the
+	// GPU culled copies are only recorded when they change, so
+	// moving copies are always recorded
+	if ((m_bGPUCulling == false) || (m_bAnimateStress == true))
+	{
+		RenderStressObjects();
+	}
+	else if (m_bStressObjectsDirty == true)
+	{
+		UploadStressInstances();
+	}
+
+	// the chunks of the streamed world around the camera
+	RenderStreamedChunks();
+
+	// submit the recorded draws grouped by shader permutation
+	if (NULL != m_pSoftwareRasterizer)
+	{
+		FlushSoftwareDraws();
+	}
+	else
+	{
+		FlushDrawCommands();
+	}
+}
+
+/***********************************************************
+ *  RenderDesk()
+ *
+ *  This method is used for recording the draws of the desk
+ *  and the props on it. The desk records the same draws in
+ *  the same order every time, so counting them gives the
+ *  draws stable object keys.
+ ***********************************************************/
+void SceneManager::RenderDesk()
 {
 	// declare the variables for the transformations
 	glm::vec3 scaleXYZ;
@@ -533,6 +1786,8 @@ void SceneManager::RenderScene()
 	float ZrotationDegrees = 0.0f;
 	glm::vec3 positionXYZ;
 
+	m_nextObjectKey = MakeObjectKey(g_DeskObjectKeys, 0, 0);
+
 	/*** Set needed transformations before drawing the basic mesh.  ***/
 	/*** This same ordering of code should be used for transforming ***/
 	/*** and drawing all the basic 3D shapes.						***/
@@ -562,8 +1817,10 @@ void SceneManager::RenderScene()
 	// set the texture data into the shader
 	SetShaderTexture("woodTexture");
 	SetShaderMaterial("wood");
+	// the desk never moves, so its lighting is baked
+	SetShaderLightmap("deskLightmap");
 	// draw the mesh with transformation values
-	m_basicMeshes->DrawPlaneMesh();
+	DrawMesh(MESH_PLANE);
 
 
 	/******** Black Desk mat ********/
@@ -591,9 +1848,10 @@ void SceneManager::RenderScene()
 	// set the texture data into the shader
 	SetShaderTexture("leatherTexture");
 	SetShaderMaterial("leather");
+	SetShaderLightmap("deskMatLightmap");
 
 	// draw the mesh with transformation values
-	m_basicMeshes->DrawPlaneMesh();
+	DrawMesh(MESH_PLANE);
 
 	/******** Red Desk mat Border********/
 	scaleXYZ = glm::vec3(10.1f, 1.1f, 6.1f);
@@ -616,8 +1874,9 @@ void SceneManager::RenderScene()
 	// set the color for the mesh
 	SetShaderColor(1.0f, 0.1f, 0.0f, 1.0f);
 	SetShaderMaterial("leather");
+	SetShaderLightmap("deskBorderLightmap");
 	// draw the mesh with transformation values
-	m_basicMeshes->DrawPlaneMesh();
+	DrawMesh(MESH_PLANE);
 
 	/******** Torus Stand Base ********/
 	scaleXYZ = glm::vec3(0.5f, 0.5f, 0.5f);
@@ -639,7 +1898,7 @@ void SceneManager::RenderScene()
 	// Dark Gray for the stand
 	SetShaderColor(0.2f, 0.2f, 0.2f, 1.0f);
 	SetShaderMaterial("plastic");
-	m_basicMeshes->DrawTorusMesh();
+	DrawMesh(MESH_TORUS);
 
 	/******** Tapered Cylinder supporting top and bottom Tori ********/
 	scaleXYZ = glm::vec3(0.05f, 0.5f, 0.4f);
@@ -656,7 +1915,7 @@ void SceneManager::RenderScene()
 	// Applied lighter gray to contrast other components
 	SetShaderColor(0.3f, 0.3f, 0.3f, 1.0f);
 	SetShaderMaterial("plastic");
-	m_basicMeshes->DrawCylinderMesh();
+	DrawMesh(MESH_CYLINDER);
 
 	/******** Pokeball base ********/
 	scaleXYZ = glm::vec3(0.3f, 0.3f, 0.3f);
@@ -678,7 +1937,7 @@ void SceneManager::RenderScene()
 	// Applied gray for contrast
 	SetShaderColor(0.2f, 0.2f, 0.2f, 1.0f);
 	SetShaderMaterial("plastic");
-	m_basicMeshes->DrawTorusMesh();
+	DrawMesh(MESH_TORUS);
 
 	/******** Red Pokeball Top Half ********/
 	scaleXYZ = glm::vec3(1.0f, 1.0f, 1.0f);
@@ -695,7 +1954,7 @@ void SceneManager::RenderScene()
 	// Set Pokeball top half as Red
 	SetShaderColor(1.0f, 0.0f, 0.0f, 1.0f);
 	SetShaderMaterial("plastic");
-	m_basicMeshes->DrawHalfSphereMesh();
+	DrawMesh(MESH_HALF_SPHERE);
 
 	/******** White Pokeball Bottom Half ********/
 	scaleXYZ = glm::vec3(1.0f, 1.0f, 1.0f);
@@ -712,7 +1971,7 @@ void SceneManager::RenderScene()
 	// Set Pokeball bottom half as White
 	SetShaderColor(1.0f, 1.0f, 1.0f, 1.0f);
 	SetShaderMaterial("plastic");
-	m_basicMeshes->DrawHalfSphereMesh();
+	DrawMesh(MESH_HALF_SPHERE);
 
 	/******** Button on Pokeball ********/
 	scaleXYZ = glm::vec3(0.15f, 0.15f, 0.15f);
@@ -729,7 +1988,7 @@ void SceneManager::RenderScene()
 	//Applied white to button 
 	SetShaderColor(1.0f, 1.0f, 1.0f, 1.0f);
 	SetShaderMaterial("plastic");
-	m_basicMeshes->DrawSphereMesh();
+	DrawMesh(MESH_SPHERE);
 
 	/******** Band on Pokeball ********/
 	scaleXYZ = glm::vec3(0.9f, 0.9f, 0.9f);
@@ -750,7 +2009,7 @@ void SceneManager::RenderScene()
 	//Applied black to band 
 	SetShaderColor(0.0f, 0.0f, 0.0f, 1.0f);
 	SetShaderMaterial("plastic");
-	m_basicMeshes->DrawTorusMesh();
+	DrawMesh(MESH_TORUS);
 
 	/******** Cube on the left of the Pokeball ********/
 	scaleXYZ = glm::vec3(1.0f, 1.0f, 1.0f);  
@@ -767,7 +2026,7 @@ void SceneManager::RenderScene()
 	SetShaderColor(0.1f, 0.4f, 0.8f, 1.0f);  // Blue color for cube testing
 	SetShaderTexture("cubeTexture");  // Apply texture to the cube
 	SetShaderMaterial("plastic");  // Apply material to the cube
-	m_basicMeshes->DrawBoxMesh();  // Render Cube
+	DrawMesh(MESH_BOX);  // Render Cube
 
 
 	/******** Can ********/
@@ -789,7 +2048,7 @@ void SceneManager::RenderScene()
 	SetShaderColor(1.0f, 1.0f, 1.0f, 1.0f);
 	SetShaderTexture("canTexture");
 	SetShaderMaterial("metal"); 
-	m_basicMeshes->DrawCylinderMesh();
+	DrawMesh(MESH_CYLINDER);
 
 	/*** Can Top ***/
 	scaleXYZ = glm::vec3(0.76f, 0.04f, 0.76f);  // Very thin disc for lid 
@@ -805,7 +2064,7 @@ void SceneManager::RenderScene()
 	SetShaderColor(0.8f, 0.8f, 0.8f, 1.0f);
 	SetShaderTexture("topTexture");  
 	SetShaderMaterial("metal");
-	m_basicMeshes->DrawCylinderMesh();
+	DrawMesh(MESH_CYLINDER);
 
 	/*** Can Bottom (Disc) ***/
 	scaleXYZ = glm::vec3(0.76f, 0.04f, 0.76f);  // Very thin disc for bottom
@@ -820,5 +2079,476 @@ void SceneManager::RenderScene()
 	
 	SetShaderColor(0.8f, 0.8f, 0.8f, 1.0f);
 	SetShaderMaterial("metal");
-	m_basicMeshes->DrawCylinderMesh();
-}
\ No newline at end of file
+	DrawMesh(MESH_CYLINDER);
+}
+
+/***********************************************************
+ *  SetStressObjects()
+ *
+ *  This method is used for generating the passed in number
+ *  of copies of the scene props behind the desk, laid out
+ *  in a grid or scattered over the same area. The props,
+ *  materials and textures are mixed so the draws do not
+ *  all share the same shader settings.
+ ***********************************************************/
+void SceneManager::SetStressObjects(int count, STRESS_LAYOUT layout)
+{
+	m_bStressObjectsDirty = true;
+	m_stressGeneration++;
+	m_stressObjects.clear();
+	m_animations->ClearInstances();
+	if (count <= 0)
+	{
+		// give the memory back once the test is over
+		std::vector<STRESS_OBJECT>().swap(m_stressObjects);
+		return;
+	}
+
+	m_stressObjects.reserve(count);
+	// the draws culled on the CPU each keep an occlusion
+	// history, made here rather than by the frames drawing them
+	if ((m_bGPUCulling == false) || (m_bAnimateStress == true))
+	{
+		m_occlusionCuller->Reserve(g_DrawCommandReserve + (count * g_MaxDrawsPerProp));
+	}
+
+	int side = (int)std::ceil(std::sqrt((double)count));
+	float extent = side * g_StressSpacing;
+	// fixed seed, so every run generates the same scene
+	unsigned int seed = 12345;
+
+	for (int i = 0; i < count; i++)
+	{
+		STRESS_OBJECT object;
+
+		if (layout == STRESS_GRID)
+		{
+			int row = i / side;
+			int column = i % side;
+			object.prop = (STRESS_PROP)(i % TOTAL_STRESS_PROPS);
+			object.position = glm::vec3(
+				(column - ((side - 1) * 0.5f)) * g_StressSpacing,
+				0.0f,
+				-g_StressStartDepth - (row * g_StressSpacing));
+		}
+		else
+		{
+			seed = (seed * 1664525u) + 1013904223u;
+			float x = (seed >> 8) / 16777216.0f;
+			seed = (seed * 1664525u) + 1013904223u;
+			float z = (seed >> 8) / 16777216.0f;
+			seed = (seed * 1664525u) + 1013904223u;
+
+			object.prop = (STRESS_PROP)((seed >> 16) % TOTAL_STRESS_PROPS);
+			object.position = glm::vec3(
+				(x - 0.5f) * extent,
+				0.0f,
+				-g_StressStartDepth - (z * extent));
+		}
+
+		object.materialTag = g_StressMaterials[(i / TOTAL_STRESS_PROPS) % g_StressMaterialCount];
+		object.textureTag = g_StressTextures[(i / TOTAL_STRESS_PROPS) % g_StressTextureCount];
+		// every other group of props turns on a turntable, the
+		// rest hop out of step with their neighbours in a wave
+		object.animation = -1;
+		if (m_bAnimateStress == true)
+		{
+			if (((i / TOTAL_STRESS_PROPS) % 2) == 0)
+			{
+				object.animation = m_animations->AddInstance(
+					m_stressClip, std::fmod(i * g_StressHopStagger, g_StressHopSeconds), 1.0f);
+			}
+			else
+			{
+				object.animation = m_animations->AddInstance(
+					m_turntableClip, std::fmod(i * g_StressHopStagger, g_TurntableSeconds), 1.0f);
+			}
+		}
+		m_stressObjects.push_back(object);
+	}
+}
+
+/***********************************************************
+ *  RenderStressObjects()
+ *
+ *  This method is used for recording the draws of every
+ *  generated stress test object.
+ ***********************************************************/
+void SceneManager::RenderStressObjects()
+{
+	for (size_t i = 0; i < m_stressObjects.size(); i++)
+	{
+		const STRESS_OBJECT& object = m_stressObjects[i];
+		m_nextObjectKey = MakeObjectKey(g_StressObjectKeys, m_stressGeneration, (unsigned int)i);
+
+		// the animated transform moves the copy from its place in
+		// the layout, in the same order as SetTransformations
+		glm::mat4 placement = glm::translate(object.position);
+		glm::vec4 tint = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+		if (object.animation >= 0)
+		{
+			glm::vec3 scaleXYZ;
+			glm::vec3 rotationDegrees;
+			glm::vec3 offset;
+			m_animations->GetTransform(object.animation, scaleXYZ, rotationDegrees, offset);
+			placement = glm::translate(object.position + offset) *
+				glm::rotate(glm::radians(rotationDegrees.x), glm::vec3(1.0f, 0.0f, 0.0f)) *
+				glm::rotate(glm::radians(rotationDegrees.y), glm::vec3(0.0f, 1.0f, 0.0f)) *
+				glm::rotate(glm::radians(rotationDegrees.z), glm::vec3(0.0f, 0.0f, 1.0f)) *
+				glm::scale(scaleXYZ);
+			tint = m_animations->GetColor(object.animation);
+		}
+
+		switch (object.prop)
+		{
+		case PROP_POKEBALL:
+			DrawPokeballProp(placement, tint, object.materialTag);
+			break;
+		case PROP_CAN:
+			DrawCanProp(placement, tint, object.materialTag);
+			break;
+		default:
+			DrawCubeProp(placement, tint, object.materialTag, object.textureTag);
+			break;
+		}
+	}
+}
+
+/***********************************************************
+ *  UploadStressInstances()
+ *
+ *  This method is used for recording the draws of every
+ *  stress test object once and grouping the ones that only
+ *  differ in the model into batches. The models and bounds
+ *  are uploaded to the GPU culling ordered by batch, and
+ *  the recorded draws are dropped again.
+ ***********************************************************/
+void SceneManager::UploadStressInstances()
+{
+	m_bStressObjectsDirty = false;
+	m_instancedBatches.clear();
+
+	size_t firstDraw = m_drawCommands.size();
+	RenderStressObjects();
+	int drawCount = (int)(m_drawCommands.size() - firstDraw);
+
+	// find the batch of every draw, the number of distinct
+	// settings is small so the batches are searched in turn
+	std::vector<int> drawBatches(drawCount);
+	for (int i = 0; i < drawCount; i++)
+	{
+		const DRAW_COMMAND& command = m_drawCommands[firstDraw + i];
+
+		int batch = 0;
+		while ((batch < (int)m_instancedBatches.size()) &&
+			(IsSameBatch(command, m_instancedBatches[batch].settings) == false))
+		{
+			batch++;
+		}
+		if (batch == (int)m_instancedBatches.size())
+		{
+			INSTANCED_BATCH instanced;
+			instanced.settings = command;
+			instanced.settings.model = glm::mat4(1.0f);
+			instanced.firstInstance = 0;
+			instanced.instanceCount = 0;
+			m_instancedBatches.push_back(instanced);
+		}
+
+		m_instancedBatches[batch].instanceCount++;
+		drawBatches[i] = batch;
+	}
+
+	// the batches reserve consecutive slots of the visible list
+	std::vector<GPUCuller::INDIRECT_COMMAND> commands(m_instancedBatches.size());
+	std::vector<int> nextInstance(m_instancedBatches.size());
+	int firstInstance = 0;
+	for (size_t i = 0; i < m_instancedBatches.size(); i++)
+	{
+		const MeshLibrary::MESH_INFO* pMesh =
+			m_meshLibrary->GetMesh((MeshLibrary::BASIC_MESH)m_instancedBatches[i].settings.mesh);
+
+		m_instancedBatches[i].firstInstance = firstInstance;
+		commands[i].count = (NULL != pMesh) ? (GLuint)pMesh->indexCount : 0;
+		commands[i].instanceCount = 0;
+		commands[i].firstIndex = 0;
+		commands[i].baseVertex = 0;
+		commands[i].baseInstance = (GLuint)firstInstance;
+		nextInstance[i] = firstInstance;
+		firstInstance += m_instancedBatches[i].instanceCount;
+	}
+
+	std::vector<GPUCuller::GPU_INSTANCE> instances(drawCount);
+	for (int i = 0; i < drawCount; i++)
+	{
+		const DRAW_COMMAND& command = m_drawCommands[firstDraw + i];
+		GPUCuller::GPU_INSTANCE& instance = instances[nextInstance[drawBatches[i]]++];
+
+		instance.model = command.model;
+		instance.boundsMin = glm::vec4(command.boundsMin, 0.0f);
+		instance.boundsMax = glm::vec4(command.boundsMax, 0.0f);
+		instance.batch = (GLuint)drawBatches[i];
+		instance.padding[0] = 0;
+		instance.padding[1] = 0;
+		instance.padding[2] = 0;
+	}
+
+	m_gpuCuller->SetInstances(instances, commands);
+
+	// the copies are never drawn from the list, so its memory
+	// goes back to the size the desk draws need
+	std::vector<DRAW_COMMAND> deskCommands(m_drawCommands.begin(), m_drawCommands.begin() + firstDraw);
+	deskCommands.reserve(g_DrawCommandReserve);
+	m_drawCommands.swap(deskCommands);
+}
+
+/***********************************************************
+ *  UpdateStreaming()
+ *
+ *  This method is used for loading and dropping the chunks
+ *  of the streamed world around the camera. The textures
+ *  the streamer uploaded or released are moved into or out
+ *  of the texture slots, and the draw list and the frame
+ *  arena are grown for the resident objects here, so the
+ *  frame that draws them does not touch the heap.
+ ***********************************************************/
+void SceneManager::UpdateStreaming(const glm::vec3& position, const glm::vec3& velocity)
+{
+	if ((NULL == m_pChunkStreamer) || (m_pChunkStreamer->IsOpen() == false))
+	{
+		return;
+	}
+
+	m_pChunkStreamer->Update(position, velocity);
+	if (m_pChunkStreamer->GetTextureGeneration() != m_streamedTextureGeneration)
+	{
+		SyncStreamedTextures();
+	}
+
+	// every draw takes an entry in the submission order and
+	// the occluder ranking
+	size_t drawCount = g_DrawCommandReserve +
+		((size_t)m_pChunkStreamer->GetResidentObjectCount() * g_MaxDrawsPerProp);
+	m_drawCommands.reserve(drawCount);
+	m_occlusionCuller->Reserve((int)drawCount);
+	size_t arenaSize = g_FrameArenaSize + (drawCount * 2 * sizeof(int));
+	if (arenaSize > m_frameArena->GetCapacity())
+	{
+		m_frameArena->Reserve(arenaSize);
+	}
+}
+
+/***********************************************************
+ *  SyncStreamedTextures()
+ *
+ *  This method is used for emptying the slots of the
+ *  streamed textures no chunk uses anymore and registering
+ *  the newly uploaded ones. A tag the scene already loaded
+ *  itself keeps the scene texture.
+ ***********************************************************/
+void SceneManager::SyncStreamedTextures()
+{
+	m_streamedTextureGeneration = m_pChunkStreamer->GetTextureGeneration();
+
+	// drop the slots whose texture was released
+	size_t kept = 0;
+	for (size_t i = 0; i < m_streamedTextureSlots.size(); i++)
+	{
+		int slot = m_streamedTextureSlots[i];
+		bool bInUse = false;
+		for (int j = 0; (j < m_pChunkStreamer->GetTextureCount()) && (bInUse == false); j++)
+		{
+			const ChunkStreamer::STREAMED_TEXTURE& texture = m_pChunkStreamer->GetTexture(j);
+			bInUse = (texture.handle.IsValid() == true) &&
+				(texture.handle.GetID() == m_textureIDs[slot].ID) &&
+				(texture.tag == m_textureIDs[slot].tag);
+		}
+
+		if (bInUse == true)
+		{
+			m_streamedTextureSlots[kept++] = slot;
+		}
+		else
+		{
+			UnregisterTexture(slot);
+		}
+	}
+	m_streamedTextureSlots.resize(kept);
+
+	// register the uploaded textures that have no slot yet
+	for (int i = 0; i < m_pChunkStreamer->GetTextureCount(); i++)
+	{
+		const ChunkStreamer::STREAMED_TEXTURE& texture = m_pChunkStreamer->GetTexture(i);
+		if ((texture.handle.IsValid() == false) || (FindTextureSlot(texture.tag.c_str()) >= 0))
+		{
+			continue;
+		}
+
+		if (RegisterTexture(texture.handle, texture.tag, texture.bHasAlpha) == true)
+		{
+			m_streamedTextureSlots.push_back(FindTextureSlot(texture.tag.c_str()));
+		}
+	}
+}
+
+/***********************************************************
+ *  RenderStreamedChunks()
+ *
+ *  This method is used for recording the draws of the
+ *  objects in the resident chunks, skipping the chunks
+ *  whose bounds are outside of the view.
+ ***********************************************************/
+void SceneManager::RenderStreamedChunks()
+{
+	if (NULL == m_pChunkStreamer)
+	{
+		return;
+	}
+
+	glm::mat4 viewProjection = m_projectionMatrix * m_viewMatrix;
+	const std::vector<const ChunkStreamer::STREAMED_CHUNK*>& chunks = m_pChunkStreamer->GetResidentChunks();
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		const ChunkStreamer::STREAMED_CHUNK& chunk = *chunks[i];
+		if (IsBoxOutsideView(viewProjection, chunk.boundsMin, chunk.boundsMax) == true)
+		{
+			continue;
+		}
+		// a chunk holds the same objects whenever it is loaded
+		unsigned int chunkGroup = ((unsigned int)(chunk.chunkZ & 0x3FFF) << 14) | (unsigned int)(chunk.chunkX & 0x3FFF);
+
+		for (size_t j = 0; j < chunk.objects.size(); j++)
+		{
+			const ChunkStreamer::CHUNK_OBJECT& object = chunk.objects[j];
+			glm::mat4 placement = glm::translate(glm::vec3(object.position[0], object.position[1], object.position[2]));
+			glm::vec4 tint = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+			m_nextObjectKey = MakeObjectKey(g_ChunkObjectKeys, chunkGroup, (unsigned int)j);
+			// the streamer checked the indices when it read the chunk
+			const char* materialTag = (object.material >= 0) ? chunk.resources[object.material].tag : "";
+			const char* textureTag = (object.texture >= 0) ? chunk.resources[object.texture].tag : "";
+
+			switch (object.prop)
+			{
+			case ChunkStreamer::PROP_POKEBALL:
+				DrawPokeballProp(placement, tint, materialTag);
+				break;
+			case ChunkStreamer::PROP_CAN:
+				DrawCanProp(placement, tint, materialTag);
+				break;
+			default:
+				DrawCubeProp(placement, tint, materialTag, textureTag);
+				break;
+			}
+		}
+	}
+}
+
+/***********************************************************
+ *  SetCameraCut()
+ *
+ *  This method is used for dropping the depth of the last
+ *  frame from the GPU culling and the occlusion history of
+ *  every object, when the next view jumps somewhere else
+ *  and the objects hidden in the last one may be in plain
+ *  sight.
+ ***********************************************************/
+void SceneManager::SetCameraCut()
+{
+	m_gpuCuller->InvalidateDepthPyramid();
+	m_occlusionCuller->Reset();
+}
+
+/***********************************************************
+ *  DrawPropPart()
+ *
+ *  This method is used for recording one part of a prop.
+ *  The transformation and color set for the part are taken
+ *  relative to the placement and tint of the whole prop.
+ ***********************************************************/
+void SceneManager::DrawPropPart(MESH_TYPE mesh, const glm::mat4& placement, const glm::vec4& tint)
+{
+	m_currentDraw.model = placement * m_currentDraw.model;
+	m_currentDraw.color *= tint;
+	DrawMesh(mesh);
+}
+
+/***********************************************************
+ *  DrawPokeballProp()
+ *
+ *  This method is used for recording a copy of the Pokeball
+ *  on its stand, placed and tinted as passed in.
+ ***********************************************************/
+void SceneManager::DrawPokeballProp(const glm::mat4& placement, const glm::vec4& tint, const char* materialTag)
+{
+	SetShaderMaterial(materialTag);
+
+	// stand base and the support between the tori
+	SetTransformations(glm::vec3(0.5f, 0.5f, 0.5f), 90.0f, 0.0f, 0.0f, glm::vec3(0.0f, 0.25f, 0.0f));
+	SetShaderColor(0.2f, 0.2f, 0.2f, 1.0f);
+	DrawPropPart(MESH_TORUS, placement, tint);
+
+	SetTransformations(glm::vec3(0.05f, 0.5f, 0.4f), 90.0f, 0.0f, 0.0f, glm::vec3(0.0f, 0.6f, 0.0f));
+	SetShaderColor(0.3f, 0.3f, 0.3f, 1.0f);
+	DrawPropPart(MESH_CYLINDER, placement, tint);
+
+	SetTransformations(glm::vec3(0.3f, 0.3f, 0.3f), 90.0f, 0.0f, 0.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+	SetShaderColor(0.2f, 0.2f, 0.2f, 1.0f);
+	DrawPropPart(MESH_TORUS, placement, tint);
+
+	// the ball halves, button and band
+	SetTransformations(glm::vec3(1.0f, 1.0f, 1.0f), 0.0f, 0.0f, 0.0f, glm::vec3(0.0f, 2.0f, 0.0f));
+	SetShaderColor(1.0f, 0.0f, 0.0f, 1.0f);
+	DrawPropPart(MESH_HALF_SPHERE, placement, tint);
+
+	SetTransformations(glm::vec3(1.0f, 1.0f, 1.0f), 180.0f, 0.0f, 0.0f, glm::vec3(0.0f, 2.0f, 0.0f));
+	SetShaderColor(1.0f, 1.0f, 1.0f, 1.0f);
+	DrawPropPart(MESH_HALF_SPHERE, placement, tint);
+
+	SetTransformations(glm::vec3(0.15f, 0.15f, 0.15f), 90.0f, 0.0f, 0.0f, glm::vec3(0.0f, 2.0f, 1.0f));
+	SetShaderColor(1.0f, 1.0f, 1.0f, 1.0f);
+	DrawPropPart(MESH_SPHERE, placement, tint);
+
+	SetTransformations(glm::vec3(0.9f, 0.9f, 0.9f), 90.0f, 0.0f, 0.0f, glm::vec3(0.0f, 2.0f, 0.0f));
+	SetShaderColor(0.0f, 0.0f, 0.0f, 1.0f);
+	DrawPropPart(MESH_TORUS, placement, tint);
+}
+
+/***********************************************************
+ *  DrawCanProp()
+ *
+ *  This method is used for recording a copy of the can,
+ *  placed and tinted as passed in.
+ ***********************************************************/
+void SceneManager::DrawCanProp(const glm::mat4& placement, const glm::vec4& tint, const char* materialTag)
+{
+	SetShaderMaterial(materialTag);
+
+	SetTransformations(glm::vec3(0.75f, 2.0f, 0.75f), 0.0f, 90.0f, 0.0f, glm::vec3(0.0f, 0.1f, 0.0f));
+	SetShaderColor(1.0f, 1.0f, 1.0f, 1.0f);
+	SetShaderTexture("canTexture");
+	DrawPropPart(MESH_CYLINDER, placement, tint);
+
+	SetTransformations(glm::vec3(0.76f, 0.04f, 0.76f), 0.0f, 90.0f, 0.0f, glm::vec3(0.0f, 2.11f, 0.0f));
+	SetShaderColor(0.8f, 0.8f, 0.8f, 1.0f);
+	SetShaderTexture("topTexture");
+	DrawPropPart(MESH_CYLINDER, placement, tint);
+
+	SetTransformations(glm::vec3(0.76f, 0.04f, 0.76f), 0.0f, 90.0f, 0.0f, glm::vec3(0.0f, 0.1f, 0.0f));
+	SetShaderColor(0.8f, 0.8f, 0.8f, 1.0f);
+	DrawPropPart(MESH_CYLINDER, placement, tint);
+}
+
+/***********************************************************
+ *  DrawCubeProp()
+ *
+ *  This method is used for recording a copy of the cube,
+ *  resting on its base, placed and tinted as passed in.
+ ***********************************************************/
+void SceneManager::DrawCubeProp(const glm::mat4& placement, const glm::vec4& tint, const char* materialTag, const char* textureTag)
+{
+	SetTransformations(glm::vec3(1.0f, 1.0f, 1.0f), 0.0f, 0.0f, 0.0f, glm::vec3(0.0f, 0.6f, 0.0f));
+	SetShaderColor(0.1f, 0.4f, 0.8f, 1.0f);
+	SetShaderTexture(textureTag);
+	SetShaderMaterial(materialTag);
+	DrawPropPart(MESH_BOX, placement, tint);
+}
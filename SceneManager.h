@@ -10,7 +10,18 @@
 #pragma once
 
 #include "ShaderManager.h"
-#include "ShapeMeshes.h"
+#include "MeshLibrary.h"
+#include "LightClusters.h"
+#include "ShaderPermutations.h"
+#include "OcclusionCulling.h"
+#include "FrameArena.h"
+#include "ResourceManager.h"
+#include "Animation.h"
+#include "SoftwareRasterizer.h"
+#include "Lightmaps.h"
+#include "GLStateCache.h"
+#include "GPUCulling.h"
+#include "ChunkStreamer.h"
 
 #include <string>
 #include <vector>
@@ -23,9 +34,15 @@
  ***********************************************************/
 class SceneManager
 {
+	// the micro-benchmarks time the private hot paths directly
+	friend class BenchmarkAccess;
+
 public:
 	// constructor
-	SceneManager(ShaderManager *pShaderManager);
+	SceneManager(
+		ShaderManager *pShaderManager,
+		ShaderPermutationSet* pShaderPermutations,
+		ResourceManager* pResourceManager);
 	// destructor
 	~SceneManager();
 
@@ -33,6 +50,8 @@ public:
 	{
 		std::string tag;
 		uint32_t ID;
+		bool bHasAlpha;		// true when any texel is not fully opaque
+		ResourceHandle handle;	// keeps the shared texture alive
 	};
 
 	struct OBJECT_MATERIAL
@@ -45,29 +64,219 @@ public:
 		std::string tag;
 	};
 
+	// basic meshes that can be drawn in the 3D scene
+	enum MESH_TYPE
+	{
+		MESH_PLANE = MeshLibrary::MESH_PLANE,
+		MESH_SPHERE = MeshLibrary::MESH_SPHERE,
+		MESH_HALF_SPHERE = MeshLibrary::MESH_HALF_SPHERE,
+		MESH_TORUS = MeshLibrary::MESH_TORUS,
+		MESH_CYLINDER = MeshLibrary::MESH_CYLINDER,
+		MESH_CONE = MeshLibrary::MESH_CONE,
+		MESH_BOX = MeshLibrary::MESH_BOX
+	};
+
+	// everything needed to submit one recorded mesh draw
+	struct DRAW_COMMAND
+	{
+		MESH_TYPE mesh;
+		glm::mat4 model;
+		glm::vec4 color;
+		glm::vec2 uvScale;
+		int textureSlot;		// -1 when untextured
+		int materialIndex;		// -1 when no material is set
+		int lightmapSlot;		// -1 when the lighting is not baked
+		unsigned int features;	// shader permutation flags
+		float viewDepth;		// view-space depth of the object origin
+		bool bTranslucent;		// true when the draw needs blending
+		glm::vec3 boundsMin;	// world-space bounding box
+		glm::vec3 boundsMax;
+		bool bOccluder;			// drawn in the occluder depth pre-pass
+		unsigned long long objectKey;	// the same for the same object
+										// every frame, for the occlusion
+										// history
+	};
+
+	// placement of the generated stress test objects
+	enum STRESS_LAYOUT
+	{
+		STRESS_GRID,
+		STRESS_RANDOM
+	};
+
+	// work submitted to the GPU for the last rendered frame
+	struct RENDER_STATS
+	{
+		int draws;
+		long long triangles;
+	};
+
 private:
+	// props that can be spawned for the stress test
+	enum STRESS_PROP
+	{
+		PROP_POKEBALL,
+		PROP_CAN,
+		PROP_CUBE,
+		TOTAL_STRESS_PROPS
+	};
+
+	// baked lighting of one static object
+	struct LIGHTMAP_INFO
+	{
+		std::string tag;
+		int textureSlot;		// -1 when the bake failed
+	};
+
+	// uniform locations of one shader permutation, looked up
+	// the first time the permutation is used
+	struct UNIFORM_LOCATIONS
+	{
+		GLuint program;			// 0 until looked up
+		GLint model;
+		GLint color;
+		GLint texture;
+		GLint uvScale;
+		GLint view;
+		GLint projection;
+		GLint viewPosition;
+		GLint ambientColor;
+		GLint ambientStrength;
+		GLint diffuseColor;
+		GLint specularColor;
+		GLint shininess;
+		GLint lightmapTexture;
+		GLint instanceOffset;
+	};
+
+	// one generated stress test object
+	struct STRESS_OBJECT
+	{
+		STRESS_PROP prop;
+		glm::vec3 position;
+		const char* materialTag;
+		const char* textureTag;
+		int animation;			// -1 when the copy stands still
+	};
+
+	// recorded stress draws that differ only in the model,
+	// drawn with one indirect call after the GPU culling
+	struct INSTANCED_BATCH
+	{
+		DRAW_COMMAND settings;	// model is the identity
+		int firstInstance;		// first slot in the visible list
+		int instanceCount;
+	};
+
 	// pointer to shader manager object
 	ShaderManager* m_pShaderManager;
+	// pointer to the owner of the shared GPU resources
+	ResourceManager* m_pResourceManager;
 	// pointer to basic shapes object
-	ShapeMeshes* m_basicMeshes;
+	MeshLibrary* m_meshLibrary;
 	// total number of loaded textures
 	int m_loadedTextures;
 	// loaded textures info
 	TEXTURE_INFO m_textureIDs[16];
+	// scene texture images decoded ahead of their upload
+	ResourceManager::DECODED_IMAGE m_decodedTextures[16];
 	// defined object materials
 	std::vector<OBJECT_MATERIAL> m_objectMaterials;
+	// scene light sources binned into view-space clusters
+	LightClusterManager* m_lightClusters;
+	// specialized shader programs for each feature combination
+	ShaderPermutationSet* m_pShaderPermutations;
+	// true when the scene is rendered with custom lighting
+	bool m_bUseLighting;
+
+	// shader settings for the next recorded draw
+	DRAW_COMMAND m_currentDraw;
+	// draws recorded while rendering the scene
+	std::vector<DRAW_COMMAND> m_drawCommands;
+	// transient per-frame data, released at the start of each frame
+	FrameArena* m_frameArena;
+	// submission order of the recorded draws, in the frame arena
+	int* m_drawOrder;
+	// permutations that received the per-frame uniforms
+	unsigned int m_preparedPermutations;
+	// shadow of the GL state, drops calls that change nothing
+	GLStateCache* m_stateCache;
+	// resource manager bindings the state cache has seen
+	unsigned int m_bindingGeneration;
+	// uniform locations of each permutation, and of the active one
+	UNIFORM_LOCATIONS m_uniformLocations[ShaderPermutationSet::TOTAL_PERMUTATIONS];
+	const UNIFORM_LOCATIONS* m_pActiveUniforms;
+	// hardware occlusion culling of the recorded draws
+	OcclusionCuller* m_occlusionCuller;
+	bool m_bOcclusionCulling;
+	// key of the next recorded draw, counted up with each draw
+	unsigned long long m_nextObjectKey;
+	// opaque draws ranked as occluder candidates, in the frame arena
+	int* m_occluderOrder;
+	// generated copies of the props drawn after the desk
+	std::vector<STRESS_OBJECT> m_stressObjects;
+	// changes with every generated set, so the keys of the old
+	// objects never name the new ones
+	unsigned int m_stressGeneration;
+	// culls the generated copies on the GPU, when supported
+	GPUCuller* m_gpuCuller;
+	bool m_bGPUCulling;
+	// batches of the culled copies, rebuilt when they change
+	std::vector<INSTANCED_BATCH> m_instancedBatches;
+	bool m_bStressObjectsDirty;
+	// draws and triangles submitted this frame
+	RENDER_STATS m_renderStats;
+	// keyframe animation of the stress test copies, the desk
+	// itself stands still
+	AnimationSystem* m_animations;
+	int m_stressClip;
+	int m_turntableClip;
+	bool m_bAnimateStress;
+	// draws on the CPU instead of the GL when set
+	SoftwareRasterizer* m_pSoftwareRasterizer;
+	// bakes the lighting of the static objects
+	LightmapBaker* m_lightmapBaker;
+	std::vector<LIGHTMAP_INFO> m_lightmaps;
+	// lightmap of the next recorded draw only, NULL for none
+	const char* m_nextLightmapTag;
+	// set while the startup pass records draws for baking
+	bool m_bBakingLightmaps;
+	// streams the chunks of a large world, NULL for none
+	ChunkStreamer* m_pChunkStreamer;
+	// texture generation of the streamer the slots match, and
+	// the slots holding its textures
+	unsigned int m_streamedTextureGeneration;
+	std::vector<int> m_streamedTextureSlots;
+
+	// view settings for the current frame
+	glm::mat4 m_viewMatrix;
+	glm::mat4 m_projectionMatrix;
+	glm::vec3 m_viewPosition;
+	float m_zNear;
+	float m_zFar;
+	int m_viewportWidth;
+	int m_viewportHeight;
+	// size of the target the viewport is a corner of, 0 when
+	// the viewport covers the whole target
+	int m_targetWidth;
+	int m_targetHeight;
 
 	// load texture images and convert to OpenGL texture data
 	bool CreateGLTexture(const char* filename, std::string tag);
+	// register a loaded texture in the next free slot
+	bool RegisterTexture(const ResourceHandle& texture, const std::string& tag, bool bHasAlpha);
+	// empty a texture slot so it can be registered again
+	void UnregisterTexture(int slot);
 	// bind loaded OpenGL textures to slots in memory
 	void BindGLTextures();
 	// free the loaded OpenGL textures
 	void DestroyGLTextures();
 	// find a loaded texture by tag
-	int FindTextureID(std::string tag);
-	int FindTextureSlot(std::string tag);
+	int FindTextureID(const char* tag);
+	int FindTextureSlot(const char* tag);
 	// find a defined material by tag
-	bool FindMaterial(std::string tag, OBJECT_MATERIAL& material);
+	bool FindMaterial(const char* tag, OBJECT_MATERIAL& material);
+	int FindMaterialIndex(const char* tag);
 
 	// set the transformation values 
 	// into the transform buffer
@@ -87,7 +296,7 @@ private:
 
 	// set the texture data into the shader
 	void SetShaderTexture(
-		std::string textureTag);
+		const char* textureTag);
 
 	// set the UV scale for the texture mapping
 	void SetTextureUVScale(
@@ -95,7 +304,60 @@ private:
 
 	// set the object material into the shader
 	void SetShaderMaterial(
-		std::string materialTag);
+		const char* materialTag);
+
+	// bake the lighting of the next draw into a lightmap, only
+	// for objects that never move under lights that never move
+	void SetShaderLightmap(
+		const char* lightmapTag);
+	// bake the lightmap of a draw, or read it from the cache,
+	// and register it as a texture
+	void BakeLightmap(const char* tag, const DRAW_COMMAND& command);
+	// find the texture slot of a baked lightmap - returns -1
+	// when it was not baked
+	int FindLightmapSlot(const char* tag);
+	// record the draws of the desk and the props on it
+	void RenderDesk();
+	// bake every lightmap of the desk before the first frame
+	void BakeLightmaps();
+
+	// record a draw of a basic mesh with the current settings
+	void DrawMesh(MESH_TYPE mesh);
+	// activate the program for the passed in feature flags
+	bool UseShaderPermutation(unsigned int features);
+	// set the uniforms shared by every draw in the frame
+	void SetFrameUniforms(unsigned int features);
+	// set the per draw uniforms into the active program
+	void SetDrawUniforms(const DRAW_COMMAND& command, const MeshLibrary::MESH_INFO& mesh);
+	// set the draw uniforms and draw the mesh
+	void SubmitDrawCommand(const DRAW_COMMAND& command);
+	// draw the instances of a batch that survived the culling
+	void SubmitInstancedBatch(int batch);
+	// draw the largest occluders and test the other draws
+	void RenderOcclusionPrePass();
+	// order the recorded draws for submission into m_drawOrder
+	int SortDrawCommands();
+	// submit the recorded opaque and then translucent draws
+	void FlushDrawCommands();
+	// hand the recorded draws to the software rasterizer
+	void FlushSoftwareDraws();
+
+	// record the draws of one copy of a prop
+	void DrawPokeballProp(const glm::mat4& placement, const glm::vec4& tint, const char* materialTag);
+	void DrawCanProp(const glm::mat4& placement, const glm::vec4& tint, const char* materialTag);
+	void DrawCubeProp(const glm::mat4& placement, const glm::vec4& tint, const char* materialTag, const char* textureTag);
+	// record one part of a prop with the current settings,
+	// moved by the placement and tinted with the prop tint
+	void DrawPropPart(MESH_TYPE mesh, const glm::mat4& placement, const glm::vec4& tint);
+	// record the draws of every generated stress test object
+	void RenderStressObjects();
+	// record the stress objects once and hand them to the
+	// GPU culling, grouped into instanced batches
+	void UploadStressInstances();
+	// move the streamed textures into and out of the slots
+	void SyncStreamedTextures();
+	// record the draws of the resident chunks in view
+	void RenderStreamedChunks();
 
 public:
 
@@ -104,8 +366,67 @@ public:
 	void PrepareScene();
 	void RenderScene();
 	void LoadSceneTextures();
+	// the CPU and GL halves of PrepareScene, for running the
+	// startup work on separate threads
+	void PrepareSceneData();
+	void PrepareSceneResources();
 	// pre-set light sources for 3D scene
 	void SetupSceneLights();
 	// pre-define the object materials for lighting
 	void DefineObjectMaterials();
+	// define the keyframe animations of the moving objects
+	void DefineSceneAnimations();
+	// evaluate the animations at the passed in time in seconds
+	void UpdateAnimations(double time);
+
+	// set the view settings used for the current frame
+	void SetSceneView(
+		const glm::mat4& view,
+		const glm::mat4& projection,
+		float zNear,
+		float zFar,
+		int viewportWidth,
+		int viewportHeight);
+	// set the size of the render target, when the viewport is
+	// only the scaled corner of it
+	void SetRenderTargetSize(int width, int height) { m_targetWidth = width; m_targetHeight = height; }
+
+	// generate the passed in number of prop copies, 0 clears them
+	void SetStressObjects(int count, STRESS_LAYOUT layout);
+	// let the copies generated from now on hop or turn on their
+	// own keyframe clips, evaluated in batches every frame
+	void SetStressAnimation(bool bAnimate) { m_bAnimateStress = bAnimate; }
+	// draw the chunks of a streamed world, NULL for none
+	void SetChunkStreamer(ChunkStreamer* pStreamer) { m_pChunkStreamer = pStreamer; }
+	// stream the world around the camera, once per frame before
+	// the scene is rendered and outside of the frame since
+	// loading and dropping chunks allocates
+	void UpdateStreaming(const glm::vec3& position, const glm::vec3& velocity);
+	// get the draws and triangles of the last rendered frame,
+	// the GPU culled objects count the instances of a few
+	// frames before
+	RENDER_STATS GetRenderStats() const { return m_renderStats; }
+	// tell the scene the next view does not follow from the
+	// last one, so the last depth must not cull anything
+	void SetCameraCut();
+	// decode the scene texture images and read or build the
+	// meshes ahead of time, safe on any thread for different
+	// indices - the loads then only upload on the GL thread
+	int GetSceneTextureCount() const;
+	bool DecodeSceneTexture(int index);
+	bool LoadSceneTexture(int index);
+	bool PrepareMesh(MESH_TYPE mesh);
+	bool LoadMesh(MESH_TYPE mesh);
+
+	// print the growth of the per-frame arena, outside of the
+	// frame since printing allocates
+	void ReportFrameArenaGrowth(std::ostream& output) { m_frameArena->ReportGrowth(output); }
+
+	// get the GL state cache of the scene, shared with the
+	// passes that draw into the same context
+	GLStateCache* GetStateCache() const { return m_stateCache; }
+
+	// render on the CPU with the passed in rasterizer, this
+	// must be set before PrepareScene and needs no GL context
+	void SetSoftwareRasterizer(SoftwareRasterizer* pRasterizer) { m_pSoftwareRasterizer = pRasterizer; }
 };
\ No newline at end of file
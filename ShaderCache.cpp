@@ -0,0 +1,696 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadercache.cpp
+// ============
+// compile shader programs and keep their linked binaries on disk
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ShaderCache.h"
+#include "AssetPack.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// declaration of global variables
+namespace
+{
+	// identifies a program cache file and its layout version
+	const unsigned int g_CacheFileMagic = 0x42435053;	// "SPCB"
+	const unsigned int g_CacheFileVersion = 1;
+
+	// header written in front of every cached program binary
+	struct CACHE_FILE_HEADER
+	{
+		unsigned int magic;
+		unsigned int version;
+		unsigned int binaryFormat;
+		unsigned int binaryLength;
+		unsigned long long key;
+	};
+}
+
+/***********************************************************
+ *  ShaderProgramCache()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+ShaderProgramCache::ShaderProgramCache(const char* cacheDirectory)
+{
+	m_cacheDirectory = cacheDirectory;
+	m_bBinariesSupported = false;
+	m_bParallelCompile = false;
+}
+
+/***********************************************************
+ *  ~ShaderProgramCache()
+ *
+ *  The destructor for the class - prefetched programs that
+ *  were never asked for are deleted
+ ***********************************************************/
+ShaderProgramCache::~ShaderProgramCache()
+{
+	for (size_t i = 0; i < m_pendingPrograms.size(); i++)
+	{
+		glDeleteShader(m_pendingPrograms[i].vertexShaderID);
+		glDeleteShader(m_pendingPrograms[i].fragmentShaderID);
+		glDeleteProgram(m_pendingPrograms[i].programID);
+	}
+	m_pendingPrograms.clear();
+}
+
+/***********************************************************
+ *  HashBytes()
+ *
+ *  This method is used for calculating a 64-bit FNV-1a
+ *  hash. Passing the previous result as the seed chains
+ *  several blocks of data into one key.
+ ***********************************************************/
+unsigned long long ShaderProgramCache::HashBytes(
+	const void* data,
+	size_t length,
+	unsigned long long seed)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	unsigned long long hash = seed;
+
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return(hash);
+}
+
+/***********************************************************
+ *  ReadSourceFile()
+ *
+ *  This method is used for reading a whole shader source
+ *  file into a string. A source in the asset pack is copied
+ *  out of the mapping without opening the file.
+ ***********************************************************/
+bool ShaderProgramCache::ReadSourceFile(const char* filename, std::string& source)
+{
+	std::vector<unsigned char> unpacked;
+	const unsigned char* packedData = NULL;
+	size_t packedSize = 0;
+	if (AssetPack::Read(filename, unpacked, packedData, packedSize) == true)
+	{
+		source.assign(reinterpret_cast<const char*>(packedData), packedSize);
+		return(true);
+	}
+
+	std::ifstream file(filename, std::ios::in | std::ios::binary);
+
+	if (!file.is_open())
+	{
+		std::cout << "Could not open shader file:" << filename << std::endl;
+		return(false);
+	}
+
+	std::stringstream buffer;
+	buffer << file.rdbuf();
+	source = buffer.str();
+
+	return(true);
+}
+
+/***********************************************************
+ *  InjectDefines()
+ *
+ *  This method is used for inserting preprocessor define
+ *  lines into the shader source. GLSL requires #version to
+ *  be the first statement, so they go right after it.
+ ***********************************************************/
+std::string ShaderProgramCache::InjectDefines(
+	const std::string& source,
+	const std::string& defines)
+{
+	if (defines.empty())
+	{
+		return(source);
+	}
+
+	size_t insertPosition = 0;
+	size_t versionPosition = source.find("#version");
+	if (versionPosition != std::string::npos)
+	{
+		size_t lineEnd = source.find('\n', versionPosition);
+		insertPosition = (lineEnd == std::string::npos) ? source.size() : lineEnd + 1;
+	}
+
+	std::string result = source.substr(0, insertPosition);
+	result += defines;
+	if (defines[defines.size() - 1] != '\n')
+	{
+		result += '\n';
+	}
+	result += source.substr(insertPosition);
+
+	return(result);
+}
+
+/***********************************************************
+ *  GetCacheFilePath()
+ *
+ *  This method is used for building the cache file path
+ *  for the passed in program key.
+ ***********************************************************/
+std::string ShaderProgramCache::GetCacheFilePath(unsigned long long key)
+{
+	char filename[32];
+	snprintf(filename, sizeof(filename), "%016llx.bin", key);
+
+	return(m_cacheDirectory + "/" + filename);
+}
+
+/***********************************************************
+ *  LoadProgramBinary()
+ *
+ *  This method is used for creating a program from a
+ *  previously cached binary. The driver may reject the
+ *  binary, for example after an update, and then 0 is
+ *  returned so the caller can compile from source.
+ ***********************************************************/
+GLuint ShaderProgramCache::LoadProgramBinary(unsigned long long key)
+{
+	std::string path = GetCacheFilePath(key);
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+
+	if (!file.is_open())
+	{
+		return(0);
+	}
+
+	CACHE_FILE_HEADER header;
+	std::vector<char> binary;
+	bool bValid = false;
+
+	if (file.read((char*)&header, sizeof(header)))
+	{
+		if ((header.magic == g_CacheFileMagic) &&
+			(header.version == g_CacheFileVersion) &&
+			(header.key == key) &&
+			(header.binaryLength > 0))
+		{
+			binary.resize(header.binaryLength);
+			bValid = !!file.read(&binary[0], binary.size());
+		}
+	}
+	file.close();
+
+	if (bValid == false)
+	{
+		std::cout << "Ignoring damaged shader cache file:" << path << std::endl;
+		return(0);
+	}
+
+	GLuint programID = glCreateProgram();
+	glProgramBinary(programID, header.binaryFormat, &binary[0], (GLsizei)binary.size());
+
+	GLint linkStatus = GL_FALSE;
+	glGetProgramiv(programID, GL_LINK_STATUS, &linkStatus);
+	if (linkStatus != GL_TRUE)
+	{
+		std::cout << "Shader cache binary rejected by the driver:" << path << std::endl;
+		glDeleteProgram(programID);
+		return(0);
+	}
+
+	return(programID);
+}
+
+/***********************************************************
+ *  SaveProgramBinary()
+ *
+ *  This method is used for writing the binary of a linked
+ *  program into the cache directory.
+ ***********************************************************/
+void ShaderProgramCache::SaveProgramBinary(unsigned long long key, GLuint programID)
+{
+	GLint binaryLength = 0;
+	glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+	if (binaryLength <= 0)
+	{
+		return;
+	}
+
+	std::vector<char> binary(binaryLength);
+	GLenum binaryFormat = 0;
+	GLsizei writtenLength = 0;
+	glGetProgramBinary(programID, binaryLength, &writtenLength, &binaryFormat, &binary[0]);
+	if (writtenLength <= 0)
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	_mkdir(m_cacheDirectory.c_str());
+#else
+	mkdir(m_cacheDirectory.c_str(), 0755);
+#endif
+
+	// write to a temporary file first so that a crash never
+	// leaves a half written binary under the real name
+	std::string path = GetCacheFilePath(key);
+	std::string tempPath = path + ".tmp";
+	std::ofstream file(tempPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Could not write shader cache file:" << path << std::endl;
+		return;
+	}
+
+	CACHE_FILE_HEADER header;
+	header.magic = g_CacheFileMagic;
+	header.version = g_CacheFileVersion;
+	header.binaryFormat = binaryFormat;
+	header.binaryLength = (unsigned int)writtenLength;
+	header.key = key;
+
+	file.write((const char*)&header, sizeof(header));
+	file.write(&binary[0], writtenLength);
+	file.close();
+	bool bWritten = !file.fail();
+
+	remove(path.c_str());
+	if ((bWritten == false) || (rename(tempPath.c_str(), path.c_str()) != 0))
+	{
+		remove(tempPath.c_str());
+		std::cout << "Could not write shader cache file:" << path << std::endl;
+	}
+}
+
+/***********************************************************
+ *  CheckShader()
+ *
+ *  This method is used for checking that a shader stage
+ *  compiled and reporting its errors. Querying the status
+ *  waits for a compile that is still running.
+ ***********************************************************/
+bool ShaderProgramCache::CheckShader(GLuint shaderID)
+{
+	GLint compileStatus = GL_FALSE;
+	glGetShaderiv(shaderID, GL_COMPILE_STATUS, &compileStatus);
+	if (compileStatus != GL_TRUE)
+	{
+		GLint logLength = 0;
+		glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &logLength);
+		std::vector<char> log(logLength + 1, 0);
+		glGetShaderInfoLog(shaderID, logLength, NULL, &log[0]);
+		std::cout << "Shader compile failed:" << std::endl << &log[0] << std::endl;
+		return(false);
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  StartProgram()
+ *
+ *  This method is used for compiling and linking a program
+ *  from its GLSL sources without asking for the result, so
+ *  a driver with parallel shader compiles can keep working
+ *  in the background. The program is flagged so that its
+ *  binary can be retrieved after linking.
+ ***********************************************************/
+void ShaderProgramCache::StartProgram(
+	const std::string& vertexSource,
+	const std::string& fragmentSource,
+	PENDING_PROGRAM& pending)
+{
+	const char* vertexPointer = vertexSource.c_str();
+	const char* fragmentPointer = fragmentSource.c_str();
+
+	pending.vertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(pending.vertexShaderID, 1, &vertexPointer, NULL);
+	glCompileShader(pending.vertexShaderID);
+
+	pending.fragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(pending.fragmentShaderID, 1, &fragmentPointer, NULL);
+	glCompileShader(pending.fragmentShaderID);
+
+	pending.programID = glCreateProgram();
+	glAttachShader(pending.programID, pending.vertexShaderID);
+	glAttachShader(pending.programID, pending.fragmentShaderID);
+	if (m_bBinariesSupported == true)
+	{
+		glProgramParameteri(pending.programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	glLinkProgram(pending.programID);
+}
+
+/***********************************************************
+ *  FinishProgram()
+ *
+ *  This method is used for waiting on a started program
+ *  and reporting its compile and link errors. A program
+ *  that came from a cached binary is already checked.
+ *  Returns 0 when the program could not be built.
+ ***********************************************************/
+GLuint ShaderProgramCache::FinishProgram(PENDING_PROGRAM& pending)
+{
+	GLuint programID = pending.programID;
+	if ((0 == pending.vertexShaderID) && (0 == pending.fragmentShaderID))
+	{
+		return(programID);
+	}
+
+	bool bCompiled = CheckShader(pending.vertexShaderID);
+	bCompiled = CheckShader(pending.fragmentShaderID) && bCompiled;
+
+	// the shader objects are no longer needed once linked
+	glDetachShader(programID, pending.vertexShaderID);
+	glDetachShader(programID, pending.fragmentShaderID);
+	glDeleteShader(pending.vertexShaderID);
+	glDeleteShader(pending.fragmentShaderID);
+	pending.vertexShaderID = 0;
+	pending.fragmentShaderID = 0;
+	pending.programID = 0;
+
+	if ((bCompiled == false) || (CheckProgram(programID) == false))
+	{
+		glDeleteProgram(programID);
+		return(0);
+	}
+
+	return(programID);
+}
+
+/***********************************************************
+ *  CheckProgram()
+ *
+ *  This method is used for checking that a program linked
+ *  and reporting its errors.
+ ***********************************************************/
+bool ShaderProgramCache::CheckProgram(GLuint programID)
+{
+	GLint linkStatus = GL_FALSE;
+	glGetProgramiv(programID, GL_LINK_STATUS, &linkStatus);
+	if (linkStatus != GL_TRUE)
+	{
+		GLint logLength = 0;
+		glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &logLength);
+		std::vector<char> log(logLength + 1, 0);
+		glGetProgramInfoLog(programID, logLength, NULL, &log[0]);
+		std::cout << "Shader program link failed:" << std::endl << &log[0] << std::endl;
+		return(false);
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  QueryDriver()
+ *
+ *  This method is used for reading the driver identity and
+ *  capabilities the first time a program is requested.
+ *  Parallel compiles are turned on with as many compiler
+ *  threads as the driver wants to use.
+ ***********************************************************/
+void ShaderProgramCache::QueryDriver()
+{
+	if (m_driverSignature.empty() == false)
+	{
+		return;
+	}
+
+	GLint formatCount = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+	m_bBinariesSupported = (formatCount > 0);
+
+	m_bParallelCompile = (GLEW_KHR_parallel_shader_compile == GL_TRUE);
+	if (m_bParallelCompile == true)
+	{
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+	}
+
+	const char* vendor = (const char*)glGetString(GL_VENDOR);
+	const char* renderer = (const char*)glGetString(GL_RENDERER);
+	const char* version = (const char*)glGetString(GL_VERSION);
+	m_driverSignature = std::string(vendor ? vendor : "") + "|" +
+		(renderer ? renderer : "") + "|" +
+		(version ? version : "");
+}
+
+/***********************************************************
+ *  PrepareSources()
+ *
+ *  This method is used for reading both shader files,
+ *  inserting the define lines and calculating the cache
+ *  key of the program.
+ ***********************************************************/
+bool ShaderProgramCache::PrepareSources(
+	const char* vertexShaderPath,
+	const char* fragmentShaderPath,
+	const std::string& defines,
+	std::string& vertexSource,
+	std::string& fragmentSource,
+	unsigned long long& key)
+{
+	if ((ReadSourceFile(vertexShaderPath, vertexSource) == false) ||
+		(ReadSourceFile(fragmentShaderPath, fragmentSource) == false))
+	{
+		return(false);
+	}
+
+	vertexSource = InjectDefines(vertexSource, defines);
+	fragmentSource = InjectDefines(fragmentSource, defines);
+
+	// the driver identity only needs to be queried once
+	QueryDriver();
+
+	// the defines are already part of both injected sources
+	key = HashBytes(vertexSource.data(), vertexSource.size());
+	key = HashBytes(fragmentSource.data(), fragmentSource.size(), key);
+	key = HashBytes(m_driverSignature.data(), m_driverSignature.size(), key);
+
+	return(true);
+}
+
+/***********************************************************
+ *  BeginProgram()
+ *
+ *  This method is used for starting to build a program,
+ *  from the cached binary when the driver accepts it and
+ *  otherwise from source.
+ ***********************************************************/
+void ShaderProgramCache::BeginProgram(
+	const std::string& vertexSource,
+	const std::string& fragmentSource,
+	unsigned long long key,
+	PENDING_PROGRAM& pending)
+{
+	pending.key = key;
+	pending.programID = 0;
+	pending.vertexShaderID = 0;
+	pending.fragmentShaderID = 0;
+
+	if (m_bBinariesSupported == true)
+	{
+		pending.programID = LoadProgramBinary(key);
+		if (0 != pending.programID)
+		{
+			std::cout << "INFO: Shader program loaded from cache:" << GetCacheFilePath(key) << std::endl;
+			return;
+		}
+	}
+
+	StartProgram(vertexSource, fragmentSource, pending);
+}
+
+/***********************************************************
+ *  PrefetchProgram()
+ *
+ *  This method is used for starting to build a program
+ *  that will be asked for later. With parallel shader
+ *  compiles the driver builds it in the background, and
+ *  LoadProgram() for the same files and defines picks up
+ *  the result.
+ ***********************************************************/
+void ShaderProgramCache::PrefetchProgram(
+	const char* vertexShaderPath,
+	const char* fragmentShaderPath,
+	const std::string& defines)
+{
+	std::string vertexSource;
+	std::string fragmentSource;
+	unsigned long long key = 0;
+
+	if (PrepareSources(vertexShaderPath, fragmentShaderPath, defines, vertexSource, fragmentSource, key) == false)
+	{
+		return;
+	}
+
+	for (size_t i = 0; i < m_pendingPrograms.size(); i++)
+	{
+		if (m_pendingPrograms[i].key == key)
+		{
+			return;
+		}
+	}
+
+	PENDING_PROGRAM pending;
+	BeginProgram(vertexSource, fragmentSource, key, pending);
+	m_pendingPrograms.push_back(pending);
+}
+
+/***********************************************************
+ *  ArePrefetchedProgramsReady()
+ *
+ *  This method is used for checking whether the driver has
+ *  finished every prefetched program, so picking them up
+ *  will not wait. Without parallel compiles there is
+ *  nothing to gain from waiting, so this is always true.
+ ***********************************************************/
+bool ShaderProgramCache::ArePrefetchedProgramsReady()
+{
+	if (m_bParallelCompile == false)
+	{
+		return(true);
+	}
+
+	for (size_t i = 0; i < m_pendingPrograms.size(); i++)
+	{
+		if (0 == m_pendingPrograms[i].vertexShaderID)
+		{
+			continue;
+		}
+
+		GLint bCompleted = GL_FALSE;
+		glGetProgramiv(m_pendingPrograms[i].programID, GL_COMPLETION_STATUS_KHR, &bCompleted);
+		if (bCompleted != GL_TRUE)
+		{
+			return(false);
+		}
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  LoadProgram()
+ *
+ *  This method is used for getting a linked program for
+ *  the passed in shader files and define lines. A cached
+ *  binary is used when the driver accepts it, otherwise
+ *  the program is built from source and then cached.
+ ***********************************************************/
+GLuint ShaderProgramCache::LoadProgram(
+	const char* vertexShaderPath,
+	const char* fragmentShaderPath,
+	const std::string& defines)
+{
+	std::string vertexSource;
+	std::string fragmentSource;
+	unsigned long long key = 0;
+
+	if (PrepareSources(vertexShaderPath, fragmentShaderPath, defines, vertexSource, fragmentSource, key) == false)
+	{
+		return(0);
+	}
+
+	// a prefetched program only needs to be finished
+	PENDING_PROGRAM pending;
+	bool bPrefetched = false;
+	for (size_t i = 0; (i < m_pendingPrograms.size()) && (bPrefetched == false); i++)
+	{
+		if (m_pendingPrograms[i].key == key)
+		{
+			pending = m_pendingPrograms[i];
+			m_pendingPrograms.erase(m_pendingPrograms.begin() + i);
+			bPrefetched = true;
+		}
+	}
+	if (bPrefetched == false)
+	{
+		BeginProgram(vertexSource, fragmentSource, key, pending);
+	}
+
+	bool bFromSource = (0 != pending.vertexShaderID);
+	GLuint programID = FinishProgram(pending);
+	if ((0 != programID) && (bFromSource == true) && (m_bBinariesSupported == true))
+	{
+		SaveProgramBinary(key, programID);
+	}
+
+	return(programID);
+}
+
+/***********************************************************
+ *  LoadComputeProgram()
+ *
+ *  This method is used for getting a linked compute program
+ *  for the passed in shader file and define lines, from the
+ *  cached binary when the driver accepts it and otherwise
+ *  built from source and then cached. Compute programs are
+ *  few and small, so they are not prefetched.
+ ***********************************************************/
+GLuint ShaderProgramCache::LoadComputeProgram(
+	const char* computeShaderPath,
+	const std::string& defines)
+{
+	std::string computeSource;
+	if (ReadSourceFile(computeShaderPath, computeSource) == false)
+	{
+		return(0);
+	}
+	computeSource = InjectDefines(computeSource, defines);
+
+	QueryDriver();
+
+	// the stage is part of the key, so the binary can never be
+	// mistaken for a graphics program built from the same text
+	const char* stageTag = "compute";
+	unsigned long long key = HashBytes(stageTag, 7);
+	key = HashBytes(computeSource.data(), computeSource.size(), key);
+	key = HashBytes(m_driverSignature.data(), m_driverSignature.size(), key);
+
+	if (m_bBinariesSupported == true)
+	{
+		GLuint programID = LoadProgramBinary(key);
+		if (0 != programID)
+		{
+			std::cout << "INFO: Shader program loaded from cache:" << GetCacheFilePath(key) << std::endl;
+			return(programID);
+		}
+	}
+
+	const char* computePointer = computeSource.c_str();
+	GLuint shaderID = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(shaderID, 1, &computePointer, NULL);
+	glCompileShader(shaderID);
+
+	GLuint programID = glCreateProgram();
+	glAttachShader(programID, shaderID);
+	if (m_bBinariesSupported == true)
+	{
+		glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	glLinkProgram(programID);
+
+	bool bCompiled = CheckShader(shaderID);
+	glDetachShader(programID, shaderID);
+	glDeleteShader(shaderID);
+
+	if ((bCompiled == false) || (CheckProgram(programID) == false))
+	{
+		glDeleteProgram(programID);
+		return(0);
+	}
+
+	if (m_bBinariesSupported == true)
+	{
+		SaveProgramBinary(key, programID);
+	}
+
+	return(programID);
+}
@@ -0,0 +1,125 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadercache.h
+// ============
+// compile shader programs and keep their linked binaries on disk
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+
+/***********************************************************
+ *  ShaderProgramCache
+ *
+ *  This class is used for building shader programs from
+ *  GLSL source files. After a successful link the program
+ *  binary is written to the cache directory, keyed by a
+ *  hash of the sources, the defines and the driver, so the
+ *  next launch can skip compiling and linking entirely.
+ *
+ *  Programs can be prefetched, which only starts the
+ *  compile and link. On drivers with parallel shader
+ *  compiles the work then runs on driver threads while
+ *  the caller does something else.
+ ***********************************************************/
+class ShaderProgramCache
+{
+public:
+	// constructor
+	ShaderProgramCache(const char* cacheDirectory);
+	// destructor
+	~ShaderProgramCache();
+
+private:
+	// a program whose build was started but not checked,
+	// the shader names are 0 when it came from a binary
+	struct PENDING_PROGRAM
+	{
+		unsigned long long key;
+		GLuint programID;
+		GLuint vertexShaderID;
+		GLuint fragmentShaderID;
+	};
+
+	// folder where the program binaries are stored
+	std::string m_cacheDirectory;
+	// driver identification mixed into every cache key
+	std::string m_driverSignature;
+	// true when the driver supports at least one binary format
+	bool m_bBinariesSupported;
+	// true when the driver compiles on its own threads
+	bool m_bParallelCompile;
+	// prefetched programs not yet asked for
+	std::vector<PENDING_PROGRAM> m_pendingPrograms;
+
+	// read a whole text file into a string, from the asset pack
+	// when it holds the file
+	bool ReadSourceFile(const char* filename, std::string& source);
+	// insert the define lines right after the #version line
+	std::string InjectDefines(const std::string& source, const std::string& defines);
+	// calculate the cache file path for a program key
+	std::string GetCacheFilePath(unsigned long long key);
+	// try to create a program from a cached binary
+	GLuint LoadProgramBinary(unsigned long long key);
+	// write the linked program binary into the cache
+	void SaveProgramBinary(unsigned long long key, GLuint programID);
+	// check a compiled shader stage and report its errors
+	bool CheckShader(GLuint shaderID);
+	// check a linked program and report its errors
+	bool CheckProgram(GLuint programID);
+	// start compiling and linking without waiting on the driver
+	void StartProgram(
+		const std::string& vertexSource,
+		const std::string& fragmentSource,
+		PENDING_PROGRAM& pending);
+	// wait for a started program, returns 0 when it failed
+	GLuint FinishProgram(PENDING_PROGRAM& pending);
+	// query the driver identity and capabilities once
+	void QueryDriver();
+	// read the sources, add the defines and calculate the key
+	bool PrepareSources(
+		const char* vertexShaderPath,
+		const char* fragmentShaderPath,
+		const std::string& defines,
+		std::string& vertexSource,
+		std::string& fragmentSource,
+		unsigned long long& key);
+	// start a program from the cached binary or the sources
+	void BeginProgram(
+		const std::string& vertexSource,
+		const std::string& fragmentSource,
+		unsigned long long key,
+		PENDING_PROGRAM& pending);
+
+public:
+	// get a linked program for the shader files and defines,
+	// owned by the caller - returns 0 when it could not be built
+	GLuint LoadProgram(
+		const char* vertexShaderPath,
+		const char* fragmentShaderPath,
+		const std::string& defines);
+	// start building a program that LoadProgram() will be
+	// asked for later
+	void PrefetchProgram(
+		const char* vertexShaderPath,
+		const char* fragmentShaderPath,
+		const std::string& defines);
+	// check whether every prefetched program is finished
+	bool ArePrefetchedProgramsReady();
+	// get a linked compute program for the shader file and
+	// defines, owned by the caller - returns 0 when it could
+	// not be built
+	GLuint LoadComputeProgram(
+		const char* computeShaderPath,
+		const std::string& defines);
+
+	// calculate a 64-bit FNV-1a hash, seeded for chaining
+	static unsigned long long HashBytes(
+		const void* data,
+		size_t length,
+		unsigned long long seed = 14695981039346656037ULL);
+};
@@ -0,0 +1,181 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderpermutations.cpp
+// ============
+// build specialized shader programs for each used feature combination
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ShaderPermutations.h"
+
+#include <iostream>
+
+// declaration of global variables
+namespace
+{
+	// define names for each feature bit, in bit order
+	const char* g_FeatureDefineNames[] =
+	{
+		"USE_TEXTURE",
+		"USE_LIGHTING",
+		"USE_LIGHTMAP",
+		"USE_INSTANCING"
+	};
+}
+
+// out of class definitions for the integral constants
+const int ShaderPermutationSet::TOTAL_FEATURE_BITS;
+const int ShaderPermutationSet::TOTAL_PERMUTATIONS;
+
+/***********************************************************
+ *  ShaderPermutationSet()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+ShaderPermutationSet::ShaderPermutationSet(
+	ResourceManager* pResourceManager,
+	const char* vertexShaderPath,
+	const char* fragmentShaderPath)
+{
+	m_pResourceManager = pResourceManager;
+	m_vertexShaderPath = vertexShaderPath;
+	m_fragmentShaderPath = fragmentShaderPath;
+
+	for (int i = 0; i < TOTAL_PERMUTATIONS; i++)
+	{
+		m_bBuildFailed[i] = false;
+	}
+}
+
+/***********************************************************
+ *  ~ShaderPermutationSet()
+ *
+ *  The destructor for the class - the program handles are
+ *  released and freed by the manager at the frame boundary
+ ***********************************************************/
+ShaderPermutationSet::~ShaderPermutationSet()
+{
+	for (int i = 0; i < TOTAL_PERMUTATIONS; i++)
+	{
+		m_programs[i].Reset();
+	}
+	m_pResourceManager = NULL;
+}
+
+/***********************************************************
+ *  BuildDefines()
+ *
+ *  This method is used for building the preprocessor define
+ *  lines for the passed in feature flags. Every feature is
+ *  defined as 0 or 1 so the shaders can use #if directly.
+ ***********************************************************/
+std::string ShaderPermutationSet::BuildDefines(unsigned int features)
+{
+	std::string defines;
+
+	for (int i = 0; i < TOTAL_FEATURE_BITS; i++)
+	{
+		defines += "#define ";
+		defines += g_FeatureDefineNames[i];
+		defines += (features & (1u << i)) ? " 1\n" : " 0\n";
+	}
+
+	return(defines);
+}
+
+/***********************************************************
+ *  IsUsefulCombination()
+ *
+ *  This method is used for checking whether the passed in
+ *  feature flags are a combination the scene draws with.
+ *  The lightmap only replaces part of the lighting, so it
+ *  is never used without it, and it belongs to a single
+ *  object, so it is never used with instancing.
+ ***********************************************************/
+bool ShaderPermutationSet::IsUsefulCombination(unsigned int features)
+{
+	if (features >= (unsigned int)TOTAL_PERMUTATIONS)
+	{
+		return(false);
+	}
+	if ((features & FEATURE_LIGHTMAP) && !(features & FEATURE_LIGHTING))
+	{
+		return(false);
+	}
+	// a lightmap belongs to one object, instances share a draw
+	if ((features & FEATURE_LIGHTMAP) && (features & FEATURE_INSTANCING))
+	{
+		return(false);
+	}
+	return(true);
+}
+
+/***********************************************************
+ *  GetProgram()
+ *
+ *  This method is used for getting the specialized program
+ *  for the passed in feature flags. The program is built
+ *  the first time the combination is requested.
+ ***********************************************************/
+GLuint ShaderPermutationSet::GetProgram(unsigned int features)
+{
+	if ((features >= (unsigned int)TOTAL_PERMUTATIONS) || (NULL == m_pResourceManager))
+	{
+		return(0);
+	}
+
+	if ((m_programs[features].IsValid() == false) && (m_bBuildFailed[features] == false))
+	{
+		m_programs[features] = m_pResourceManager->LoadProgram(
+			m_vertexShaderPath.c_str(),
+			m_fragmentShaderPath.c_str(),
+			BuildDefines(features));
+
+		if (m_programs[features].IsValid() == false)
+		{
+			std::cout << "Could not build shader permutation:" << features << std::endl;
+			m_bBuildFailed[features] = true;
+		}
+	}
+
+	return(m_programs[features].GetID());
+}
+
+/***********************************************************
+ *  PrefetchProgram()
+ *
+ *  This method is used for starting to build the program
+ *  for the passed in feature flags ahead of its first use,
+ *  so the driver can compile several permutations at once.
+ *  GetProgram() picks up the result.
+ ***********************************************************/
+void ShaderPermutationSet::PrefetchProgram(unsigned int features)
+{
+	if ((features >= (unsigned int)TOTAL_PERMUTATIONS) || (NULL == m_pResourceManager))
+	{
+		return;
+	}
+
+	if ((m_programs[features].IsValid() == false) && (m_bBuildFailed[features] == false))
+	{
+		m_pResourceManager->PrefetchProgram(
+			m_vertexShaderPath.c_str(),
+			m_fragmentShaderPath.c_str(),
+			BuildDefines(features));
+	}
+}
+
+/***********************************************************
+ *  ArePrefetchedProgramsReady()
+ *
+ *  This method is used for checking whether the prefetched
+ *  programs can be picked up without waiting on the driver.
+ ***********************************************************/
+bool ShaderPermutationSet::ArePrefetchedProgramsReady()
+{
+	if (NULL == m_pResourceManager)
+	{
+		return(true);
+	}
+
+	return(m_pResourceManager->ArePrefetchedProgramsReady());
+}
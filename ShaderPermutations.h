@@ -0,0 +1,79 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderpermutations.h
+// ============
+// build specialized shader programs for each used feature combination
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "ResourceManager.h"
+
+#include <string>
+
+/***********************************************************
+ *  ShaderPermutationSet
+ *
+ *  This class is used for turning shader feature flags into
+ *  preprocessor defines, so each feature combination gets
+ *  its own specialized program without runtime branching.
+ *  Programs are only built the first time a combination
+ *  is requested.
+ ***********************************************************/
+class ShaderPermutationSet
+{
+public:
+	// shader features that can be compiled in or out
+	enum FEATURE_FLAGS
+	{
+		FEATURE_TEXTURE = 1 << 0,
+		FEATURE_LIGHTING = 1 << 1,
+		// ambient and diffuse lighting come from a baked lightmap,
+		// only used together with FEATURE_LIGHTING
+		FEATURE_LIGHTMAP = 1 << 2,
+		// the model matrix comes from the instances that survived
+		// the GPU culling, never used together with a lightmap
+		FEATURE_INSTANCING = 1 << 3
+	};
+
+	// number of feature bits, bounds the number of programs
+	static const int TOTAL_FEATURE_BITS = 4;
+	static const int TOTAL_PERMUTATIONS = 1 << TOTAL_FEATURE_BITS;
+
+	// constructor
+	ShaderPermutationSet(
+		ResourceManager* pResourceManager,
+		const char* vertexShaderPath,
+		const char* fragmentShaderPath);
+	// destructor
+	~ShaderPermutationSet();
+
+private:
+	// manager that builds and owns the programs
+	ResourceManager* m_pResourceManager;
+	// shader source files shared by all permutations
+	std::string m_vertexShaderPath;
+	std::string m_fragmentShaderPath;
+	// built programs indexed by feature flags, empty if not built
+	ResourceHandle m_programs[TOTAL_PERMUTATIONS];
+	// set when a program failed so it is not rebuilt every frame
+	bool m_bBuildFailed[TOTAL_PERMUTATIONS];
+
+public:
+	// get the program for the feature flags, building it on
+	// first use - returns 0 when the program failed to build
+	GLuint GetProgram(unsigned int features);
+	// start building the program for the feature flags so a
+	// later GetProgram() does not have to wait for the driver
+	void PrefetchProgram(unsigned int features);
+	// check whether the prefetched programs are all built
+	bool ArePrefetchedProgramsReady();
+	// get the manager used for building the programs
+	ResourceManager* GetResourceManager() const { return m_pResourceManager; }
+
+	// build the define lines for the feature flags
+	static std::string BuildDefines(unsigned int features);
+	// check whether the scene can draw with the feature flags,
+	// for building every program it may need ahead of time
+	static bool IsUsefulCombination(unsigned int features);
+};
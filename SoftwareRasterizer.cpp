@@ -0,0 +1,1054 @@
+///////////////////////////////////////////////////////////////////////////////
+// softwarerasterizer.cpp
+// ============
+// draw the scene on the CPU for machines without a GPU
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "SoftwareRasterizer.h"
+#include "AssetPack.h"
+#include "MemoryAccounting.h"
+
+#include "stb_image.h"
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+// declaration of global variables
+namespace
+{
+	const char* g_ColorBufferName = "softwareColorBuffer";
+	const char* g_DepthBufferName = "softwareDepthBuffer";
+	const char* g_TextureName = "softwareTextures";
+
+	// offsets of the interpolated attributes
+	const int g_WorldPositionAttribute = 0;
+	const int g_NormalAttribute = 3;
+	const int g_TextureCoordinateAttribute = 6;
+
+	// pixels shaded together, one per SSE lane
+	const int g_QuadWidth = 4;
+	// a clipped triangle has at most one more corner
+	const int g_MaxClippedVertices = 4;
+
+	/***********************************************************
+	 *  Dot3()
+	 *
+	 *  This function is used for the dot product of four
+	 *  vectors at once, one per lane.
+	 ***********************************************************/
+	inline __m128 Dot3(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+	{
+		return(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz)));
+	}
+
+	/***********************************************************
+	 *  Normalize3()
+	 *
+	 *  This function is used for normalizing four vectors at
+	 *  once, one per lane.
+	 ***********************************************************/
+	inline void Normalize3(__m128& x, __m128& y, __m128& z)
+	{
+		__m128 length = _mm_sqrt_ps(_mm_max_ps(Dot3(x, y, z, x, y, z), _mm_set1_ps(1.0e-20f)));
+		__m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), length);
+		x = _mm_mul_ps(x, inverse);
+		y = _mm_mul_ps(y, inverse);
+		z = _mm_mul_ps(z, inverse);
+	}
+
+	/***********************************************************
+	 *  Interpolate()
+	 *
+	 *  This function is used for blending one value of the
+	 *  three corners with the barycentric weights of a quad.
+	 ***********************************************************/
+	inline __m128 Interpolate(__m128 b0, __m128 b1, __m128 b2, float v0, float v1, float v2)
+	{
+		return(_mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(b0, _mm_set1_ps(v0)), _mm_mul_ps(b1, _mm_set1_ps(v1))),
+			_mm_mul_ps(b2, _mm_set1_ps(v2))));
+	}
+
+	/***********************************************************
+	 *  ToByte()
+	 *
+	 *  This function is used for converting four channel
+	 *  values to 8-bit integers, rounded like the GL does.
+	 ***********************************************************/
+	inline __m128i ToByte(__m128 value)
+	{
+		value = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		return(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f))));
+	}
+
+	/***********************************************************
+	 *  FromByte()
+	 *
+	 *  This function is used for reading one channel of four
+	 *  packed RGBA8 pixels as values from 0 to 1.
+	 ***********************************************************/
+	inline __m128 FromByte(__m128i pixels, int shift)
+	{
+		__m128i channel = _mm_and_si128(_mm_srli_epi32(pixels, shift), _mm_set1_epi32(0xFF));
+		return(_mm_mul_ps(_mm_cvtepi32_ps(channel), _mm_set1_ps(1.0f / 255.0f)));
+	}
+
+	/***********************************************************
+	 *  LerpVertex()
+	 *
+	 *  This function is used for the point on a clip space
+	 *  edge where it crosses the near plane.
+	 ***********************************************************/
+	template<typename VERTEX>
+	VERTEX LerpVertex(const VERTEX& a, const VERTEX& b, float t, int attributeCount)
+	{
+		VERTEX result;
+		result.clipPosition = a.clipPosition + ((b.clipPosition - a.clipPosition) * t);
+		for (int i = 0; i < attributeCount; i++)
+		{
+			result.attributes[i] = a.attributes[i] + ((b.attributes[i] - a.attributes[i]) * t);
+		}
+		return(result);
+	}
+}
+
+// out of class definitions for the integral constants
+const int SoftwareRasterizer::TILE_SIZE;
+const int SoftwareRasterizer::ATTRIBUTE_COUNT;
+
+/***********************************************************
+ *  SoftwareRasterizer()
+ *
+ *  The constructor for the class - the worker threads are
+ *  started here and sleep until the first frame
+ ***********************************************************/
+SoftwareRasterizer::SoftwareRasterizer(int threadCount)
+{
+	m_width = 0;
+	m_height = 0;
+	m_stride = 0;
+	m_tilesX = 0;
+	m_tilesY = 0;
+	m_clearColor = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	m_viewProjection = glm::mat4(1.0f);
+	m_viewPosition = glm::vec3(0.0f);
+	m_totalTriangles = 0;
+	m_workGeneration = 0;
+	m_pendingWorkers = 0;
+	m_stage = STAGE_VERTICES;
+	m_bShutdown = false;
+	m_nextJob = 0;
+
+	if (threadCount <= 0)
+	{
+		threadCount = std::max((int)std::thread::hardware_concurrency(), 1);
+	}
+
+	m_triangles.resize(threadCount);
+	for (int i = 0; i < threadCount - 1; i++)
+	{
+		m_workers.push_back(std::thread(&SoftwareRasterizer::WorkerMain, this, i));
+	}
+}
+
+/***********************************************************
+ *  ~SoftwareRasterizer()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+SoftwareRasterizer::~SoftwareRasterizer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_workMutex);
+		m_bShutdown = true;
+	}
+	m_workReady.notify_all();
+
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		m_workers[i].join();
+	}
+	m_workers.clear();
+
+	Resize(0, 0);
+	for (size_t i = 0; i < m_textures.size(); i++)
+	{
+		MemoryAccounting::Free(MemoryAccounting::CATEGORY_TEXTURE, g_TextureName,
+			(long long)m_textures[i].texels.size() * sizeof(unsigned int));
+	}
+	m_textures.clear();
+}
+
+/***********************************************************
+ *  Resize()
+ *
+ *  This method is used for setting the size of the image.
+ *  The buffers are padded to whole tiles so the quads of
+ *  the last tile never need a bounds check.
+ ***********************************************************/
+bool SoftwareRasterizer::Resize(int width, int height)
+{
+	if (false == m_colorBuffer.empty())
+	{
+		long long pixels = (long long)m_colorBuffer.size();
+		MemoryAccounting::Free(MemoryAccounting::CATEGORY_TEXTURE, g_ColorBufferName, pixels * sizeof(unsigned int));
+		MemoryAccounting::Free(MemoryAccounting::CATEGORY_TEXTURE, g_DepthBufferName, pixels * sizeof(float));
+	}
+
+	m_width = std::max(width, 0);
+	m_height = std::max(height, 0);
+	m_tilesX = (m_width + TILE_SIZE - 1) / TILE_SIZE;
+	m_tilesY = (m_height + TILE_SIZE - 1) / TILE_SIZE;
+	m_stride = m_tilesX * TILE_SIZE;
+
+	size_t pixels = (size_t)m_stride * m_tilesY * TILE_SIZE;
+	std::vector<unsigned int>(pixels).swap(m_colorBuffer);
+	std::vector<float>(pixels).swap(m_depthBuffer);
+	m_bins.clear();
+	m_bins.resize(m_triangles.size() * m_tilesX * m_tilesY);
+
+	if (pixels == 0)
+	{
+		return(false);
+	}
+
+	MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_TEXTURE, g_ColorBufferName, (long long)pixels * sizeof(unsigned int));
+	MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_TEXTURE, g_DepthBufferName, (long long)pixels * sizeof(float));
+	return(true);
+}
+
+/***********************************************************
+ *  LoadTexture()
+ *
+ *  This method is used for decoding an image file into a
+ *  texture, from the asset pack when it holds the file. The
+ *  rows are flipped like the GL textures, so the texture
+ *  coordinates of the meshes line up.
+ ***********************************************************/
+int SoftwareRasterizer::LoadTexture(const char* filename, bool& bHasAlpha)
+{
+	bHasAlpha = false;
+
+	int width = 0;
+	int height = 0;
+	int colorChannels = 0;
+	stbi_set_flip_vertically_on_load(true);
+
+	std::vector<unsigned char> unpacked;
+	const unsigned char* packedData = NULL;
+	size_t packedSize = 0;
+	unsigned char* image = NULL;
+	if (AssetPack::Read(filename, unpacked, packedData, packedSize) == true)
+	{
+		image = stbi_load_from_memory(packedData, (int)packedSize, &width, &height, &colorChannels, 0);
+	}
+	else
+	{
+		image = stbi_load(filename, &width, &height, &colorChannels, 0);
+	}
+	if (NULL == image)
+	{
+		std::cout << "Could not load image:" << filename << std::endl;
+		return(-1);
+	}
+	if ((colorChannels != 3) && (colorChannels != 4))
+	{
+		std::cout << "Not implemented to handle image with " << colorChannels << " channels" << std::endl;
+		stbi_image_free(image);
+		return(-1);
+	}
+
+	TEXTURE texture;
+	texture.width = width;
+	texture.height = height;
+	texture.texels.resize((size_t)width * height);
+	for (size_t i = 0; i < texture.texels.size(); i++)
+	{
+		const unsigned char* source = image + (i * colorChannels);
+		unsigned int alpha = (colorChannels == 4) ? source[3] : 255;
+		texture.texels[i] = source[0] | (source[1] << 8) | (source[2] << 16) | (alpha << 24);
+		if (alpha < 255)
+		{
+			bHasAlpha = true;
+		}
+	}
+	stbi_image_free(image);
+
+	std::cout << "Successfully loaded software texture:" << filename << ", width:" << width << ", height:" << height << std::endl;
+	MemoryAccounting::Allocate(MemoryAccounting::CATEGORY_TEXTURE, g_TextureName,
+		(long long)texture.texels.size() * sizeof(unsigned int));
+
+	m_textures.push_back(texture);
+	return((int)m_textures.size() - 1);
+}
+
+/***********************************************************
+ *  BeginFrame()
+ *
+ *  This method is used for starting a frame with the view
+ *  and the lights it is drawn with.
+ ***********************************************************/
+void SoftwareRasterizer::BeginFrame(
+	const glm::mat4& view,
+	const glm::mat4& projection,
+	const glm::vec3& viewPosition,
+	const std::vector<LightClusterManager::LIGHT_SOURCE>& lights)
+{
+	m_viewProjection = projection * view;
+	m_viewPosition = viewPosition;
+	m_lights = lights;
+	m_draws.clear();
+}
+
+/***********************************************************
+ *  AddDraw()
+ *
+ *  This method is used for recording a draw. Draws without
+ *  geometry are left out.
+ ***********************************************************/
+void SoftwareRasterizer::AddDraw(const DRAW& draw)
+{
+	if ((NULL == draw.pGeometry) || (draw.pGeometry->indices.empty() == true))
+	{
+		return;
+	}
+	m_draws.push_back(draw);
+}
+
+/***********************************************************
+ *  EndFrame()
+ *
+ *  This method is used for drawing the recorded draws. Each
+ *  stage runs on every thread and finishes before the next.
+ ***********************************************************/
+void SoftwareRasterizer::EndFrame()
+{
+	if (m_colorBuffer.empty() == true)
+	{
+		return;
+	}
+
+	int drawCount = (int)m_draws.size();
+	m_vertexOffsets.resize(drawCount + 1);
+	m_triangleOffsets.resize(drawCount + 1);
+	m_vertexOffsets[0] = 0;
+	m_triangleOffsets[0] = 0;
+	for (int i = 0; i < drawCount; i++)
+	{
+		const MeshLibrary::MESH_GEOMETRY* pGeometry = m_draws[i].pGeometry;
+		m_vertexOffsets[i + 1] = m_vertexOffsets[i] + (int)pGeometry->positions.size();
+		m_triangleOffsets[i + 1] = m_triangleOffsets[i] + (int)(pGeometry->indices.size() / 3);
+	}
+	m_totalTriangles = m_triangleOffsets[drawCount];
+	m_vertices.resize(m_vertexOffsets[drawCount]);
+
+	for (size_t i = 0; i < m_triangles.size(); i++)
+	{
+		m_triangles[i].clear();
+	}
+	for (size_t i = 0; i < m_bins.size(); i++)
+	{
+		m_bins[i].clear();
+	}
+
+	RunStage(STAGE_VERTICES);
+	RunStage(STAGE_TRIANGLES);
+	RunStage(STAGE_TILES);
+}
+
+/***********************************************************
+ *  WorkerMain()
+ *
+ *  This method is run by each worker thread. It sleeps until
+ *  a stage is posted, runs its share and reports back.
+ ***********************************************************/
+void SoftwareRasterizer::WorkerMain(int workerIndex)
+{
+	unsigned int lastGeneration = 0;
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_workMutex);
+			while ((m_bShutdown == false) && (m_workGeneration == lastGeneration))
+			{
+				m_workReady.wait(lock);
+			}
+			if (m_bShutdown == true)
+			{
+				return;
+			}
+			lastGeneration = m_workGeneration;
+		}
+
+		// the calling thread is thread 0
+		RunShare(workerIndex + 1);
+
+		{
+			std::lock_guard<std::mutex> lock(m_workMutex);
+			m_pendingWorkers--;
+			if (m_pendingWorkers == 0)
+			{
+				m_workDone.notify_one();
+			}
+		}
+	}
+}
+
+/***********************************************************
+ *  RunStage()
+ *
+ *  This method is used for running a stage on the calling
+ *  thread and every worker, returning once all are done.
+ ***********************************************************/
+void SoftwareRasterizer::RunStage(FRAME_STAGE stage)
+{
+	m_stage = stage;
+	m_nextJob = 0;
+
+	if (m_workers.empty() == true)
+	{
+		RunShare(0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_workMutex);
+		m_pendingWorkers = (int)m_workers.size();
+		m_workGeneration++;
+	}
+	m_workReady.notify_all();
+
+	RunShare(0);
+
+	std::unique_lock<std::mutex> lock(m_workMutex);
+	while (m_pendingWorkers > 0)
+	{
+		m_workDone.wait(lock);
+	}
+}
+
+/***********************************************************
+ *  RunShare()
+ *
+ *  This method is used for running one thread's share of a
+ *  stage. Draws and tiles are taken one at a time so uneven
+ *  work balances out, triangles are split into contiguous
+ *  ranges so the bins keep the draw order.
+ ***********************************************************/
+void SoftwareRasterizer::RunShare(int thread)
+{
+	if (m_stage == STAGE_VERTICES)
+	{
+		int drawCount = (int)m_draws.size();
+		for (int draw = m_nextJob++; draw < drawCount; draw = m_nextJob++)
+		{
+			TransformDraw(draw);
+		}
+	}
+	else if (m_stage == STAGE_TRIANGLES)
+	{
+		int threads = (int)m_triangles.size();
+		int share = (m_totalTriangles + threads - 1) / threads;
+		int begin = std::min(share * thread, m_totalTriangles);
+		int end = std::min(begin + share, m_totalTriangles);
+		SetupTriangles(thread, begin, end);
+	}
+	else
+	{
+		int tileCount = m_tilesX * m_tilesY;
+		for (int tile = m_nextJob++; tile < tileCount; tile = m_nextJob++)
+		{
+			RasterizeTile(tile);
+		}
+	}
+}
+
+/***********************************************************
+ *  TransformDraw()
+ *
+ *  This method is used for transforming the vertices of one
+ *  draw like the vertex shader, into clip space with the
+ *  world position, normal and scaled texture coordinate.
+ ***********************************************************/
+void SoftwareRasterizer::TransformDraw(int draw)
+{
+	const DRAW& command = m_draws[draw];
+	const MeshLibrary::MESH_GEOMETRY& geometry = *command.pGeometry;
+
+	glm::mat4 modelViewProjection = m_viewProjection * command.model;
+	glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(command.model)));
+
+	CLIP_VERTEX* pVertices = &m_vertices[m_vertexOffsets[draw]];
+	for (size_t i = 0; i < geometry.positions.size(); i++)
+	{
+		glm::vec4 position = glm::vec4(geometry.positions[i], 1.0f);
+		glm::vec3 worldPosition = glm::vec3(command.model * position);
+		glm::vec3 normal = normalMatrix * geometry.normals[i];
+		glm::vec2 textureCoordinate = geometry.textureCoordinates[i] * command.uvScale;
+
+		CLIP_VERTEX& vertex = pVertices[i];
+		vertex.clipPosition = modelViewProjection * position;
+		vertex.attributes[g_WorldPositionAttribute] = worldPosition.x;
+		vertex.attributes[g_WorldPositionAttribute + 1] = worldPosition.y;
+		vertex.attributes[g_WorldPositionAttribute + 2] = worldPosition.z;
+		vertex.attributes[g_NormalAttribute] = normal.x;
+		vertex.attributes[g_NormalAttribute + 1] = normal.y;
+		vertex.attributes[g_NormalAttribute + 2] = normal.z;
+		vertex.attributes[g_TextureCoordinateAttribute] = textureCoordinate.x;
+		vertex.attributes[g_TextureCoordinateAttribute + 1] = textureCoordinate.y;
+	}
+}
+
+/***********************************************************
+ *  SetupTriangles()
+ *
+ *  This method is used for assembling a range of triangles.
+ *  Triangles outside one side of the view are dropped, and
+ *  the ones crossing the near plane are clipped against it,
+ *  which leaves one or two triangles in front of it.
+ ***********************************************************/
+void SoftwareRasterizer::SetupTriangles(int thread, int begin, int end)
+{
+	if (begin >= end)
+	{
+		return;
+	}
+
+	int draw = (int)(std::upper_bound(m_triangleOffsets.begin(), m_triangleOffsets.end(), begin) - m_triangleOffsets.begin()) - 1;
+	for (int triangle = begin; triangle < end; triangle++)
+	{
+		while (triangle >= m_triangleOffsets[draw + 1])
+		{
+			draw++;
+		}
+
+		const std::vector<unsigned int>& indices = m_draws[draw].pGeometry->indices;
+		const CLIP_VERTEX* pVertices = &m_vertices[m_vertexOffsets[draw]];
+		int first = (triangle - m_triangleOffsets[draw]) * 3;
+		const CLIP_VERTEX* corners[3] =
+		{
+			&pVertices[indices[first]],
+			&pVertices[indices[first + 1]],
+			&pVertices[indices[first + 2]]
+		};
+
+		// outcodes of the six planes, a triangle with every
+		// corner outside the same plane cannot be seen
+		int outside = 0x3F;
+		int behind = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			const glm::vec4& p = corners[i]->clipPosition;
+			int code = 0;
+			code |= (p.x < -p.w) ? 0x01 : 0;
+			code |= (p.x > p.w) ? 0x02 : 0;
+			code |= (p.y < -p.w) ? 0x04 : 0;
+			code |= (p.y > p.w) ? 0x08 : 0;
+			code |= (p.z < -p.w) ? 0x10 : 0;
+			code |= (p.z > p.w) ? 0x20 : 0;
+			outside &= code;
+			behind |= code & 0x10;
+		}
+		if (outside != 0)
+		{
+			continue;
+		}
+
+		if (behind == 0)
+		{
+			AddTriangle(thread, draw, *corners[0], *corners[1], *corners[2]);
+			continue;
+		}
+
+		// keep the part in front of the near plane, z >= -w
+		CLIP_VERTEX clipped[g_MaxClippedVertices];
+		int clippedCount = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			const CLIP_VERTEX& a = *corners[i];
+			const CLIP_VERTEX& b = *corners[(i + 1) % 3];
+			float distanceA = a.clipPosition.z + a.clipPosition.w;
+			float distanceB = b.clipPosition.z + b.clipPosition.w;
+
+			if (distanceA >= 0.0f)
+			{
+				clipped[clippedCount++] = a;
+			}
+			if ((distanceA >= 0.0f) != (distanceB >= 0.0f))
+			{
+				float t = distanceA / (distanceA - distanceB);
+				clipped[clippedCount++] = LerpVertex(a, b, t, ATTRIBUTE_COUNT);
+			}
+		}
+
+		for (int i = 2; i < clippedCount; i++)
+		{
+			AddTriangle(thread, draw, clipped[0], clipped[i - 1], clipped[i]);
+		}
+	}
+}
+
+/***********************************************************
+ *  AddTriangle()
+ *
+ *  This method is used for projecting a triangle onto the
+ *  screen, setting up its edge functions and adding it to
+ *  the bins of the tiles its bounding box touches. Both
+ *  windings are drawn, like the GL path without culling.
+ ***********************************************************/
+void SoftwareRasterizer::AddTriangle(int thread, int draw, const CLIP_VERTEX& v0, const CLIP_VERTEX& v1, const CLIP_VERTEX& v2)
+{
+	const CLIP_VERTEX* corners[3] = { &v0, &v1, &v2 };
+	float screenX[3];
+	float screenY[3];
+	SETUP_TRIANGLE setup;
+
+	for (int i = 0; i < 3; i++)
+	{
+		const glm::vec4& p = corners[i]->clipPosition;
+		float inverseW = 1.0f / p.w;
+		screenX[i] = ((p.x * inverseW * 0.5f) + 0.5f) * m_width;
+		// the image starts at the top row
+		screenY[i] = (0.5f - (p.y * inverseW * 0.5f)) * m_height;
+		setup.depth[i] = (p.z * inverseW * 0.5f) + 0.5f;
+		setup.inverseW[i] = inverseW;
+		for (int a = 0; a < ATTRIBUTE_COUNT; a++)
+		{
+			setup.attributes[i][a] = corners[i]->attributes[a] * inverseW;
+		}
+	}
+
+	float area = ((screenX[1] - screenX[0]) * (screenY[2] - screenY[0])) -
+		((screenY[1] - screenY[0]) * (screenX[2] - screenX[0]));
+	if (std::fabs(area) < 1.0e-8f)
+	{
+		return;
+	}
+
+	// the weight of each corner comes from the opposite edge,
+	// swapping two corners turns the other winding around
+	int order[3] = { 0, 1, 2 };
+	if (area < 0.0f)
+	{
+		order[1] = 2;
+		order[2] = 1;
+		area = -area;
+	}
+
+	SETUP_TRIANGLE triangle;
+	for (int i = 0; i < 3; i++)
+	{
+		int corner = order[i];
+		int a = order[(i + 1) % 3];
+		int b = order[(i + 2) % 3];
+		float dx = screenX[b] - screenX[a];
+		float dy = screenY[b] - screenY[a];
+
+		triangle.edgeX[i] = -dy / area;
+		triangle.edgeY[i] = dx / area;
+		triangle.edgeOffset[i] = ((dy * screenX[a]) - (dx * screenY[a])) / area;
+		triangle.bTopLeft[i] = (dy < 0.0f) || ((dy == 0.0f) && (dx > 0.0f));
+		triangle.depth[i] = setup.depth[corner];
+		triangle.inverseW[i] = setup.inverseW[corner];
+		for (int attribute = 0; attribute < ATTRIBUTE_COUNT; attribute++)
+		{
+			triangle.attributes[i][attribute] = setup.attributes[corner][attribute];
+		}
+	}
+
+	// pixel centers inside the bounds, clamped to the image
+	float minX = std::max(std::min(std::min(screenX[0], screenX[1]), screenX[2]), -1.0f);
+	float maxX = std::min(std::max(std::max(screenX[0], screenX[1]), screenX[2]), (float)m_width + 1.0f);
+	float minY = std::max(std::min(std::min(screenY[0], screenY[1]), screenY[2]), -1.0f);
+	float maxY = std::min(std::max(std::max(screenY[0], screenY[1]), screenY[2]), (float)m_height + 1.0f);
+	triangle.minX = std::max((int)std::ceil(minX - 0.5f), 0);
+	triangle.maxX = std::min((int)std::floor(maxX - 0.5f), m_width - 1);
+	triangle.minY = std::max((int)std::ceil(minY - 0.5f), 0);
+	triangle.maxY = std::min((int)std::floor(maxY - 0.5f), m_height - 1);
+	if ((triangle.minX > triangle.maxX) || (triangle.minY > triangle.maxY))
+	{
+		return;
+	}
+	triangle.draw = draw;
+
+	std::vector<SETUP_TRIANGLE>& triangles = m_triangles[thread];
+	triangles.push_back(triangle);
+	int index = (int)triangles.size() - 1;
+
+	int tileCount = m_tilesX * m_tilesY;
+	for (int tileY = triangle.minY / TILE_SIZE; tileY <= triangle.maxY / TILE_SIZE; tileY++)
+	{
+		for (int tileX = triangle.minX / TILE_SIZE; tileX <= triangle.maxX / TILE_SIZE; tileX++)
+		{
+			m_bins[(thread * tileCount) + (tileY * m_tilesX) + tileX].push_back(index);
+		}
+	}
+}
+
+/***********************************************************
+ *  RasterizeTile()
+ *
+ *  This method is used for clearing one tile and drawing
+ *  the triangles binned into it, in the order they were
+ *  added. Only one thread works on a tile at a time.
+ ***********************************************************/
+void SoftwareRasterizer::RasterizeTile(int tile)
+{
+	int tileX0 = (tile % m_tilesX) * TILE_SIZE;
+	int tileY0 = (tile / m_tilesX) * TILE_SIZE;
+	int tileX1 = std::min(tileX0 + TILE_SIZE, m_width);
+	int tileY1 = std::min(tileY0 + TILE_SIZE, m_height);
+
+	__m128i clearColor = _mm_set1_epi32((int)(
+		(unsigned int)(m_clearColor.r * 255.0f + 0.5f) |
+		((unsigned int)(m_clearColor.g * 255.0f + 0.5f) << 8) |
+		((unsigned int)(m_clearColor.b * 255.0f + 0.5f) << 16) |
+		((unsigned int)(m_clearColor.a * 255.0f + 0.5f) << 24)));
+	__m128 clearDepth = _mm_set1_ps(1.0f);
+	for (int y = tileY0; y < tileY0 + TILE_SIZE; y++)
+	{
+		size_t row = (size_t)y * m_stride;
+		for (int x = tileX0; x < tileX0 + TILE_SIZE; x += g_QuadWidth)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&m_colorBuffer[row + x]), clearColor);
+			_mm_storeu_ps(&m_depthBuffer[row + x], clearDepth);
+		}
+	}
+
+	int tileCount = m_tilesX * m_tilesY;
+	for (size_t thread = 0; thread < m_triangles.size(); thread++)
+	{
+		const std::vector<int>& bin = m_bins[(thread * tileCount) + tile];
+		const std::vector<SETUP_TRIANGLE>& triangles = m_triangles[thread];
+		for (size_t i = 0; i < bin.size(); i++)
+		{
+			RasterizeTriangle(triangles[bin[i]], tileX0, tileY0, tileX1, tileY1);
+		}
+	}
+}
+
+/***********************************************************
+ *  RasterizeTriangle()
+ *
+ *  This method is used for drawing the part of a triangle
+ *  inside a tile, four pixels at a time. The edge functions
+ *  give the coverage, the depth is tested, and the covered
+ *  pixels are shaded like the fragment shader.
+ ***********************************************************/
+void SoftwareRasterizer::RasterizeTriangle(
+	const SETUP_TRIANGLE& triangle,
+	int tileX0,
+	int tileY0,
+	int tileX1,
+	int tileY1)
+{
+	const DRAW& draw = m_draws[triangle.draw];
+	const TEXTURE* pTexture = NULL;
+	if ((draw.texture >= 0) && (draw.texture < (int)m_textures.size()))
+	{
+		pTexture = &m_textures[draw.texture];
+	}
+	bool bLighting = draw.bLighting && (m_lights.empty() == false);
+
+	// quads start on a multiple of four, tiles are aligned
+	int startX = std::max(triangle.minX, tileX0) & ~(g_QuadWidth - 1);
+	int endX = std::min(triangle.maxX, tileX1 - 1);
+	int startY = std::max(triangle.minY, tileY0);
+	int endY = std::min(triangle.maxY, tileY1 - 1);
+
+	const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	__m128 edgeX[3];
+	for (int i = 0; i < 3; i++)
+	{
+		edgeX[i] = _mm_set1_ps(triangle.edgeX[i]);
+	}
+
+	float shininess = std::max(draw.material.shininess, 0.0001f);
+	float laneU[g_QuadWidth];
+	float laneV[g_QuadWidth];
+	float laneSpecular[g_QuadWidth];
+	float laneColor[4][g_QuadWidth];
+
+	for (int y = startY; y <= endY; y++)
+	{
+		float pixelY = (float)y + 0.5f;
+		__m128 rowWeight[3];
+		for (int i = 0; i < 3; i++)
+		{
+			rowWeight[i] = _mm_set1_ps((triangle.edgeY[i] * pixelY) + triangle.edgeOffset[i]);
+		}
+
+		size_t row = (size_t)y * m_stride;
+		for (int x = startX; x <= endX; x += g_QuadWidth)
+		{
+			__m128 pixelX = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+
+			// barycentric weights, a pixel exactly on an edge
+			// belongs to the triangle on its top or left side
+			__m128 weight[3];
+			__m128 covered = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int i = 0; i < 3; i++)
+			{
+				weight[i] = _mm_add_ps(_mm_mul_ps(edgeX[i], pixelX), rowWeight[i]);
+				covered = _mm_and_ps(covered, triangle.bTopLeft[i] ?
+					_mm_cmpge_ps(weight[i], zero) : _mm_cmpgt_ps(weight[i], zero));
+			}
+			if (_mm_movemask_ps(covered) == 0)
+			{
+				continue;
+			}
+
+			// less or equal depth test, depth is linear on screen
+			float* pDepth = &m_depthBuffer[row + x];
+			__m128 storedDepth = _mm_loadu_ps(pDepth);
+			__m128 depth = Interpolate(weight[0], weight[1], weight[2],
+				triangle.depth[0], triangle.depth[1], triangle.depth[2]);
+			covered = _mm_and_ps(covered, _mm_cmple_ps(depth, storedDepth));
+			int coveredLanes = _mm_movemask_ps(covered);
+			if (coveredLanes == 0)
+			{
+				continue;
+			}
+			if (draw.bTranslucent == false)
+			{
+				_mm_storeu_ps(pDepth, _mm_or_ps(_mm_and_ps(covered, depth), _mm_andnot_ps(covered, storedDepth)));
+			}
+
+			// perspective correct weights for the attributes
+			__m128 inverseW = Interpolate(weight[0], weight[1], weight[2],
+				triangle.inverseW[0], triangle.inverseW[1], triangle.inverseW[2]);
+			__m128 w = _mm_div_ps(one, inverseW);
+			__m128 b0 = _mm_mul_ps(weight[0], w);
+			__m128 b1 = _mm_mul_ps(weight[1], w);
+			__m128 b2 = _mm_mul_ps(weight[2], w);
+			const float (*attributes)[ATTRIBUTE_COUNT] = triangle.attributes;
+
+			__m128 red;
+			__m128 green;
+			__m128 blue;
+			__m128 alpha;
+			if (NULL != pTexture)
+			{
+				_mm_storeu_ps(laneU, Interpolate(b0, b1, b2,
+					attributes[0][g_TextureCoordinateAttribute], attributes[1][g_TextureCoordinateAttribute], attributes[2][g_TextureCoordinateAttribute]));
+				_mm_storeu_ps(laneV, Interpolate(b0, b1, b2,
+					attributes[0][g_TextureCoordinateAttribute + 1], attributes[1][g_TextureCoordinateAttribute + 1], attributes[2][g_TextureCoordinateAttribute + 1]));
+				for (int lane = 0; lane < g_QuadWidth; lane++)
+				{
+					float texel[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+					if (coveredLanes & (1 << lane))
+					{
+						SampleTexture(*pTexture, laneU[lane], laneV[lane], texel);
+					}
+					for (int channel = 0; channel < 4; channel++)
+					{
+						laneColor[channel][lane] = texel[channel];
+					}
+				}
+				red = _mm_loadu_ps(laneColor[0]);
+				green = _mm_loadu_ps(laneColor[1]);
+				blue = _mm_loadu_ps(laneColor[2]);
+				alpha = _mm_loadu_ps(laneColor[3]);
+			}
+			else
+			{
+				red = _mm_set1_ps(draw.color.r);
+				green = _mm_set1_ps(draw.color.g);
+				blue = _mm_set1_ps(draw.color.b);
+				alpha = _mm_set1_ps(draw.color.a);
+			}
+
+			if (bLighting == true)
+			{
+				__m128 positionX = Interpolate(b0, b1, b2, attributes[0][0], attributes[1][0], attributes[2][0]);
+				__m128 positionY = Interpolate(b0, b1, b2, attributes[0][1], attributes[1][1], attributes[2][1]);
+				__m128 positionZ = Interpolate(b0, b1, b2, attributes[0][2], attributes[1][2], attributes[2][2]);
+				__m128 normalX = Interpolate(b0, b1, b2, attributes[0][3], attributes[1][3], attributes[2][3]);
+				__m128 normalY = Interpolate(b0, b1, b2, attributes[0][4], attributes[1][4], attributes[2][4]);
+				__m128 normalZ = Interpolate(b0, b1, b2, attributes[0][5], attributes[1][5], attributes[2][5]);
+				Normalize3(normalX, normalY, normalZ);
+
+				__m128 viewX = _mm_sub_ps(_mm_set1_ps(m_viewPosition.x), positionX);
+				__m128 viewY = _mm_sub_ps(_mm_set1_ps(m_viewPosition.y), positionY);
+				__m128 viewZ = _mm_sub_ps(_mm_set1_ps(m_viewPosition.z), positionZ);
+				Normalize3(viewX, viewY, viewZ);
+
+				__m128 phongRed = zero;
+				__m128 phongGreen = zero;
+				__m128 phongBlue = zero;
+				for (size_t l = 0; l < m_lights.size(); l++)
+				{
+					const LightClusterManager::LIGHT_SOURCE& light = m_lights[l];
+					glm::vec3 ambient = glm::vec3(light.ambientColor) * draw.material.ambientColor * draw.material.ambientStrength;
+					glm::vec3 diffuse = glm::vec3(light.diffuseColor) * draw.material.diffuseColor;
+					glm::vec3 specular = light.specularColor.w * light.diffuseColor.w *
+						glm::vec3(light.specularColor) * draw.material.specularColor;
+
+					__m128 offsetX = _mm_sub_ps(_mm_set1_ps(light.positionRadius.x), positionX);
+					__m128 offsetY = _mm_sub_ps(_mm_set1_ps(light.positionRadius.y), positionY);
+					__m128 offsetZ = _mm_sub_ps(_mm_set1_ps(light.positionRadius.z), positionZ);
+					__m128 distance = _mm_sqrt_ps(Dot3(offsetX, offsetY, offsetZ, offsetX, offsetY, offsetZ));
+
+					// smooth falloff that reaches zero at the range
+					__m128 ratio = _mm_div_ps(distance, _mm_set1_ps(light.positionRadius.w));
+					ratio = _mm_mul_ps(ratio, ratio);
+					__m128 falloff = _mm_min_ps(_mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(ratio, ratio)), zero), one);
+					__m128 attenuation = _mm_mul_ps(falloff, falloff);
+
+					__m128 inverseDistance = _mm_div_ps(one, _mm_max_ps(distance, _mm_set1_ps(0.0001f)));
+					__m128 lightX = _mm_mul_ps(offsetX, inverseDistance);
+					__m128 lightY = _mm_mul_ps(offsetY, inverseDistance);
+					__m128 lightZ = _mm_mul_ps(offsetZ, inverseDistance);
+					__m128 normalDotLight = Dot3(normalX, normalY, normalZ, lightX, lightY, lightZ);
+					__m128 impact = _mm_max_ps(normalDotLight, zero);
+
+					// reflect(-light, normal)
+					__m128 twiceDot = _mm_add_ps(normalDotLight, normalDotLight);
+					__m128 reflectX = _mm_sub_ps(_mm_mul_ps(twiceDot, normalX), lightX);
+					__m128 reflectY = _mm_sub_ps(_mm_mul_ps(twiceDot, normalY), lightY);
+					__m128 reflectZ = _mm_sub_ps(_mm_mul_ps(twiceDot, normalZ), lightZ);
+					_mm_storeu_ps(laneSpecular, _mm_max_ps(Dot3(viewX, viewY, viewZ, reflectX, reflectY, reflectZ), zero));
+					for (int lane = 0; lane < g_QuadWidth; lane++)
+					{
+						laneSpecular[lane] = std::pow(laneSpecular[lane], shininess);
+					}
+					__m128 specularComponent = _mm_loadu_ps(laneSpecular);
+
+					phongRed = _mm_add_ps(phongRed, _mm_mul_ps(attenuation, _mm_add_ps(_mm_set1_ps(ambient.r),
+						_mm_add_ps(_mm_mul_ps(impact, _mm_set1_ps(diffuse.r)), _mm_mul_ps(specularComponent, _mm_set1_ps(specular.r))))));
+					phongGreen = _mm_add_ps(phongGreen, _mm_mul_ps(attenuation, _mm_add_ps(_mm_set1_ps(ambient.g),
+						_mm_add_ps(_mm_mul_ps(impact, _mm_set1_ps(diffuse.g)), _mm_mul_ps(specularComponent, _mm_set1_ps(specular.g))))));
+					phongBlue = _mm_add_ps(phongBlue, _mm_mul_ps(attenuation, _mm_add_ps(_mm_set1_ps(ambient.b),
+						_mm_add_ps(_mm_mul_ps(impact, _mm_set1_ps(diffuse.b)), _mm_mul_ps(specularComponent, _mm_set1_ps(specular.b))))));
+				}
+
+				red = _mm_mul_ps(red, phongRed);
+				green = _mm_mul_ps(green, phongGreen);
+				blue = _mm_mul_ps(blue, phongBlue);
+			}
+
+			unsigned int* pColor = &m_colorBuffer[row + x];
+			__m128i stored = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pColor));
+			if (draw.bTranslucent == true)
+			{
+				// source alpha, one minus source alpha
+				__m128 inverseAlpha = _mm_sub_ps(one, _mm_min_ps(_mm_max_ps(alpha, zero), one));
+				__m128 sourceAlpha = _mm_sub_ps(one, inverseAlpha);
+				red = _mm_add_ps(_mm_mul_ps(red, sourceAlpha), _mm_mul_ps(FromByte(stored, 0), inverseAlpha));
+				green = _mm_add_ps(_mm_mul_ps(green, sourceAlpha), _mm_mul_ps(FromByte(stored, 8), inverseAlpha));
+				blue = _mm_add_ps(_mm_mul_ps(blue, sourceAlpha), _mm_mul_ps(FromByte(stored, 16), inverseAlpha));
+				alpha = _mm_add_ps(_mm_mul_ps(alpha, sourceAlpha), _mm_mul_ps(FromByte(stored, 24), inverseAlpha));
+			}
+
+			__m128i packed = _mm_or_si128(
+				_mm_or_si128(ToByte(red), _mm_slli_epi32(ToByte(green), 8)),
+				_mm_or_si128(_mm_slli_epi32(ToByte(blue), 16), _mm_slli_epi32(ToByte(alpha), 24)));
+			__m128i mask = _mm_castps_si128(covered);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pColor),
+				_mm_or_si128(_mm_and_si128(mask, packed), _mm_andnot_si128(mask, stored)));
+		}
+	}
+}
+
+/***********************************************************
+ *  SampleTexture()
+ *
+ *  This method is used for sampling a texture like the GL
+ *  textures are set up, bilinear with repeat wrapping.
+ ***********************************************************/
+void SoftwareRasterizer::SampleTexture(const TEXTURE& texture, float u, float v, float* rgba) const
+{
+	if (!(std::fabs(u) < 1.0e6f) || !(std::fabs(v) < 1.0e6f))
+	{
+		u = 0.0f;
+		v = 0.0f;
+	}
+
+	float x = ((u - std::floor(u)) * texture.width) - 0.5f;
+	float y = ((v - std::floor(v)) * texture.height) - 0.5f;
+	float floorX = std::floor(x);
+	float floorY = std::floor(y);
+	float blendX = x - floorX;
+	float blendY = y - floorY;
+
+	int x0 = ((int)floorX + texture.width) % texture.width;
+	int y0 = ((int)floorY + texture.height) % texture.height;
+	int x1 = (x0 + 1) % texture.width;
+	int y1 = (y0 + 1) % texture.height;
+
+	unsigned int texels[4] =
+	{
+		texture.texels[(size_t)y0 * texture.width + x0],
+		texture.texels[(size_t)y0 * texture.width + x1],
+		texture.texels[(size_t)y1 * texture.width + x0],
+		texture.texels[(size_t)y1 * texture.width + x1]
+	};
+	float weights[4] =
+	{
+		(1.0f - blendX) * (1.0f - blendY),
+		blendX * (1.0f - blendY),
+		(1.0f - blendX) * blendY,
+		blendX * blendY
+	};
+
+	for (int channel = 0; channel < 4; channel++)
+	{
+		float value = 0.0f;
+		for (int i = 0; i < 4; i++)
+		{
+			value += weights[i] * (float)((texels[i] >> (channel * 8)) & 0xFF);
+		}
+		rgba[channel] = value * (1.0f / 255.0f);
+	}
+}
+
+/***********************************************************
+ *  WriteImage()
+ *
+ *  This method is used for writing the rendered image into
+ *  a binary PPM file.
+ ***********************************************************/
+bool SoftwareRasterizer::WriteImage(const char* filename) const
+{
+	if (m_colorBuffer.empty() == true)
+	{
+		return(false);
+	}
+
+	std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Could not write software image:" << filename << std::endl;
+		return(false);
+	}
+
+	char header[64];
+	snprintf(header, sizeof(header), "P6\n%d %d\n255\n", m_width, m_height);
+	file << header;
+
+	std::vector<unsigned char> row((size_t)m_width * 3);
+	for (int y = 0; y < m_height; y++)
+	{
+		const unsigned int* pixels = &m_colorBuffer[(size_t)y * m_stride];
+		for (int x = 0; x < m_width; x++)
+		{
+			row[x * 3] = (unsigned char)(pixels[x] & 0xFF);
+			row[x * 3 + 1] = (unsigned char)((pixels[x] >> 8) & 0xFF);
+			row[x * 3 + 2] = (unsigned char)((pixels[x] >> 16) & 0xFF);
+		}
+		file.write(reinterpret_cast<const char*>(&row[0]), row.size());
+	}
+
+	file.close();
+	return(!file.fail());
+}
@@ -0,0 +1,218 @@
+///////////////////////////////////////////////////////////////////////////////
+// softwarerasterizer.h
+// ============
+// draw the scene on the CPU for machines without a GPU
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "MeshLibrary.h"
+#include "LightClusters.h"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/***********************************************************
+ *  SoftwareRasterizer
+ *
+ *  This class is used for rendering the recorded scene draws
+ *  without a GL context. It follows the GL path: the same
+ *  matrices, the Phong model of the fragment shader with
+ *  every light in range, bilinear repeat texture sampling,
+ *  a less or equal depth test and alpha blending of the
+ *  translucent draws.
+ *
+ *  A frame runs in three stages shared by the calling thread
+ *  and the workers. The vertices of each draw are
+ *  transformed, the triangles are clipped against the near
+ *  plane and binned into screen tiles, and then each tile
+ *  is cleared and rasterized by one thread. Each thread
+ *  bins a contiguous range of triangles and a tile walks
+ *  the bins in thread order, so draws land in the order
+ *  they were added. The edge functions, depth test,
+ *  interpolation and lighting run on four pixels at a time
+ *  with SSE.
+ ***********************************************************/
+class SoftwareRasterizer
+{
+public:
+	// width and height of a screen tile in pixels
+	static const int TILE_SIZE = 32;
+	// number of floats interpolated across a triangle, the
+	// world position, the normal and the texture coordinate
+	static const int ATTRIBUTE_COUNT = 8;
+
+	// lighting settings of a draw, like OBJECT_MATERIAL
+	struct SURFACE_MATERIAL
+	{
+		glm::vec3 ambientColor;
+		float ambientStrength;
+		glm::vec3 diffuseColor;
+		glm::vec3 specularColor;
+		float shininess;
+	};
+
+	// everything needed to draw one mesh
+	struct DRAW
+	{
+		const MeshLibrary::MESH_GEOMETRY* pGeometry;
+		glm::mat4 model;
+		glm::vec4 color;			// used when untextured
+		glm::vec2 uvScale;
+		int texture;				// -1 when untextured
+		bool bLighting;
+		SURFACE_MATERIAL material;
+		bool bTranslucent;			// blended, no depth writes
+	};
+
+	// constructor, 0 threads uses every core
+	SoftwareRasterizer(int threadCount);
+	// destructor
+	~SoftwareRasterizer();
+
+private:
+	// stages of a frame run by every thread
+	enum FRAME_STAGE
+	{
+		STAGE_VERTICES,
+		STAGE_TRIANGLES,
+		STAGE_TILES
+	};
+
+	// decoded texture, rows start at the bottom like in GL
+	struct TEXTURE
+	{
+		int width;
+		int height;
+		std::vector<unsigned int> texels;	// RGBA8
+	};
+
+	// transformed vertex of a draw
+	struct CLIP_VERTEX
+	{
+		glm::vec4 clipPosition;
+		float attributes[ATTRIBUTE_COUNT];
+	};
+
+	// triangle ready for rasterizing, the edge functions are
+	// scaled so they give the barycentric weight of each
+	// vertex at a pixel center
+	struct SETUP_TRIANGLE
+	{
+		float edgeX[3];
+		float edgeY[3];
+		float edgeOffset[3];
+		// edges that own the pixels lying exactly on them
+		bool bTopLeft[3];
+		float depth[3];
+		float inverseW[3];
+		// attributes divided by w for perspective correction
+		float attributes[3][ATTRIBUTE_COUNT];
+		int minX;
+		int minY;
+		int maxX;
+		int maxY;
+		int draw;
+	};
+
+	// size of the image and the padded buffers
+	int m_width;
+	int m_height;
+	int m_stride;
+	int m_tilesX;
+	int m_tilesY;
+	std::vector<unsigned int> m_colorBuffer;	// RGBA8, top row first
+	std::vector<float> m_depthBuffer;
+	glm::vec4 m_clearColor;
+
+	// loaded textures, indexed by the draws
+	std::vector<TEXTURE> m_textures;
+
+	// view and lights of the frame being recorded
+	glm::mat4 m_viewProjection;
+	glm::vec3 m_viewPosition;
+	std::vector<LightClusterManager::LIGHT_SOURCE> m_lights;
+
+	// draws of the frame and where their data starts
+	std::vector<DRAW> m_draws;
+	std::vector<int> m_vertexOffsets;
+	std::vector<int> m_triangleOffsets;
+	int m_totalTriangles;
+	std::vector<CLIP_VERTEX> m_vertices;
+
+	// set up triangles and tile bins, one of each per thread
+	std::vector<std::vector<SETUP_TRIANGLE> > m_triangles;
+	std::vector<std::vector<int> > m_bins;
+
+	// worker threads and the stage they share
+	std::vector<std::thread> m_workers;
+	std::mutex m_workMutex;
+	std::condition_variable m_workReady;
+	std::condition_variable m_workDone;
+	unsigned int m_workGeneration;
+	int m_pendingWorkers;
+	FRAME_STAGE m_stage;
+	bool m_bShutdown;
+	// next draw or tile taken by a thread in a stage
+	std::atomic<int> m_nextJob;
+
+	// disable copying, the rasterizer owns its threads
+	SoftwareRasterizer(const SoftwareRasterizer&);
+	SoftwareRasterizer& operator=(const SoftwareRasterizer&);
+
+	// wait for stages and run the worker's share
+	void WorkerMain(int workerIndex);
+	// run a stage on every thread and wait for all of them
+	void RunStage(FRAME_STAGE stage);
+	// run one thread's share of the current stage
+	void RunShare(int thread);
+
+	// transform the vertices of one draw
+	void TransformDraw(int draw);
+	// clip, set up and bin a range of triangles
+	void SetupTriangles(int thread, int begin, int end);
+	// set up and bin a triangle that is in front of the camera
+	void AddTriangle(int thread, int draw, const CLIP_VERTEX& v0, const CLIP_VERTEX& v1, const CLIP_VERTEX& v2);
+	// clear and draw every binned triangle of one tile
+	void RasterizeTile(int tile);
+	// draw the part of a triangle inside a tile
+	void RasterizeTriangle(const SETUP_TRIANGLE& triangle, int tileX0, int tileY0, int tileX1, int tileY1);
+	// sample a texture with bilinear filtering and repeat
+	void SampleTexture(const TEXTURE& texture, float u, float v, float* rgba) const;
+
+public:
+	// set the size of the image, false when it is empty
+	bool Resize(int width, int height);
+	// decode an image file into a texture, returns its index
+	// or -1 when it could not be loaded
+	int LoadTexture(const char* filename, bool& bHasAlpha);
+
+	// start recording the draws of a frame
+	void BeginFrame(
+		const glm::mat4& view,
+		const glm::mat4& projection,
+		const glm::vec3& viewPosition,
+		const std::vector<LightClusterManager::LIGHT_SOURCE>& lights);
+	// record a draw, in the order it should be drawn
+	void AddDraw(const DRAW& draw);
+	// draw the recorded draws into the image
+	void EndFrame();
+
+	// get the rendered image, RGBA8 rows of GetStride pixels
+	// with the top row first
+	const unsigned int* GetPixels() const { return m_colorBuffer.empty() ? NULL : &m_colorBuffer[0]; }
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+	int GetStride() const { return m_stride; }
+	// get the number of threads sharing each frame
+	int GetThreadCount() const { return (int)m_workers.size() + 1; }
+	// write the rendered image into a PPM file
+	bool WriteImage(const char* filename) const;
+};
@@ -0,0 +1,384 @@
+///////////////////////////////////////////////////////////////////////////////
+// startupgraph.cpp
+// ============
+// run the startup work as a dependency graph on workers and the GL thread
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "StartupGraph.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+// declaration of global variables
+namespace
+{
+	// width of the bars drawn in the timeline
+	const int g_TimelineColumns = 40;
+	// how long the context thread sleeps when every ready
+	// context task is waiting on the driver
+	const int g_PollIntervalMilliseconds = 1;
+}
+
+// out of class definitions for the integral constants
+const int StartupGraph::INVALID_ID;
+
+/***********************************************************
+ *  StartupGraph()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+StartupGraph::StartupGraph(int workerCount)
+{
+	// the context thread has its own work, so one core is
+	// left out of the worker count
+	if (workerCount <= 0)
+	{
+		workerCount = std::max((int)std::thread::hardware_concurrency() - 1, 1);
+	}
+	m_workerCount = workerCount;
+	m_unfinishedTasks = 0;
+	m_bFailed = false;
+}
+
+/***********************************************************
+ *  ~StartupGraph()
+ *
+ *  The destructor for the class - the workers are already
+ *  joined when Run() returns
+ ***********************************************************/
+StartupGraph::~StartupGraph()
+{
+}
+
+/***********************************************************
+ *  IsValidTask()
+ *
+ *  This method is used for checking a task index.
+ ***********************************************************/
+bool StartupGraph::IsValidTask(int task) const
+{
+	return((task >= 0) && (task < (int)m_tasks.size()));
+}
+
+/***********************************************************
+ *  GetElapsedTime()
+ *
+ *  This method is used for getting the milliseconds since
+ *  the graph started running.
+ ***********************************************************/
+double StartupGraph::GetElapsedTime() const
+{
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - m_startTime;
+	return(elapsed.count());
+}
+
+/***********************************************************
+ *  AddTask()
+ *
+ *  This method is used for adding a task to the graph. It
+ *  starts once every task it depends on has finished.
+ ***********************************************************/
+int StartupGraph::AddTask(
+	const std::string& name,
+	TASK_THREAD thread,
+	const std::function<TASK_RESULT()>& work)
+{
+	if (!work)
+	{
+		std::cout << "Startup task has no work:" << name << std::endl;
+		return(INVALID_ID);
+	}
+
+	TASK task;
+	task.name = name;
+	task.thread = thread;
+	task.work = work;
+	task.remainingInputs = 0;
+	task.state = STATE_WAITING;
+	task.startTime = -1.0;
+	task.endTime = -1.0;
+	task.threadIndex = -1;
+	task.pollCount = 0;
+	m_tasks.push_back(task);
+
+	return((int)m_tasks.size() - 1);
+}
+
+/***********************************************************
+ *  AddDependency()
+ *
+ *  This method is used for making a task wait until another
+ *  task has finished. Only tasks added earlier can be
+ *  depended on, which keeps the graph free of cycles.
+ ***********************************************************/
+bool StartupGraph::AddDependency(int task, int dependsOn)
+{
+	if ((IsValidTask(task) == false) || (IsValidTask(dependsOn) == false) || (dependsOn >= task))
+	{
+		std::cout << "Invalid startup task dependency:" << task << " on " << dependsOn << std::endl;
+		return(false);
+	}
+
+	m_tasks[dependsOn].dependents.push_back(task);
+	m_tasks[task].remainingInputs++;
+
+	return(true);
+}
+
+/***********************************************************
+ *  QueueTask()
+ *
+ *  This method is used for handing a task whose inputs are
+ *  all finished to the thread it runs on.
+ ***********************************************************/
+void StartupGraph::QueueTask(int task)
+{
+	m_tasks[task].state = STATE_READY;
+	if (m_tasks[task].thread == THREAD_CONTEXT)
+	{
+		m_contextQueue.push_back(task);
+	}
+	else
+	{
+		m_workerQueue.push_back(task);
+	}
+}
+
+/***********************************************************
+ *  CompleteTask()
+ *
+ *  This method is used for recording the result of a task
+ *  and queueing the dependents that have no inputs left.
+ *  A failed task stops the graph from starting anything.
+ ***********************************************************/
+void StartupGraph::CompleteTask(int task, TASK_RESULT result)
+{
+	TASK& finished = m_tasks[task];
+	finished.endTime = GetElapsedTime();
+	m_unfinishedTasks--;
+
+	if (result == TASK_FAILED)
+	{
+		std::cout << "Startup task failed:" << finished.name << std::endl;
+		finished.state = STATE_FAILED;
+		m_bFailed = true;
+	}
+	else
+	{
+		finished.state = STATE_FINISHED;
+		for (size_t i = 0; i < finished.dependents.size(); i++)
+		{
+			int dependent = finished.dependents[i];
+			m_tasks[dependent].remainingInputs--;
+			if (m_tasks[dependent].remainingInputs == 0)
+			{
+				QueueTask(dependent);
+			}
+		}
+	}
+
+	m_condition.notify_all();
+}
+
+/***********************************************************
+ *  WorkerThread()
+ *
+ *  This method is used by each worker for running the CPU
+ *  tasks until the graph is finished or has failed.
+ ***********************************************************/
+void StartupGraph::WorkerThread(int threadIndex)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (true)
+	{
+		while ((m_workerQueue.empty() == true) && (m_unfinishedTasks > 0) && (m_bFailed == false))
+		{
+			m_condition.wait(lock);
+		}
+		if ((m_bFailed == true) || (m_workerQueue.empty() == true))
+		{
+			break;
+		}
+
+		int task = m_workerQueue.front();
+		m_workerQueue.pop_front();
+		TASK& running = m_tasks[task];
+		running.state = STATE_RUNNING;
+		running.threadIndex = threadIndex;
+		if (running.startTime < 0.0)
+		{
+			running.startTime = GetElapsedTime();
+		}
+
+		lock.unlock();
+		TASK_RESULT result = running.work();
+		lock.lock();
+
+		// a worker task has nothing to wait for, but one that
+		// asks to be called again just goes to the back
+		if (result == TASK_PENDING)
+		{
+			running.pollCount++;
+			QueueTask(task);
+			continue;
+		}
+		CompleteTask(task, result);
+	}
+}
+
+/***********************************************************
+ *  Run()
+ *
+ *  This method is used for running the graph. The workers
+ *  start on the tasks without inputs right away, while the
+ *  calling thread runs the context tasks as they become
+ *  ready. Returns once every task has finished, or as soon
+ *  as the running tasks are done after one has failed.
+ ***********************************************************/
+bool StartupGraph::Run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	m_startTime = std::chrono::steady_clock::now();
+	m_unfinishedTasks = (int)m_tasks.size();
+	m_bFailed = false;
+	m_workerQueue.clear();
+	m_contextQueue.clear();
+	for (size_t i = 0; i < m_tasks.size(); i++)
+	{
+		if (m_tasks[i].remainingInputs == 0)
+		{
+			QueueTask((int)i);
+		}
+	}
+
+	std::vector<std::thread> workers;
+	for (int i = 0; i < m_workerCount; i++)
+	{
+		workers.push_back(std::thread(&StartupGraph::WorkerThread, this, i + 1));
+	}
+
+	while ((m_unfinishedTasks > 0) && (m_bFailed == false))
+	{
+		if (m_contextQueue.empty() == true)
+		{
+			m_condition.wait(lock);
+			continue;
+		}
+
+		int task = m_contextQueue.front();
+		m_contextQueue.pop_front();
+		TASK& running = m_tasks[task];
+		running.state = STATE_RUNNING;
+		running.threadIndex = 0;
+		if (running.startTime < 0.0)
+		{
+			running.startTime = GetElapsedTime();
+		}
+
+		lock.unlock();
+		TASK_RESULT result = running.work();
+		lock.lock();
+
+		if (result != TASK_PENDING)
+		{
+			CompleteTask(task, result);
+			continue;
+		}
+
+		// poll the task again after the other ready context
+		// tasks, and sleep until a worker finishes something
+		// when nothing but polling is left
+		running.pollCount++;
+		QueueTask(task);
+
+		bool bOnlyPolling = true;
+		for (size_t i = 0; (i < m_contextQueue.size()) && (bOnlyPolling == true); i++)
+		{
+			bOnlyPolling = (m_tasks[m_contextQueue[i]].pollCount > 0);
+		}
+		if (bOnlyPolling == true)
+		{
+			m_condition.wait_for(lock, std::chrono::milliseconds(g_PollIntervalMilliseconds));
+		}
+	}
+
+	lock.unlock();
+	m_condition.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+
+	return(m_bFailed == false);
+}
+
+/***********************************************************
+ *  WriteTimeline()
+ *
+ *  This method is used for writing when each task ran, on
+ *  which thread and how often it was polled, in the order
+ *  the tasks started, with a bar over the whole startup.
+ ***********************************************************/
+void StartupGraph::WriteTimeline(std::ostream& output) const
+{
+	double totalTime = 0.0;
+	std::vector<int> order;
+	for (size_t i = 0; i < m_tasks.size(); i++)
+	{
+		order.push_back((int)i);
+		totalTime = std::max(totalTime, m_tasks[i].endTime);
+	}
+	// tasks that never ran go last
+	std::stable_sort(order.begin(), order.end(), [this](int a, int b)
+	{
+		double startA = m_tasks[a].startTime;
+		double startB = m_tasks[b].startTime;
+		return((startB < 0.0) ? (startA >= 0.0) : ((startA >= 0.0) && (startA < startB)));
+	});
+
+	output << "Startup timeline: " << m_tasks.size() << " tasks in "
+		<< std::fixed << std::setprecision(1) << totalTime << " ms on the context thread and "
+		<< m_workerCount << " workers" << std::endl;
+
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const TASK& task = m_tasks[order[i]];
+
+		if ((task.state != STATE_FINISHED) && (task.state != STATE_FAILED))
+		{
+			output << "  " << std::setw(8) << "-" << std::setw(9) << "-" << "  "
+				<< std::setw(8) << "-" << "  " << task.name << " (not run)" << std::endl;
+			continue;
+		}
+
+		std::string bar(g_TimelineColumns, ' ');
+		if (totalTime > 0.0)
+		{
+			int first = (int)(task.startTime / totalTime * g_TimelineColumns);
+			int last = (int)(task.endTime / totalTime * g_TimelineColumns);
+			first = std::min(first, g_TimelineColumns - 1);
+			last = std::min(std::max(last, first + 1), g_TimelineColumns);
+			bar.replace(first, last - first, last - first, '#');
+		}
+
+		std::string thread = (task.threadIndex == 0) ? "context" : ("worker " + std::to_string(task.threadIndex));
+		output << "  " << std::setw(8) << task.startTime << std::setw(9) << task.endTime << "  "
+			<< std::setw(8) << thread << "  |" << bar << "|  " << task.name;
+		if (task.pollCount > 0)
+		{
+			output << " (polled " << task.pollCount << " times)";
+		}
+		if (task.state == STATE_FAILED)
+		{
+			output << " FAILED";
+		}
+		output << std::endl;
+	}
+
+	output << std::defaultfloat << std::setprecision(6);
+}
@@ -0,0 +1,139 @@
+///////////////////////////////////////////////////////////////////////////////
+// startupgraph.h
+// ============
+// run the startup work as a dependency graph on workers and the GL thread
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/***********************************************************
+ *  StartupGraph
+ *
+ *  This class is used for running the loading work of the
+ *  application as soon as its inputs are ready, instead of
+ *  one step after the other. Each task declares the tasks
+ *  it depends on and the thread it needs.
+ *
+ *  Worker tasks are CPU only, like decoding images or
+ *  building meshes, and run on a pool of threads that is
+ *  started with the graph, so they can begin before the
+ *  window even exists. Context tasks touch GL and run on
+ *  the thread that calls Run(), which creates and owns the
+ *  context. A context task may return TASK_PENDING while it
+ *  waits for the driver, and is then polled again after
+ *  the other ready context tasks had their turn.
+ *
+ *  A task can only depend on tasks added before it, so the
+ *  graph can never contain a cycle. The start and end of
+ *  every task are recorded for the startup timeline.
+ ***********************************************************/
+class StartupGraph
+{
+public:
+	// thread a task has to run on
+	enum TASK_THREAD
+	{
+		THREAD_WORKER,
+		THREAD_CONTEXT
+	};
+
+	// outcome of one call of a task function
+	enum TASK_RESULT
+	{
+		TASK_DONE,
+		TASK_PENDING,		// context tasks only, call again later
+		TASK_FAILED
+	};
+
+	// returned when a task could not be added
+	static const int INVALID_ID = -1;
+
+	// constructor, 0 workers uses every core but one
+	StartupGraph(int workerCount);
+	// destructor
+	~StartupGraph();
+
+private:
+	// progress of a task
+	enum TASK_STATE
+	{
+		STATE_WAITING,		// inputs are not ready yet
+		STATE_READY,		// queued for its thread
+		STATE_RUNNING,
+		STATE_FINISHED,
+		STATE_FAILED
+	};
+
+	// a task and its place in the graph
+	struct TASK
+	{
+		std::string name;
+		TASK_THREAD thread;
+		std::function<TASK_RESULT()> work;
+		std::vector<int> dependents;
+		int remainingInputs;
+		TASK_STATE state;
+		// milliseconds since Run() started, -1 until known
+		double startTime;
+		double endTime;
+		// 0 for the context thread, workers count from 1
+		int threadIndex;
+		int pollCount;
+	};
+
+	std::vector<TASK> m_tasks;
+	int m_workerCount;
+
+	// shared with the workers while the graph runs
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::deque<int> m_workerQueue;
+	std::deque<int> m_contextQueue;
+	int m_unfinishedTasks;
+	bool m_bFailed;
+	std::chrono::steady_clock::time_point m_startTime;
+
+	// disable copying, the graph owns its threads while running
+	StartupGraph(const StartupGraph&);
+	StartupGraph& operator=(const StartupGraph&);
+
+	// check a task index passed by the caller
+	bool IsValidTask(int task) const;
+	// get the milliseconds since Run() started
+	double GetElapsedTime() const;
+	// queue a task whose inputs are all finished, the lock
+	// must be held
+	void QueueTask(int task);
+	// record the result of a task and queue the dependents
+	// that became ready, the lock must be held
+	void CompleteTask(int task, TASK_RESULT result);
+	// take and run worker tasks until the graph is done
+	void WorkerThread(int threadIndex);
+
+public:
+	// add a task, returns its index
+	int AddTask(
+		const std::string& name,
+		TASK_THREAD thread,
+		const std::function<TASK_RESULT()>& work);
+	// make a task wait for another task added before it
+	bool AddDependency(int task, int dependsOn);
+
+	// run every task, the calling thread runs the context
+	// tasks - returns false when a task failed, after which
+	// no further task is started
+	bool Run();
+
+	// write when each task ran and on which thread
+	void WriteTimeline(std::ostream& output) const;
+};
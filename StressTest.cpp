@@ -0,0 +1,302 @@
+///////////////////////////////////////////////////////////////////////////////
+// stresstest.cpp
+// ============
+// sweep the scene through growing object counts and measure each size
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "StressTest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+// declaration of global variables
+namespace
+{
+	// frames rendered before measuring each step, covers the
+	// lazy mesh loads and the occlusion query history
+	const int g_WarmupFrames = 30;
+	// frames measured for each step
+	const int g_MeasuredFrames = 120;
+}
+
+// out of class definitions for the integral constants
+const int StressTest::QUERY_FRAMES;
+
+/***********************************************************
+ *  StressTest()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+StressTest::StressTest(SceneManager* pSceneManager, SceneManager::STRESS_LAYOUT layout)
+{
+	m_pSceneManager = pSceneManager;
+	m_layout = layout;
+	m_currentStep = 0;
+	m_stepFrame = 0;
+	m_cpuTotalMs = 0.0;
+	m_gpuTotalMs = 0.0;
+	m_gpuSamples = 0;
+	m_drawTotal = 0;
+	m_triangleTotal = 0;
+	m_queryFrame = 0;
+
+	glGenQueries(QUERY_FRAMES * 2, &m_timestampQueries[0][0]);
+	for (int i = 0; i < QUERY_FRAMES; i++)
+	{
+		m_bQueryIssued[i] = false;
+	}
+}
+
+/***********************************************************
+ *  ~StressTest()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+StressTest::~StressTest()
+{
+	glDeleteQueries(QUERY_FRAMES * 2, &m_timestampQueries[0][0]);
+	m_pSceneManager = NULL;
+}
+
+/***********************************************************
+ *  AddStep()
+ *
+ *  This method is used for adding an object count to the
+ *  sweep. Steps are measured in the order they are added.
+ ***********************************************************/
+void StressTest::AddStep(int objectCount)
+{
+	m_stepSizes.push_back(std::max(objectCount, 0));
+}
+
+/***********************************************************
+ *  CollectGpuTime()
+ *
+ *  This method is used for adding the GPU time between the
+ *  timestamp pair in the passed in slot to the totals. The
+ *  result is only read without waiting when it is ready.
+ ***********************************************************/
+void StressTest::CollectGpuTime(int slot, bool bWait)
+{
+	if (m_bQueryIssued[slot] == false)
+	{
+		return;
+	}
+
+	if (bWait == false)
+	{
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(m_timestampQueries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available == GL_FALSE)
+		{
+			return;
+		}
+	}
+
+	GLuint64 startTime = 0;
+	GLuint64 endTime = 0;
+	glGetQueryObjectui64v(m_timestampQueries[slot][0], GL_QUERY_RESULT, &startTime);
+	glGetQueryObjectui64v(m_timestampQueries[slot][1], GL_QUERY_RESULT, &endTime);
+	m_bQueryIssued[slot] = false;
+
+	if (endTime > startTime)
+	{
+		m_gpuTotalMs += (double)(endTime - startTime) / 1000000.0;
+	}
+	m_gpuSamples++;
+}
+
+/***********************************************************
+ *  RenderFrame()
+ *
+ *  This method is used for rendering the scene at the
+ *  object count of the current step, measuring the frame
+ *  once the step is warmed up.
+ ***********************************************************/
+void StressTest::RenderFrame()
+{
+	if (IsFinished() == true)
+	{
+		m_pSceneManager->RenderScene();
+		return;
+	}
+
+	if (m_stepFrame == 0)
+	{
+		m_pSceneManager->SetStressObjects(m_stepSizes[m_currentStep], m_layout);
+	}
+
+	if (m_stepFrame < g_WarmupFrames)
+	{
+		m_pSceneManager->RenderScene();
+		m_stepFrame++;
+		return;
+	}
+
+	// read back older frames as they finish, only the slot
+	// about to be reused has to be waited on
+	for (int i = 0; i < QUERY_FRAMES; i++)
+	{
+		CollectGpuTime(i, false);
+	}
+	int slot = m_queryFrame % QUERY_FRAMES;
+	CollectGpuTime(slot, true);
+
+	glQueryCounter(m_timestampQueries[slot][0], GL_TIMESTAMP);
+	std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+
+	m_pSceneManager->RenderScene();
+
+	std::chrono::high_resolution_clock::time_point endTime = std::chrono::high_resolution_clock::now();
+	glQueryCounter(m_timestampQueries[slot][1], GL_TIMESTAMP);
+	m_bQueryIssued[slot] = true;
+	m_queryFrame++;
+
+	SceneManager::RENDER_STATS stats = m_pSceneManager->GetRenderStats();
+	m_cpuTotalMs += std::chrono::duration<double, std::milli>(endTime - startTime).count();
+	m_drawTotal += stats.draws;
+	m_triangleTotal += stats.triangles;
+
+	m_stepFrame++;
+	if (m_stepFrame >= g_WarmupFrames + g_MeasuredFrames)
+	{
+		FinishStep();
+	}
+}
+
+/***********************************************************
+ *  FinishStep()
+ *
+ *  This method is used for waiting on the outstanding GPU
+ *  times of the step, storing its results and resetting
+ *  the totals for the next step.
+ ***********************************************************/
+void StressTest::FinishStep()
+{
+	for (int i = 0; i < QUERY_FRAMES; i++)
+	{
+		CollectGpuTime(i, true);
+	}
+
+	STEP_RESULT result;
+	result.objects = m_stepSizes[m_currentStep];
+	result.frames = g_MeasuredFrames;
+	result.cpuSubmitMs = m_cpuTotalMs / g_MeasuredFrames;
+	result.gpuMs = (m_gpuSamples > 0) ? (m_gpuTotalMs / m_gpuSamples) : 0.0;
+	result.drawsPerFrame = (double)m_drawTotal / g_MeasuredFrames;
+	result.trianglesPerFrame = (double)m_triangleTotal / g_MeasuredFrames;
+
+	// the throughput is limited by whichever side is slower
+	double frameSeconds = std::max(result.cpuSubmitMs, result.gpuMs) / 1000.0;
+	result.drawsPerSecond = (frameSeconds > 0.0) ? (result.drawsPerFrame / frameSeconds) : 0.0;
+	result.trianglesPerSecond = (frameSeconds > 0.0) ? (result.trianglesPerFrame / frameSeconds) : 0.0;
+	m_results.push_back(result);
+
+	std::cout << "Stress test " << result.objects << " objects: CPU " << result.cpuSubmitMs
+		<< " ms, GPU " << result.gpuMs << " ms, " << result.drawsPerFrame << " draws" << std::endl;
+
+	m_cpuTotalMs = 0.0;
+	m_gpuTotalMs = 0.0;
+	m_gpuSamples = 0;
+	m_drawTotal = 0;
+	m_triangleTotal = 0;
+	m_stepFrame = 0;
+	m_currentStep++;
+
+	// the last step leaves the scene as it was
+	if (IsFinished() == true)
+	{
+		m_pSceneManager->SetStressObjects(0, m_layout);
+	}
+}
+
+/***********************************************************
+ *  WriteReport()
+ *
+ *  This method is used for writing the results as a table.
+ ***********************************************************/
+void StressTest::WriteReport(std::ostream& output) const
+{
+	output << "Stress test results" << std::endl;
+	output << std::setw(10) << "objects"
+		<< std::setw(12) << "cpu ms"
+		<< std::setw(12) << "gpu ms"
+		<< std::setw(14) << "draws/frame"
+		<< std::setw(16) << "draws/s"
+		<< std::setw(16) << "tris/s" << std::endl;
+
+	std::ios::fmtflags flags = output.flags();
+	std::streamsize precision = output.precision();
+	output << std::fixed;
+	for (size_t i = 0; i < m_results.size(); i++)
+	{
+		const STEP_RESULT& result = m_results[i];
+		output << std::setw(10) << result.objects
+			<< std::setprecision(3)
+			<< std::setw(12) << result.cpuSubmitMs
+			<< std::setw(12) << result.gpuMs
+			<< std::setprecision(0)
+			<< std::setw(14) << result.drawsPerFrame
+			<< std::setw(16) << result.drawsPerSecond
+			<< std::setw(16) << result.trianglesPerSecond << std::endl;
+	}
+	output.flags(flags);
+	output.precision(precision);
+}
+
+/***********************************************************
+ *  WriteJSON()
+ *
+ *  This method is used for writing the results into a JSON
+ *  file, so runs before and after a change can be compared.
+ ***********************************************************/
+bool StressTest::WriteJSON(const char* filename) const
+{
+	std::string path = filename;
+	std::string tempPath = path + ".tmp";
+
+	std::ofstream file(tempPath.c_str(), std::ios::out | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Could not write stress test report:" << path << std::endl;
+		return(false);
+	}
+
+	file << "{\n";
+	file << "  \"layout\": \"" << ((m_layout == SceneManager::STRESS_GRID) ? "grid" : "random") << "\",\n";
+	file << "  \"steps\": [";
+	for (size_t i = 0; i < m_results.size(); i++)
+	{
+		const STEP_RESULT& result = m_results[i];
+		file << ((i == 0) ? "\n" : ",\n");
+		file << "    { \"objects\": " << result.objects
+			<< ", \"frames\": " << result.frames
+			<< ", \"cpuSubmitMs\": " << result.cpuSubmitMs
+			<< ", \"gpuMs\": " << result.gpuMs
+			<< ", \"drawsPerFrame\": " << result.drawsPerFrame
+			<< ", \"trianglesPerFrame\": " << result.trianglesPerFrame
+			<< ", \"drawsPerSecond\": " << result.drawsPerSecond
+			<< ", \"trianglesPerSecond\": " << result.trianglesPerSecond << " }";
+	}
+	file << (m_results.empty() ? "]\n" : "\n  ]\n");
+	file << "}\n";
+
+	file.close();
+	bool bWritten = !file.fail();
+
+	remove(path.c_str());
+	if ((bWritten == false) || (rename(tempPath.c_str(), path.c_str()) != 0))
+	{
+		remove(tempPath.c_str());
+		std::cout << "Could not write stress test report:" << path << std::endl;
+		return(false);
+	}
+
+	return(true);
+}
@@ -0,0 +1,93 @@
+///////////////////////////////////////////////////////////////////////////////
+// stresstest.h
+// ============
+// sweep the scene through growing object counts and measure each size
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "SceneManager.h"
+
+#include <GL/glew.h>
+
+#include <ostream>
+#include <vector>
+
+/***********************************************************
+ *  StressTest
+ *
+ *  This class is used for rendering the scene with a growing
+ *  number of generated prop copies. Each size is rendered
+ *  for a few warm up frames and then measured: the CPU time
+ *  spent recording and submitting the scene, the GPU time
+ *  between two timestamp queries around it, and the draws
+ *  and triangles submitted. Timestamps are used instead of
+ *  an elapsed time query, so the test can run while the
+ *  dynamic resolution timer query is active.
+ ***********************************************************/
+class StressTest
+{
+public:
+	// measurements of one object count
+	struct STEP_RESULT
+	{
+		int objects;
+		int frames;
+		double cpuSubmitMs;			// per frame
+		double gpuMs;				// per frame
+		double drawsPerFrame;
+		double trianglesPerFrame;
+		double drawsPerSecond;		// at the slower of CPU and GPU
+		double trianglesPerSecond;
+	};
+
+	// number of frames a timestamp pair can be in flight
+	static const int QUERY_FRAMES = 4;
+
+	// constructor
+	StressTest(SceneManager* pSceneManager, SceneManager::STRESS_LAYOUT layout);
+	// destructor
+	~StressTest();
+
+private:
+	// pointer to the scene being measured
+	SceneManager* m_pSceneManager;
+	SceneManager::STRESS_LAYOUT m_layout;
+
+	// object counts to sweep through and their results
+	std::vector<int> m_stepSizes;
+	std::vector<STEP_RESULT> m_results;
+	int m_currentStep;
+	int m_stepFrame;
+
+	// totals over the measured frames of the current step
+	double m_cpuTotalMs;
+	double m_gpuTotalMs;
+	int m_gpuSamples;
+	long long m_drawTotal;
+	long long m_triangleTotal;
+
+	// timestamps before and after the scene of recent frames
+	GLuint m_timestampQueries[QUERY_FRAMES][2];
+	bool m_bQueryIssued[QUERY_FRAMES];
+	int m_queryFrame;
+
+	// read the timestamp pair in the slot into the totals
+	void CollectGpuTime(int slot, bool bWait);
+	// store the results of the current step and move on
+	void FinishStep();
+
+public:
+	// add an object count to the sweep
+	void AddStep(int objectCount);
+	// render the scene for the current step of the sweep
+	void RenderFrame();
+	// true once every step has been measured
+	bool IsFinished() const { return m_currentStep >= (int)m_stepSizes.size(); }
+
+	// write the results as a table
+	void WriteReport(std::ostream& output) const;
+	// write the results into a JSON file
+	bool WriteJSON(const char* filename) const;
+};
@@ -14,37 +14,29 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/type_ptr.hpp>    
 
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
 // declaration of the global variables and defines
 namespace
 {
 	// Variables for window width and height
 	const int WINDOW_WIDTH = 1000;
 	const int WINDOW_HEIGHT = 800;
-	const char* g_ViewName = "view";
-	const char* g_ProjectionName = "projection";
-
-	// camera object used for viewing and interacting with
-	// the 3D scene
-	Camera* g_pCamera = nullptr;
-
-	// these variables are used for mouse movement processing
-	float gLastX = WINDOW_WIDTH / 2.0f;
-	float gLastY = WINDOW_HEIGHT / 2.0f;
-	bool gFirstMouse = true;
-
-	// time between current frame and last frame
-	float gDeltaTime = 0.0f; 
-	float gLastFrame = 0.0f;
-
-	// the following variable is false when orthographic projection
-	// is off and true when it is on
-	bool bOrthographicProjection = false;
-	bool perspectiveKeyPressed = false;
-	bool orthographicKeyPressed = false;
-	bool lastProjectionMode = false; // false = Perspective, true = Orthographic
-
-	// movement speed variable initialized
-	float movementSpeed = 2.5f;
+
+	// camera the perspective view starts from and returns to
+	const glm::vec3 g_DefaultCameraPosition = glm::vec3(0.0f, 5.0f, 12.0f);
+	const glm::vec3 g_DefaultCameraFront = glm::vec3(0.0f, -0.5f, -2.0f);
+	const glm::vec3 g_DefaultCameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
+	const float g_DefaultCameraZoom = 80.0f;
+	const float g_PerspectiveNear = 0.1f;
+	const float g_PerspectiveFar = 100.0f;
+
+	// movement speed the camera starts with
+	const float g_DefaultMovementSpeed = 2.5f;
+	// weight of the newest frame in the smoothed camera velocity
+	const float g_VelocitySmoothing = 0.25f;
 }
 
 /***********************************************************
@@ -52,18 +44,88 @@ namespace
  *
  *  The constructor for the class
  ***********************************************************/
-ViewManager::ViewManager(
-	ShaderManager *pShaderManager)
+ViewManager::ViewManager()
 {
 	// initialize the member variables
-	m_pShaderManager = pShaderManager;
 	m_pWindow = NULL;
-	g_pCamera = new Camera();
+	m_zNear = 0.1f;
+	m_zFar = 100.0f;
+	m_pCamera = new Camera();
 	// default camera view parameters
-	g_pCamera->Position = glm::vec3(0.0f, 5.0f, 12.0f);
-	g_pCamera->Front = glm::vec3(0.0f, -0.5f, -2.0f);
-	g_pCamera->Up = glm::vec3(0.0f, 1.0f, 0.0f);
-	g_pCamera->Zoom = 80;
+	m_pCamera->Position = g_DefaultCameraPosition;
+	m_pCamera->Front = g_DefaultCameraFront;
+	m_pCamera->Up = g_DefaultCameraUp;
+	m_pCamera->Zoom = g_DefaultCameraZoom;
+
+	// the input state belongs to this view, so several views
+	// with their own windows do not share a camera
+	m_lastMouseX = WINDOW_WIDTH / 2.0f;
+	m_lastMouseY = WINDOW_HEIGHT / 2.0f;
+	m_bFirstMouse = true;
+	m_deltaTime = 0.0f;
+	m_lastFrame = 0.0f;
+	m_bOrthographicProjection = false;
+	m_bPerspectiveKeyPressed = false;
+	m_bOrthographicKeyPressed = false;
+	m_bLastProjectionMode = false;
+	m_bCameraCut = false;
+	m_movementSpeed = g_DefaultMovementSpeed;
+	m_cameraVelocity = glm::vec3(0.0f);
+	m_lastCameraPosition = g_DefaultCameraPosition;
+}
+
+/***********************************************************
+ *  GetDefaultSceneView()
+ *
+ *  This method is used for getting the perspective view of
+ *  the starting camera, for rendering without a window.
+ ***********************************************************/
+void ViewManager::GetDefaultSceneView(
+	int width,
+	int height,
+	glm::mat4& view,
+	glm::mat4& projection,
+	float& zNear,
+	float& zFar)
+{
+	GetSceneView(
+		g_DefaultCameraPosition,
+		g_DefaultCameraPosition + g_DefaultCameraFront,
+		g_DefaultCameraZoom,
+		width,
+		height,
+		view,
+		projection,
+		zNear,
+		zFar);
+}
+
+/***********************************************************
+ *  GetSceneView()
+ *
+ *  This method is used for getting the perspective view of
+ *  a camera at the passed in position looking at the target,
+ *  for rendering without a window.
+ ***********************************************************/
+void ViewManager::GetSceneView(
+	const glm::vec3& position,
+	const glm::vec3& target,
+	float fieldOfView,
+	int width,
+	int height,
+	glm::mat4& view,
+	glm::mat4& projection,
+	float& zNear,
+	float& zFar)
+{
+	view = glm::lookAt(position, target, g_DefaultCameraUp);
+	projection = glm::perspective(
+		glm::radians(fieldOfView),
+		(float)width / (float)std::max(height, 1),
+		g_PerspectiveNear,
+		g_PerspectiveFar);
+	zNear = g_PerspectiveNear;
+	zFar = g_PerspectiveFar;
 }
 
 /***********************************************************
@@ -74,12 +136,11 @@ ViewManager::ViewManager(
 ViewManager::~ViewManager()
 {
 	// free up allocated memory
-	m_pShaderManager = NULL;
 	m_pWindow = NULL;
-	if (NULL != g_pCamera)
+	if (NULL != m_pCamera)
 	{
-		delete g_pCamera;
-		g_pCamera = NULL;
+		delete m_pCamera;
+		m_pCamera = NULL;
 	}
 }
 
@@ -106,6 +167,9 @@ GLFWwindow* ViewManager::CreateDisplayWindow(const char* windowTitle)
 	}
 	glfwMakeContextCurrent(window);
 
+	// the input callbacks find this view through the window
+	glfwSetWindowUserPointer(window, this);
+
 	// tell GLFW to capture all mouse events
 	//glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
@@ -115,10 +179,6 @@ GLFWwindow* ViewManager::CreateDisplayWindow(const char* windowTitle)
 	// callback for receiving mouse scroll events 
 	glfwSetScrollCallback(window, &ViewManager::Mouse_Scroll_Callback);
 
-	// enable blending for supporting tranparent rendering
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
 	m_pWindow = window;
 
 	return(window);
@@ -131,27 +191,42 @@ GLFWwindow* ViewManager::CreateDisplayWindow(const char* windowTitle)
  *  the mouse is moved within the active GLFW display window.
  ***********************************************************/
 void ViewManager::Mouse_Position_Callback(GLFWwindow* window, double xMousePos, double yMousePos)
+{
+	ViewManager* pViewManager = static_cast<ViewManager*>(glfwGetWindowUserPointer(window));
+	if (NULL != pViewManager)
+	{
+		pViewManager->ProcessMouseMovement(xMousePos, yMousePos);
+	}
+}
+
+/***********************************************************
+ *  ProcessMouseMovement()
+ *
+ *  This method is used for turning the camera of this view
+ *  by the mouse movement since the last event.
+ ***********************************************************/
+void ViewManager::ProcessMouseMovement(double xMousePos, double yMousePos)
 {
 	// when the first mouse move event is received, this needs to be recorded so that
 	// all subsequent mouse moves can correctly calculate the X position offset and Y
 	// position offset for proper operation
-	if (gFirstMouse)
+	if (m_bFirstMouse)
 	{
-		gLastX = xMousePos;
-		gLastY = yMousePos;
-		gFirstMouse = false;
+		m_lastMouseX = xMousePos;
+		m_lastMouseY = yMousePos;
+		m_bFirstMouse = false;
 	}
 
 	// calculate the X offset and Y offset values for moving the 3D camera accordingly
-	float xOffset = xMousePos - gLastX;
-	float yOffset = gLastY - yMousePos; // reversed since y-coordinates go from bottom to top
+	float xOffset = xMousePos - m_lastMouseX;
+	float yOffset = m_lastMouseY - yMousePos; // reversed since y-coordinates go from bottom to top
 
 	// set the current positions into the last position variables
-	gLastX = xMousePos;
-	gLastY = yMousePos;
+	m_lastMouseX = xMousePos;
+	m_lastMouseY = yMousePos;
 
 	// move the 3D camera according to the calculated offsets
-	g_pCamera->ProcessMouseMovement(xOffset, yOffset);
+	m_pCamera->ProcessMouseMovement(xOffset, yOffset);
 }
 
 /***********************************************************
@@ -162,13 +237,22 @@ void ViewManager::Mouse_Position_Callback(GLFWwindow* window, double xMousePos,
 
 void ViewManager::Mouse_Scroll_Callback(GLFWwindow* window, double xOffset, double yOffset)
 {
+	ViewManager* pViewManager = static_cast<ViewManager*>(glfwGetWindowUserPointer(window));
+	if (NULL == pViewManager)
+	{
+		return;
+	}
+
 	// Adjusts the movement speed based on scroll wheel input
+	float& movementSpeed = pViewManager->m_movementSpeed;
 	movementSpeed += yOffset * 0.2f;  // Adjust sensitivity as needed
 	movementSpeed = glm::clamp(movementSpeed, 0.5f, 10.0f); // Prevents crazy speeds 
 
 	// Adds camera speed to the title for easier user adjustement
-	std::string title = "7-1 Final Project - Camera Speed: " + std::to_string(movementSpeed);
-	glfwSetWindowTitle(window, title.c_str());
+	// formatted into a stack buffer so scrolling never allocates
+	char title[64];
+	snprintf(title, sizeof(title), "7-1 Final Project - Camera Speed: %f", movementSpeed);
+	glfwSetWindowTitle(window, title);
 }
 
 /***********************************************************
@@ -186,7 +270,7 @@ void ViewManager::Mouse_Scroll_Callback(GLFWwindow* window, double xOffset, doub
 		}
 
 		// if the camera object is null, then exit this method
-		if (NULL == g_pCamera)
+		if (NULL == m_pCamera)
 		{
 			return;
 		}
@@ -194,50 +278,50 @@ void ViewManager::Mouse_Scroll_Callback(GLFWwindow* window, double xOffset, doub
 		// process camera zooming in and out
 		if (glfwGetKey(m_pWindow, GLFW_KEY_W) == GLFW_PRESS)
 		{
-			g_pCamera->ProcessKeyboard(FORWARD, gDeltaTime * movementSpeed);
+			m_pCamera->ProcessKeyboard(FORWARD, m_deltaTime * m_movementSpeed);
 		}
 		if (glfwGetKey(m_pWindow, GLFW_KEY_S) == GLFW_PRESS)
 		{
-			g_pCamera->ProcessKeyboard(BACKWARD, gDeltaTime * movementSpeed);
+			m_pCamera->ProcessKeyboard(BACKWARD, m_deltaTime * m_movementSpeed);
 		}
 
 		// process camera panning left and right
 		if (glfwGetKey(m_pWindow, GLFW_KEY_A) == GLFW_PRESS)
 		{
-			g_pCamera->ProcessKeyboard(LEFT, gDeltaTime * movementSpeed);
+			m_pCamera->ProcessKeyboard(LEFT, m_deltaTime * m_movementSpeed);
 		}
 		if (glfwGetKey(m_pWindow, GLFW_KEY_D) == GLFW_PRESS)
 		{
-			g_pCamera->ProcessKeyboard(RIGHT, gDeltaTime * movementSpeed);
+			m_pCamera->ProcessKeyboard(RIGHT, m_deltaTime * m_movementSpeed);
 		}
 
 		// process camera movement up and down
 		if (glfwGetKey(m_pWindow, GLFW_KEY_Q) == GLFW_PRESS)
 		{
-			g_pCamera->ProcessKeyboard(UP, gDeltaTime * movementSpeed);
+			m_pCamera->ProcessKeyboard(UP, m_deltaTime * m_movementSpeed);
 		}
 		if (glfwGetKey(m_pWindow, GLFW_KEY_E) == GLFW_PRESS)
 		{
-			g_pCamera->ProcessKeyboard(DOWN, gDeltaTime * movementSpeed);
+			m_pCamera->ProcessKeyboard(DOWN, m_deltaTime * m_movementSpeed);
 		}
 	
 		// Toggle Orthographic and Perspective Projections (Only Once Per Key Press)
-		if (glfwGetKey(m_pWindow, GLFW_KEY_P) == GLFW_PRESS && !perspectiveKeyPressed) {
-			bOrthographicProjection = false;
-			perspectiveKeyPressed = true;
+		if (glfwGetKey(m_pWindow, GLFW_KEY_P) == GLFW_PRESS && !m_bPerspectiveKeyPressed) {
+			m_bOrthographicProjection = false;
+			m_bPerspectiveKeyPressed = true;
 			std::cout << "Perspective Projection Enabled" << std::endl;
 		}
 		if (glfwGetKey(m_pWindow, GLFW_KEY_P) == GLFW_RELEASE) {
-			perspectiveKeyPressed = false;
+			m_bPerspectiveKeyPressed = false;
 		}
 
-		if (glfwGetKey(m_pWindow, GLFW_KEY_O) == GLFW_PRESS && !orthographicKeyPressed) {
-			bOrthographicProjection = true;
-			orthographicKeyPressed = true;
+		if (glfwGetKey(m_pWindow, GLFW_KEY_O) == GLFW_PRESS && !m_bOrthographicKeyPressed) {
+			m_bOrthographicProjection = true;
+			m_bOrthographicKeyPressed = true;
 			std::cout << "Orthographic Projection Enabled" << std::endl;
 		}
 		if (glfwGetKey(m_pWindow, GLFW_KEY_O) == GLFW_RELEASE) {
-			orthographicKeyPressed = false;
+			m_bOrthographicKeyPressed = false;
 		}
 	}
 
@@ -255,19 +339,20 @@ void ViewManager::Mouse_Scroll_Callback(GLFWwindow* window, double xOffset, doub
 
 		// per-frame timing
 		float currentFrame = glfwGetTime();
-		gDeltaTime = currentFrame - gLastFrame;
-		gLastFrame = currentFrame;
+		m_deltaTime = currentFrame - m_lastFrame;
+		m_lastFrame = currentFrame;
 		ProcessKeyboardEvents();
 
-		// gets the current view matrix from the camera
-		view = g_pCamera->GetViewMatrix();
-		if (bOrthographicProjection) {
-			if (!lastProjectionMode) {
+		// the projection toggle moves the camera in one jump
+		m_bCameraCut = (m_bOrthographicProjection != m_bLastProjectionMode);
+
+		if (m_bOrthographicProjection) {
+			if (!m_bLastProjectionMode) {
 				// Moves the camera directly in front of the Pokball
-				g_pCamera->Position = glm::vec3(0.0f, 2.0f, 10.0f); 
-				g_pCamera->Front = glm::vec3(0.0f, 0.0f, -1.0f);    
-				g_pCamera->Up = glm::vec3(0.0f, 1.0f, 0.0f);       
-				lastProjectionMode = true;
+				m_pCamera->Position = glm::vec3(0.0f, 2.0f, 10.0f); 
+				m_pCamera->Front = glm::vec3(0.0f, 0.0f, -1.0f);    
+				m_pCamera->Up = glm::vec3(0.0f, 1.0f, 0.0f);       
+				m_bLastProjectionMode = true;
 			}
 
 			// Defines an orthographic projection
@@ -278,29 +363,63 @@ void ViewManager::Mouse_Scroll_Callback(GLFWwindow* window, double xOffset, doub
 			float near = 0.1f;  
 			float far = 50.0f;
 			projection = glm::ortho(left, right, bottom, top, near, far);
+			m_zNear = near;
+			m_zFar = far;
 		}
 		else {
-			if (lastProjectionMode) {
+			if (m_bLastProjectionMode) {
 				// Resets the camera for perspective mode
-				g_pCamera->Position = glm::vec3(0.0f, 5.0f, 12.0f);
-				g_pCamera->Front = glm::vec3(0.0f, -0.5f, -2.0f);
-				g_pCamera->Up = glm::vec3(0.0f, 1.0f, 0.0f);
-				lastProjectionMode = false;
+				m_pCamera->Position = g_DefaultCameraPosition;
+				m_pCamera->Front = g_DefaultCameraFront;
+				m_pCamera->Up = g_DefaultCameraUp;
+				m_bLastProjectionMode = false;
 			}
 
-			projection = glm::perspective(glm::radians(g_pCamera->Zoom),
+			projection = glm::perspective(glm::radians(m_pCamera->Zoom),
 				(GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT,
-				0.1f, 100.0f);
+				g_PerspectiveNear, g_PerspectiveFar);
+			m_zNear = g_PerspectiveNear;
+			m_zFar = g_PerspectiveFar;
 		}
 
-		// if the shader manager object is valid
-		if (NULL != m_pShaderManager)
+		// gets the current view matrix from the camera, after the
+		// toggle moved it, so the jump and the new projection
+		// start in the same frame
+		view = m_pCamera->GetViewMatrix();
+
+		// keep the view settings for the rest of the frame, the
+		// scene sets them into each program it uses
+		m_viewMatrix = view;
+		m_projectionMatrix = projection;
+
+		// smooth the velocity over a few frames, so uneven frame
+		// times do not throw the streaming prefetch around
+		if (m_deltaTime > 0.0f)
 		{
-			// set the view matrix into the shader for proper rendering
-			m_pShaderManager->setMat4Value(g_ViewName, view);
-			// set the view matrix into the shader for proper rendering
-			m_pShaderManager->setMat4Value(g_ProjectionName, projection);
-			// set the view position of the camera into the shader for proper rendering
-			m_pShaderManager->setVec3Value("viewPosition", g_pCamera->Position);
+			glm::vec3 velocity = (m_pCamera->Position - m_lastCameraPosition) / m_deltaTime;
+			m_cameraVelocity += (velocity - m_cameraVelocity) * g_VelocitySmoothing;
 		}
-	}
\ No newline at end of file
+		m_lastCameraPosition = m_pCamera->Position;
+	}
+
+/***********************************************************
+ *  GetDisplayWidth()
+ *
+ *  This method is used for getting the width of the
+ *  display window.
+ ***********************************************************/
+int ViewManager::GetDisplayWidth() const
+{
+	return(WINDOW_WIDTH);
+}
+
+/***********************************************************
+ *  GetDisplayHeight()
+ *
+ *  This method is used for getting the height of the
+ *  display window.
+ ***********************************************************/
+int ViewManager::GetDisplayHeight() const
+{
+	return(WINDOW_HEIGHT);
+}
\ No newline at end of file
@@ -9,7 +9,8 @@
 
 #pragma once
 
-#include "ShaderManager.h"
+#include <GL/glew.h>
+#include <glm/glm.hpp>
 #include "camera.h"
 
 // GLFW library
@@ -19,8 +20,7 @@ class ViewManager
 {
 public:
 	// constructor
-	ViewManager(
-		ShaderManager* pShaderManager);
+	ViewManager();
 	// destructor
 	~ViewManager();
 
@@ -28,13 +28,47 @@ public:
 	static void Mouse_Position_Callback(GLFWwindow* window, double xMousePos, double yMousePos);
 
 private:
-	// pointer to shader manager object
-	ShaderManager* m_pShaderManager;
 	// active OpenGL display window
 	GLFWwindow* m_pWindow;
+	// camera object used for viewing and interacting with
+	// the 3D scene
+	Camera* m_pCamera;
+
+	// these variables are used for mouse movement processing
+	float m_lastMouseX;
+	float m_lastMouseY;
+	bool m_bFirstMouse;
+
+	// time between current frame and last frame
+	float m_deltaTime;
+	float m_lastFrame;
+
+	// true while the orthographic projection is on
+	bool m_bOrthographicProjection;
+	bool m_bPerspectiveKeyPressed;
+	bool m_bOrthographicKeyPressed;
+	bool m_bLastProjectionMode;		// false = Perspective, true = Orthographic
+	// set for the frame the projection toggle moved the camera
+	bool m_bCameraCut;
+
+	// movement speed of the camera, changed by scrolling
+	float m_movementSpeed;
+
+	// smoothed camera velocity in units per second, measured
+	// from the camera position of the previous frame
+	glm::vec3 m_cameraVelocity;
+	glm::vec3 m_lastCameraPosition;
+
+	// view settings calculated for the current frame
+	glm::mat4 m_viewMatrix;
+	glm::mat4 m_projectionMatrix;
+	float m_zNear;
+	float m_zFar;
 
 	// process keyboard events for interaction with the 3D scene
 	void ProcessKeyboardEvents();
+	// turn the camera by a mouse movement
+	void ProcessMouseMovement(double xMousePos, double yMousePos);
 
 	// Mouse scroll callback for adjusting camera movement speed
 	static void Mouse_Scroll_Callback(GLFWwindow* window, double xOffset, double yOffset);
@@ -45,4 +79,42 @@ public:
 
 	// prepare the conversion from 3D object display to 2D scene display
 	void PrepareSceneView();
+
+	// get the view settings calculated for the current frame
+	const glm::mat4& GetViewMatrix() const { return m_viewMatrix; }
+	const glm::mat4& GetProjectionMatrix() const { return m_projectionMatrix; }
+	float GetNearPlane() const { return m_zNear; }
+	float GetFarPlane() const { return m_zFar; }
+	// check whether the camera jumped in the current frame, so
+	// nothing learned from the last view may be used
+	bool IsCameraCut() const { return m_bCameraCut; }
+	// get where the camera is and how fast it moves, for
+	// streaming the world ahead of it
+	glm::vec3 GetCameraPosition() const { return m_pCamera->Position; }
+	const glm::vec3& GetCameraVelocity() const { return m_cameraVelocity; }
+	// get the size of the display window
+	int GetDisplayWidth() const;
+	int GetDisplayHeight() const;
+
+	// get the view of the starting camera for an image of the
+	// passed in size, used when rendering without a window
+	static void GetDefaultSceneView(
+		int width,
+		int height,
+		glm::mat4& view,
+		glm::mat4& projection,
+		float& zNear,
+		float& zFar);
+	// get the view of a camera at the position looking at the
+	// target with the vertical field of view in degrees
+	static void GetSceneView(
+		const glm::vec3& position,
+		const glm::vec3& target,
+		float fieldOfView,
+		int width,
+		int height,
+		glm::mat4& view,
+		glm::mat4& projection,
+		float& zNear,
+		float& zFar);
 };
\ No newline at end of file
@@ -0,0 +1,352 @@
+///////////////////////////////////////////////////////////////////////////////
+// benchmarkmain.cpp
+// ============
+// micro-benchmarks of the CPU side scene hot paths
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "BenchmarkRunner.h"
+#include "SceneManager.h"
+#include "MeshLibrary.h"
+#include "MeshOptimizer.h"
+
+#include "stb_image.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// declaration of global variables
+namespace
+{
+	// shortest timed run of each benchmark, in seconds
+	const double g_MinimumRunSeconds = 0.2;
+	// results file used when none is passed on the command line
+	const char* const g_DefaultResultsFile = "benchmarks.json";
+
+	// input sizes of the lookup benchmarks
+	const int g_MaterialCounts[] = { 4, 16, 64, 256 };
+	// the scene has 16 texture slots
+	const int g_TextureCounts[] = { 4, 8, 16 };
+	// quads per side of the grids given to the vertex cache optimizer
+	const int g_GridSizes[] = { 16, 64, 256 };
+	// scene textures decoded by the texture benchmark
+	const char* const g_TextureFiles[] =
+	{
+		"textures/wood.jpg",
+		"textures/leather.jpg",
+		"textures/cube.jpg",
+		"textures/can.jpg",
+		"textures/top.png"
+	};
+
+	// results are added here so the timed loops cannot be
+	// optimized away
+	volatile long long g_Sink = 0;
+}
+
+/***********************************************************
+ *  BenchmarkAccess
+ *
+ *  This class is used for reaching the private hot paths of
+ *  the scene and the mesh library, which both declare it a
+ *  friend. The benchmarks never create a GL context - the
+ *  measured paths only record state, and the scene is made
+ *  without a shader or resource manager.
+ ***********************************************************/
+class BenchmarkAccess
+{
+public:
+	static void SetTransformations(SceneManager& scene, float angle)
+	{
+		scene.SetTransformations(
+			glm::vec3(1.0f, 2.0f, 1.0f),
+			angle,
+			angle * 0.5f,
+			0.0f,
+			glm::vec3(angle, 0.0f, -angle));
+	}
+	static float GetModelValue(const SceneManager& scene)
+	{
+		return(scene.m_currentDraw.model[3][0]);
+	}
+
+	static void SetMaterials(SceneManager& scene, const std::vector<std::string>& tags)
+	{
+		scene.m_objectMaterials.clear();
+		for (size_t i = 0; i < tags.size(); i++)
+		{
+			SceneManager::OBJECT_MATERIAL material;
+			material.ambientColor = glm::vec3(0.2f, 0.2f, 0.2f);
+			material.ambientStrength = 0.2f;
+			material.diffuseColor = glm::vec3(0.5f, 0.5f, 0.5f);
+			material.specularColor = glm::vec3(0.3f, 0.3f, 0.3f);
+			material.shininess = 0.5f;
+			material.tag = tags[i];
+			scene.m_objectMaterials.push_back(material);
+		}
+	}
+	static bool FindMaterial(SceneManager& scene, const char* tag, SceneManager::OBJECT_MATERIAL& material)
+	{
+		return(scene.FindMaterial(tag, material));
+	}
+	static void SetShaderMaterial(SceneManager& scene, const char* tag)
+	{
+		scene.SetShaderMaterial(tag);
+	}
+	static int GetMaterialIndex(const SceneManager& scene)
+	{
+		return(scene.m_currentDraw.materialIndex);
+	}
+
+	static void SetTextures(SceneManager& scene, const std::vector<std::string>& tags)
+	{
+		scene.m_loadedTextures = 0;
+		for (size_t i = 0; (i < tags.size()) && (scene.m_loadedTextures < 16); i++)
+		{
+			SceneManager::TEXTURE_INFO& texture = scene.m_textureIDs[scene.m_loadedTextures];
+			texture.tag = tags[i];
+			texture.ID = (uint32_t)(i + 1);
+			texture.bHasAlpha = false;
+			scene.m_loadedTextures++;
+		}
+	}
+	static int FindTextureSlot(SceneManager& scene, const char* tag)
+	{
+		return(scene.FindTextureSlot(tag));
+	}
+
+	static bool BuildMeshImage(MeshLibrary& library, MeshLibrary::BASIC_MESH mesh, std::vector<unsigned char>& image)
+	{
+		return(library.BuildMeshImage(mesh, 0, image));
+	}
+};
+
+/***********************************************************
+ *  MakeTags()
+ *
+ *  This function is used for making the passed in number of
+ *  distinct tags with a shared prefix, like scene tags.
+ ***********************************************************/
+std::vector<std::string> MakeTags(const char* prefix, int count)
+{
+	std::vector<std::string> tags;
+	for (int i = 0; i < count; i++)
+	{
+		tags.push_back(std::string(prefix) + std::to_string(i));
+	}
+	return(tags);
+}
+
+/***********************************************************
+ *  RunSceneBenchmarks()
+ *
+ *  This function is used for timing the scene methods that
+ *  run for every recorded draw.
+ ***********************************************************/
+void RunSceneBenchmarks(BenchmarkRunner& runner)
+{
+	SceneManager scene(NULL, NULL, NULL);
+
+	runner.Run("SetTransformations", 1, [&scene](long long iterations)
+	{
+		for (long long i = 0; i < iterations; i++)
+		{
+			BenchmarkAccess::SetTransformations(scene, (float)(i & 255));
+		}
+		g_Sink += (long long)BenchmarkAccess::GetModelValue(scene);
+	});
+
+	for (size_t size = 0; size < sizeof(g_MaterialCounts) / sizeof(g_MaterialCounts[0]); size++)
+	{
+		int count = g_MaterialCounts[size];
+		std::vector<std::string> tags = MakeTags("material", count);
+		BenchmarkAccess::SetMaterials(scene, tags);
+
+		// every tag is looked up in turn, so the times are the
+		// average over the positions in the list
+		runner.Run("FindMaterial", count, [&scene, &tags, count](long long iterations)
+		{
+			SceneManager::OBJECT_MATERIAL material;
+			long long found = 0;
+			for (long long i = 0; i < iterations; i++)
+			{
+				found += BenchmarkAccess::FindMaterial(scene, tags[(size_t)(i % count)].c_str(), material) ? 1 : 0;
+			}
+			g_Sink += found;
+		});
+
+		runner.Run("SetShaderMaterial", count, [&scene, &tags, count](long long iterations)
+		{
+			for (long long i = 0; i < iterations; i++)
+			{
+				BenchmarkAccess::SetShaderMaterial(scene, tags[(size_t)(i % count)].c_str());
+			}
+			g_Sink += BenchmarkAccess::GetMaterialIndex(scene);
+		});
+	}
+
+	for (size_t size = 0; size < sizeof(g_TextureCounts) / sizeof(g_TextureCounts[0]); size++)
+	{
+		int count = g_TextureCounts[size];
+		std::vector<std::string> tags = MakeTags("texture", count);
+		BenchmarkAccess::SetTextures(scene, tags);
+
+		runner.Run("FindTextureSlot", count, [&scene, &tags, count](long long iterations)
+		{
+			long long slots = 0;
+			for (long long i = 0; i < iterations; i++)
+			{
+				slots += BenchmarkAccess::FindTextureSlot(scene, tags[(size_t)(i % count)].c_str());
+			}
+			g_Sink += slots;
+		});
+	}
+
+	// the scene does not own these textures
+	BenchmarkAccess::SetTextures(scene, std::vector<std::string>());
+}
+
+/***********************************************************
+ *  RunTextureBenchmarks()
+ *
+ *  This function is used for timing the decode of the scene
+ *  textures from memory, the step CreateGLTexture runs on
+ *  the CPU. The parameter is the size of the file. The
+ *  decoder allocates with malloc, which the allocation
+ *  tracking does not see.
+ ***********************************************************/
+void RunTextureBenchmarks(BenchmarkRunner& runner)
+{
+	for (size_t i = 0; i < sizeof(g_TextureFiles) / sizeof(g_TextureFiles[0]); i++)
+	{
+		std::ifstream file(g_TextureFiles[i], std::ios::in | std::ios::binary);
+		if (!file.is_open())
+		{
+			std::cout << "Skipping missing texture:" << g_TextureFiles[i] << std::endl;
+			continue;
+		}
+		std::vector<unsigned char> bytes(
+			(std::istreambuf_iterator<char>(file)),
+			std::istreambuf_iterator<char>());
+		if (bytes.empty() == true)
+		{
+			continue;
+		}
+
+		std::string name = std::string("TextureDecode/") + g_TextureFiles[i];
+		runner.Run(name.c_str(), (long long)bytes.size(), [&bytes](long long iterations)
+		{
+			for (long long i = 0; i < iterations; i++)
+			{
+				int width = 0;
+				int height = 0;
+				int colorChannels = 0;
+				stbi_set_flip_vertically_on_load(true);
+				unsigned char* image = stbi_load_from_memory(
+					&bytes[0], (int)bytes.size(), &width, &height, &colorChannels, 0);
+				if (NULL != image)
+				{
+					g_Sink += image[0];
+					stbi_image_free(image);
+				}
+			}
+		});
+	}
+}
+
+/***********************************************************
+ *  RunMeshBenchmarks()
+ *
+ *  This function is used for timing the build of each basic
+ *  mesh, and the vertex cache optimizer on growing grids.
+ ***********************************************************/
+void RunMeshBenchmarks(BenchmarkRunner& runner)
+{
+	MeshLibrary library(NULL, "meshcache");
+
+	for (int mesh = 0; mesh < MeshLibrary::TOTAL_BASIC_MESHES; mesh++)
+	{
+		MeshLibrary::BASIC_MESH basicMesh = (MeshLibrary::BASIC_MESH)mesh;
+		std::vector<unsigned char> image;
+
+		// the build prints a line per mesh, which is muted
+		// here so the console is not part of the timing
+		std::streambuf* consoleBuffer = std::cout.rdbuf(NULL);
+		BenchmarkAccess::BuildMeshImage(library, basicMesh, image);
+		std::cout.rdbuf(consoleBuffer);
+		std::cout.clear();
+
+		std::string name = std::string("MeshBuild/") + MeshLibrary::GetMeshName(basicMesh);
+		runner.Run(name.c_str(), (long long)image.size(), [&library, &image, basicMesh](long long iterations)
+		{
+			std::streambuf* consoleBuffer = std::cout.rdbuf(NULL);
+			for (long long i = 0; i < iterations; i++)
+			{
+				BenchmarkAccess::BuildMeshImage(library, basicMesh, image);
+			}
+			std::cout.rdbuf(consoleBuffer);
+			std::cout.clear();
+			g_Sink += (long long)image.size();
+		});
+	}
+
+	for (size_t size = 0; size < sizeof(g_GridSizes) / sizeof(g_GridSizes[0]); size++)
+	{
+		int side = g_GridSizes[size];
+		unsigned int vertexCount = (unsigned int)((side + 1) * (side + 1));
+		std::vector<unsigned int> grid;
+		for (int row = 0; row < side; row++)
+		{
+			for (int column = 0; column < side; column++)
+			{
+				unsigned int corner = (unsigned int)((row * (side + 1)) + column);
+				grid.push_back(corner);
+				grid.push_back(corner + side + 1);
+				grid.push_back(corner + 1);
+				grid.push_back(corner + 1);
+				grid.push_back(corner + side + 1);
+				grid.push_back(corner + side + 2);
+			}
+		}
+
+		std::vector<unsigned int> indices;
+		indices.reserve(grid.size());
+		runner.Run("OptimizeVertexCache", (long long)(grid.size() / 3), [&grid, &indices, vertexCount](long long iterations)
+		{
+			for (long long i = 0; i < iterations; i++)
+			{
+				indices.assign(grid.begin(), grid.end());
+				MeshOptimizer::OptimizeVertexCache(indices, vertexCount);
+			}
+			g_Sink += indices[0];
+		});
+	}
+}
+
+/***********************************************************
+ *  main(int, char*)
+ *
+ *  This function gets called after the benchmarks have been
+ *  launched. The optional argument is the results file.
+ ***********************************************************/
+int main(int argc, char* argv[])
+{
+	const char* resultsFile = (argc > 1) ? argv[1] : g_DefaultResultsFile;
+
+	BenchmarkRunner runner(g_MinimumRunSeconds);
+	RunSceneBenchmarks(runner);
+	RunTextureBenchmarks(runner);
+	RunMeshBenchmarks(runner);
+
+	std::cout << std::endl;
+	runner.WriteReport(std::cout);
+	if (runner.WriteJSON(resultsFile) == false)
+	{
+		return(EXIT_FAILURE);
+	}
+
+	return(EXIT_SUCCESS);
+}
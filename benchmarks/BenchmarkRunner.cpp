@@ -0,0 +1,167 @@
+///////////////////////////////////////////////////////////////////////////////
+// benchmarkrunner.cpp
+// ============
+// time small operations in isolation and collect the results
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "BenchmarkRunner.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+// declaration of global variables
+namespace
+{
+	/***********************************************************
+	 *  WriteJSONString()
+	 *
+	 *  This function is used for writing a quoted JSON string,
+	 *  escaping the characters that file paths may contain.
+	 ***********************************************************/
+	void WriteJSONString(std::ostream& output, const std::string& text)
+	{
+		output << '"';
+		for (size_t i = 0; i < text.size(); i++)
+		{
+			char character = text[i];
+			if ((character == '"') || (character == '\\'))
+			{
+				output << '\\' << character;
+			}
+			else if ((unsigned char)character < 0x20)
+			{
+				output << ' ';
+			}
+			else
+			{
+				output << character;
+			}
+		}
+		output << '"';
+	}
+}
+
+/***********************************************************
+ *  BenchmarkRunner()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+BenchmarkRunner::BenchmarkRunner(double minimumSeconds)
+{
+	m_minimumSeconds = minimumSeconds;
+}
+
+/***********************************************************
+ *  AddResult()
+ *
+ *  This method is used for storing the measured run of a
+ *  benchmark and printing it as it finishes.
+ ***********************************************************/
+void BenchmarkRunner::AddResult(
+	const char* name,
+	long long parameter,
+	long long iterations,
+	double seconds,
+	const AllocationTracker::ALLOCATION_STATS& stats)
+{
+	BENCHMARK_RESULT result;
+	result.name = name;
+	result.parameter = parameter;
+	result.iterations = iterations;
+	result.nsPerOp = (seconds * 1.0e9) / iterations;
+	result.allocationsPerOp = (double)stats.allocations / iterations;
+	result.bytesPerOp = (double)stats.bytes / iterations;
+	m_results.push_back(result);
+
+	std::cout << name << "/" << parameter << ": " << result.nsPerOp << " ns/op, "
+		<< result.allocationsPerOp << " allocs/op" << std::endl;
+}
+
+/***********************************************************
+ *  WriteReport()
+ *
+ *  This method is used for writing the results as a table.
+ ***********************************************************/
+void BenchmarkRunner::WriteReport(std::ostream& output) const
+{
+	std::ios::fmtflags flags = output.flags();
+	std::streamsize precision = output.precision();
+
+	output << std::left << std::setw(36) << "benchmark" << std::right
+		<< std::setw(12) << "parameter"
+		<< std::setw(14) << "ns/op"
+		<< std::setw(14) << "allocs/op"
+		<< std::setw(14) << "bytes/op" << std::endl;
+
+	output << std::fixed;
+	for (size_t i = 0; i < m_results.size(); i++)
+	{
+		const BENCHMARK_RESULT& result = m_results[i];
+		output << std::left << std::setw(36) << result.name << std::right
+			<< std::setw(12) << result.parameter
+			<< std::setprecision(1) << std::setw(14) << result.nsPerOp
+			<< std::setprecision(2) << std::setw(14) << result.allocationsPerOp
+			<< std::setprecision(0) << std::setw(14) << result.bytesPerOp << std::endl;
+	}
+
+	if (AllocationTracker::IsEnabled() == false)
+	{
+		output << "Allocations are not counted, build with ENABLE_ALLOCATION_TRACKING" << std::endl;
+	}
+
+	output.flags(flags);
+	output.precision(precision);
+}
+
+/***********************************************************
+ *  WriteJSON()
+ *
+ *  This method is used for writing the results into a JSON
+ *  file, so runs of two commits can be diffed.
+ ***********************************************************/
+bool BenchmarkRunner::WriteJSON(const char* filename) const
+{
+	std::string path = filename;
+	std::string tempPath = path + ".tmp";
+
+	std::ofstream file(tempPath.c_str(), std::ios::out | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Could not write benchmark results:" << path << std::endl;
+		return(false);
+	}
+
+	file << "{\n";
+	file << "  \"allocationTracking\": " << (AllocationTracker::IsEnabled() ? "true" : "false") << ",\n";
+	file << "  \"benchmarks\": [";
+	for (size_t i = 0; i < m_results.size(); i++)
+	{
+		const BENCHMARK_RESULT& result = m_results[i];
+		file << ((i == 0) ? "\n" : ",\n");
+		file << "    { \"name\": ";
+		WriteJSONString(file, result.name);
+		file << ", \"parameter\": " << result.parameter
+			<< ", \"iterations\": " << result.iterations
+			<< ", \"nsPerOp\": " << result.nsPerOp
+			<< ", \"allocationsPerOp\": " << result.allocationsPerOp
+			<< ", \"bytesPerOp\": " << result.bytesPerOp << " }";
+	}
+	file << (m_results.empty() ? "]\n" : "\n  ]\n");
+	file << "}\n";
+
+	file.close();
+	bool bWritten = !file.fail();
+
+	remove(path.c_str());
+	if ((bWritten == false) || (rename(tempPath.c_str(), path.c_str()) != 0))
+	{
+		remove(tempPath.c_str());
+		std::cout << "Could not write benchmark results:" << path << std::endl;
+		return(false);
+	}
+
+	return(true);
+}
@@ -0,0 +1,91 @@
+///////////////////////////////////////////////////////////////////////////////
+// benchmarkrunner.h
+// ============
+// time small operations in isolation and collect the results
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "AllocationTracking.h"
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/***********************************************************
+ *  BenchmarkRunner
+ *
+ *  This class is used for timing one operation at a time.
+ *  Each benchmark is a callable that runs the operation a
+ *  passed in number of times. The count is doubled until
+ *  one run takes long enough to time reliably, and that
+ *  last run gives the time and the heap allocations per
+ *  operation. Allocations are only counted when the build
+ *  defines ENABLE_ALLOCATION_TRACKING.
+ ***********************************************************/
+class BenchmarkRunner
+{
+public:
+	// measurements of one benchmark
+	struct BENCHMARK_RESULT
+	{
+		std::string name;
+		long long parameter;		// input size the benchmark ran with
+		long long iterations;
+		double nsPerOp;
+		double allocationsPerOp;
+		double bytesPerOp;
+	};
+
+	// constructor
+	BenchmarkRunner(double minimumSeconds);
+
+private:
+	// shortest run that is accepted as the measurement
+	double m_minimumSeconds;
+	// results in the order the benchmarks ran
+	std::vector<BENCHMARK_RESULT> m_results;
+
+	// store a result and print it
+	void AddResult(
+		const char* name,
+		long long parameter,
+		long long iterations,
+		double seconds,
+		const AllocationTracker::ALLOCATION_STATS& stats);
+
+public:
+	// run a benchmark, the operation is called with the
+	// number of times it should repeat
+	template<typename OPERATION>
+	void Run(const char* name, long long parameter, OPERATION operation)
+	{
+		// one untimed call warms the caches and lazy state
+		operation(1LL);
+
+		long long iterations = 1;
+		for (;;)
+		{
+			AllocationScope scope(name);
+			std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+			operation(iterations);
+			std::chrono::high_resolution_clock::time_point endTime = std::chrono::high_resolution_clock::now();
+			AllocationTracker::ALLOCATION_STATS stats = scope.GetStats();
+
+			double seconds = std::chrono::duration<double>(endTime - startTime).count();
+			if ((seconds >= m_minimumSeconds) || (iterations >= (1LL << 40)))
+			{
+				AddResult(name, parameter, iterations, seconds, stats);
+				return;
+			}
+			iterations *= 2;
+		}
+	}
+
+	// write the results as a table
+	void WriteReport(std::ostream& output) const;
+	// write the results into a JSON file
+	bool WriteJSON(const char* filename) const;
+};
@@ -0,0 +1,278 @@
+///////////////////////////////////////////////////////////////////////////////
+// counterreader.cpp
+// ============
+// show the live render counters published by a running scene
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "PerformanceCounters.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+// declaration of global variables
+namespace
+{
+	// time between two reports when none is passed, in ms
+	const int g_DefaultInterval = 500;
+	// characters of the longest histogram bar
+	const int g_BarWidth = 40;
+	// buckets of the histogram over the frame history
+	const int g_HistoryBuckets = 10;
+	// counter whose history is shown when none is passed
+	const char* const g_DefaultHistogramCounter = "frameTimeMicroseconds";
+}
+
+/***********************************************************
+ *  PrintBar()
+ *
+ *  This function is used for printing one histogram row,
+ *  scaled against the largest count of the histogram.
+ ***********************************************************/
+void PrintBar(const char* label, unsigned long long count, unsigned long long largest)
+{
+	int length = 0;
+	if (largest > 0)
+	{
+		length = (int)((count * g_BarWidth + largest - 1) / largest);
+	}
+
+	printf("  %-18s %10llu |", label, count);
+	for (int i = 0; i < length; i++)
+	{
+		putchar('#');
+	}
+	putchar('\n');
+}
+
+/***********************************************************
+ *  PrintCounters()
+ *
+ *  This function is used for printing the values of the
+ *  newest frame, and the rates since the previous report
+ *  when there is one.
+ ***********************************************************/
+void PrintCounters(
+	const PerformanceCounters::SHARED_COUNTERS& current,
+	const PerformanceCounters::SHARED_COUNTERS* pPrevious,
+	double elapsedSeconds)
+{
+	printf("process %u, frame %llu\n", current.processId, current.frameNumber);
+	printf("  %-24s %16s %16s %16s\n", "counter", "last frame", "per frame", "per second");
+
+	unsigned long long frames = 0;
+	if (NULL != pPrevious)
+	{
+		frames = current.frameNumber - pPrevious->frameNumber;
+	}
+
+	for (int i = 0; i < PerformanceCounters::TOTAL_COUNTERS; i++)
+	{
+		printf("  %-24s %16lld", current.counterNames[i], current.lastFrame[i]);
+		if ((frames > 0) && (elapsedSeconds > 0.0))
+		{
+			long long delta = current.totals[i] - pPrevious->totals[i];
+			printf(" %16.1f %16.1f\n", (double)delta / frames, (double)delta / elapsedSeconds);
+		}
+		else
+		{
+			printf(" %16s %16s\n", "-", "-");
+		}
+	}
+
+	if ((frames > 0) && (elapsedSeconds > 0.0))
+	{
+		printf("  %-24s %16.1f\n", "framesPerSecond", frames / elapsedSeconds);
+	}
+}
+
+/***********************************************************
+ *  PrintFrameTimeHistogram()
+ *
+ *  This function is used for printing the frame times of
+ *  every frame published so far.
+ ***********************************************************/
+void PrintFrameTimeHistogram(const PerformanceCounters::SHARED_COUNTERS& current)
+{
+	unsigned long long largest = 0;
+	for (int i = 0; i < PerformanceCounters::HISTOGRAM_BUCKETS; i++)
+	{
+		largest = std::max(largest, current.frameTimeHistogram[i]);
+	}
+
+	printf("frame time, all frames\n");
+	for (int i = 0; i < PerformanceCounters::HISTOGRAM_BUCKETS; i++)
+	{
+		char label[32];
+		if (i == PerformanceCounters::HISTOGRAM_BUCKETS - 1)
+		{
+			snprintf(label, sizeof(label), ">= %.1f ms", current.bucketLimits[i - 1] / 1000.0);
+		}
+		else
+		{
+			snprintf(label, sizeof(label), "< %.1f ms", current.bucketLimits[i] / 1000.0);
+		}
+		PrintBar(label, current.frameTimeHistogram[i], largest);
+	}
+}
+
+/***********************************************************
+ *  PrintHistoryHistogram()
+ *
+ *  This function is used for printing the spread of one
+ *  counter over the frames still in the history, split into
+ *  equal ranges between its smallest and largest value.
+ ***********************************************************/
+void PrintHistoryHistogram(const PerformanceCounters::SHARED_COUNTERS& current, int counter)
+{
+	int frames = (int)std::min<unsigned long long>(current.frameNumber, PerformanceCounters::HISTORY_FRAMES);
+	if (frames == 0)
+	{
+		return;
+	}
+
+	long long smallest = current.history[0][counter];
+	long long largestValue = smallest;
+	for (int i = 0; i < frames; i++)
+	{
+		smallest = std::min(smallest, current.history[i][counter]);
+		largestValue = std::max(largestValue, current.history[i][counter]);
+	}
+
+	// a narrow range of whole numbers gets one bucket per value
+	unsigned long long counts[g_HistoryBuckets] = {};
+	long long range = (largestValue - smallest) + 1;
+	int bucketCount = (int)std::min<long long>(g_HistoryBuckets, range);
+	for (int i = 0; i < frames; i++)
+	{
+		long long offset = current.history[i][counter] - smallest;
+		counts[(int)((offset * bucketCount) / range)]++;
+	}
+
+	unsigned long long largest = 0;
+	for (int i = 0; i < bucketCount; i++)
+	{
+		largest = std::max(largest, counts[i]);
+	}
+
+	printf("%s, last %d frames\n", current.counterNames[counter], frames);
+	for (int i = 0; i < bucketCount; i++)
+	{
+		char label[32];
+		snprintf(label, sizeof(label), ">= %lld", smallest + ((range * i) / bucketCount));
+		PrintBar(label, counts[i], largest);
+	}
+}
+
+/***********************************************************
+ *  main(int, char*)
+ *
+ *  This function gets called after the reader has been
+ *  launched. The options are
+ *    --once             print a single report and exit
+ *    --interval <ms>    time between two reports
+ *    --histogram <name> counter shown over the history
+ ***********************************************************/
+int main(int argc, char* argv[])
+{
+	bool bOnce = false;
+	int interval = g_DefaultInterval;
+	const char* histogramCounter = g_DefaultHistogramCounter;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--once") == 0)
+		{
+			bOnce = true;
+		}
+		else if ((strcmp(argv[i], "--interval") == 0) && (i + 1 < argc))
+		{
+			interval = std::max(atoi(argv[++i]), 10);
+		}
+		else if ((strcmp(argv[i], "--histogram") == 0) && (i + 1 < argc))
+		{
+			histogramCounter = argv[++i];
+		}
+	}
+
+	int histogramIndex = -1;
+	for (int i = 0; i < PerformanceCounters::TOTAL_COUNTERS; i++)
+	{
+		if (strcmp(histogramCounter, PerformanceCounters::GetCounterName((PerformanceCounters::COUNTER)i)) == 0)
+		{
+			histogramIndex = i;
+		}
+	}
+	if (histogramIndex < 0)
+	{
+		std::cout << "Unknown counter:" << histogramCounter << std::endl;
+		return(EXIT_FAILURE);
+	}
+
+	// the snapshots are too large to keep on the stack
+	PerformanceCounters::SHARED_COUNTERS* pCurrent = new PerformanceCounters::SHARED_COUNTERS;
+	PerformanceCounters::SHARED_COUNTERS* pPrevious = new PerformanceCounters::SHARED_COUNTERS;
+	bool bHasPrevious = false;
+	std::chrono::steady_clock::time_point previousTime;
+
+	PerformanceCounters::SharedCounterReader reader;
+	bool bWaiting = false;
+	int result = EXIT_SUCCESS;
+	while (true)
+	{
+		bool bRead = reader.Read(*pCurrent);
+		if (bRead == false)
+		{
+			// the scene is not running yet, or was restarted
+			reader.Close();
+			bHasPrevious = false;
+			bRead = (reader.Open() == true) && (reader.Read(*pCurrent) == true);
+		}
+
+		if (bRead == true)
+		{
+			std::chrono::steady_clock::time_point currentTime = std::chrono::steady_clock::now();
+			double elapsedSeconds = 0.0;
+			if (bHasPrevious == true)
+			{
+				elapsedSeconds = std::chrono::duration<double>(currentTime - previousTime).count();
+			}
+
+			std::cout << std::endl;
+			PrintCounters(*pCurrent, bHasPrevious ? pPrevious : NULL, elapsedSeconds);
+			PrintFrameTimeHistogram(*pCurrent);
+			PrintHistoryHistogram(*pCurrent, histogramIndex);
+			fflush(stdout);
+			bWaiting = false;
+
+			std::swap(pCurrent, pPrevious);
+			previousTime = currentTime;
+			bHasPrevious = true;
+		}
+		else if (bOnce == true)
+		{
+			std::cout << "No running scene publishes performance counters" << std::endl;
+			result = EXIT_FAILURE;
+		}
+		else if (bWaiting == false)
+		{
+			std::cout << "Waiting for a running scene..." << std::endl;
+			bWaiting = true;
+		}
+
+		if (bOnce == true)
+		{
+			break;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+	}
+
+	delete pCurrent;
+	delete pPrevious;
+
+	return(result);
+}
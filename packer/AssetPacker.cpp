@@ -0,0 +1,316 @@
+///////////////////////////////////////////////////////////////////////////////
+// assetpacker.cpp
+// ============
+// pack the textures, shaders and meshes into one asset pack
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "AssetPack.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// declaration of global variables
+namespace
+{
+	// compression is only kept when it saves at least this
+	// fraction, otherwise the entry stays a zero-copy view
+	const double g_MinimumSavings = 0.25;
+	// marks a list line whose file is never compressed
+	const char* const g_StoreOption = "store";
+
+	// one file going into the pack
+	struct PACK_INPUT
+	{
+		std::string path;				// where the file is read from
+		std::string name;				// what the loaders ask for
+		bool bStore;					// never compressed when set
+		std::vector<unsigned char> data;
+		std::vector<unsigned char> compressed;
+		unsigned long long nameHash;
+		unsigned int nameOffset;
+		unsigned int compression;
+	};
+}
+
+/***********************************************************
+ *  NormalizeName()
+ *
+ *  This function is used for turning a listed path into
+ *  the entry name the loaders ask for, with forward
+ *  slashes and no leading "./".
+ ***********************************************************/
+std::string NormalizeName(const std::string& path)
+{
+	std::string name = path;
+	std::replace(name.begin(), name.end(), '\\', '/');
+	while (name.compare(0, 2, "./") == 0)
+	{
+		name.erase(0, 2);
+	}
+	return(name);
+}
+
+/***********************************************************
+ *  ReadList()
+ *
+ *  This function is used for reading the files to pack,
+ *  one path per line relative to the working directory,
+ *  optionally followed by "store" to keep the file
+ *  uncompressed - # starts a comment.
+ ***********************************************************/
+bool ReadList(const char* filename, std::vector<PACK_INPUT>& inputs)
+{
+	std::ifstream file(filename);
+	if (!file.is_open())
+	{
+		std::cout << "Could not open asset list:" << filename << std::endl;
+		return(false);
+	}
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+		{
+			line.erase(comment);
+		}
+
+		std::istringstream fields(line);
+		std::string path;
+		std::string option;
+		if (!(fields >> path))
+		{
+			continue;
+		}
+		fields >> option;
+
+		PACK_INPUT input;
+		input.path = path;
+		input.name = NormalizeName(path);
+		input.bStore = (option == g_StoreOption);
+		input.nameHash = AssetPack::HashName(input.name.c_str());
+		input.nameOffset = 0;
+		input.compression = AssetPack::COMPRESSION_NONE;
+		inputs.push_back(input);
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  ReadInputFile()
+ *
+ *  This function is used for reading a listed file and
+ *  compressing it when that saves enough.
+ ***********************************************************/
+bool ReadInputFile(PACK_INPUT& input)
+{
+	std::ifstream file(input.path.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+	{
+		return(false);
+	}
+
+	std::streamoff length = file.tellg();
+	input.data.resize((size_t)std::max<std::streamoff>(length, 0));
+	file.seekg(0, std::ios::beg);
+	if ((input.data.empty() == false) &&
+		(!file.read(reinterpret_cast<char*>(&input.data[0]), length)))
+	{
+		return(false);
+	}
+
+	if ((input.bStore == false) && (input.data.empty() == false))
+	{
+		AssetPack::Compress(&input.data[0], input.data.size(), input.compressed);
+		if (input.compressed.size() <= input.data.size() * (1.0 - g_MinimumSavings))
+		{
+			input.compression = AssetPack::COMPRESSION_LZ;
+		}
+		else
+		{
+			std::vector<unsigned char>().swap(input.compressed);
+		}
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  WritePadding()
+ *
+ *  This function is used for writing zeros up to the next
+ *  multiple of the entry alignment.
+ ***********************************************************/
+void WritePadding(std::ofstream& file, unsigned long long& position)
+{
+	static const char zeros[AssetPack::ENTRY_ALIGNMENT] = { 0 };
+	size_t padding = (size_t)((AssetPack::ENTRY_ALIGNMENT - (position % AssetPack::ENTRY_ALIGNMENT)) % AssetPack::ENTRY_ALIGNMENT);
+	file.write(zeros, padding);
+	position += padding;
+}
+
+/***********************************************************
+ *  WritePack()
+ *
+ *  This function is used for writing the header, the table
+ *  of contents sorted by name hash, the names and then the
+ *  aligned entry data.
+ ***********************************************************/
+bool WritePack(const char* filename, std::vector<PACK_INPUT>& inputs)
+{
+	std::sort(inputs.begin(), inputs.end(), [](const PACK_INPUT& a, const PACK_INPUT& b)
+	{
+		return((a.nameHash != b.nameHash) ? (a.nameHash < b.nameHash) : (a.name < b.name));
+	});
+
+	// lay the names and the data out before writing anything
+	std::string names;
+	for (size_t i = 0; i < inputs.size(); i++)
+	{
+		inputs[i].nameOffset = (unsigned int)names.size();
+		names += inputs[i].name;
+		names += '\0';
+	}
+
+	AssetPack::PACK_HEADER header;
+	memset(&header, 0, sizeof(header));
+	header.magic = AssetPack::PACK_MAGIC;
+	header.version = AssetPack::PACK_VERSION;
+	header.entryCount = (unsigned int)inputs.size();
+	header.nameBytes = (unsigned int)names.size();
+	header.namesOffset = sizeof(header) + inputs.size() * sizeof(AssetPack::PACK_ENTRY);
+
+	unsigned long long position = header.namesOffset + names.size();
+	std::vector<AssetPack::PACK_ENTRY> entries(inputs.size());
+	for (size_t i = 0; i < inputs.size(); i++)
+	{
+		position += (AssetPack::ENTRY_ALIGNMENT - (position % AssetPack::ENTRY_ALIGNMENT)) % AssetPack::ENTRY_ALIGNMENT;
+
+		const std::vector<unsigned char>& stored =
+			(inputs[i].compression == AssetPack::COMPRESSION_NONE) ? inputs[i].data : inputs[i].compressed;
+		memset(&entries[i], 0, sizeof(entries[i]));
+		entries[i].nameHash = inputs[i].nameHash;
+		entries[i].offset = position;
+		entries[i].storedSize = stored.size();
+		entries[i].size = inputs[i].data.size();
+		entries[i].nameOffset = inputs[i].nameOffset;
+		entries[i].compression = inputs[i].compression;
+		position += stored.size();
+	}
+
+	std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Could not write asset pack:" << filename << std::endl;
+		return(false);
+	}
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	if (entries.empty() == false)
+	{
+		file.write(reinterpret_cast<const char*>(&entries[0]), entries.size() * sizeof(entries[0]));
+	}
+	file.write(names.data(), names.size());
+
+	position = header.namesOffset + names.size();
+	for (size_t i = 0; i < inputs.size(); i++)
+	{
+		WritePadding(file, position);
+
+		const std::vector<unsigned char>& stored =
+			(inputs[i].compression == AssetPack::COMPRESSION_NONE) ? inputs[i].data : inputs[i].compressed;
+		if (stored.empty() == false)
+		{
+			file.write(reinterpret_cast<const char*>(&stored[0]), stored.size());
+		}
+		position += stored.size();
+	}
+
+	if (!file.good())
+	{
+		std::cout << "Could not write asset pack:" << filename << std::endl;
+		return(false);
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  main(int, char*)
+ *
+ *  This function is used for packing the files of a list
+ *  into an asset pack and printing what each entry takes.
+ *  Listed files that do not exist, like meshes the scene
+ *  has not cached yet, are skipped.
+ ***********************************************************/
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		printf("usage: AssetPacker <output.pack> <list.txt> [--store]\n");
+		printf("  --store  keep every entry uncompressed\n");
+		return(EXIT_FAILURE);
+	}
+
+	std::vector<PACK_INPUT> listed;
+	if (ReadList(argv[2], listed) == false)
+	{
+		return(EXIT_FAILURE);
+	}
+	bool bStoreAll = ((argc > 3) && (strcmp(argv[3], "--store") == 0));
+
+	std::vector<PACK_INPUT> inputs;
+	for (size_t i = 0; i < listed.size(); i++)
+	{
+		bool bDuplicate = false;
+		for (size_t j = 0; (j < inputs.size()) && (bDuplicate == false); j++)
+		{
+			bDuplicate = (inputs[j].name == listed[i].name);
+		}
+		if (bDuplicate == true)
+		{
+			printf("Skipping duplicate entry: %s\n", listed[i].name.c_str());
+			continue;
+		}
+
+		listed[i].bStore = (listed[i].bStore == true) || (bStoreAll == true);
+		if (ReadInputFile(listed[i]) == false)
+		{
+			printf("Skipping missing file: %s\n", listed[i].path.c_str());
+			continue;
+		}
+		inputs.push_back(listed[i]);
+	}
+
+	if (WritePack(argv[1], inputs) == false)
+	{
+		return(EXIT_FAILURE);
+	}
+
+	unsigned long long totalSize = 0;
+	unsigned long long totalStored = 0;
+	printf("  %-40s %12s %12s  %s\n", "entry", "bytes", "stored", "compression");
+	for (size_t i = 0; i < inputs.size(); i++)
+	{
+		const PACK_INPUT& input = inputs[i];
+		size_t stored = (input.compression == AssetPack::COMPRESSION_NONE) ? input.data.size() : input.compressed.size();
+		printf("  %-40s %12zu %12zu  %s\n", input.name.c_str(), input.data.size(), stored,
+			(input.compression == AssetPack::COMPRESSION_NONE) ? "none" : "lz");
+		totalSize += input.data.size();
+		totalStored += stored;
+	}
+	printf("Packed %zu entries, %llu bytes into %llu: %s\n",
+		inputs.size(), totalSize, totalStored, argv[1]);
+
+	return(EXIT_SUCCESS);
+}
@@ -0,0 +1,9 @@
+#version 430 core
+
+// color writes are masked off, only the depth test matters
+out vec4 outFragmentColor;
+
+void main()
+{
+	outFragmentColor = vec4(1.0f);
+}
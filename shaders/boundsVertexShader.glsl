@@ -0,0 +1,13 @@
+#version 430 core
+
+// unit cube corner, stretched into the bounding box
+layout (location = 0) in vec3 inVertexPosition;
+
+uniform mat4 viewProjection;
+uniform vec3 boundsMin;
+uniform vec3 boundsMax;
+
+void main()
+{
+	gl_Position = viewProjection * vec4(mix(boundsMin, boundsMax, inVertexPosition), 1.0f);
+}
@@ -0,0 +1,137 @@
+#version 430 core
+
+// one invocation per object, the size matches GPUCuller::WORKGROUP_SIZE
+layout (local_size_x = 64) in;
+
+// layouts and binding points match GPUCuller
+struct INSTANCE
+{
+	mat4 model;
+	vec4 boundsMin;
+	vec4 boundsMax;
+	uvec4 batch;
+};
+struct INDIRECT_COMMAND
+{
+	uint count;
+	uint instanceCount;
+	uint firstIndex;
+	int baseVertex;
+	uint baseInstance;
+};
+
+layout (std430, binding = 3) readonly buffer InstanceBuffer
+{
+	INSTANCE instances[];
+};
+layout (std430, binding = 4) writeonly buffer VisibleInstanceBuffer
+{
+	uint visibleInstances[];
+};
+layout (std430, binding = 5) buffer CommandBuffer
+{
+	INDIRECT_COMMAND commands[];
+};
+
+uniform int instanceCount;
+// world-space planes of the current view, pointing inwards
+uniform vec4 frustumPlanes[6];
+
+// farthest depth of the previous frame, level 0 is half the
+// depth buffer size and each level halves again
+uniform sampler2D depthPyramid;
+uniform int useDepthPyramid;
+uniform int pyramidLevels;
+// view the pyramid was rendered with, and the size in pixels
+// of the corner of the pyramid that frame was drawn into
+uniform mat4 pyramidViewProjection;
+uniform vec2 depthSize;
+
+// test the box corner farthest along each plane normal
+bool IsInsideFrustum(vec3 boundsMin, vec3 boundsMax)
+{
+	for (int i = 0; i < 6; i++)
+	{
+		vec3 corner = mix(boundsMin, boundsMax, greaterThan(frustumPlanes[i].xyz, vec3(0.0f)));
+		if (dot(frustumPlanes[i].xyz, corner) + frustumPlanes[i].w < 0.0f)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// test the nearest depth of the box against the farthest depth
+// of the pixels its screen rectangle covers
+bool IsOccluded(vec3 boundsMin, vec3 boundsMax)
+{
+	vec2 screenMin = vec2(1.0f);
+	vec2 screenMax = vec2(0.0f);
+	float nearestDepth = 1.0f;
+	for (int i = 0; i < 8; i++)
+	{
+		vec3 corner = vec3(
+			((i & 1) != 0) ? boundsMax.x : boundsMin.x,
+			((i & 2) != 0) ? boundsMax.y : boundsMin.y,
+			((i & 4) != 0) ? boundsMax.z : boundsMin.z);
+		vec4 clip = pyramidViewProjection * vec4(corner, 1.0f);
+
+		// a box reaching behind the camera is never culled
+		if (clip.w <= 0.0f)
+		{
+			return false;
+		}
+
+		vec3 ndc = clip.xyz / clip.w;
+		screenMin = min(screenMin, ndc.xy * 0.5f + 0.5f);
+		screenMax = max(screenMax, ndc.xy * 0.5f + 0.5f);
+		nearestDepth = min(nearestDepth, ndc.z * 0.5f + 0.5f);
+	}
+
+	vec2 pixelMin = clamp(screenMin, 0.0f, 1.0f) * depthSize;
+	vec2 pixelMax = clamp(screenMax, 0.0f, 1.0f) * depthSize;
+
+	// a texel of level L covers 2^(L+1) pixels, so on the level
+	// where one texel spans the rectangle it touches 2x2 texels
+	float extent = max(pixelMax.x - pixelMin.x, pixelMax.y - pixelMin.y);
+	int level = clamp(int(ceil(log2(max(extent, 1.0f)))) - 1, 0, pyramidLevels - 1);
+	// the texels past the drawn corner are left from other frames
+	int texelShift = level + 1;
+	ivec2 levelSize = max((ivec2(depthSize) + (1 << texelShift) - 1) >> texelShift, ivec2(1));
+	float texelPixels = float(1 << texelShift);
+	ivec2 texelMin = clamp(ivec2(pixelMin / texelPixels), ivec2(0), levelSize - 1);
+	ivec2 texelMax = clamp(ivec2(pixelMax / texelPixels), ivec2(0), levelSize - 1);
+
+	float farthestDepth = max(
+		max(texelFetch(depthPyramid, texelMin, level).r,
+			texelFetch(depthPyramid, ivec2(texelMax.x, texelMin.y), level).r),
+		max(texelFetch(depthPyramid, ivec2(texelMin.x, texelMax.y), level).r,
+			texelFetch(depthPyramid, texelMax, level).r));
+
+	return (nearestDepth > farthestDepth);
+}
+
+void main()
+{
+	uint index = gl_GlobalInvocationID.x;
+	if (index >= uint(instanceCount))
+	{
+		return;
+	}
+
+	vec3 boundsMin = instances[index].boundsMin.xyz;
+	vec3 boundsMax = instances[index].boundsMax.xyz;
+	if (IsInsideFrustum(boundsMin, boundsMax) == false)
+	{
+		return;
+	}
+	if ((useDepthPyramid != 0) && IsOccluded(boundsMin, boundsMax))
+	{
+		return;
+	}
+
+	// append the object to the instances of its batch
+	uint batch = instances[index].batch.x;
+	uint slot = atomicAdd(commands[batch].instanceCount, 1u);
+	visibleInstances[commands[batch].baseInstance + slot] = index;
+}
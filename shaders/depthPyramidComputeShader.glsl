@@ -0,0 +1,33 @@
+#version 430 core
+
+// one invocation per texel of the level being built
+layout (local_size_x = 8, local_size_y = 8) in;
+
+// level 0 reads the copied depth buffer, every other level
+// reads the pyramid level above it
+uniform sampler2D sourceDepth;
+uniform int sourceLevel;
+uniform vec2 sourceSize;
+
+layout (r32f, binding = 0) writeonly uniform image2D targetLevel;
+
+void main()
+{
+	ivec2 target = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(target, imageSize(targetLevel))))
+	{
+		return;
+	}
+
+	// the level sizes are rounded up, so the last texel of an
+	// odd sized source is clamped onto the edge
+	ivec2 lastSource = ivec2(sourceSize) - 1;
+	ivec2 first = target * 2;
+	float farthestDepth = max(
+		max(texelFetch(sourceDepth, min(first, lastSource), sourceLevel).r,
+			texelFetch(sourceDepth, min(first + ivec2(1, 0), lastSource), sourceLevel).r),
+		max(texelFetch(sourceDepth, min(first + ivec2(0, 1), lastSource), sourceLevel).r,
+			texelFetch(sourceDepth, min(first + ivec2(1, 1), lastSource), sourceLevel).r));
+
+	imageStore(targetLevel, target, vec4(farthestDepth));
+}
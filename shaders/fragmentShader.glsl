@@ -0,0 +1,171 @@
+#version 430 core
+
+// feature switches, injected per permutation by ShaderPermutationSet
+#ifndef USE_TEXTURE
+#define USE_TEXTURE 0
+#endif
+#ifndef USE_LIGHTING
+#define USE_LIGHTING 0
+#endif
+#ifndef USE_LIGHTMAP
+#define USE_LIGHTMAP 0
+#endif
+
+out vec4 outFragmentColor;
+
+uniform vec4 objectColor = vec4(1.0f);
+
+in vec3 fragmentPosition;
+in vec3 fragmentVertexNormal;
+in vec2 fragmentTextureCoordinate;
+in float fragmentViewDepth;
+
+#if USE_LIGHTMAP
+// ambient and diffuse lighting of the static lights, baked by
+// LightmapBaker with the material already applied
+in vec2 fragmentLightmapCoordinate;
+uniform sampler2D lightmapTexture;
+#endif
+
+#if USE_TEXTURE
+uniform sampler2D objectTexture;
+uniform vec2 UVscale = vec2(1.0f, 1.0f);
+#endif
+
+#if USE_LIGHTING
+struct Material
+{
+	vec3 ambientColor;
+	float ambientStrength;
+	vec3 diffuseColor;
+	vec3 specularColor;
+	float shininess;
+};
+
+// matches LightClusterManager::LIGHT_SOURCE
+struct LightSource
+{
+	vec4 positionRadius;	// xyz = position, w = range
+	vec4 ambientColor;		// w unused
+	vec4 diffuseColor;		// w = focal strength
+	vec4 specularColor;		// w = specular intensity
+};
+
+// matches LightClusterManager::CLUSTER_RANGE
+struct ClusterRange
+{
+	uint offset;
+	uint count;
+};
+
+layout (std430, binding = 0) readonly buffer LightBuffer
+{
+	LightSource lightSources[];
+};
+
+layout (std430, binding = 1) readonly buffer ClusterBuffer
+{
+	ClusterRange clusterRanges[];
+};
+
+layout (std430, binding = 2) readonly buffer LightIndexBuffer
+{
+	uint lightIndices[];
+};
+
+uniform vec3 viewPosition;
+uniform Material material;
+
+// cluster grid dimensions, viewport size and depth range
+uniform vec3 clusterGridSize;
+uniform vec2 clusterScreenSize;
+uniform vec2 clusterDepthRange;
+
+// find the index of the cluster that holds this fragment
+uint GetClusterIndex()
+{
+	uvec3 grid = uvec3(clusterGridSize);
+	float zNear = clusterDepthRange.x;
+	float zFar = clusterDepthRange.y;
+
+	uint x = uint(gl_FragCoord.x * clusterGridSize.x / clusterScreenSize.x);
+	uint y = uint(gl_FragCoord.y * clusterGridSize.y / clusterScreenSize.y);
+	// depth slices are spaced exponentially between the planes
+	float slice = log(max(fragmentViewDepth, zNear) / zNear) * clusterGridSize.z / log(zFar / zNear);
+	uint z = uint(max(slice, 0.0f));
+
+	x = min(x, grid.x - 1u);
+	y = min(y, grid.y - 1u);
+	z = min(z, grid.z - 1u);
+
+	return(x + (y * grid.x) + (z * grid.x * grid.y));
+}
+
+// calculate the phong contribution of a single light source
+vec3 CalcLightSource(LightSource light, vec3 lightNormal, vec3 vertexPosition, vec3 viewDirection)
+{
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+
+	vec3 lightOffset = light.positionRadius.xyz - vertexPosition;
+	float lightDistance = length(lightOffset);
+
+	// smooth falloff that reaches zero at the light range
+	float falloff = clamp(1.0f - pow(lightDistance / light.positionRadius.w, 4.0f), 0.0f, 1.0f);
+	float attenuation = falloff * falloff;
+
+	// calculate ambient lighting
+	ambient = light.ambientColor.rgb * material.ambientColor * material.ambientStrength;
+
+	// calculate diffuse lighting
+	vec3 lightDirection = lightOffset / max(lightDistance, 0.0001f);
+	float impact = max(dot(lightNormal, lightDirection), 0.0f);
+	diffuse = impact * light.diffuseColor.rgb * material.diffuseColor;
+
+	// calculate specular lighting
+	vec3 reflectDirection = reflect(-lightDirection, lightNormal);
+	float specularComponent = pow(max(dot(viewDirection, reflectDirection), 0.0f), max(material.shininess, 0.0001f));
+	specular = light.specularColor.w * light.diffuseColor.w * specularComponent * light.specularColor.rgb * material.specularColor;
+
+#if USE_LIGHTMAP
+	// the view dependent part is all that is left to evaluate
+	return(specular * attenuation);
+#else
+	return((ambient + diffuse + specular) * attenuation);
+#endif
+}
+#endif
+
+void main()
+{
+#if USE_TEXTURE
+	vec4 baseColor = texture(objectTexture, fragmentTextureCoordinate * UVscale);
+#else
+	vec4 baseColor = objectColor;
+#endif
+
+#if USE_LIGHTING
+	{
+		vec3 lightNormal = normalize(fragmentVertexNormal);
+		vec3 viewDirection = normalize(viewPosition - fragmentPosition);
+#if USE_LIGHTMAP
+		vec3 phongResult = texture(lightmapTexture, fragmentLightmapCoordinate).rgb;
+#else
+		vec3 phongResult = vec3(0.0f);
+#endif
+
+		// only the lights assigned to this cluster are evaluated
+		ClusterRange range = clusterRanges[GetClusterIndex()];
+		for (uint i = 0u; i < range.count; i++)
+		{
+			uint lightIndex = lightIndices[range.offset + i];
+			phongResult += CalcLightSource(lightSources[lightIndex], lightNormal, fragmentPosition, viewDirection);
+		}
+
+		outFragmentColor = vec4(phongResult * baseColor.rgb, baseColor.a);
+	}
+#else
+	outFragmentColor = baseColor;
+#endif
+}
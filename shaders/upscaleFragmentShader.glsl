@@ -0,0 +1,42 @@
+#version 430 core
+
+// filter switch, injected by DynamicResolution
+#ifndef USE_SHARPEN
+#define USE_SHARPEN 0
+#endif
+
+in vec2 fragmentTextureCoordinate;
+
+out vec4 outFragmentColor;
+
+uniform sampler2D sourceTexture;
+// part of the texture the scene was rendered into
+uniform vec2 sourceScale;
+uniform vec2 sourceTexelSize;
+uniform float sharpness;
+
+void main()
+{
+	// keep the bilinear taps inside the rendered corner
+	vec2 maxCoordinate = sourceScale - (0.5f * sourceTexelSize);
+	vec2 coordinate = min(fragmentTextureCoordinate * sourceScale, maxCoordinate);
+
+	vec3 color = texture(sourceTexture, coordinate).rgb;
+
+#if USE_SHARPEN
+	// unsharp mask from the four neighbours, clamped to their
+	// range so edges do not ring
+	vec3 north = texture(sourceTexture, min(coordinate + vec2(0.0f, sourceTexelSize.y), maxCoordinate)).rgb;
+	vec3 south = texture(sourceTexture, coordinate - vec2(0.0f, sourceTexelSize.y)).rgb;
+	vec3 east = texture(sourceTexture, min(coordinate + vec2(sourceTexelSize.x, 0.0f), maxCoordinate)).rgb;
+	vec3 west = texture(sourceTexture, coordinate - vec2(sourceTexelSize.x, 0.0f)).rgb;
+
+	vec3 neighbourMin = min(min(north, south), min(east, west));
+	vec3 neighbourMax = max(max(north, south), max(east, west));
+	vec3 blurred = 0.25f * (north + south + east + west);
+
+	color = clamp(color + (sharpness * (color - blurred)), min(neighbourMin, color), max(neighbourMax, color));
+#endif
+
+	outFragmentColor = vec4(color, 1.0f);
+}
@@ -0,0 +1,12 @@
+#version 430 core
+
+out vec2 fragmentTextureCoordinate;
+
+// one triangle covering the screen, built from the vertex index
+void main()
+{
+	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+
+	fragmentTextureCoordinate = corner;
+	gl_Position = vec4((corner * 2.0f) - 1.0f, 0.0f, 1.0f);
+}
@@ -0,0 +1,100 @@
+#version 430 core
+
+// feature switches, injected per permutation by ShaderPermutationSet
+#ifndef USE_LIGHTING
+#define USE_LIGHTING 0
+#endif
+#ifndef USE_LIGHTMAP
+#define USE_LIGHTMAP 0
+#endif
+#ifndef USE_INSTANCING
+#define USE_INSTANCING 0
+#endif
+
+// packed vertices from MeshLibrary - the position is normalized
+// into the mesh bounds and expanded by the model matrix, the
+// normal is octahedral encoded for that same packed space
+layout (location = 0) in vec3 inVertexPosition;
+layout (location = 1) in vec2 inVertexNormal;
+layout (location = 2) in vec2 inTextureCoordinate;
+#if USE_LIGHTMAP
+layout (location = 3) in vec2 inLightmapCoordinate;
+#endif
+
+out vec3 fragmentPosition;
+out vec3 fragmentVertexNormal;
+out vec2 fragmentTextureCoordinate;
+#if USE_LIGHTMAP
+out vec2 fragmentLightmapCoordinate;
+#endif
+// positive view-space depth, used to select the light cluster
+out float fragmentViewDepth;
+
+// the occluder depth pre-pass uses a different permutation, so
+// the position must come out bit-identical in every program
+invariant gl_Position;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+#if USE_INSTANCING
+// objects culled on the GPU, laid out and bound by GPUCuller
+struct INSTANCE
+{
+	mat4 model;
+	vec4 boundsMin;
+	vec4 boundsMax;
+	uvec4 batch;
+};
+layout (std430, binding = 3) readonly buffer InstanceBuffer
+{
+	INSTANCE instances[];
+};
+layout (std430, binding = 4) readonly buffer VisibleInstanceBuffer
+{
+	uint visibleInstances[];
+};
+// first slot of the drawn batch in the visible instance list
+uniform int instanceOffset;
+#endif
+
+#if USE_LIGHTING
+// unfold an octahedral encoded normal back onto the unit sphere
+vec3 DecodeOctahedral(vec2 encoded)
+{
+	vec3 normal = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+	float fold = max(-normal.z, 0.0f);
+	normal.x += (normal.x >= 0.0f) ? -fold : fold;
+	normal.y += (normal.y >= 0.0f) ? -fold : fold;
+	return normalize(normal);
+}
+#endif
+
+void main()
+{
+	// the model uniform holds the dequantize matrix of the mesh
+	// for instanced draws, behind the transform of the instance
+	mat4 objectModel = model;
+#if USE_INSTANCING
+	objectModel = instances[visibleInstances[instanceOffset + gl_InstanceID]].model * model;
+#endif
+
+	vec4 worldPosition = objectModel * vec4(inVertexPosition, 1.0f);
+	vec4 viewSpacePosition = view * worldPosition;
+
+	gl_Position = projection * viewSpacePosition;
+
+	fragmentPosition = vec3(worldPosition);
+#if USE_LIGHTING
+	fragmentVertexNormal = mat3(transpose(inverse(objectModel))) * DecodeOctahedral(inVertexNormal);
+#else
+	// the normal is only used by the lighting
+	fragmentVertexNormal = vec3(0.0f);
+#endif
+	fragmentTextureCoordinate = inTextureCoordinate;
+#if USE_LIGHTMAP
+	fragmentLightmapCoordinate = inLightmapCoordinate;
+#endif
+	fragmentViewDepth = -viewSpacePosition.z;
+}